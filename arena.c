@@ -0,0 +1,91 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define ALIGN (2 * sizeof(void*))
+
+struct arena_chunk {
+      struct arena_chunk* next;
+      size_t size;
+      char data[];
+};
+
+static void add_chunk(struct arena* arena, size_t min) {
+      size_t size = min > CHUNK_SIZE? min : CHUNK_SIZE;
+      struct arena_chunk* c = malloc(sizeof(*c) + size);
+      assert(c);
+      c->size = size;
+      c->next = arena->chunks;
+      arena->chunks = c;
+      arena->next = c->data;
+      arena->end = c->data + size;
+      arena->stats.reserved += size;
+}
+
+void* arena_alloc(struct arena* arena, int kind, size_t size) {
+      assert(arena);
+      assert(kind >= 0 && kind < ARENA_NKINDS);
+
+      size = (size + ALIGN - 1) & ~(ALIGN - 1);
+      if (!arena->next || (size_t)(arena->end - arena->next) < size)
+            add_chunk(arena, size);
+
+      void* p = arena->next;
+      arena->next += size;
+      arena->stats.bytes += size;
+      ++arena->stats.nodes[kind];
+      return memset(p, 0, size);
+}
+
+char* arena_strdup(struct arena* arena, const char* str) {
+      assert(str);
+      size_t len = strlen(str);
+      char* s = arena_alloc(arena, ARENA_STR, len + 1);
+      memcpy(s, str, len);
+      return s;
+}
+
+void arena_reset(struct arena* arena) {
+      assert(arena);
+
+      // Keep the oldest chunk (if it's a regular one) for the next round.
+      struct arena_chunk* keep = NULL;
+      struct arena_chunk* c = arena->chunks;
+      while (c) {
+            struct arena_chunk* next = c->next;
+            if (!next && c->size == CHUNK_SIZE) keep = c;
+            else free(c);
+            c = next;
+      }
+
+      memset(&arena->stats, 0, sizeof(arena->stats));
+      arena->chunks = keep;
+      arena->next = keep? keep->data : NULL;
+      arena->end = keep? keep->data + keep->size : NULL;
+      if (keep) {
+            keep->next = NULL;
+            arena->stats.reserved = keep->size;
+      }
+}
+
+const struct arena_stats* arena_stats(const struct arena* arena) {
+      assert(arena);
+      return &arena->stats;
+}
+
+const char* arena_kind_to_str(int kind) {
+      switch (kind) {
+            case ARENA_ITEM: return "item";
+            case ARENA_STMT: return "stmt";
+            case ARENA_EXP: return "exp";
+            case ARENA_PAT: return "pat";
+            case ARENA_PAIR: return "pair";
+            case ARENA_TYPE: return "type";
+            case ARENA_LIST: return "list";
+            case ARENA_STR: return "str";
+            case ARENA_OTHER: return "other";
+      }
+      return "?";
+}
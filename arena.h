@@ -0,0 +1,53 @@
+#ifndef RUSTC_ARENA_H_
+#define RUSTC_ARENA_H_
+
+#include <stddef.h>
+
+// *** Arenas ***
+
+// A bump allocator. Allocations are never freed individually; the whole arena
+// is released at once by arena_reset(), which keeps the first chunk around for
+// reuse.
+
+// What an allocation is for, only used for the stats.
+enum {
+      ARENA_ITEM,
+      ARENA_STMT,
+      ARENA_EXP,
+      ARENA_PAT,
+      ARENA_PAIR,
+      ARENA_TYPE,
+      ARENA_LIST,
+      ARENA_STR,
+      ARENA_OTHER,
+      ARENA_NKINDS,
+};
+
+struct arena_stats {
+      size_t bytes;           // handed out to callers, including padding
+      size_t reserved;        // allocated from the system
+      size_t nodes[ARENA_NKINDS];
+};
+
+struct arena_chunk;
+
+struct arena {
+      struct arena_chunk* chunks;
+      char* next;
+      char* end;
+      struct arena_stats stats;
+};
+
+#define ARENA_INIT {NULL, NULL, NULL, {0, 0, {0}}}
+
+// Returns zeroed memory that lives until the next arena_reset().
+void* arena_alloc(struct arena*, int kind, size_t size);
+char* arena_strdup(struct arena*, const char* str);
+
+// Frees everything allocated from the arena.
+void arena_reset(struct arena*);
+
+const struct arena_stats* arena_stats(const struct arena*);
+const char* arena_kind_to_str(int kind);
+
+#endif
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include "ast.h"
 #include "type.h"
+#include "arena.h"
 
 static struct item* item_new(int kind);
 
@@ -17,15 +18,50 @@ static struct exp* exp_new(int kind);
 
 // *** Crate ***
 
+static struct arena arena = ARENA_INIT;
+
+struct arena* crate_arena(void) {
+      return &arena;
+}
+
 void crate_destroy(GList* items) {
-      g_list_free_full(items, (GDestroyNotify)item_destroy);
+      // The one part of the crate that isn't in the arena.
+      for (GList* i = items; i; i = i->next) {
+            struct item* item = i->data;
+            if (item->kind == ITEM_STRUCT_DEF && item->struct_def.index)
+                  g_hash_table_destroy(item->struct_def.index);
+      }
+      type_table_destroy();
+      symbol_table_destroy();
+      arena_reset(&arena);
+}
+
+GList* ast_list_prepend(GList* list, gpointer data) {
+      GList* cell = arena_alloc(&arena, ARENA_LIST, sizeof(*cell));
+      cell->data = data;
+      cell->next = list;
+      if (list) list->prev = cell;
+      return cell;
+}
+
+GList* ast_list_finish(GList* reversed) {
+      int n = g_list_length(reversed);
+      if (!n) return NULL;
+
+      GList* cells = arena_alloc(&arena, ARENA_LIST, n * sizeof(*cells));
+      for (int i = n - 1; i >= 0; --i, reversed = reversed->next)
+            cells[i].data = reversed->data;
+      for (int i = 0; i != n; ++i) {
+            cells[i].prev = i? &cells[i - 1] : NULL;
+            cells[i].next = i + 1 != n? &cells[i + 1] : NULL;
+      }
+      return cells;
 }
 
 // *** Items ***
 
 static struct item* item_new(int kind) {
-      struct item* n = calloc(1, sizeof(*n));
-      assert(n);
+      struct item* n = arena_alloc(&arena, ARENA_ITEM, sizeof(*n));
       n->kind = kind;
       n->type = type_invalid();
       return n;
@@ -49,44 +85,39 @@ struct item* item_struct_def(Symbol id, GList* fields) {
       n->struct_def.fields = fields;
       return n;
 }
-void item_destroy(struct item* item) {
-      if (!item) return;
-
-      type_destroy(item->type);
+struct type* item_get_field_type(struct item* struct_def, Symbol id) {
+      struct pair* field_def = item_get_field(struct_def, id);
+      if (!field_def) return type_error();
+      return field_def->field_def.type;
+}
 
-      switch (item->kind) {
-            case ITEM_FN_DEF:
-                  type_destroy(item->fn_def.type);
-                  exp_destroy(item->fn_def.block);
-                  break;
-            case ITEM_ENUM_DEF:
-                  g_list_free_full(item->enum_def.ctors, (GDestroyNotify)pair_destroy);
-                  break;
-            case ITEM_STRUCT_DEF:
-                  g_list_free_full(item->struct_def.fields, (GDestroyNotify)pair_destroy);
-                  break;
-      }
+struct pair* item_get_field(const struct item* struct_def, Symbol id) {
+      assert(id.kind == SYMBOL_FIELD);
 
-      free(item);
+      if (!struct_def || struct_def->kind != ITEM_STRUCT_DEF) return NULL;
+      assert(struct_def->struct_def.index);
+      return g_hash_table_lookup(struct_def->struct_def.index, GINT_TO_POINTER(id.value));
 }
 
-struct type* item_get_field_type(struct item* struct_def, Symbol id) {
-      assert(id.kind == SYMBOL_FIELD);
+struct pair* item_get_ctor(const struct item* enum_def, Symbol id, int* tag) {
+      assert(id.kind == SYMBOL_CTOR);
 
-      if (!struct_def) return type_error();
-      for (GList* f = struct_def->struct_def.fields; f; f = f->next) {
-            struct pair* field_def = f->data;
-            if (id.value == field_def->field_def.id.value)
-                  return field_def->field_def.type;
+      if (!enum_def || enum_def->kind != ITEM_ENUM_DEF) return NULL;
+      int n = 0;
+      for (GList* c = enum_def->enum_def.ctors; c; c = c->next, ++n) {
+            struct pair* ctor_def = c->data;
+            if (id.value == ctor_def->ctor_def.id.value) {
+                  if (tag) *tag = n;
+                  return ctor_def;
+            }
       }
-      return type_error();
+      return NULL;
 }
 
 // *** Statements ***
 
 static struct stmt* stmt_new(int kind) {
-      struct stmt* n = calloc(1, sizeof(*n));
-      assert(n);
+      struct stmt* n = arena_alloc(&arena, ARENA_STMT, sizeof(*n));
       n->kind = kind;
       n->type = type_invalid();
       return n;
@@ -108,32 +139,10 @@ struct stmt* stmt_exp(struct exp* exp) {
       n->exp = exp;
       return n;
 }
-void stmt_destroy(struct stmt* stmt) {
-      if (!stmt) return;
-
-      type_destroy(stmt->type);
-
-      switch (stmt->kind) {
-            case STMT_LET:
-                  pat_destroy(stmt->let.pat);
-                  type_destroy(stmt->let.type);
-                  exp_destroy(stmt->let.exp);
-                  break;
-
-            case STMT_RETURN:
-            case STMT_EXP:
-                  exp_destroy(stmt->exp);
-                  break;
-      }
-
-      free(stmt);
-}
-
 // *** Patterns ***
 
 static struct pat* pat_new(int kind) {
-      struct pat* n = calloc(1, sizeof(*n));
-      assert(n);
+      struct pat* n = arena_alloc(&arena, ARENA_PAT, sizeof(*n));
       n->kind = kind;
       return n;
 }
@@ -195,43 +204,41 @@ struct pat* pat_u8(int num) {
 }
 struct pat* pat_str(char* str) {
       struct pat* n = pat_new(PAT_STR);
-      n->str = str;
-      return n;
-}
-void pat_destroy(struct pat* pat) {
-      if (!pat) return;
-
-      switch (pat->kind) {
-            case PAT_WILD:
-            case PAT_UNIT:
-            case PAT_TRUE:
-            case PAT_FALSE:
-                  return;
-
-            case PAT_REF:
-                  pat_destroy(pat->pat);
-                  break;
-            case PAT_ARRAY:
-                  g_list_free_full(pat->array.pats, (GDestroyNotify)pat_destroy);
-                  break;
-            case PAT_ENUM:
-                  g_list_free_full(pat->ctor.pats, (GDestroyNotify)pat_destroy);
-                  break;
-            case PAT_STRUCT:
-                  g_list_free_full(pat->strct.fields, (GDestroyNotify)pair_destroy);
-                  break;
-            case PAT_STR:
-                  free(pat->str);
-                  break;
-      }
-      free(pat);
-}
+      n->str = arena_strdup(&arena, str);
+      free(str);
+      return n;
+}
+// *** Operators ***
+
+const struct op_info op_table[OP_COUNT] = {
+      [OP_INVALID]    = {"?",  0,               "?",          "?",          "err"},
+      [OP_ADDROF]     = {"&",  OPF_ADDROF,      "addr-of",    "addr-of",    "err"},
+      [OP_NOT]        = {"!",  OPF_BOOL,        "not",        "not",        "not"},
+      [OP_ADD]        = {"+",  OPF_ARITH,       "add",        "add",        "add"},
+      [OP_SUB]        = {"-",  OPF_ARITH,       "sub",        "neg",        "sub"},
+      [OP_MUL]        = {"*",  OPF_ARITH,       "mul",        "deref",      "mul"},
+      [OP_DIV]        = {"/",  OPF_ARITH,       "div",        "div",        "sdiv"},
+      [OP_REM]        = {"%",  OPF_ARITH,       "rem",        "rem",        "srem"},
+      [OP_ASSIGN]     = {"=",  OPF_ASSIGN,      "assign",     "assign",     "assign"},
+      [OP_ADD_ASSIGN] = {"+=", OPF_CMP_ASSIGN,  "assign-add", "assign-add", "add"},
+      [OP_SUB_ASSIGN] = {"-=", OPF_CMP_ASSIGN,  "assign-sub", "assign-sub", "sub"},
+      [OP_MUL_ASSIGN] = {"*=", OPF_CMP_ASSIGN,  "assign-mul", "assign-mul", "mul"},
+      [OP_DIV_ASSIGN] = {"/=", OPF_CMP_ASSIGN,  "assign-div", "assign-div", "sdiv"},
+      [OP_REM_ASSIGN] = {"%=", OPF_CMP_ASSIGN,  "assign-rem", "assign-rem", "srem"},
+      [OP_AND]        = {"&&", OPF_BOOL,        "and",        "and",        "and"},
+      [OP_OR]         = {"||", OPF_BOOL,        "or",         "or",         "or"},
+      [OP_EQ]         = {"==", OPF_EQ,          "eq",         "eq",         "eq"},
+      [OP_NEQ]        = {"!=", OPF_EQ,          "neq",        "neq",        "ne"},
+      [OP_LT]         = {"<",  OPF_COMPARE,     "lt",         "lt",         "slt"},
+      [OP_LEQ]        = {"<=", OPF_COMPARE,     "leq",        "leq",        "sle"},
+      [OP_GT]         = {">",  OPF_COMPARE,     "gt",         "gt",         "sgt"},
+      [OP_GEQ]        = {">=", OPF_COMPARE,     "geq",        "geq",        "sge"},
+};
 
 // *** Expressions ***
 
 static struct exp* exp_new(int kind) {
-      struct exp* n = calloc(1, sizeof(*n));
-      assert(n);
+      struct exp* n = arena_alloc(&arena, ARENA_EXP, sizeof(*n));
       n->kind = kind;
       n->type = type_invalid();
       return n;
@@ -250,7 +257,8 @@ struct exp* exp_i32(int num) {
 }
 struct exp* exp_str(char* str) {
       struct exp* n = exp_new(EXP_STR);
-      n->str = str;
+      n->str = arena_strdup(&arena, str);
+      free(str);
       n->type = type_ref(type_slice(type_u8()));
       return n;
 }
@@ -345,7 +353,7 @@ struct exp* exp_block(GList* stmts, struct exp* exp) {
       n->block.exp = exp;
       return n;
 }
-struct exp* exp_unary(const char* op, struct exp* exp) {
+struct exp* exp_unary(int op, struct exp* exp) {
       struct exp* n = exp_new(EXP_UNARY);
       n->unary.op = op;
       n->unary.exp = exp;
@@ -353,147 +361,59 @@ struct exp* exp_unary(const char* op, struct exp* exp) {
 }
 struct exp* exp_addrof_mut(struct exp* exp) {
       struct exp* n = exp_new(EXP_UNARY);
-      n->unary.op = "&";
+      n->unary.op = OP_ADDROF;
       n->unary.mut = true;
       n->unary.exp = exp;
       return n;
 }
-struct exp* exp_binary(const char* op, struct exp* left, struct exp* right) {
+struct exp* exp_binary(int op, struct exp* left, struct exp* right) {
       struct exp* n = exp_new(EXP_BINARY);
       n->binary.op = op;
       n->binary.left = left;
       n->binary.right = right;
       return n;
 }
-void exp_destroy(struct exp* exp) {
-      if (!exp) return;
-
-      type_destroy(exp->type);
-
+static int exp_op_flags(const struct exp* exp) {
+      if (!exp) return 0;
       switch (exp->kind) {
-            case EXP_TRUE:
-            case EXP_FALSE:
-            case EXP_UNIT:
-                  return;
-
-            case EXP_STR:
-                  free(exp->str);
-                  break;
-            case EXP_ENUM:
-                  g_list_free_full(exp->lit_enum.exps, (GDestroyNotify)exp_destroy);
-                  break;
-            case EXP_STRUCT:
-                  g_list_free_full(exp->lit_struct.fields, (GDestroyNotify)pair_destroy);
-                  break;
-            case EXP_ARRAY:
-                  g_list_free_full(exp->lit_array.exps, (GDestroyNotify)exp_destroy);
-                  break;
-            case EXP_LOOKUP:
-                  exp_destroy(exp->lookup.exp);
-                  break;
-            case EXP_INDEX:
-                  exp_destroy(exp->index.exp);
-                  exp_destroy(exp->index.idx);
-                  break;
-            case EXP_FN_CALL:
-                  g_list_free_full(exp->fn_call.exps, (GDestroyNotify)exp_destroy);
-                  break;
-            case EXP_BOX_NEW:
-                  exp_destroy(exp->exp);
-                  break;
-            case EXP_MATCH:
-                  exp_destroy(exp->match.exp);
-                  g_list_free_full(exp->match.arms, (GDestroyNotify)pair_destroy);
-                  break;
-            case EXP_IF:
-                  exp_destroy(exp->if_else.cond);
-                  exp_destroy(exp->if_else.block_true);
-                  exp_destroy(exp->if_else.block_false);
-                  break;
-            case EXP_WHILE:
-                  exp_destroy(exp->loop_while.cond);
-                  exp_destroy(exp->loop_while.block);
-                  break;
-            case EXP_LOOP:
-                  exp_destroy(exp->exp);
-                  break;
-            case EXP_BLOCK:
-                  g_list_free_full(exp->block.stmts, (GDestroyNotify)stmt_destroy);
-                  exp_destroy(exp->block.exp);
-                  break;
-            case EXP_UNARY:
-                  exp_destroy(exp->unary.exp);
-                  break;
-            case EXP_BINARY:
-                  exp_destroy(exp->binary.left);
-                  exp_destroy(exp->binary.right);
-                  break;
+            case EXP_UNARY: return op_table[exp->unary.op].flags;
+            case EXP_BINARY: return op_table[exp->binary.op].flags;
       }
-
-      free(exp);
+      return 0;
 }
 
-bool exp_is_addrof(struct exp* exp) {
-      return exp && (
-            !strcmp(exp->unary.op, "&")
-      );
+bool exp_is_addrof(const struct exp* exp) {
+      return exp_op_flags(exp) & OPF_ADDROF;
 }
 
-bool exp_is_arith(struct exp* exp) {
-      return exp && (
-            !strcmp(exp->binary.op, "+")
-            || !strcmp(exp->binary.op, "-")
-            || !strcmp(exp->binary.op, "*")
-            || !strcmp(exp->binary.op, "/")
-            || !strcmp(exp->binary.op, "%")
-      );
+bool exp_is_arith(const struct exp* exp) {
+      return exp_op_flags(exp) & OPF_ARITH;
 }
 
-bool exp_is_assign(struct exp* exp) {
-      return exp && (
-            !strcmp(exp->binary.op, "=")
-      );
+bool exp_is_assign(const struct exp* exp) {
+      return exp_op_flags(exp) & OPF_ASSIGN;
 }
 
-bool exp_is_cmp_assign(struct exp* exp) {
-      return exp && (
-            !strcmp(exp->binary.op, "+=")
-            || !strcmp(exp->binary.op, "-=")
-            || !strcmp(exp->binary.op, "*=")
-            || !strcmp(exp->binary.op, "/=")
-            || !strcmp(exp->binary.op, "%=")
-      );
+bool exp_is_cmp_assign(const struct exp* exp) {
+      return exp_op_flags(exp) & OPF_CMP_ASSIGN;
 }
 
-bool exp_is_compare(struct exp* exp) {
-      return exp && (
-            !strcmp(exp->binary.op, "<=")
-            || !strcmp(exp->binary.op, ">=")
-            || !strcmp(exp->binary.op, "<")
-            || !strcmp(exp->binary.op, ">")
-      );
+bool exp_is_compare(const struct exp* exp) {
+      return exp_op_flags(exp) & OPF_COMPARE;
 }
 
-bool exp_is_eq(struct exp* exp) {
-      return exp && (
-            !strcmp(exp->binary.op, "==")
-            || !strcmp(exp->binary.op, "!=")
-      );
+bool exp_is_eq(const struct exp* exp) {
+      return exp_op_flags(exp) & OPF_EQ;
 }
 
-bool exp_is_bool(struct exp* exp) {
-      return exp && (
-            !strcmp(exp->binary.op, "&&")
-            || !strcmp(exp->binary.op, "||")
-            || !strcmp(exp->unary.op, "!")
-      );
+bool exp_is_bool(const struct exp* exp) {
+      return exp_op_flags(exp) & OPF_BOOL;
 }
 
 // *** Pairs ***
 
 static struct pair* pair(int kind) {
-      struct pair* n = calloc(1, sizeof(*n));
-      assert(n);
+      struct pair* n = arena_alloc(&arena, ARENA_PAIR, sizeof(*n));
       n->kind = kind;
       return n;
 }
@@ -533,30 +453,137 @@ struct pair* match_arm(GList* pats, struct exp* block) {
       n->match_arm.block = block;
       return n;
 }
-void pair_destroy(struct pair* pair) {
-      if (!pair) return;
-      switch (pair->kind) {
-            case PAIR_FIELD_DEF:
-                  type_destroy(pair->field_def.type);
+
+// *** Copying ***
+
+static struct stmt* stmt_clone(const struct stmt* stmt);
+static struct pair* pair_clone(const struct pair* pair);
+
+static GList* list_clone(const GList* list, gpointer (*clone)(gconstpointer)) {
+      GList* copy = NULL;
+      for (const GList* p = list; p; p = p->next)
+            copy = ast_list_prepend(copy, clone(p->data));
+      return ast_list_finish(copy);
+}
+
+struct pat* pat_clone(const struct pat* pat) {
+      if (!pat) return NULL;
+      switch (pat->kind) {
+            // The shared ones.
+            case PAT_WILD: case PAT_UNIT: case PAT_TRUE: case PAT_FALSE:
+                  return (struct pat*)pat;
+      }
+
+      struct pat* n = pat_new(pat->kind);
+      *n = *pat;
+      switch (pat->kind) {
+            case PAT_REF:
+                  n->pat = pat_clone(pat->pat);
                   break;
-            case PAIR_CTOR_DEF:
-                  g_list_free_full(pair->ctor_def.types, (GDestroyNotify)type_destroy);
+            case PAT_ARRAY:
+                  n->array.pats = list_clone(pat->array.pats, (gpointer (*)(gconstpointer))pat_clone);
                   break;
-            case PAIR_PARAM:
-                  pat_destroy(pair->param.pat);
-                  type_destroy(pair->param.type);
+            case PAT_ENUM:
+                  n->ctor.pats = list_clone(pat->ctor.pats, (gpointer (*)(gconstpointer))pat_clone);
+                  break;
+            case PAT_STRUCT:
+                  n->strct.fields = list_clone(pat->strct.fields, (gpointer (*)(gconstpointer))pair_clone);
                   break;
+      }
+      return n;
+}
+
+static struct pair* pair_clone(const struct pair* p) {
+      struct pair* n = pair(p->kind);
+      *n = *p;
+      switch (p->kind) {
             case PAIR_FIELD_PAT:
-                  pat_destroy(pair->field_pat.pat);
+                  n->field_pat.pat = pat_clone(p->field_pat.pat);
                   break;
             case PAIR_FIELD_INIT:
-                  exp_destroy(pair->field_init.exp);
+                  n->field_init.exp = exp_clone(p->field_init.exp);
                   break;
             case PAIR_MATCH_ARM:
-                  g_list_free_full(pair->match_arm.pats, (GDestroyNotify)pat_destroy);
-                  exp_destroy(pair->match_arm.block);
+                  n->match_arm.pats = list_clone(p->match_arm.pats, (gpointer (*)(gconstpointer))pat_clone);
+                  n->match_arm.block = exp_clone(p->match_arm.block);
+                  break;
+      }
+      return n;
+}
+
+static struct stmt* stmt_clone(const struct stmt* stmt) {
+      struct stmt* n = stmt_new(stmt->kind);
+      *n = *stmt;
+      switch (stmt->kind) {
+            case STMT_LET:
+                  n->let.pat = pat_clone(stmt->let.pat);
+                  n->let.exp = exp_clone(stmt->let.exp);
+                  break;
+            case STMT_RETURN:
+            case STMT_EXP:
+                  n->exp = exp_clone(stmt->exp);
                   break;
       }
-      free(pair);
+      return n;
 }
 
+static GList* exps_clone(const GList* exps) {
+      return list_clone(exps, (gpointer (*)(gconstpointer))exp_clone);
+}
+
+struct exp* exp_clone(const struct exp* exp) {
+      if (!exp) return NULL;
+
+      struct exp* n = exp_new(exp->kind);
+      *n = *exp;
+      switch (exp->kind) {
+            case EXP_ENUM:
+                  n->lit_enum.exps = exps_clone(exp->lit_enum.exps);
+                  break;
+            case EXP_STRUCT:
+                  n->lit_struct.fields = list_clone(exp->lit_struct.fields, (gpointer (*)(gconstpointer))pair_clone);
+                  break;
+            case EXP_LOOKUP:
+                  n->lookup.exp = exp_clone(exp->lookup.exp);
+                  break;
+            case EXP_INDEX:
+                  n->index.exp = exp_clone(exp->index.exp);
+                  n->index.idx = exp_clone(exp->index.idx);
+                  break;
+            case EXP_FN_CALL:
+                  n->fn_call.exps = exps_clone(exp->fn_call.exps);
+                  break;
+            case EXP_ARRAY:
+                  n->lit_array.exps = exps_clone(exp->lit_array.exps);
+                  break;
+            case EXP_BOX_NEW:
+            case EXP_LOOP:
+                  n->exp = exp_clone(exp->exp);
+                  break;
+            case EXP_MATCH:
+                  n->match.exp = exp_clone(exp->match.exp);
+                  n->match.arms = list_clone(exp->match.arms, (gpointer (*)(gconstpointer))pair_clone);
+                  break;
+            case EXP_IF:
+                  n->if_else.cond = exp_clone(exp->if_else.cond);
+                  n->if_else.block_true = exp_clone(exp->if_else.block_true);
+                  n->if_else.block_false = exp_clone(exp->if_else.block_false);
+                  break;
+            case EXP_WHILE:
+                  n->loop_while.cond = exp_clone(exp->loop_while.cond);
+                  n->loop_while.block = exp_clone(exp->loop_while.block);
+                  break;
+            case EXP_BLOCK:
+                  n->block.stmts = list_clone(exp->block.stmts, (gpointer (*)(gconstpointer))stmt_clone);
+                  n->block.exp = exp_clone(exp->block.exp);
+                  break;
+            case EXP_UNARY:
+                  n->unary.exp = exp_clone(exp->unary.exp);
+                  break;
+            case EXP_BINARY:
+                  n->binary.left = exp_clone(exp->binary.left);
+                  n->binary.right = exp_clone(exp->binary.right);
+                  break;
+      }
+      return n;
+}
@@ -14,8 +14,26 @@ struct pair;
 
 // *** Crate ***
 
+// Every node of the crate (items, statements, expressions, patterns, pairs,
+// types and the list cells linking them) is allocated from this arena.
+struct arena* crate_arena(void);
+
+// Frees the whole crate at once by resetting the arena. Node pointers (and
+// interned types and symbols) are invalid afterwards.
 void crate_destroy(GList* items);
 
+// Like g_list_prepend(), but the new cell is allocated from the crate arena.
+// Lists built this way must never be freed with g_list_free(). The parser
+// builds every list back to front this way, in constant time per element.
+GList* ast_list_prepend(GList* list, gpointer data);
+
+// Turns a list built back to front into the final (front to back) list, laid
+// out as one array of cells: walking it with ->next is a sequential scan, and
+// the i-th child is ast_list_at(list, i). The AST's lists all look like this
+// once parsing is done.
+GList* ast_list_finish(GList* reversed);
+#define ast_list_at(list, i) ((list)[i].data)
+
 // *** Items ***
 
 enum {
@@ -33,12 +51,16 @@ struct item {
             struct  {
                   struct type* type;
                   struct exp* block;
+                  // Set by resolve_crate(): the number of bindings.
+                  int slots;
             } fn_def;
             struct {
                   GList* ctors;
             } enum_def;
             struct {
                   GList* fields;
+                  // Set by build_env: field id -> its PAIR_FIELD_DEF.
+                  GHashTable* index;
             } struct_def;
       };
 };
@@ -46,12 +68,21 @@ struct item {
 struct item* item_fn_def(Symbol id, GList* params, struct type* ret, struct exp* block);
 struct item* item_enum_def(Symbol id, GList* ctors);
 struct item* item_struct_def(Symbol id, GList* fields);
-void item_destroy(struct item* item);
 
 // Return given a struct def, return type corresponding to the parameter field
 // id, type_error() otherwise.
 struct type* item_get_field_type(struct item* struct_def, Symbol id);
 
+// Given a struct def, returns the PAIR_FIELD_DEF for the field id, NULL if def
+// isn't a struct or has no such field. Both go through the index build_env
+// makes, so they take constant time.
+struct pair* item_get_field(const struct item* struct_def, Symbol id);
+
+// Given an enum def, returns the PAIR_CTOR_DEF for the constructor id and sets
+// *tag to its position among the constructors (if tag isn't NULL). Returns NULL
+// if def isn't an enum or has no such constructor.
+struct pair* item_get_ctor(const struct item* enum_def, Symbol id, int* tag);
+
 // *** Statements ***
 
 enum {
@@ -78,7 +109,6 @@ struct stmt {
 struct stmt* stmt_let(struct pat* pat, struct type* type, struct exp* exp);
 struct stmt* stmt_return(struct exp* exp);
 struct stmt* stmt_exp(struct exp* exp);
-void stmt_destroy(struct stmt* stmt);
 
 // *** Patterns ***
 
@@ -109,6 +139,13 @@ struct pat {
                   bool ref;
                   bool mut;
                   Symbol id;
+                  // Set by resolve_crate(): the binding's index among the
+                  // bindings of its function and the (unique) name of the
+                  // IR stack slot holding it, and whether & or &mut is
+                  // ever applied to it.
+                  int slot;
+                  const char* ir_name;
+                  bool borrowed;
             } bind;
             struct {
                   GList* pats;
@@ -136,8 +173,61 @@ struct pat* pat_enum(Symbol eid, Symbol cid, GList* pats);
 struct pat* pat_struct(Symbol id, GList* fields);
 struct pat* pat_i32(int num);
 struct pat* pat_u8(int num);
+// Takes ownership of (frees) the string.
 struct pat* pat_str(char* str);
-void pat_destroy(struct pat* pat);
+
+// *** Operators ***
+
+// Unary/binary operators, as written in the source. A few tokens are shared by
+// a unary and a binary operator (e.g., OP_SUB is also negation and OP_MUL is
+// also deref); they're told apart by the kind of expression holding them.
+enum {
+      OP_INVALID,
+      OP_ADDROF,        // &
+      OP_NOT,           // !
+      OP_ADD,           // +
+      OP_SUB,           // -
+      OP_MUL,           // *
+      OP_DIV,           // /
+      OP_REM,           // %
+      OP_ASSIGN,        // =
+      OP_ADD_ASSIGN,    // +=
+      OP_SUB_ASSIGN,    // -=
+      OP_MUL_ASSIGN,    // *=
+      OP_DIV_ASSIGN,    // /=
+      OP_REM_ASSIGN,    // %=
+      OP_AND,           // &&
+      OP_OR,            // ||
+      OP_EQ,            // ==
+      OP_NEQ,           // !=
+      OP_LT,            // <
+      OP_LEQ,           // <=
+      OP_GT,            // >
+      OP_GEQ,           // >=
+      OP_COUNT,
+};
+
+// Operator classes, see the exp_is_*() tests below.
+enum {
+      OPF_ADDROF = 1 << 0,
+      OPF_ARITH = 1 << 1,
+      OPF_ASSIGN = 1 << 2,
+      OPF_CMP_ASSIGN = 1 << 3,
+      OPF_COMPARE = 1 << 4,
+      OPF_EQ = 1 << 5,
+      OPF_BOOL = 1 << 6,
+};
+
+struct op_info {
+      const char* lexeme;
+      int flags;
+      const char* name;       // for the AST printer
+      const char* unary_name; // same, when used as a unary operator
+      const char* llvm;       // LLVM instruction or icmp condition
+};
+
+// Indexed by OP_*.
+extern const struct op_info op_table[OP_COUNT];
 
 // *** Expressions ***
 
@@ -168,7 +258,15 @@ enum {
 
 struct exp {
       int kind;
+      // EXP_BOX_NEW: set by escape_crate(), if the box can live in the frame
+      // of the fn making it.
+      bool local;
       struct type* type;
+      // EXP_ID: the PAT_BIND this refers to, set by resolve_crate(). NULL for
+      // names bound outside any function (fns, builtins).
+      struct pat* bind;
+      // EXP_STR: its index in the crate's string pool, set by resolve_crate().
+      int string;
 
       union {
             int num;
@@ -217,12 +315,12 @@ struct exp {
                   struct exp* exp;
             } block;
             struct {
-                  const char* op;
+                  int op;
                   bool mut;
                   struct exp* exp;
             } unary;
             struct {
-                  const char* op;
+                  int op;
                   struct exp* left;
                   struct exp* right;
             } binary;
@@ -231,6 +329,7 @@ struct exp {
 
 struct exp* exp_u8(int num);
 struct exp* exp_i32(int num);
+// Takes ownership of (frees) the string.
 struct exp* exp_str(char* str);
 struct exp* exp_true(void);
 struct exp* exp_false(void);
@@ -248,19 +347,18 @@ struct exp* exp_if(struct exp* exp, struct exp* block_true, struct exp* block_fa
 struct exp* exp_while(struct exp* exp, struct exp* block);
 struct exp* exp_loop(struct exp* block);
 struct exp* exp_block(GList* stmts, struct exp* exp);
-struct exp* exp_unary(const char* op, struct exp* exp);
+struct exp* exp_unary(int op, struct exp* exp);
 struct exp* exp_addrof_mut(struct exp* exp);
-struct exp* exp_binary(const char* op, struct exp* left, struct exp* right);
-void exp_destroy(struct exp* exp);
+struct exp* exp_binary(int op, struct exp* left, struct exp* right);
 
 // Test for various classes of unary/binary expressions.
-bool exp_is_addrof(struct exp*);          // &
-bool exp_is_arith(struct exp*);           // +, -, *, /, %
-bool exp_is_assign(struct exp*);          // =
-bool exp_is_cmp_assign(struct exp*);      // +=, -=, *=, /=, %=
-bool exp_is_compare(struct exp*);         // <=, >=, <, >
-bool exp_is_eq(struct exp*);              // ==, !=
-bool exp_is_bool(struct exp*);            // !, &&, ||
+bool exp_is_addrof(const struct exp*);          // &
+bool exp_is_arith(const struct exp*);           // +, -, *, /, %
+bool exp_is_assign(const struct exp*);          // =
+bool exp_is_cmp_assign(const struct exp*);      // +=, -=, *=, /=, %=
+bool exp_is_compare(const struct exp*);         // <=, >=, <, >
+bool exp_is_eq(const struct exp*);              // ==, !=
+bool exp_is_bool(const struct exp*);            // !, &&, ||
 
 // *** Pairs ***
 
@@ -280,6 +378,8 @@ struct pair {
             struct {
                   Symbol id;
                   struct type* type;
+                  // Set by build_env: its position in the declaration.
+                  int index;
             } field_def;
             struct {
                   Symbol id;
@@ -310,6 +410,13 @@ struct pair* param(struct pat* pat, struct type* type);
 struct pair* field_pat(Symbol id, struct pat* pat);
 struct pair* field_init(Symbol id, struct exp* exp);
 struct pair* match_arm(GList* pats, struct exp* block);
-void pair_destroy(struct pair* pair);
+
+// *** Copying ***
+
+// Deep copies from the crate arena. A copy shares only types (which are
+// interned) and strings with the original: its patterns are new nodes, so
+// resolve_crate() numbers its bindings apart from the original's.
+struct exp* exp_clone(const struct exp* exp);
+struct pat* pat_clone(const struct pat* pat);
 
 #endif
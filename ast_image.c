@@ -0,0 +1,823 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast_image.h"
+#include "ast.h"
+#include "arena.h"
+
+// Bumped whenever the layout below, or what goes in it, changes.
+#define IMAGE_MAGIC "pa4 ast\n"
+#define IMAGE_VERSION 1
+
+enum {
+      IMAGE_SYMS,
+      IMAGE_STRS,
+      IMAGE_TYPES,
+      IMAGE_ITEMS,
+      IMAGE_STMTS,
+      IMAGE_EXPS,
+      IMAGE_PATS,
+      IMAGE_PAIRS,
+      IMAGE_LISTS,
+      IMAGE_NTABLES,
+};
+
+// References in the tables: a type or node is its index in its table, -1 for
+// NULL. A string is its offset in IMAGE_STRS (NUL-terminated), -1 for NULL.
+// A list is the offset in IMAGE_LISTS of its length, which its elements
+// follow, -1 for the empty list. A symbol is (index in IMAGE_SYMS + 1) << 3,
+// or'ed with its kind, 0 for none (where a node has no symbol to give).
+
+struct image_header {
+      char magic[8];
+      uint32_t version;
+      // The crate's items, a list.
+      int32_t crate;
+      // Offsets from the start of the image, every one a multiple of 4.
+      struct {
+            uint32_t offset, count;
+      } tables[IMAGE_NTABLES];
+};
+
+struct image_sym {
+      uint32_t str, len;
+};
+
+// The types come children first, so each can be built from the ones before.
+struct image_type {
+      int32_t kind, type, length, id;
+      // TYPE_FN: the list of its PAIR_PARAMs.
+      int32_t params;
+};
+
+// An item, statement, expression, pattern or pair. Its fields go in a[], in
+// the order they're declared in ast.h; see put_item() and the like.
+struct image_node {
+      int32_t kind, type;
+      int32_t a[4];
+};
+
+static const size_t row_size[IMAGE_NTABLES] = {
+      [IMAGE_SYMS] = sizeof(struct image_sym),
+      [IMAGE_STRS] = 1,
+      [IMAGE_TYPES] = sizeof(struct image_type),
+      [IMAGE_ITEMS] = sizeof(struct image_node),
+      [IMAGE_STMTS] = sizeof(struct image_node),
+      [IMAGE_EXPS] = sizeof(struct image_node),
+      [IMAGE_PATS] = sizeof(struct image_node),
+      [IMAGE_PAIRS] = sizeof(struct image_node),
+      [IMAGE_LISTS] = sizeof(int32_t),
+};
+
+/* Writing */
+
+struct writer {
+      GArray* rows[IMAGE_NTABLES];
+      // Per table, pointer (symbol value, for IMAGE_SYMS) -> its index + 1.
+      GHashTable* ids[IMAGE_NTABLES];
+};
+
+typedef int32_t (*put_fn)(struct writer*, const void*);
+
+static int32_t put_type(struct writer* w, const void* p);
+static int32_t put_stmt(struct writer* w, const void* p);
+static int32_t put_exp(struct writer* w, const void* p);
+static int32_t put_pat(struct writer* w, const void* p);
+static int32_t put_pair(struct writer* w, const void* p);
+
+// The index of what p points to in the table: sets *fresh and makes room
+// for it the first time it's seen.
+static int32_t row_for(struct writer* w, int table, const void* p, bool* fresh) {
+      gpointer id = g_hash_table_lookup(w->ids[table], p);
+      *fresh = !id;
+      if (id) return GPOINTER_TO_INT(id) - 1;
+
+      int32_t i = w->rows[table]->len;
+      g_array_set_size(w->rows[table], i + 1);
+      g_hash_table_insert(w->ids[table], (gpointer)p, GINT_TO_POINTER(i + 1));
+      return i;
+}
+
+static int32_t put_str(struct writer* w, const char* str) {
+      if (!str) return -1;
+      int32_t offset = w->rows[IMAGE_STRS]->len;
+      g_array_append_vals(w->rows[IMAGE_STRS], str, strlen(str) + 1);
+      return offset;
+}
+
+static int32_t put_sym(struct writer* w, Symbol id) {
+      if (!id.value) return 0;
+      bool fresh;
+      int32_t i = row_for(w, IMAGE_SYMS, GINT_TO_POINTER(id.value), &fresh);
+      if (fresh) {
+            // The string is the same whatever the kind.
+            const char* str = symbol_to_str((Symbol){SYMBOL_VAR, id.value});
+            struct image_sym sym = {put_str(w, str), strlen(str)};
+            g_array_index(w->rows[IMAGE_SYMS], struct image_sym, i) = sym;
+      }
+      return (i + 1) << 3 | id.kind;
+}
+
+static int32_t put_list(struct writer* w, const GList* list, put_fn put) {
+      if (!list) return -1;
+      // The elements first: they can have lists of their own.
+      guint n = g_list_length((GList*)list);
+      int32_t* elems = g_new(int32_t, n + 1);
+      elems[0] = n;
+      for (guint i = 1; list; list = list->next, ++i)
+            elems[i] = put(w, list->data);
+
+      int32_t offset = w->rows[IMAGE_LISTS]->len;
+      g_array_append_vals(w->rows[IMAGE_LISTS], elems, n + 1);
+      g_free(elems);
+      return offset;
+}
+
+static int32_t put_type(struct writer* w, const void* p) {
+      const struct type* type = p;
+      if (!type) return -1;
+      gpointer id = g_hash_table_lookup(w->ids[IMAGE_TYPES], type);
+      if (id) return GPOINTER_TO_INT(id) - 1;
+
+      struct image_type r = {
+            type->kind,
+            put_type(w, type->type),
+            type->length,
+            type->kind == TYPE_ID? put_sym(w, type->id) : 0,
+            type->kind == TYPE_FN? put_list(w, type->params, put_pair) : -1,
+      };
+      bool fresh;
+      int32_t i = row_for(w, IMAGE_TYPES, type, &fresh);
+      g_array_index(w->rows[IMAGE_TYPES], struct image_type, i) = r;
+      return i;
+}
+
+static int32_t put_item(struct writer* w, const void* p) {
+      const struct item* item = p;
+      if (!item) return -1;
+      bool fresh;
+      int32_t i = row_for(w, IMAGE_ITEMS, item, &fresh);
+      if (!fresh) return i;
+
+      struct image_node r = {item->kind, put_type(w, item->type), {put_sym(w, item->id)}};
+      switch (item->kind) {
+            case ITEM_FN_DEF:
+                  r.a[1] = put_type(w, item->fn_def.type);
+                  r.a[2] = put_exp(w, item->fn_def.block);
+                  break;
+            case ITEM_ENUM_DEF:
+                  r.a[1] = put_list(w, item->enum_def.ctors, put_pair);
+                  break;
+            case ITEM_STRUCT_DEF:
+                  r.a[1] = put_list(w, item->struct_def.fields, put_pair);
+                  break;
+      }
+      g_array_index(w->rows[IMAGE_ITEMS], struct image_node, i) = r;
+      return i;
+}
+
+static int32_t put_stmt(struct writer* w, const void* p) {
+      const struct stmt* stmt = p;
+      if (!stmt) return -1;
+      bool fresh;
+      int32_t i = row_for(w, IMAGE_STMTS, stmt, &fresh);
+      if (!fresh) return i;
+
+      struct image_node r = {stmt->kind, put_type(w, stmt->type)};
+      switch (stmt->kind) {
+            case STMT_LET:
+                  r.a[0] = put_pat(w, stmt->let.pat);
+                  r.a[1] = put_type(w, stmt->let.type);
+                  r.a[2] = put_exp(w, stmt->let.exp);
+                  break;
+            case STMT_RETURN:
+            case STMT_EXP:
+                  r.a[0] = put_exp(w, stmt->exp);
+                  break;
+      }
+      g_array_index(w->rows[IMAGE_STMTS], struct image_node, i) = r;
+      return i;
+}
+
+static int32_t put_pat(struct writer* w, const void* p) {
+      const struct pat* pat = p;
+      if (!pat) return -1;
+      bool fresh;
+      int32_t i = row_for(w, IMAGE_PATS, pat, &fresh);
+      if (!fresh) return i;
+
+      struct image_node r = {pat->kind, -1};
+      switch (pat->kind) {
+            case PAT_REF:
+                  r.a[0] = put_pat(w, pat->pat);
+                  break;
+            case PAT_I32:
+            case PAT_U8:
+                  r.a[0] = pat->num;
+                  break;
+            case PAT_STR:
+                  r.a[0] = put_str(w, pat->str);
+                  break;
+            case PAT_BIND:
+                  r.a[0] = pat->bind.ref;
+                  r.a[1] = pat->bind.mut;
+                  r.a[2] = put_sym(w, pat->bind.id);
+                  break;
+            case PAT_ARRAY:
+                  r.a[0] = put_list(w, pat->array.pats, put_pat);
+                  break;
+            case PAT_ENUM:
+                  r.a[0] = put_sym(w, pat->ctor.eid);
+                  r.a[1] = put_sym(w, pat->ctor.cid);
+                  r.a[2] = put_list(w, pat->ctor.pats, put_pat);
+                  break;
+            case PAT_STRUCT:
+                  r.a[0] = put_sym(w, pat->strct.id);
+                  r.a[1] = put_list(w, pat->strct.fields, put_pair);
+                  break;
+      }
+      g_array_index(w->rows[IMAGE_PATS], struct image_node, i) = r;
+      return i;
+}
+
+static int32_t put_exp(struct writer* w, const void* p) {
+      const struct exp* exp = p;
+      if (!exp) return -1;
+      bool fresh;
+      int32_t i = row_for(w, IMAGE_EXPS, exp, &fresh);
+      if (!fresh) return i;
+
+      struct image_node r = {exp->kind, put_type(w, exp->type)};
+      switch (exp->kind) {
+            case EXP_U8:
+            case EXP_I32:
+                  r.a[0] = exp->num;
+                  break;
+            case EXP_STR:
+                  r.a[0] = put_str(w, exp->str);
+                  break;
+            case EXP_ID:
+                  r.a[0] = put_sym(w, exp->id);
+                  break;
+            case EXP_ENUM:
+                  r.a[0] = put_sym(w, exp->lit_enum.eid);
+                  r.a[1] = put_sym(w, exp->lit_enum.cid);
+                  r.a[2] = put_list(w, exp->lit_enum.exps, put_exp);
+                  break;
+            case EXP_STRUCT:
+                  r.a[0] = put_sym(w, exp->lit_struct.id);
+                  r.a[1] = put_list(w, exp->lit_struct.fields, put_pair);
+                  break;
+            case EXP_LOOKUP:
+                  r.a[0] = put_exp(w, exp->lookup.exp);
+                  r.a[1] = put_sym(w, exp->lookup.id);
+                  break;
+            case EXP_INDEX:
+                  r.a[0] = put_exp(w, exp->index.exp);
+                  r.a[1] = put_exp(w, exp->index.idx);
+                  break;
+            case EXP_FN_CALL:
+                  r.a[0] = put_sym(w, exp->fn_call.id);
+                  r.a[1] = put_list(w, exp->fn_call.exps, put_exp);
+                  break;
+            case EXP_ARRAY:
+                  r.a[0] = put_list(w, exp->lit_array.exps, put_exp);
+                  break;
+            case EXP_BOX_NEW:
+            case EXP_LOOP:
+                  r.a[0] = put_exp(w, exp->exp);
+                  r.a[1] = exp->local;
+                  break;
+            case EXP_MATCH:
+                  r.a[0] = put_exp(w, exp->match.exp);
+                  r.a[1] = put_list(w, exp->match.arms, put_pair);
+                  break;
+            case EXP_IF:
+                  r.a[0] = put_exp(w, exp->if_else.cond);
+                  r.a[1] = put_exp(w, exp->if_else.block_true);
+                  r.a[2] = put_exp(w, exp->if_else.block_false);
+                  break;
+            case EXP_WHILE:
+                  r.a[0] = put_exp(w, exp->loop_while.cond);
+                  r.a[1] = put_exp(w, exp->loop_while.block);
+                  break;
+            case EXP_BLOCK:
+                  r.a[0] = put_list(w, exp->block.stmts, put_stmt);
+                  r.a[1] = put_exp(w, exp->block.exp);
+                  break;
+            case EXP_UNARY:
+                  r.a[0] = exp->unary.op;
+                  r.a[1] = exp->unary.mut;
+                  r.a[2] = put_exp(w, exp->unary.exp);
+                  break;
+            case EXP_BINARY:
+                  r.a[0] = exp->binary.op;
+                  r.a[1] = put_exp(w, exp->binary.left);
+                  r.a[2] = put_exp(w, exp->binary.right);
+                  break;
+      }
+      g_array_index(w->rows[IMAGE_EXPS], struct image_node, i) = r;
+      return i;
+}
+
+static int32_t put_pair(struct writer* w, const void* p) {
+      const struct pair* pair = p;
+      if (!pair) return -1;
+      bool fresh;
+      int32_t i = row_for(w, IMAGE_PAIRS, pair, &fresh);
+      if (!fresh) return i;
+
+      struct image_node r = {pair->kind, -1};
+      switch (pair->kind) {
+            case PAIR_FIELD_DEF:
+                  r.a[0] = put_sym(w, pair->field_def.id);
+                  r.a[1] = put_type(w, pair->field_def.type);
+                  r.a[2] = pair->field_def.index;
+                  break;
+            case PAIR_CTOR_DEF:
+                  r.a[0] = put_sym(w, pair->ctor_def.id);
+                  r.a[1] = put_list(w, pair->ctor_def.types, put_type);
+                  break;
+            case PAIR_PARAM:
+                  r.a[0] = put_pat(w, pair->param.pat);
+                  r.a[1] = put_type(w, pair->param.type);
+                  break;
+            case PAIR_FIELD_PAT:
+                  r.a[0] = put_sym(w, pair->field_pat.id);
+                  r.a[1] = put_pat(w, pair->field_pat.pat);
+                  break;
+            case PAIR_FIELD_INIT:
+                  r.a[0] = put_sym(w, pair->field_init.id);
+                  r.a[1] = put_exp(w, pair->field_init.exp);
+                  break;
+            case PAIR_MATCH_ARM:
+                  r.a[0] = put_list(w, pair->match_arm.pats, put_pat);
+                  r.a[1] = put_exp(w, pair->match_arm.block);
+                  break;
+      }
+      g_array_index(w->rows[IMAGE_PAIRS], struct image_node, i) = r;
+      return i;
+}
+
+void ast_image_write(const GList* items, struct ir_writer* out) {
+      struct writer w;
+      for (int t = 0; t != IMAGE_NTABLES; ++t) {
+            w.rows[t] = g_array_new(false, true, row_size[t]);
+            w.ids[t] = g_hash_table_new(NULL, NULL);
+      }
+
+      struct image_header h = {IMAGE_MAGIC, IMAGE_VERSION, put_list(&w, items, put_item)};
+      uint32_t offset = sizeof h;
+      for (int t = 0; t != IMAGE_NTABLES; ++t) {
+            // Padded out so the next table is aligned.
+            while (w.rows[t]->len * row_size[t] % 4) g_array_set_size(w.rows[t], w.rows[t]->len + 1);
+            h.tables[t].offset = offset;
+            h.tables[t].count = w.rows[t]->len;
+            offset += w.rows[t]->len * row_size[t];
+      }
+
+      ir_putn(out, (const char*)&h, sizeof h);
+      for (int t = 0; t != IMAGE_NTABLES; ++t) {
+            ir_putn(out, w.rows[t]->data, w.rows[t]->len * row_size[t]);
+            g_array_free(w.rows[t], true);
+            g_hash_table_destroy(w.ids[t]);
+      }
+}
+
+/* Loading */
+
+struct loader {
+      const char* image;
+      const char* name;
+      const struct image_header* h;
+      Symbol* syms;
+      struct type** types;
+      // For the node tables, IMAGE_ITEMS to IMAGE_PAIRS: and how many times
+      // each node is referred to.
+      void** nodes[IMAGE_NTABLES];
+      int* refs[IMAGE_NTABLES];
+};
+
+static void bad_image(const struct loader* l) {
+      printf("Error: %s isn't a valid AST image.\n", l->name);
+      exit(1);
+}
+
+static uint32_t count(const struct loader* l, int table) {
+      return l->h->tables[table].count;
+}
+
+static const void* row(const struct loader* l, int table, int32_t i) {
+      if (i < 0 || (uint32_t)i >= count(l, table)) bad_image(l);
+      return l->image + l->h->tables[table].offset + i * row_size[table];
+}
+
+// Every symbol the loader asks for has to be there.
+static Symbol get_sym(const struct loader* l, int32_t ref) {
+      int kind = ref & 7;
+      int32_t i = (ref >> 3) - 1;
+      if (ref < 0 || kind == SYMBOL_INVALID || kind > SYMBOL_FIELD) bad_image(l);
+      row(l, IMAGE_SYMS, i);
+      return (Symbol){kind, l->syms[i].value};
+}
+
+static const char* get_str(const struct loader* l, int32_t ref, size_t len) {
+      const char* str = row(l, IMAGE_STRS, ref);
+      if (ref + len >= count(l, IMAGE_STRS) || str[len]) bad_image(l);
+      return str;
+}
+
+static char* get_strdup(const struct loader* l, int32_t ref) {
+      if (ref == -1) return NULL;
+      const char* str = row(l, IMAGE_STRS, ref);
+      const char* end = memchr(str, 0, count(l, IMAGE_STRS) - ref);
+      if (!end) bad_image(l);
+      return arena_strdup(crate_arena(), str);
+}
+
+// Types can only refer to the ones before them (below limit).
+static struct type* get_type(const struct loader* l, int32_t i, int32_t limit) {
+      if (i == -1) return NULL;
+      if (i < 0 || i >= limit) bad_image(l);
+      return l->types[i];
+}
+
+static void* get_node(const struct loader* l, int table, int32_t i) {
+      if (i == -1) return NULL;
+      row(l, table, i);
+      ++l->refs[table][i];
+      return l->nodes[table][i];
+}
+
+static GList* get_list(const struct loader* l, int32_t ref, int table) {
+      if (ref == -1) return NULL;
+      const int32_t* elems = row(l, IMAGE_LISTS, ref);
+      int32_t n = elems[0];
+      if (n <= 0 || n >= (int32_t)(count(l, IMAGE_LISTS) - ref)) bad_image(l);
+
+      GList* cells = arena_alloc(crate_arena(), ARENA_LIST, n * sizeof(*cells));
+      for (int32_t i = 0; i != n; ++i) {
+            cells[i].data = table == IMAGE_TYPES?
+                  (void*)get_type(l, elems[i + 1], count(l, IMAGE_TYPES)) : get_node(l, table, elems[i + 1]);
+            cells[i].prev = i? &cells[i - 1] : NULL;
+            cells[i].next = i + 1 != n? &cells[i + 1] : NULL;
+      }
+      return cells;
+}
+
+static void load_types(struct loader* l) {
+      int32_t n = count(l, IMAGE_TYPES);
+      l->types = g_new(struct type*, n);
+      for (int32_t i = 0; i != n; ++i) {
+            const struct image_type* r = row(l, IMAGE_TYPES, i);
+            struct type* type = get_type(l, r->type, i);
+            struct type* t = NULL;
+            switch (r->kind) {
+                  case TYPE_INVALID: t = type_invalid(); break;
+                  case TYPE_ERROR: t = type_error(); break;
+                  case TYPE_OK: t = type_ok(); break;
+                  case TYPE_UNIT: t = type_unit(); break;
+                  case TYPE_I32: t = type_i32(); break;
+                  case TYPE_U8: t = type_u8(); break;
+                  case TYPE_BOOL: t = type_bool(); break;
+                  case TYPE_DIV: t = type_div(); break;
+                  case TYPE_REF: if (type) t = type_ref(type); break;
+                  case TYPE_MUT: if (type) t = type_mut(type); break;
+                  case TYPE_SLICE: if (type) t = type_slice(type); break;
+                  case TYPE_ARRAY: if (type) t = type_array(type, r->length); break;
+                  case TYPE_BOX: if (type) t = type_box(type); break;
+                  case TYPE_ID: t = type_id(get_sym(l, r->id)); break;
+                  case TYPE_FN: t = type_fn(get_list(l, r->params, IMAGE_PAIRS), type); break;
+            }
+            if (!t) bad_image(l);
+            l->types[i] = t;
+      }
+}
+
+// The node a row of the kind stands for if it's one of the shared ones, like
+// the unit expression, or NULL.
+static void* shared_node(int table, int kind) {
+      if (table == IMAGE_EXPS && kind == EXP_TRUE) return exp_true();
+      if (table == IMAGE_EXPS && kind == EXP_FALSE) return exp_false();
+      if (table == IMAGE_EXPS && kind == EXP_UNIT) return exp_unit();
+      if (table == IMAGE_PATS && kind == PAT_WILD) return pat_wild();
+      if (table == IMAGE_PATS && kind == PAT_UNIT) return pat_unit();
+      if (table == IMAGE_PATS && kind == PAT_TRUE) return pat_true();
+      if (table == IMAGE_PATS && kind == PAT_FALSE) return pat_false();
+      return NULL;
+}
+
+// Makes every node (but the shared ones) so that they can be referred to
+// before they're filled in.
+static void alloc_nodes(struct loader* l) {
+      static const int kinds[IMAGE_NTABLES] = {
+            [IMAGE_ITEMS] = ARENA_ITEM,
+            [IMAGE_STMTS] = ARENA_STMT,
+            [IMAGE_EXPS] = ARENA_EXP,
+            [IMAGE_PATS] = ARENA_PAT,
+            [IMAGE_PAIRS] = ARENA_PAIR,
+      };
+      static const size_t sizes[IMAGE_NTABLES] = {
+            [IMAGE_ITEMS] = sizeof(struct item),
+            [IMAGE_STMTS] = sizeof(struct stmt),
+            [IMAGE_EXPS] = sizeof(struct exp),
+            [IMAGE_PATS] = sizeof(struct pat),
+            [IMAGE_PAIRS] = sizeof(struct pair),
+      };
+
+      for (int t = IMAGE_ITEMS; t <= IMAGE_PAIRS; ++t) {
+            l->nodes[t] = g_new(void*, count(l, t));
+            l->refs[t] = g_new0(int, count(l, t));
+            for (uint32_t i = 0; i != count(l, t); ++i) {
+                  const struct image_node* r = row(l, t, i);
+                  void* n = shared_node(t, r->kind);
+                  if (!n) n = arena_alloc(crate_arena(), kinds[t], sizes[t]);
+                  l->nodes[t][i] = n;
+            }
+      }
+}
+
+static void load_items(const struct loader* l) {
+      int32_t ntypes = count(l, IMAGE_TYPES);
+      for (uint32_t i = 0; i != count(l, IMAGE_ITEMS); ++i) {
+            const struct image_node* r = row(l, IMAGE_ITEMS, i);
+            struct item* n = l->nodes[IMAGE_ITEMS][i];
+            n->kind = r->kind;
+            n->type = get_type(l, r->type, ntypes);
+            n->id = get_sym(l, r->a[0]);
+            switch (r->kind) {
+                  case ITEM_FN_DEF:
+                        n->fn_def.type = get_type(l, r->a[1], ntypes);
+                        n->fn_def.block = get_node(l, IMAGE_EXPS, r->a[2]);
+                        if (!n->fn_def.type || n->fn_def.type->kind != TYPE_FN) bad_image(l);
+                        break;
+                  case ITEM_ENUM_DEF:
+                        n->enum_def.ctors = get_list(l, r->a[1], IMAGE_PAIRS);
+                        break;
+                  case ITEM_STRUCT_DEF:
+                        n->struct_def.fields = get_list(l, r->a[1], IMAGE_PAIRS);
+                        break;
+                  default:
+                        bad_image(l);
+            }
+      }
+}
+
+static void load_stmts(const struct loader* l) {
+      int32_t ntypes = count(l, IMAGE_TYPES);
+      for (uint32_t i = 0; i != count(l, IMAGE_STMTS); ++i) {
+            const struct image_node* r = row(l, IMAGE_STMTS, i);
+            struct stmt* n = l->nodes[IMAGE_STMTS][i];
+            n->kind = r->kind;
+            n->type = get_type(l, r->type, ntypes);
+            switch (r->kind) {
+                  case STMT_LET:
+                        n->let.pat = get_node(l, IMAGE_PATS, r->a[0]);
+                        n->let.type = get_type(l, r->a[1], ntypes);
+                        n->let.exp = get_node(l, IMAGE_EXPS, r->a[2]);
+                        break;
+                  case STMT_RETURN:
+                  case STMT_EXP:
+                        n->exp = get_node(l, IMAGE_EXPS, r->a[0]);
+                        break;
+                  default:
+                        bad_image(l);
+            }
+      }
+}
+
+static void load_pats(const struct loader* l) {
+      for (uint32_t i = 0; i != count(l, IMAGE_PATS); ++i) {
+            const struct image_node* r = row(l, IMAGE_PATS, i);
+            struct pat* n = l->nodes[IMAGE_PATS][i];
+            switch (r->kind) {
+                  case PAT_WILD:
+                  case PAT_UNIT:
+                  case PAT_TRUE:
+                  case PAT_FALSE:
+                        continue;
+                  case PAT_REF:
+                        n->pat = get_node(l, IMAGE_PATS, r->a[0]);
+                        break;
+                  case PAT_I32:
+                  case PAT_U8:
+                        n->num = r->a[0];
+                        break;
+                  case PAT_STR:
+                        n->str = get_strdup(l, r->a[0]);
+                        break;
+                  case PAT_BIND:
+                        n->bind.ref = r->a[0];
+                        n->bind.mut = r->a[1];
+                        n->bind.id = get_sym(l, r->a[2]);
+                        break;
+                  case PAT_ARRAY:
+                        n->array.pats = get_list(l, r->a[0], IMAGE_PATS);
+                        break;
+                  case PAT_ENUM:
+                        n->ctor.eid = get_sym(l, r->a[0]);
+                        n->ctor.cid = get_sym(l, r->a[1]);
+                        n->ctor.pats = get_list(l, r->a[2], IMAGE_PATS);
+                        break;
+                  case PAT_STRUCT:
+                        n->strct.id = get_sym(l, r->a[0]);
+                        n->strct.fields = get_list(l, r->a[1], IMAGE_PAIRS);
+                        break;
+                  default:
+                        bad_image(l);
+            }
+            n->kind = r->kind;
+      }
+}
+
+static void load_exps(const struct loader* l) {
+      int32_t ntypes = count(l, IMAGE_TYPES);
+      for (uint32_t i = 0; i != count(l, IMAGE_EXPS); ++i) {
+            const struct image_node* r = row(l, IMAGE_EXPS, i);
+            struct exp* n = l->nodes[IMAGE_EXPS][i];
+            switch (r->kind) {
+                  case EXP_TRUE:
+                  case EXP_FALSE:
+                  case EXP_UNIT:
+                        continue;
+                  case EXP_U8:
+                  case EXP_I32:
+                        n->num = r->a[0];
+                        break;
+                  case EXP_STR:
+                        n->str = get_strdup(l, r->a[0]);
+                        break;
+                  case EXP_ID:
+                        n->id = get_sym(l, r->a[0]);
+                        break;
+                  case EXP_ENUM:
+                        n->lit_enum.eid = get_sym(l, r->a[0]);
+                        n->lit_enum.cid = get_sym(l, r->a[1]);
+                        n->lit_enum.exps = get_list(l, r->a[2], IMAGE_EXPS);
+                        break;
+                  case EXP_STRUCT:
+                        n->lit_struct.id = get_sym(l, r->a[0]);
+                        n->lit_struct.fields = get_list(l, r->a[1], IMAGE_PAIRS);
+                        break;
+                  case EXP_LOOKUP:
+                        n->lookup.exp = get_node(l, IMAGE_EXPS, r->a[0]);
+                        n->lookup.id = get_sym(l, r->a[1]);
+                        break;
+                  case EXP_INDEX:
+                        n->index.exp = get_node(l, IMAGE_EXPS, r->a[0]);
+                        n->index.idx = get_node(l, IMAGE_EXPS, r->a[1]);
+                        break;
+                  case EXP_FN_CALL:
+                        n->fn_call.id = get_sym(l, r->a[0]);
+                        n->fn_call.exps = get_list(l, r->a[1], IMAGE_EXPS);
+                        break;
+                  case EXP_ARRAY:
+                        n->lit_array.exps = get_list(l, r->a[0], IMAGE_EXPS);
+                        break;
+                  case EXP_BOX_NEW:
+                  case EXP_LOOP:
+                        n->exp = get_node(l, IMAGE_EXPS, r->a[0]);
+                        n->local = r->a[1];
+                        break;
+                  case EXP_MATCH:
+                        n->match.exp = get_node(l, IMAGE_EXPS, r->a[0]);
+                        n->match.arms = get_list(l, r->a[1], IMAGE_PAIRS);
+                        break;
+                  case EXP_IF:
+                        n->if_else.cond = get_node(l, IMAGE_EXPS, r->a[0]);
+                        n->if_else.block_true = get_node(l, IMAGE_EXPS, r->a[1]);
+                        n->if_else.block_false = get_node(l, IMAGE_EXPS, r->a[2]);
+                        break;
+                  case EXP_WHILE:
+                        n->loop_while.cond = get_node(l, IMAGE_EXPS, r->a[0]);
+                        n->loop_while.block = get_node(l, IMAGE_EXPS, r->a[1]);
+                        break;
+                  case EXP_BLOCK:
+                        n->block.stmts = get_list(l, r->a[0], IMAGE_STMTS);
+                        n->block.exp = get_node(l, IMAGE_EXPS, r->a[1]);
+                        break;
+                  case EXP_UNARY:
+                        n->unary.op = r->a[0];
+                        n->unary.mut = r->a[1];
+                        n->unary.exp = get_node(l, IMAGE_EXPS, r->a[2]);
+                        break;
+                  case EXP_BINARY:
+                        n->binary.op = r->a[0];
+                        n->binary.left = get_node(l, IMAGE_EXPS, r->a[1]);
+                        n->binary.right = get_node(l, IMAGE_EXPS, r->a[2]);
+                        break;
+                  default:
+                        bad_image(l);
+            }
+            if ((r->kind == EXP_UNARY || r->kind == EXP_BINARY) && (r->a[0] <= OP_INVALID || r->a[0] >= OP_COUNT))
+                  bad_image(l);
+            // Every expression of a checked crate has a type, that of a value
+            // (or an error).
+            if (r->type == -1) bad_image(l);
+            n->kind = r->kind;
+            n->type = get_type(l, r->type, ntypes);
+            if (n->type->kind == TYPE_INVALID || n->type->kind == TYPE_OK || n->type->kind == TYPE_FN) bad_image(l);
+      }
+}
+
+static void load_pairs(const struct loader* l) {
+      int32_t ntypes = count(l, IMAGE_TYPES);
+      for (uint32_t i = 0; i != count(l, IMAGE_PAIRS); ++i) {
+            const struct image_node* r = row(l, IMAGE_PAIRS, i);
+            struct pair* n = l->nodes[IMAGE_PAIRS][i];
+            n->kind = r->kind;
+            switch (r->kind) {
+                  case PAIR_FIELD_DEF:
+                        n->field_def.id = get_sym(l, r->a[0]);
+                        n->field_def.type = get_type(l, r->a[1], ntypes);
+                        n->field_def.index = r->a[2];
+                        break;
+                  case PAIR_CTOR_DEF:
+                        n->ctor_def.id = get_sym(l, r->a[0]);
+                        n->ctor_def.types = get_list(l, r->a[1], IMAGE_TYPES);
+                        break;
+                  case PAIR_PARAM:
+                        n->param.pat = get_node(l, IMAGE_PATS, r->a[0]);
+                        n->param.type = get_type(l, r->a[1], ntypes);
+                        break;
+                  case PAIR_FIELD_PAT:
+                        n->field_pat.id = get_sym(l, r->a[0]);
+                        n->field_pat.pat = get_node(l, IMAGE_PATS, r->a[1]);
+                        break;
+                  case PAIR_FIELD_INIT:
+                        n->field_init.id = get_sym(l, r->a[0]);
+                        n->field_init.exp = get_node(l, IMAGE_EXPS, r->a[1]);
+                        break;
+                  case PAIR_MATCH_ARM:
+                        n->match_arm.pats = get_list(l, r->a[0], IMAGE_PATS);
+                        n->match_arm.block = get_node(l, IMAGE_EXPS, r->a[1]);
+                        break;
+                  default:
+                        bad_image(l);
+            }
+      }
+}
+
+// The nodes have to make up a tree: every one but the shared ones referred to
+// exactly once, which also rules out cycles. The passes after loading walk the
+// crate and rewrite it in place, so a node reached twice (or from below) would
+// have them trip over their own changes or go round forever.
+static void check_tree(const struct loader* l) {
+      for (int t = IMAGE_ITEMS; t <= IMAGE_PAIRS; ++t) {
+            for (uint32_t i = 0; i != count(l, t); ++i) {
+                  const struct image_node* r = row(l, t, i);
+                  if (l->refs[t][i] != 1 && !shared_node(t, r->kind)) bad_image(l);
+            }
+      }
+}
+
+GList* ast_image_load(const void* image, size_t size, const char* name) {
+      struct loader l = {image, name, image};
+
+      if (size < sizeof *l.h || memcmp(l.h->magic, IMAGE_MAGIC, sizeof l.h->magic)) bad_image(&l);
+      if (l.h->version != IMAGE_VERSION) {
+            printf("Error: %s is an AST image of another version (%u, not %u).\n",
+                        name, l.h->version, IMAGE_VERSION);
+            exit(1);
+      }
+      for (int t = 0; t != IMAGE_NTABLES; ++t) {
+            uint64_t offset = l.h->tables[t].offset;
+            if (offset % 4 || offset + (uint64_t)l.h->tables[t].count * row_size[t] > size) bad_image(&l);
+      }
+
+      l.syms = g_new(Symbol, count(&l, IMAGE_SYMS));
+      for (uint32_t i = 0; i != count(&l, IMAGE_SYMS); ++i) {
+            const struct image_sym* r = row(&l, IMAGE_SYMS, i);
+            l.syms[i] = symbol_intern(get_str(&l, r->str, r->len), r->len);
+      }
+      alloc_nodes(&l);
+      load_types(&l);
+      load_items(&l);
+      load_stmts(&l);
+      load_pats(&l);
+      load_exps(&l);
+      load_pairs(&l);
+      GList* items = get_list(&l, l.h->crate, IMAGE_ITEMS);
+      check_tree(&l);
+
+      // As build_env has it, for item_get_field().
+      for (GList* i = items; i; i = i->next) {
+            struct item* item = i->data;
+            if (item->kind != ITEM_STRUCT_DEF) continue;
+            item->struct_def.index = g_hash_table_new(NULL, NULL);
+            for (GList* j = item->struct_def.fields; j; j = j->next) {
+                  struct pair* pair = j->data;
+                  if (pair->kind != PAIR_FIELD_DEF) bad_image(&l);
+                  g_hash_table_insert(item->struct_def.index, GINT_TO_POINTER(pair->field_def.id.value), pair);
+            }
+      }
+
+      for (int t = IMAGE_ITEMS; t <= IMAGE_PAIRS; ++t) {
+            g_free(l.nodes[t]);
+            g_free(l.refs[t]);
+      }
+      g_free(l.types);
+      g_free(l.syms);
+      return items;
+}
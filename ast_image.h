@@ -0,0 +1,28 @@
+#ifndef RUSTC_AST_IMAGE_H_
+#define RUSTC_AST_IMAGE_H_
+
+#include <stddef.h>
+#include <glib.h>
+#include "ir_writer.h"
+
+// *** AST images (--emit-ast, --load-ast) ***
+
+// A checked crate, saved in a binary form that loads back without lexing,
+// parsing or checking again: a header, then flat tables of symbols, strings,
+// types, items, statements, expressions, patterns, pairs and lists, the nodes
+// referring to each other by index. The image is written in the host's byte
+// order and is versioned: a loader only takes images of its own version.
+
+// Writes the crate as annotate_crate() left it (types, errors included).
+void ast_image_write(const GList* items, struct ir_writer* out);
+
+// Rebuilds the crate in the crate arena from the image (which can be an
+// mmap()ed file) and builds the struct field indexes as build_env does. The
+// result is the crate ast_image_write() was given, ready for crate_print() or
+// codegen; the image isn't needed once this returns. Exits on an image that
+// isn't valid, mentioning name: one whose references go astray, whose nodes
+// don't make up a tree, or that lacks a symbol or an expression's type. The
+// types themselves are taken to be what the checker made of the crate.
+GList* ast_image_load(const void* image, size_t size, const char* name);
+
+#endif
@@ -1,8 +1,14 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "symbol.h"
 #include "ast_print.h"
+#include "cache.h"
+#include "ir_writer.h"
+#include "parallel.h"
+#include "runtime.h"
+#include "stats.h"
 
 static void print_indent(void);
 static void print_typed_head(const char* head, const struct type* type);
@@ -11,7 +17,7 @@ static void print_typed_leaf(const char* head, const struct type* type);
 static void print_leaf(const char* head);
 static void print_rparen(void);
 
-static const char* op_to_str(const char* op, bool unary, bool mut);
+static const char* op_to_str(int op, bool unary, bool mut);
 
 static void symbol_print(Symbol id);
 static void item_print(const struct item*);
@@ -21,21 +27,30 @@ static void exp_print(const struct exp*);
 static void pair_print(const struct pair*);
 static void type_print(const struct type*);
 
-static void llvm_stmt(const struct stmt* stmt);
-void llvm_item(const struct item*);
-void llvm_exp(const struct exp*);
+// Everything codegen needs to know about the function being lowered. Each
+// function gets its own, so that functions can be lowered concurrently.
+struct codegen_ctx {
+      struct ir_writer* out;
+      int last_register;
+      struct type* last_type;
+      int last_label;
+      int last_if;
+      // With --ssa: the current value of each binding of the function that
+      // lives in a register, indexed by slot (NULL if they all live in
+      // memory), and the label of the block being emitted.
+      struct llvm_value* vals;
+      const struct pat** binds;
+      int slots;
+      const char* block;
+      int block_n;
+};
+
+static void llvm_stmt(const struct stmt* stmt, struct codegen_ctx* cg);
+void llvm_item(const struct item*, struct codegen_ctx* cg);
+void llvm_exp(const struct exp*, struct codegen_ctx* cg);
 const char* llvm_get_type(const struct type* type);
-void llvm_print_type(const struct type* type);
-const char* llvm_op_to_str(const char* op);
-static void llvm_strings(const struct item* item);
-
-static int last_register;
-static struct type* last_type;
-static int last_label;
-static GList* last_args;
-static int last_if;
-static int num_to_print = 0; 
-static int last_string = 2; 
+void llvm_print_type(const struct type* type, struct codegen_ctx* cg);
+const char* llvm_op_to_str(int op);
 
 #define INDENT "  "
 static int indent_level;
@@ -252,30 +267,10 @@ static void pat_print(const struct pat* pat) {
 
 // *** Expressions ***
 
-static const char* op_to_str(const char* op, bool unary, bool mut) {
-      assert(op);
-      if (!strcmp(op, "&")) return mut? "addr-of-mut" : "addr-of";
-      if (!strcmp(op, "!")) return "not";
-      if (!strcmp(op, "+")) return "add";
-      if (!strcmp(op, "-")) return unary? "neg" : "sub";
-      if (!strcmp(op, "*")) return unary? "deref" : "mul";
-      if (!strcmp(op, "/")) return "div";
-      if (!strcmp(op, "%")) return "rem";
-      if (!strcmp(op, "=")) return "assign";
-      if (!strcmp(op, "+=")) return "assign-add";
-      if (!strcmp(op, "-=")) return "assign-sub";
-      if (!strcmp(op, "*=")) return "assign-mul";
-      if (!strcmp(op, "/=")) return "assign-div";
-      if (!strcmp(op, "%=")) return "assign-rem";
-      if (!strcmp(op, "&&")) return "and";
-      if (!strcmp(op, "||")) return "or";
-      if (!strcmp(op, "!=")) return "neq";
-      if (!strcmp(op, "==")) return "eq";
-      if (!strcmp(op, "<")) return "lt";
-      if (!strcmp(op, "<=")) return "leq";
-      if (!strcmp(op, ">")) return "gt";
-      if (!strcmp(op, ">=")) return "geq";
-      assert(false);
+static const char* op_to_str(int op, bool unary, bool mut) {
+      assert(op > OP_INVALID && op < OP_COUNT);
+      if (op == OP_ADDROF && mut) return "addr-of-mut";
+      return unary? op_table[op].unary_name : op_table[op].name;
 }
 
 static void exp_print(const struct exp* exp) {
@@ -577,66 +572,382 @@ void type_print_pretty(const struct type* type) {
 
 /* LLVM */
 
-void llvm_crate(const GList* items){
-  printf("@.str = private unnamed_addr constant [3 x i8] c\"%%s\\00\", align 1\n");
-  printf("@.str1 = private unnamed_addr constant [3 x i8] c\"%%d\\00\", align 1\n");
-  
-  g_list_foreach((GList*)items, (GFunc)llvm_strings, NULL);
-  printf("\n");
-  g_list_foreach((GList*)items, (GFunc)llvm_item, NULL);
+// One function's worth of lowering: the item, the buffer it is lowered
+// into and its cache entry, if any (a hit isn't lowered at all).
+struct llvm_job {
+  const struct item* item;
+  struct ir_writer* out;
+  struct cache_entry* cached;
+};
+
+static void llvm_job_run(void* item, void* data){
+  struct llvm_job* job = item;
+  if (job->cached && job->cached->hit) return;
+  struct codegen_ctx cg = { .out = job->out };
+  llvm_item(job->item, &cg);
+
+  if (stats_enabled){
+    // Instructions are the lines indented by two spaces.
+    size_t len, i;
+    const char* ir = ir_writer_data(job->out, &len);
+    int n = 0;
+    for (i = 0; i + 2 < len; i++)
+      if ((i == 0 || ir[i - 1] == '\n') && ir[i] == ' ' && ir[i + 1] == ' ')
+        n++;
+    stats_add(STATS_IR_INSTS, n);
+  }
+}
+
+void llvm_crate(const GList* items, const GPtrArray* strings, GHashTable* cache, struct ir_writer* w){
+  const GList* l;
+  int i, n;
+
+  for (i = 0; i < (int)strings->len; i++)
+    ir_string(w, i, g_ptr_array_index(strings, i));
+  ir_putc(w, '\n');
+
+  // Each item is lowered into its own buffer so the items can be handed out
+  // to worker threads; the buffers are then spliced back in source order.
+  n = g_list_length((GList*)items);
+  struct llvm_job* jobs = calloc(n, sizeof *jobs);
+  void** work = calloc(n, sizeof *work);
+  for (l = items, i = 0; l; l = l->next, i++){
+    const struct item* item = l->data;
+    jobs[i].item = item;
+    jobs[i].out = ir_writer_mem();
+    if (cache) jobs[i].cached = g_hash_table_lookup(cache, item);
+    work[i] = &jobs[i];
+  }
+
+  parallel_for(work, n, llvm_job_run, NULL);
+
+  // A fresh function's buffer goes into its cache entry as it is.
+  for (i = 0; i < n; i++){
+    struct cache_entry* cached = jobs[i].cached;
+    if (cached && cached->hit){
+      ir_append(w, cached->ir);
+      ir_writer_close(jobs[i].out);
+    } else {
+      ir_append(w, jobs[i].out);
+      if (cached) cached->ir = jobs[i].out;
+      else ir_writer_close(jobs[i].out);
+    }
+  }
+  free(work);
+  free(jobs);
   
-  printf("; Function Attrs: nounwind\ndeclare i32 @printf(i8*, ...) #0\n\n");
-  printf("!0 = !{!\"clang version 3.6.0 (tags/RELEASE_360/final)\"}\n");
+  runtime_print(w);
+  ir_putc(w, '\n');
+  ir_lit(w, "!0 = !{!\"clang version 3.6.0 (tags/RELEASE_360/final)\"}\n");
+}
+
+// The stack slot a variable lives in, as named by resolve_crate().
+static const char* llvm_slot(const struct exp* id){
+  assert(id->kind == EXP_ID);
+  if (id->bind) return id->bind->bind.ir_name;
+  return symbol_to_str(id->id);
+}
+
+// A parameter's incoming value: its slot name without the ".addr".
+static void llvm_param_value(const struct pat* pat, struct codegen_ctx* cg){
+  ir_putn(cg->out, pat->bind.ir_name, strlen(pat->bind.ir_name) - strlen(".addr"));
+}
+
+bool llvm_ssa;
+
+// What a binding that lives in a register holds at some point of the function.
+enum {
+  VAL_MEM,      // nothing: the binding lives in memory (or is out of scope)
+  VAL_UNDEF,    // declared but not yet assigned
+  VAL_REG,      // %r<n>
+  VAL_LIT,      // the constant n
+  VAL_PARAM,    // the incoming parameter
+  VAL_PHI,      // the phi at the join with label number n
+};
+
+struct llvm_value {
+  int kind;
+  int n;
+};
+
+static void llvm_visit(const struct exp* exp, void (*fn)(const struct exp*, void*), void* data);
+
+// Whether a variable reference is to a binding that lives in a register.
+static bool llvm_in_reg(const struct exp* id, struct codegen_ctx* cg){
+  return cg->vals && id->kind == EXP_ID && id->bind && cg->vals[id->bind->bind.slot].kind != VAL_MEM;
+}
+
+// Whether a new binding of the given type gets a register instead of a slot:
+// i32s that are never borrowed.
+static bool llvm_wants_reg(const struct pat* pat, const struct type* type, struct codegen_ctx* cg){
+  return cg->vals && pat->kind == PAT_BIND && !pat->bind.borrowed && type_eq(type, type_i32());
+}
+
+static void llvm_def(const struct pat* pat, int kind, int n, struct codegen_ctx* cg){
+  cg->binds[pat->bind.slot] = pat;
+  cg->vals[pat->bind.slot].kind = kind;
+  cg->vals[pat->bind.slot].n = n;
+}
+
+static void llvm_print_value(int slot, struct llvm_value v, struct codegen_ctx* cg){
+  const struct pat* pat = cg->binds[slot];
+  switch (v.kind){
+    case VAL_UNDEF:
+      ir_lit(cg->out, "undef");
+      break;
+    case VAL_REG:
+      ir_reg(cg->out, v.n);
+      break;
+    case VAL_LIT:
+      ir_int(cg->out, v.n);
+      break;
+    case VAL_PARAM:
+      ir_putc(cg->out, '%');
+      llvm_param_value(pat, cg);
+      break;
+    case VAL_PHI:
+      ir_putc(cg->out, '%');
+      ir_puts(cg->out, pat->bind.ir_name);
+      ir_lit(cg->out, ".phi");
+      ir_int(cg->out, v.n);
+      break;
+    default:
+      assert(false);
+  }
+}
+
+// Notes that the block with the given label starts (its label was just
+// printed).
+static void llvm_enter(const char* name, int n, struct codegen_ctx* cg){
+  cg->block = name;
+  cg->block_n = n;
+}
+
+static void llvm_print_block(const char* name, int n, struct codegen_ctx* cg){
+  ir_putc(cg->out, '%');
+  ir_puts(cg->out, name);
+  if (n >= 0) ir_int(cg->out, n);
+}
+
+static struct llvm_value* llvm_save(struct codegen_ctx* cg){
+  struct llvm_value* vals = g_new(struct llvm_value, cg->slots);
+  memcpy(vals, cg->vals, cg->slots * sizeof *vals);
+  return vals;
+}
+
+// Where an if's branches meet again: every binding that ended up with
+// different values in the two gets a phi. The else branch's values are the
+// current ones.
+static void llvm_join(int l, const struct llvm_value* then_vals, const char* then_block, int then_n,
+    const char* else_block, int else_n, struct codegen_ctx* cg){
+  int i;
+  for (i = 0; i != cg->slots; i++){
+    struct llvm_value a = then_vals[i], b = cg->vals[i];
+    if (a.kind == VAL_MEM || b.kind == VAL_MEM){
+      // Declared inside one of the branches.
+      cg->vals[i].kind = VAL_MEM;
+      continue;
+    }
+    if (a.kind == b.kind && a.n == b.n) continue;
+
+    ir_lit(cg->out, "  %");
+    ir_puts(cg->out, cg->binds[i]->bind.ir_name);
+    ir_lit(cg->out, ".phi");
+    ir_int(cg->out, l);
+    ir_lit(cg->out, " = phi i32 [ ");
+    llvm_print_value(i, a, cg);
+    ir_lit(cg->out, ", ");
+    llvm_print_block(then_block, then_n, cg);
+    ir_lit(cg->out, " ], [ ");
+    llvm_print_value(i, b, cg);
+    ir_lit(cg->out, ", ");
+    llvm_print_block(else_block, else_n, cg);
+    ir_lit(cg->out, " ]\n");
+    cg->vals[i].kind = VAL_PHI;
+    cg->vals[i].n = l;
+  }
+}
+
+// Marks (in the bool array) the bindings an expression assigns to.
+static void llvm_assigned(const struct exp* exp, void* data){
+  bool* assigned = data;
+  if ((exp_is_assign(exp) || exp_is_cmp_assign(exp))
+      && exp->binary.left->kind == EXP_ID && exp->binary.left->bind)
+    assigned[exp->binary.left->bind->bind.slot] = true;
 }
 
-void llvm_item(const struct item* item){
-  last_register = 0;
-  last_label = 0;
-  last_if = 0;
+// Clears the flag for expressions whose lowering jumps to blocks that aren't
+// set up as joins (&&, || and loop), so their functions keep every binding in
+// memory.
+static void llvm_structured(const struct exp* exp, void* data){
+  bool* ok = data;
+  if (exp->kind == EXP_LOOP
+      || (exp->kind == EXP_BINARY && (exp->binary.op == OP_AND || exp->binary.op == OP_OR)))
+    *ok = false;
+}
+
+static void llvm_visit_stmt(const struct stmt* stmt, void (*fn)(const struct exp*, void*), void* data){
+  switch (stmt->kind){
+    case STMT_LET:
+      llvm_visit(stmt->let.exp, fn, data);
+      break;
+    case STMT_RETURN:
+    case STMT_EXP:
+      llvm_visit(stmt->exp, fn, data);
+      break;
+  }
+}
+
+// Calls fn on every expression in the tree, parents first.
+static void llvm_visit(const struct exp* exp, void (*fn)(const struct exp*, void*), void* data){
+  const GList* p;
+  if (!exp) return;
+  fn(exp, data);
+
+  switch (exp->kind){
+    case EXP_ENUM:
+      for (p = exp->lit_enum.exps; p; p = p->next)
+        llvm_visit(p->data, fn, data);
+      break;
+    case EXP_STRUCT:
+      for (p = exp->lit_struct.fields; p; p = p->next){
+        const struct pair* field = p->data;
+        llvm_visit(field->field_init.exp, fn, data);
+      }
+      break;
+    case EXP_LOOKUP:
+      llvm_visit(exp->lookup.exp, fn, data);
+      break;
+    case EXP_INDEX:
+      llvm_visit(exp->index.exp, fn, data);
+      llvm_visit(exp->index.idx, fn, data);
+      break;
+    case EXP_FN_CALL:
+      for (p = exp->fn_call.exps; p; p = p->next)
+        llvm_visit(p->data, fn, data);
+      break;
+    case EXP_ARRAY:
+      for (p = exp->lit_array.exps; p; p = p->next)
+        llvm_visit(p->data, fn, data);
+      break;
+    case EXP_BOX_NEW:
+    case EXP_LOOP:
+      llvm_visit(exp->exp, fn, data);
+      break;
+    case EXP_MATCH:
+      llvm_visit(exp->match.exp, fn, data);
+      for (p = exp->match.arms; p; p = p->next){
+        const struct pair* arm = p->data;
+        llvm_visit(arm->match_arm.block, fn, data);
+      }
+      break;
+    case EXP_IF:
+      llvm_visit(exp->if_else.cond, fn, data);
+      llvm_visit(exp->if_else.block_true, fn, data);
+      llvm_visit(exp->if_else.block_false, fn, data);
+      break;
+    case EXP_WHILE:
+      llvm_visit(exp->loop_while.cond, fn, data);
+      llvm_visit(exp->loop_while.block, fn, data);
+      break;
+    case EXP_BLOCK:
+      for (p = exp->block.stmts; p; p = p->next)
+        llvm_visit_stmt(p->data, fn, data);
+      llvm_visit(exp->block.exp, fn, data);
+      break;
+    case EXP_UNARY:
+      llvm_visit(exp->unary.exp, fn, data);
+      break;
+    case EXP_BINARY:
+      llvm_visit(exp->binary.left, fn, data);
+      llvm_visit(exp->binary.right, fn, data);
+      break;
+  }
+}
+
+void llvm_item(const struct item* item, struct codegen_ctx* cg){
+  cg->last_register = 0;
+  cg->last_label = 0;
+  cg->last_if = 0;
   GList* p;
-  last_args = NULL;
   switch (item->kind){
     case ITEM_FN_DEF:{
-      last_args = item->fn_def.type->params;
+      bool structured = true;
+
+      if (llvm_ssa)
+        llvm_visit(item->fn_def.block, llvm_structured, &structured);
+      if (llvm_ssa && structured && item->fn_def.slots){
+        cg->slots = item->fn_def.slots;
+        cg->vals = g_new0(struct llvm_value, cg->slots);
+        cg->binds = g_new0(const struct pat*, cg->slots);
+      }
+      llvm_enter("entry", -1, cg);
         
       // NoUnwind
-      printf("; Function Attrs: nounwind\n");
+      ir_lit(cg->out, "; Function Attrs: nounwind\n");
       
       // Print function name
-      printf("define %s @%s(", llvm_get_type(item->fn_def.type->type), symbol_to_str(item->id));
-      last_type = item->fn_def.type->type;
+      ir_lit(cg->out, "define ");
+      ir_puts(cg->out, llvm_get_type(item->fn_def.type->type));
+      ir_lit(cg->out, " @");
+      ir_puts(cg->out, symbol_to_str(item->id));
+      ir_putc(cg->out, '(');
+      cg->last_type = item->fn_def.type->type;
       
       // Loop through all params
       for(p = item->fn_def.type->params; p; p = p->next){
         struct pair* param = p->data;
         
-        printf("%s %%%s", llvm_get_type(param->param.type), symbol_to_str(param->param.pat->bind.id));  // TODO (POSSIBLY) : Make sure there is no clash between ids and other registers. i.e.: variables called "r" or "retval" might cause problems
+        ir_puts(cg->out, llvm_get_type(param->param.type));
+        ir_lit(cg->out, " %");
+        llvm_param_value(param->param.pat, cg);
         
         if (p->next)
-          printf(", ");
+          ir_lit(cg->out, ", ");
       }
       
-      printf(") #0 {\n");
-      printf("entry:\n");
+      ir_lit(cg->out, ") #0 {\n");
+      ir_lit(cg->out, "entry:\n");
       
       // Loop through all params
       for(p = item->fn_def.type->params; p; p = p->next){
         struct pair* param = p->data;
+
+        if (llvm_wants_reg(param->param.pat, param->param.type, cg)){
+          llvm_def(param->param.pat, VAL_PARAM, 0, cg);
+          continue;
+        }
         
-        printf("  %%%s.addr = alloca %s, align 4\n", symbol_to_str(param->param.pat->bind.id), llvm_get_type(param->param.type));
-        printf("  store %s %%%s, %s* %%%s.addr, align 4\n", llvm_get_type(param->param.type), symbol_to_str(param->param.pat->bind.id), llvm_get_type(param->param.type), symbol_to_str(param->param.pat->bind.id));
+        ir_lit(cg->out, "  %");
+        ir_puts(cg->out, param->param.pat->bind.ir_name);
+        ir_lit(cg->out, " = alloca ");
+        ir_puts(cg->out, llvm_get_type(param->param.type));
+        ir_lit(cg->out, ", align 4\n");
+        ir_lit(cg->out, "  store ");
+        ir_puts(cg->out, llvm_get_type(param->param.type));
+        ir_lit(cg->out, " %");
+        llvm_param_value(param->param.pat, cg);
+        ir_lit(cg->out, ", ");
+        ir_puts(cg->out, llvm_get_type(param->param.type));
+        ir_lit(cg->out, "* %");
+        ir_puts(cg->out, param->param.pat->bind.ir_name);
+        ir_lit(cg->out, ", align 4\n");
         
       }
       
       //printf("%retval = alloca i32, align 4");  // ???: There isn't a retval register for every function
 
-      llvm_exp(item->fn_def.block);
+      llvm_exp(item->fn_def.block, cg);
       
       // If main
       if (!strcmp(symbol_to_str(item->id), "main"))
-        printf("  ret i32 0\n");
+        ir_lit(cg->out, "  call void @rt.flush()\n  ret i32 0\n");
       
-      printf("}\n\n");
+      ir_lit(cg->out, "}\n\n");
+      g_free(cg->vals);
+      g_free(cg->binds);
+      cg->vals = NULL;
+      cg->binds = NULL;
       break;
     }
 
@@ -644,55 +955,28 @@ void llvm_item(const struct item* item){
       break;
     case ITEM_STRUCT_DEF:
       //item->
-      printf("%%struct.%s = type { ", symbol_to_str(item->id));
+      ir_lit(cg->out, "%struct.");
+      ir_puts(cg->out, symbol_to_str(item->id));
+      ir_lit(cg->out, " = type { ");
       for(p = item->struct_def.fields; p; p = p->next){
         struct pair* field_def = p->data; 
 
         //print statement
 
-        printf("%s", llvm_get_type(field_def->field_def.type));
+        ir_puts(cg->out, llvm_get_type(field_def->field_def.type));
 
         if(p->next){
-          printf(", ");
+          ir_lit(cg->out, ", ");
         }
       }
-      printf(" }\n\n");
+      ir_lit(cg->out, " }\n\n");
       break;
   }
   
 }
 
-const char* llvm_op_to_str(const char* op){
-
-  //if (!strcmp(op, "&")) return mut? "addr-of-mut" : "addr-of";
-  if (!strcmp(op, "!")) return "not";
-  
-  // MATH
-  if (!strcmp(op, "+")) return "add";
-  if (!strcmp(op, "-")) return "sub";
-  if (!strcmp(op, "*")) return "mul";
-  if (!strcmp(op, "/")) return "sdiv";
-  if (!strcmp(op, "%")) return "srem";
-  
-  // ASSIGN
-  if (!strcmp(op, "=")) return "assign";
-  if (!strcmp(op, "+=")) return "add";
-  if (!strcmp(op, "-=")) return "sub";
-  if (!strcmp(op, "*=")) return "mul";
-  if (!strcmp(op, "/=")) return "sdiv";
-  if (!strcmp(op, "%=")) return "srem";
-  
-  // BOOLEAN
-  if (!strcmp(op, "&&")) return "and"; // TODO
-  if (!strcmp(op, "||")) return "or";  // TODO
-  if (!strcmp(op, "!=")) return "ne";
-  if (!strcmp(op, "==")) return "eq";
-  if (!strcmp(op, "<")) return "slt";
-  if (!strcmp(op, "<=")) return "sle";
-  if (!strcmp(op, ">")) return "sgt";
-  if (!strcmp(op, ">=")) return "sge";
-  
-  return "err";
+const char* llvm_op_to_str(int op){
+  return op_table[op].llvm;
 }
 
 const char* llvm_get_type(const struct type* type){
@@ -744,114 +1028,147 @@ const char* llvm_get_type(const struct type* type){
   return "<TYPE>";
 }
 
-void llvm_print_type(const struct type* type){
-  printf("%s", llvm_get_type(type));
+void llvm_print_type(const struct type* type, struct codegen_ctx* cg){
+  ir_puts(cg->out, llvm_get_type(type));
 }
 
-void llvm_exp(const struct exp* exp){
-  int l;
+void llvm_exp(const struct exp* exp, struct codegen_ctx* cg){
+  int l, num_to_print;
   GList* p; 
   if (!exp) return;
-  last_register++;
-  char* function_var = "";
+  cg->last_register++;
   
   switch (exp->kind) {
     case EXP_UNIT:
-      //printf("%%r%d = <UNIT>\n", last_register);
+      //printf("%%r%d = <UNIT>\n", cg->last_register);
       return;
       break;
     case EXP_TRUE:
-      printf("%%r%d = <TRUE>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <TRUE>\n");
       return;
       break;
     case EXP_FALSE:
-      printf("%%r%d = <FALSE>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <FALSE>\n");
       return;
       break;
     case EXP_I32:
-      printf("%%r%d = <I32>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <I32>\n");
       return;
       break;
     case EXP_U8:
-      printf("%%r%d = <U8>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <U8>\n");
       return;
       break;
     case EXP_STR:
-      printf("%%r%d = <STR>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <STR>\n");
       return;
       break;
     case EXP_ID:
-    
-      // Check if variable is function variable 
-      for(p = last_args; p; p = p->next){
-        struct pair* param = p->data;
-        if (!strcmp(symbol_to_str(param->param.pat->bind.id),symbol_to_str(exp->id))){
-          function_var = ".addr";
-          break;
-        }
+      // In a register: copy it, so the value ends up in %r<last_register>
+      // like everything else's. The copy is free.
+      if (llvm_in_reg(exp, cg)){
+        ir_lit(cg->out, "  ");
+        ir_reg(cg->out, cg->last_register);
+        ir_lit(cg->out, " = bitcast i32 ");
+        llvm_print_value(exp->bind->bind.slot, cg->vals[exp->bind->bind.slot], cg);
+        ir_lit(cg->out, " to i32\n");
+        return;
       }
-      printf("  %%r%d = load %s* %%%s%s, align 4\n", last_register, llvm_get_type(exp->type), symbol_to_str(exp->id), function_var);
+    
+      ir_lit(cg->out, "  ");
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = load ");
+      ir_puts(cg->out, llvm_get_type(exp->type));
+      ir_lit(cg->out, "* %");
+      ir_puts(cg->out, llvm_slot(exp));
+      ir_lit(cg->out, ", align 4\n");
 
     
       return;
       break;
     case EXP_ENUM:
-      printf("%%r%d = <ENUM>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <ENUM>\n");
       return;
       break;
     case EXP_STRUCT:
-      last_register++;
+      cg->last_register++;
       //print struct variable name, %struct.Name
       //printf("%%struct%d = getelementptr inbounds %%struct.%s* %%s, i32 0, i32 0\n", "struct_mem", "struct_name", "struct_var");
-      //printf("store i32 %d, i32* %s%d, align 4\n", 10, "struct_mem", last_register);
+      //printf("store i32 %d, i32* %s%d, align 4\n", 10, "struct_mem", cg->last_register);
 
 	return; 
 	break;
     case EXP_ARRAY:
-      printf("%%r%d = <ARRAY>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <ARRAY>\n");
       return;
       break;
     case EXP_LOOKUP:
-      printf("%%r%d = <LOOKUP>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <LOOKUP>\n");
       return;
       break;
     case EXP_INDEX:
-      printf("%%r%d = <INDEX>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <INDEX>\n");
       return;
       break;
 
     case EXP_FN_CALL: 
 
       if (!strcmp(symbol_to_str(exp->fn_call.id), "printi")){
+      bool literal = false;
       //get parameter list and type
       for(p = exp->fn_call.exps; p; p = p->next){
         struct exp* expression = p->data;
 
 	      if(expression->kind == EXP_I32){
-		      num_to_print = expression->num; 
+		      num_to_print = expression->num;
+		      literal = true;
         }
         else{
-          llvm_exp(expression);
-          last_register++;
+          llvm_exp(expression, cg);
+          cg->last_register++;
 	      }        
       }
             
-	if(num_to_print == 0){
+	if(!literal){
 
-      printf("  %%r%d = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds ([3 x i8]* @.str1, i32 0, i32 0), i32 %%r%d) #1\n", last_register, last_register-1);
-	}else if(num_to_print != 0){
-	printf("  %%r%d = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds ([3 x i8]* @.str1, i32 0, i32 0), i32 %d) #1\n", last_register, num_to_print);
+      ir_lit(cg->out, "  call void @rt.print.int(i32 ");
+      ir_reg(cg->out, cg->last_register-1);
+      ir_lit(cg->out, ")\n");
+	}else{
+	ir_lit(cg->out, "  call void @rt.print.int(i32 ");
+	ir_int(cg->out, num_to_print);
+	ir_lit(cg->out, ")\n");
 
 	}
 
       }else if(!strcmp(symbol_to_str(exp->fn_call.id), "prints")){
 		for(p = exp->fn_call.exps; p; p = p->next){
 			struct exp* expression = p->data; 
+			if(expression->kind != EXP_STR){
+				llvm_exp(expression, cg);
+				ir_lit(cg->out, "  call void @rt.print.cstr(i8* ");
+				ir_reg(cg->out, cg->last_register);
+				ir_lit(cg->out, ")\n");
+				continue;
+			}
 			int len = strlen(expression->str);
-			//printf("%d\n", len);
 			
-			printf("  %%r%d = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds ([%d x i8]* @.str%d, i32 0, i32 0)) #1\n", last_register,len+1,last_string);
-			last_string++;
+			ir_lit(cg->out, "  call void @rt.print.str(i8* getelementptr inbounds ([");
+			ir_int(cg->out, len+1);
+			ir_lit(cg->out, " x i8]* @.str");
+			ir_int(cg->out, expression->string);
+			ir_lit(cg->out, ", i32 0, i32 0), i64 ");
+			ir_int(cg->out, len);
+			ir_lit(cg->out, ")\n");
 
 		}
 	}else{
@@ -862,8 +1179,8 @@ void llvm_exp(const struct exp* exp){
             struct exp* expression = p->data; 
      		
 		if(expression->kind != EXP_I32){
-			llvm_exp(expression);
-			args[i] = -1*last_register;
+			llvm_exp(expression, cg);
+			args[i] = -1*cg->last_register;
 			i++; 
 		}else{
 			args[i] = expression->num; 
@@ -872,8 +1189,14 @@ void llvm_exp(const struct exp* exp){
 		
 	} 
 
-	    last_register++;	
-	    printf("  %%r%d = call %s @%s(", last_register, llvm_get_type(exp->type), symbol_to_str(exp->fn_call.id));
+	    cg->last_register++;	
+	    ir_lit(cg->out, "  ");
+	    ir_reg(cg->out, cg->last_register);
+	    ir_lit(cg->out, " = call ");
+	    ir_puts(cg->out, llvm_get_type(exp->type));
+	    ir_lit(cg->out, " @");
+	    ir_puts(cg->out, symbol_to_str(exp->fn_call.id));
+	    ir_putc(cg->out, '(');
 
 	//second loop
 	
@@ -882,107 +1205,237 @@ void llvm_exp(const struct exp* exp){
 		struct exp* expression = p->data; 
 		
 		if(args[i] < 0){
-			printf("  %s %%r%d", llvm_get_type(expression->type), args[i]*-1);
+			ir_lit(cg->out, "  ");
+			ir_puts(cg->out, llvm_get_type(expression->type));
+			ir_putc(cg->out, ' ');
+			ir_reg(cg->out, args[i]*-1);
 			i++;
 		}else{
-			printf("i32 %d", args[i]);
+			ir_lit(cg->out, "i32 ");
+			ir_int(cg->out, args[i]);
 			i++;
 		}
 
 		if(p->next){
-			printf(", ");
+			ir_lit(cg->out, ", ");
 		}
 	}
-	printf(")\n");
+	ir_lit(cg->out, ")\n");
       }   
       return;
       break;
     case EXP_BOX_NEW:
-      printf("%%r%d = <BOX NEW>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <BOX NEW>\n");
       return;
       break;
     case EXP_MATCH:
-      printf("%%r%d = <MATCH>\n", last_register);
+      ir_reg(cg->out, cg->last_register);
+      ir_lit(cg->out, " = <MATCH>\n");
       return;
       break;
-    case EXP_IF:
-      l = last_label++;
-      last_if = l;
-      llvm_exp(exp->if_else.cond);
-      printf("  br i1 %%cmp%d, label %%if.then%d, label %%if.else%d\n\nif.then%d:\n",
-             last_register,
-             l,
-             l,
-             l);
+    case EXP_IF:{
+      struct llvm_value* before = NULL, *then_vals = NULL;
+      const char* then_block;
+      int then_n;
+
+      l = cg->last_label++;
+      cg->last_if = l;
+      llvm_exp(exp->if_else.cond, cg);
+      ir_lit(cg->out, "  br i1 %cmp");
+      ir_int(cg->out, cg->last_register);
+      ir_lit(cg->out, ", label %if.then");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ", label %if.else");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\nif.then");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
+      llvm_enter("if.then", l, cg);
+      if (cg->vals) before = llvm_save(cg);
       
-      llvm_exp(exp->if_else.block_true);
-      printf("  br label %%if.end%d\n\nif.else%d:\n",
-             l,
-             l);
+      llvm_exp(exp->if_else.block_true, cg);
+      ir_lit(cg->out, "  br label %if.end");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\nif.else");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
+      then_block = cg->block;
+      then_n = cg->block_n;
+      llvm_enter("if.else", l, cg);
+      if (cg->vals){
+        then_vals = llvm_save(cg);
+        memcpy(cg->vals, before, cg->slots * sizeof *before);
+      }
     
-      llvm_exp(exp->if_else.block_false);
-      printf("  br label %%if.end%d\n\nif.end%d:\n",
-             l,
-             l);
+      llvm_exp(exp->if_else.block_false, cg);
+      ir_lit(cg->out, "  br label %if.end");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\nif.end");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
+      if (cg->vals){
+        llvm_join(l, then_vals, then_block, then_n, cg->block, cg->block_n, cg);
+        g_free(before);
+        g_free(then_vals);
+      }
+      llvm_enter("if.end", l, cg);
     
       return;
       break;
-    case EXP_WHILE:
-      l = last_label++;
+    }
+    case EXP_WHILE:{
+      struct llvm_value* header = NULL;
+      bool* carried = NULL;
+      int i;
+
+      l = cg->last_label++;
       
-      printf("  br label %%while.cond%d\n\nwhile.cond%d:\n",
-             l,
-             l);
+      ir_lit(cg->out, "  br label %while.cond");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\nwhile.cond");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
+
+      // Whatever the loop assigns to comes in either from before the loop or
+      // from the end of the last iteration (the latch block), where it's
+      // copied to a name known up front.
+      if (cg->vals){
+        carried = g_new0(bool, cg->slots);
+        llvm_visit(exp->loop_while.cond, llvm_assigned, carried);
+        llvm_visit(exp->loop_while.block, llvm_assigned, carried);
+        for (i = 0; i != cg->slots; i++){
+          if (!carried[i] || cg->vals[i].kind == VAL_MEM){
+            carried[i] = false;
+            continue;
+          }
+          ir_lit(cg->out, "  %");
+          ir_puts(cg->out, cg->binds[i]->bind.ir_name);
+          ir_lit(cg->out, ".phi");
+          ir_int(cg->out, l);
+          ir_lit(cg->out, " = phi i32 [ ");
+          llvm_print_value(i, cg->vals[i], cg);
+          ir_lit(cg->out, ", ");
+          llvm_print_block(cg->block, cg->block_n, cg);
+          ir_lit(cg->out, " ], [ %");
+          ir_puts(cg->out, cg->binds[i]->bind.ir_name);
+          ir_lit(cg->out, ".latch");
+          ir_int(cg->out, l);
+          ir_lit(cg->out, ", %while.latch");
+          ir_int(cg->out, l);
+          ir_lit(cg->out, " ]\n");
+          cg->vals[i].kind = VAL_PHI;
+          cg->vals[i].n = l;
+        }
+        header = llvm_save(cg);
+      }
+      llvm_enter("while.cond", l, cg);
     
-      llvm_exp(exp->loop_while.cond);
-      printf("  br i1 %%cmp%d, label %%while.body%d, label %%while.end%d\n\n",
-             last_register,
-             l,
-             l);
+      llvm_exp(exp->loop_while.cond, cg);
+      ir_lit(cg->out, "  br i1 %cmp");
+      ir_int(cg->out, cg->last_register);
+      ir_lit(cg->out, ", label %while.body");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ", label %while.end");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\n");
       
-      printf("while.body%d:\n", l);
-      llvm_exp(exp->loop_while.block);
+      ir_lit(cg->out, "while.body");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
+      llvm_enter("while.body", l, cg);
+      llvm_exp(exp->loop_while.block, cg);
+
+      if (cg->vals){
+        ir_lit(cg->out, "  br label %while.latch");
+        ir_int(cg->out, l);
+        ir_lit(cg->out, "\n\nwhile.latch");
+        ir_int(cg->out, l);
+        ir_lit(cg->out, ":\n");
+        for (i = 0; i != cg->slots; i++){
+          if (!carried[i]) continue;
+          ir_lit(cg->out, "  %");
+          ir_puts(cg->out, cg->binds[i]->bind.ir_name);
+          ir_lit(cg->out, ".latch");
+          ir_int(cg->out, l);
+          ir_lit(cg->out, " = bitcast i32 ");
+          llvm_print_value(i, cg->vals[i], cg);
+          ir_lit(cg->out, " to i32\n");
+        }
+        // The loop is left from the header, so that's where the values come
+        // from.
+        memcpy(cg->vals, header, cg->slots * sizeof *header);
+        g_free(header);
+        g_free(carried);
+      }
       
-      printf("  br label %%while.cond%d\n\nwhile.end%d:\n", l, l);
+      ir_lit(cg->out, "  br label %while.cond");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\nwhile.end");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
+      llvm_enter("while.end", l, cg);
       return;
       break;
+    }
     case EXP_LOOP:
-      l = last_label++;
-      printf("  br label %%loop.begin%d\n\nloop.begin%d:\n", l, l);
-      llvm_exp(exp->exp);
-      printf("  br label %%loop.begin%d\n\nloop.begin%d:\n", l, l);
+      l = cg->last_label++;
+      ir_lit(cg->out, "  br label %loop.begin");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\nloop.begin");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
+      llvm_exp(exp->exp, cg);
+      ir_lit(cg->out, "  br label %loop.begin");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, "\n\nloop.begin");
+      ir_int(cg->out, l);
+      ir_lit(cg->out, ":\n");
       return;
       break;
     case EXP_BLOCK:
-      g_list_foreach(exp->block.stmts, (GFunc)llvm_stmt, NULL);
-      llvm_exp(exp->block.exp);
+      g_list_foreach(exp->block.stmts, (GFunc)llvm_stmt, cg);
+      llvm_exp(exp->block.exp, cg);
       return;
       break;
     case EXP_UNARY:
-      llvm_exp(exp->unary.exp);
+      llvm_exp(exp->unary.exp, cg);
       return;
       break;
     case EXP_BINARY:
     
       // Plain assignment
-      if (!strcmp(exp->binary.op, "=")){
-        // Check if variable is function variable 
-        for(p = last_args; p; p = p->next){
-          struct pair* param = p->data;
-          if (!strcmp(symbol_to_str(param->param.pat->bind.id),symbol_to_str(exp->binary.left->id))){
-            function_var = ".addr";
-            break;
+      if (exp_is_assign(exp)){
+        if (llvm_in_reg(exp->binary.left, cg)){
+          const struct pat* bind = exp->binary.left->bind;
+          if (exp->binary.right->kind == EXP_I32)
+            llvm_def(bind, VAL_LIT, exp->binary.right->num, cg);
+          else{
+            llvm_exp(exp->binary.right, cg);
+            llvm_def(bind, VAL_REG, cg->last_register, cg);
           }
         }
         // Register
-        if (exp->binary.right->kind != EXP_I32){
-          llvm_exp(exp->binary.right);
-
-          printf("  store %s %%r%d, %s* %%%s%s, align 4\n", llvm_get_type(exp->binary.right->type), last_register, llvm_get_type(exp->binary.right->type), symbol_to_str(exp->binary.left->id), function_var);   
+        else if (exp->binary.right->kind != EXP_I32){
+          llvm_exp(exp->binary.right, cg);
+
+          ir_lit(cg->out, "  store ");
+          ir_puts(cg->out, llvm_get_type(exp->binary.right->type));
+          ir_putc(cg->out, ' ');
+          ir_reg(cg->out, cg->last_register);
+          ir_lit(cg->out, ", ");
+          ir_puts(cg->out, llvm_get_type(exp->binary.right->type));
+          ir_lit(cg->out, "* %");
+          ir_puts(cg->out, llvm_slot(exp->binary.left));
+          ir_lit(cg->out, ", align 4\n");   
         }
         // Plain number
         else{
-          printf("  store i32 %d, i32* %%%s%s, align 4\n", exp->binary.right->num, symbol_to_str(exp->binary.left->id), function_var);   
+          ir_lit(cg->out, "  store i32 ");
+          ir_int(cg->out, exp->binary.right->num);
+          ir_lit(cg->out, ", i32* %");
+          ir_puts(cg->out, llvm_slot(exp->binary.left));
+          ir_lit(cg->out, ", align 4\n");   
 
         }
         // TODO: Add string support here
@@ -992,90 +1445,110 @@ void llvm_exp(const struct exp* exp){
         
       }
       // Combo assignment
-      else if (!strcmp(exp->binary.op, "+=") ||
-          !strcmp(exp->binary.op, "-=") ||
-          !strcmp(exp->binary.op, "*=") ||
-          !strcmp(exp->binary.op, "/=") ||
-          !strcmp(exp->binary.op, "%="))  {
-        // Check if variable is function variable 
-        for(p = last_args; p; p = p->next){
-          struct pair* param = p->data;
-          if (!strcmp(symbol_to_str(param->param.pat->bind.id),symbol_to_str(exp->binary.left->id))){
-            function_var = ".addr";
-            break;
-          }
-        }
+      else if (exp_is_cmp_assign(exp))  {
         
-        llvm_exp(exp->binary.left);
-        l = last_register;
+        llvm_exp(exp->binary.left, cg);
+        l = cg->last_register;
         
         if (exp->binary.right->kind != EXP_I32){
-          llvm_exp(exp->binary.right);
+          llvm_exp(exp->binary.right, cg);
         }
-        last_register++;
+        cg->last_register++;
 
         // Print beginning
-        printf("  %%r%d = %s i32 %%r%d, ", last_register, llvm_op_to_str(exp->binary.op), l);
+        ir_lit(cg->out, "  ");
+        ir_reg(cg->out, cg->last_register);
+        ir_lit(cg->out, " = ");
+        ir_puts(cg->out, llvm_op_to_str(exp->binary.op));
+        ir_lit(cg->out, " i32 ");
+        ir_reg(cg->out, l);
+        ir_lit(cg->out, ", ");
 
         // Print end
         if (exp->binary.right->kind == EXP_I32)
-          printf("%d", exp->binary.right->num);
+          ir_int(cg->out, exp->binary.right->num);
         else
-          printf("%%r%d", last_register - 1);
+          ir_reg(cg->out, cg->last_register - 1);
 
 
-        printf("\n  store i32 %%r%d, i32* %%%s%s, align 4\n", last_register, symbol_to_str(exp->binary.left->id), function_var);
+        if (llvm_in_reg(exp->binary.left, cg)){
+          ir_putc(cg->out, '\n');
+          llvm_def(exp->binary.left->bind, VAL_REG, cg->last_register, cg);
+        }else{
+          ir_lit(cg->out, "\n  store i32 ");
+          ir_reg(cg->out, cg->last_register);
+          ir_lit(cg->out, ", i32* %");
+          ir_puts(cg->out, llvm_slot(exp->binary.left));
+          ir_lit(cg->out, ", align 4\n");
+        }
 
         
       } 
       // Arithmetic
-      else if (!strcmp(exp->binary.op, "+") ||
-               !strcmp(exp->binary.op, "-") ||
-               !strcmp(exp->binary.op, "*") ||
-               !strcmp(exp->binary.op, "/") ||
-               !strcmp(exp->binary.op, "%"))  {
+      else if (exp_is_arith(exp))  {
         
         // Do left expression
         if (exp->binary.left->kind != EXP_I32){
-          llvm_exp(exp->binary.left);
-          l = last_register++;
+          llvm_exp(exp->binary.left, cg);
+          l = cg->last_register++;
         }
 
         // Do right expression
         if (exp->binary.right->kind != EXP_I32){
-          llvm_exp(exp->binary.right);
-          last_register++;
+          llvm_exp(exp->binary.right, cg);
+          cg->last_register++;
         }
 
         // Print beginning
-        printf("  %%r%d = %s i32 ", last_register, llvm_op_to_str(exp->binary.op));
+        ir_lit(cg->out, "  ");
+        ir_reg(cg->out, cg->last_register);
+        ir_lit(cg->out, " = ");
+        ir_puts(cg->out, llvm_op_to_str(exp->binary.op));
+        ir_lit(cg->out, " i32 ");
 
         // Print left
         if (exp->binary.left->kind == EXP_I32)
-          printf("%d, ", exp->binary.left->num);
+          ir_int(cg->out, exp->binary.left->num);
         else
-          printf("%%r%d, ", l);
+          ir_reg(cg->out, l);
+        ir_lit(cg->out, ", ");
 
         // Print right
         if (exp->binary.right->kind == EXP_I32)
-          printf("%d", exp->binary.right->num);
+          ir_int(cg->out, exp->binary.right->num);
         else
-          printf("%%r%d", last_register - 1); 
-        printf("\n");
+          ir_reg(cg->out, cg->last_register - 1); 
+        ir_putc(cg->out, '\n');
       }
       // AND
-      else if(!strcmp(exp->binary.op, "&&")){
-
-        llvm_exp(exp->binary.left);
-        printf("  br i1 %%cmp%d, label %%land.lhs.true%d, label %%if.end%d\n\n", last_register, last_label, last_if);
-        printf("land.lhs.true%d:\n", last_label++);
-        llvm_exp(exp->binary.right);
+      else if(exp->binary.op == OP_AND){
+
+        llvm_exp(exp->binary.left, cg);
+        ir_lit(cg->out, "  br i1 %cmp");
+        ir_int(cg->out, cg->last_register);
+        ir_lit(cg->out, ", label %land.lhs.true");
+        ir_int(cg->out, cg->last_label);
+        ir_lit(cg->out, ", label %if.end");
+        ir_int(cg->out, cg->last_if);
+        ir_lit(cg->out, "\n\n");
+        ir_lit(cg->out, "land.lhs.true");
+        ir_int(cg->out, cg->last_label++);
+        ir_lit(cg->out, ":\n");
+        llvm_exp(exp->binary.right, cg);
       }
-      else if(!strcmp(exp->binary.op, "||")){
-        llvm_exp(exp->binary.left);
-        printf("  br i1 %%cmp%d, label %%if.then%d, label %%lor.lhs.false%d\n\n", last_register, last_if, last_label);
-        printf("lor.lhs.false%d:\n", last_label++);
-        llvm_exp(exp->binary.right);
+      else if(exp->binary.op == OP_OR){
+        llvm_exp(exp->binary.left, cg);
+        ir_lit(cg->out, "  br i1 %cmp");
+        ir_int(cg->out, cg->last_register);
+        ir_lit(cg->out, ", label %if.then");
+        ir_int(cg->out, cg->last_if);
+        ir_lit(cg->out, ", label %lor.lhs.false");
+        ir_int(cg->out, cg->last_label);
+        ir_lit(cg->out, "\n\n");
+        ir_lit(cg->out, "lor.lhs.false");
+        ir_int(cg->out, cg->last_label++);
+        ir_lit(cg->out, ":\n");
+        llvm_exp(exp->binary.right, cg);
       }
       // Boolean
       // TODO: Possibly merge with arith
@@ -1085,44 +1558,52 @@ void llvm_exp(const struct exp* exp){
         
         // Do left expression
         if (exp->binary.left->kind != EXP_I32){
-          llvm_exp(exp->binary.left);
-          l = last_register;
+          llvm_exp(exp->binary.left, cg);
+          l = cg->last_register;
         }
 
 	
 
         // Do right expression
         if (exp->binary.right->kind != EXP_I32){
-          llvm_exp(exp->binary.right);
-          last_register++;
+          llvm_exp(exp->binary.right, cg);
+          cg->last_register++;
         }
         
         // Print beginning
-        printf("  %%cmp%d = icmp %s %s ", last_register, llvm_op_to_str(exp->binary.op), llvm_get_type(exp->binary.left->type));
+        ir_lit(cg->out, "  %cmp");
+        ir_int(cg->out, cg->last_register);
+        ir_lit(cg->out, " = icmp ");
+        ir_puts(cg->out, llvm_op_to_str(exp->binary.op));
+        ir_putc(cg->out, ' ');
+        ir_puts(cg->out, llvm_get_type(exp->binary.left->type));
+        ir_putc(cg->out, ' ');
         
         // Print left
         if (exp->binary.left->kind == EXP_I32)
-          printf("%d, ", exp->binary.left->num);
+          ir_int(cg->out, exp->binary.left->num);
         else
-          printf("%%r%d, ", l);
+          ir_reg(cg->out, l);
+        ir_lit(cg->out, ", ");
         
         // Print right
         if (exp->binary.right->kind == EXP_I32)
-          printf("%d", exp->binary.right->num);
+          ir_int(cg->out, exp->binary.right->num);
         else
-          printf("%%r%d", last_register - 1); 
-        printf("\n");
+          ir_reg(cg->out, cg->last_register - 1); 
+        ir_putc(cg->out, '\n');
         
       }
       return;
   }
   
-  printf("%%r%d = ...\n", last_register);
+  ir_reg(cg->out, cg->last_register);
+  ir_lit(cg->out, " = ...\n");
   
 }
 
-static void llvm_stmt(const struct stmt* stmt){
-  last_register++;
+static void llvm_stmt(const struct stmt* stmt, struct codegen_ctx* cg){
+  cg->last_register++;
   struct type* t;
   
   switch (stmt->kind) {
@@ -1131,17 +1612,45 @@ static void llvm_stmt(const struct stmt* stmt){
         t = stmt->let.type;
       else
         t = stmt->let.exp->type;
+
+      if (llvm_wants_reg(stmt->let.pat, t, cg)){
+        if (!stmt->let.exp)
+          llvm_def(stmt->let.pat, VAL_UNDEF, 0, cg);
+        else if (stmt->let.exp->kind == EXP_I32)
+          llvm_def(stmt->let.pat, VAL_LIT, stmt->let.exp->num, cg);
+        else{
+          llvm_exp(stmt->let.exp, cg);
+          llvm_def(stmt->let.pat, VAL_REG, cg->last_register, cg);
+        }
+        break;
+      }
       
-        printf("  %%%s = alloca %s, align 4\n", symbol_to_str(stmt->let.pat->bind.id), llvm_get_type(t));
+        ir_lit(cg->out, "  %");
+        ir_puts(cg->out, stmt->let.pat->bind.ir_name);
+        ir_lit(cg->out, " = alloca ");
+        ir_puts(cg->out, llvm_get_type(t));
+        ir_lit(cg->out, ", align 4\n");
       
         
       if (stmt->let.exp){
         
         if (stmt->let.exp->kind != EXP_I32){
-          llvm_exp(stmt->let.exp);
-          printf("  store %s %%r%d, %s* %%%s, align 4\n", llvm_get_type(t), last_register, llvm_get_type(t), symbol_to_str(stmt->let.pat->bind.id));
+          llvm_exp(stmt->let.exp, cg);
+          ir_lit(cg->out, "  store ");
+          ir_puts(cg->out, llvm_get_type(t));
+          ir_putc(cg->out, ' ');
+          ir_reg(cg->out, cg->last_register);
+          ir_lit(cg->out, ", ");
+          ir_puts(cg->out, llvm_get_type(t));
+          ir_lit(cg->out, "* %");
+          ir_puts(cg->out, stmt->let.pat->bind.ir_name);
+          ir_lit(cg->out, ", align 4\n");
         }else{
-          printf("  store i32 %d, i32* %%%s, align 5\n", stmt->let.exp->num, symbol_to_str(stmt->let.pat->bind.id)); 
+          ir_lit(cg->out, "  store i32 ");
+          ir_int(cg->out, stmt->let.exp->num);
+          ir_lit(cg->out, ", i32* %");
+          ir_puts(cg->out, stmt->let.pat->bind.ir_name);
+          ir_lit(cg->out, ", align 5\n"); 
         }
         
       }
@@ -1149,62 +1658,21 @@ static void llvm_stmt(const struct stmt* stmt){
       break;
     case STMT_RETURN:
       if (stmt->exp->kind != EXP_I32){
-        llvm_exp(stmt->exp);
-        printf("  ret %s %%%d\n", llvm_get_type(last_type), last_register);
+        llvm_exp(stmt->exp, cg);
+        ir_lit(cg->out, "  ret ");
+        ir_puts(cg->out, llvm_get_type(cg->last_type));
+        ir_lit(cg->out, " %");
+        ir_int(cg->out, cg->last_register);
+        ir_putc(cg->out, '\n');
       }else{
-        printf("  ret i32 %d\n", stmt->exp->num); 
+        ir_lit(cg->out, "  ret i32 ");
+        ir_int(cg->out, stmt->exp->num);
+        ir_putc(cg->out, '\n'); 
       }
       break;
     case STMT_EXP:
-      llvm_exp(stmt->exp);
+      llvm_exp(stmt->exp, cg);
       break;
   }
   
 }
-
-static void llvm_strings(const struct item* item){
-  int i = 2;
-  struct stmt* stmt;
-  struct exp* exp;
-  GList* l;
-  
-  if (item->kind == ITEM_FN_DEF){
-    
-    for(l = item->fn_def.block->block.stmts; l; l = l->next){
-      stmt = l->data;
-      
-      if (stmt->kind == STMT_EXP){
-        if (stmt->exp->kind == EXP_FN_CALL){
-          if(!strcmp(symbol_to_str(stmt->exp->fn_call.id),"prints")){
-            exp = stmt->exp->fn_call.exps->data;
-            if (exp->kind == EXP_STR){
-              //@.str = private unnamed_addr constant [3 x i8] c"%s\00", align 1
-              printf("@.str%d = private unnamed_addr constant [%u x i8] c\"%s\\00\", align 1\n",
-                     i,
-                     (unsigned)strlen(exp->str) + 1,
-                     exp->str);
-              i++;
-            }
-          }
-        }
-      }
-      
-    }
-    /*
-    if (exp->block.exp && exp->block.exp->kind == EXP_FN_CALL){
-      if(!strcmp(symbol_to_str(exp->block.exp->fn_call.id),"prints")){
-        exp = exp->block.exp->fn_call.exps->data;
-        if (exp->kind == EXP_STR){
-          //@.str = private unnamed_addr constant [3 x i8] c"%s\00", align 1
-          printf("@.str%d = private unnamed_addr constant [%u x i8] c\"%s\\00\", align 1\n",
-                 i,
-                 (unsigned)strlen(exp->str) + 1,
-                 exp->str);
-        }
-      }
-    }*/
-     
-  }
-
-}
-  
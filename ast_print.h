@@ -3,10 +3,19 @@
 
 #include <glib.h>
 #include "ast.h"
+#include "ir_writer.h"
 
 void crate_print(const GList* items);
 void item_print_pretty(const struct item*);
-void llvm_crate(const GList* items);
+// Emits LLVM IR for the (well-typed) crate into the writer, with strings, the
+// pool resolve_crate() returned, as its string constants. With a cache (from
+// cache_open(), or NULL) the fns it has are spliced in rather than lowered.
+//
+// With llvm_ssa set, the i32 bindings whose address is never taken live in
+// registers (with phis where control flow joins) rather than in stack slots,
+// in every function that doesn't use &&, || or loop.
+extern bool llvm_ssa;
+void llvm_crate(const GList* items, const GPtrArray* strings, GHashTable* cache, struct ir_writer* out);
 
 /* Print out type in Rust syntax style. */
 void type_print_pretty(const struct type*);
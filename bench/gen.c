@@ -0,0 +1,88 @@
+// Generates synthetic crates for the benchmarks: gen <shape> <n> writes a
+// program to stdout whose size grows linearly with n.
+//
+//   fns      n functions, each called from main
+//   stmts    main with n statements
+//   nest     main with n nested while loops
+//   struct   a struct with n fields and a literal initializing them all
+//   match    a match with n arms
+//   array    an array literal with n elements
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void gen_fns(int n) {
+      for (int i = 0; i != n; ++i)
+            printf("fn f%d(x: i32) -> i32 {\n    let y = x + %d;\n    return y;\n}\n\n", i, i);
+      printf("fn main() {\n    let mut x = 0;\n");
+      for (int i = 0; i != n; ++i)
+            printf("    x = f%d(x);\n", i);
+      printf("    printi(x);\n}\n");
+}
+
+static void gen_stmts(int n) {
+      printf("fn main() {\n    let mut x = 0;\n");
+      for (int i = 0; i != n; ++i)
+            printf("    x = x + %d;\n", i);
+      printf("    printi(x);\n}\n");
+}
+
+static void gen_nest(int n) {
+      printf("fn main() {\n    let mut x = 0;\n");
+      for (int i = 0; i != n; ++i)
+            printf("%*swhile (x < %d) {\n%*sx += 1;\n", 4 + i, "", i, 5 + i, "");
+      for (int i = n; i--; )
+            printf("%*s}%s\n", 4 + i, "", i? "" : ";");
+      printf("    printi(x);\n}\n");
+}
+
+static void gen_struct(int n) {
+      printf("struct S {\n");
+      for (int i = 0; i != n; ++i)
+            printf("    f%d: i32%s\n", i, i + 1 != n? "," : "");
+      printf("}\n\nfn main() {\n    let s = S {\n");
+      for (int i = 0; i != n; ++i)
+            printf("        f%d: %d%s\n", i, i, i + 1 != n? "," : "");
+      printf("    };\n    printi(s.f0);\n}\n");
+}
+
+static void gen_match(int n) {
+      printf("fn main() {\n    let x = 1;\n    match (x) {\n");
+      for (int i = 0; i != n; ++i)
+            printf("        %d => { printi(%d); },\n", i, i);
+      printf("        _ => { printi(0); }\n    };\n}\n");
+}
+
+static void gen_array(int n) {
+      printf("fn main() {\n    let a = [\n");
+      for (int i = 0; i != n; ++i)
+            printf("        %d%s\n", i, i + 1 != n? "," : "");
+      printf("    ];\n    printi(a[0]);\n}\n");
+}
+
+static const struct {
+      const char* name;
+      void (*gen)(int);
+} shapes[] = {
+      {"fns", gen_fns},
+      {"stmts", gen_stmts},
+      {"nest", gen_nest},
+      {"struct", gen_struct},
+      {"match", gen_match},
+      {"array", gen_array},
+};
+
+int main(int argc, char** argv) {
+      int n = argc == 3? atoi(argv[2]) : 0;
+      if (n > 0) {
+            for (size_t i = 0; i != sizeof(shapes) / sizeof(*shapes); ++i) {
+                  if (!strcmp(argv[1], shapes[i].name)) {
+                        shapes[i].gen(n);
+                        return 0;
+                  }
+            }
+      }
+
+      printf("Usage: %s fns|stmts|nest|struct|match|array <n>\n", argv[0]);
+      return 1;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs pa4 over the synthetic crates from bench/gen at increasing sizes and
+# prints, per run, the time spent in each phase (from --stats=json), the total,
+# source lines per second and peak RSS. Doubling sizes make superlinear phases
+# stand out: their column should roughly double from one row to the next.
+#
+# Usage: bench/run.sh [pa4 [gen]]. BENCH_SIZES overrides the sizes and
+# BENCH_SHAPES the shapes (see bench/gen.c).
+
+PA4=${1:-./pa4}
+GEN=${2:-bench/gen}
+SIZES=${BENCH_SIZES:-1000 2000 4000 8000 16000}
+SHAPES=${BENCH_SHAPES:-fns stmts nest struct match array}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Pulls "name": number out of the stats JSON.
+field() {
+      sed -n "s/.*\"$1\": {\"wall\": \([0-9.]*\).*/\1/p; s/.*\"$1\": \([0-9.]*\).*/\1/p" "$TMP/stats.json" | head -n 1
+}
+
+printf "%-7s %7s %8s %9s %9s %9s %9s %9s %10s %9s\n" \
+      shape n lines parse annotate resolve codegen total lines/s rss_kb
+
+for shape in $SHAPES; do
+      for n in $SIZES; do
+            # Each loop level costs a handful of parser stack slots, and the
+            # bison stack tops out at 10000.
+            [ "$shape" = nest ] && n=$((n / 10))
+
+            "$GEN" "$shape" "$n" > "$TMP/in.rs" || exit 1
+            lines=$(wc -l < "$TMP/in.rs")
+
+            if ! "$PA4" --stats=json < "$TMP/in.rs" > /dev/null 2> "$TMP/stats.json"; then
+                  echo "$shape $n: pa4 failed" >&2
+                  continue
+            fi
+
+            parse=$(field parse)
+            annotate=$(field annotate)
+            resolve=$(field resolve)
+            codegen=$(field codegen)
+            total=0
+            for p in parse build_env check_main annotate fold inline reach resolve escape lower optimize codegen destroy; do
+                  total=$(echo "$total $(field $p)" | awk '{ print $1 + $2 }')
+            done
+            rate=$(echo "$lines $total" | awk '{ if ($2 > 0) printf "%d", $1 / $2; else print "-" }')
+
+            printf "%-7s %7d %8d %9.4f %9.4f %9.4f %9.4f %9.4f %10s %9d\n" \
+                  "$shape" "$n" "$lines" "$parse" "$annotate" "$resolve" "$codegen" "$total" "$rate" "$(field peak_rss_kb)"
+      done
+done
@@ -0,0 +1,386 @@
+#include <stdint.h>
+#include "bounds.h"
+#include "ast.h"
+#include "stats.h"
+
+// The per-function state. Blocks are referred to by their reverse postorder
+// number, which is also what their mark is set to (-1 if unreachable).
+struct range {
+      struct mir_fn* fn;
+      // Of struct mir_block*, in reverse postorder.
+      GPtrArray* order;
+      int* idom;
+      // Register -> the instruction defining it (NULL for a parameter) and the
+      // block that's in.
+      struct mir_inst** def;
+      struct mir_block** def_block;
+      // Register -> whether it's never negative, as far as is known so far.
+      // For a slot's register (see stores), whether what's in it never is.
+      bool* nonneg;
+      // Register -> of struct mir_value, what's stored to the stack slot it's
+      // the alloca of, if that holds an i32 and is only ever loaded and stored
+      // (as loop counters are unless mem2reg has run); NULL otherwise.
+      GArray** stores;
+      // Scratch space, a flag per block.
+      bool* seen;
+};
+
+static struct mir_block* block_at(const struct range* g, int i) {
+      return g_ptr_array_index(g->order, i);
+}
+
+static bool dominates(const struct range* g, int a, int b) {
+      while (b != a && b) b = g->idom[b];
+      return b == a;
+}
+
+static void find_defs(struct range* g) {
+      struct mir_fn* fn = g->fn;
+      g->def = g_new0(struct mir_inst*, fn->regs->len);
+      g->def_block = g_new0(struct mir_block*, fn->regs->len);
+      for (guint i = 0; i != g->order->len; ++i) {
+            struct mir_block* b = block_at(g, i);
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  if (inst->dst < 0) continue;
+                  g->def[inst->dst] = inst;
+                  g->def_block[inst->dst] = b;
+            }
+      }
+}
+
+static void disqualify(struct mir_value* v, void* data) {
+      struct range* g = data;
+      if (v->kind != MIR_REG || !g->stores[v->n]) return;
+      g_array_free(g->stores[v->n], true);
+      g->stores[v->n] = NULL;
+}
+
+static void find_slots(struct range* g) {
+      struct mir_fn* fn = g->fn;
+      g->stores = g_new0(GArray*, fn->regs->len);
+
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  if (inst->kind == MIR_ALLOCA && mir_reg_info(fn, inst->dst)->type->type->unmut == type_i32())
+                        g->stores[inst->dst] = g_array_new(false, false, sizeof(struct mir_value));
+            }
+      }
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  if (inst->kind == MIR_STORE) disqualify(&inst->b, g);
+                  else if (inst->kind != MIR_LOAD) mir_inst_operands(inst, disqualify, g);
+            }
+            disqualify(&b->term.value, g);
+      }
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  if (inst->kind == MIR_STORE && inst->a.kind == MIR_REG && g->stores[inst->a.n])
+                        g_array_append_val(g->stores[inst->a.n], inst->b);
+            }
+      }
+}
+
+// The slot the register is a load of (see range.stores), or -1.
+static int slot_loaded(const struct range* g, int reg) {
+      const struct mir_inst* inst = g->def[reg];
+      if (!inst || inst->kind != MIR_LOAD || inst->a.kind != MIR_REG || !g->stores[inst->a.n]) return -1;
+      return inst->a.n;
+}
+
+static int inst_index(const struct mir_block* b, const struct mir_inst* inst) {
+      return inst - &g_array_index(b->insts, struct mir_inst, 0);
+}
+
+// Whether any of instructions [from, to) of b stores to the slot.
+static bool stores_to(const struct mir_block* b, int slot, int from, int to) {
+      for (int i = from; i < to; ++i) {
+            const struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, i);
+            if (inst->kind == MIR_STORE && inst->a.kind == MIR_REG && inst->a.n == slot) return true;
+      }
+      return false;
+}
+
+// Whether register reg holds what x did when d ended by branching on to c (c
+// dominating reg's definition): it's x, or they're loads of the same slot, the
+// one compared in d itself, with no store to the slot on any way from there.
+static bool same_value(const struct range* g, const struct mir_value* x,
+            const struct mir_block* d, const struct mir_block* c, int reg) {
+      if (x->kind != MIR_REG) return false;
+      if (x->n == reg) return true;
+
+      int slot = slot_loaded(g, x->n);
+      const struct mir_block* b = g->def_block[reg];
+      if (slot < 0 || slot != slot_loaded(g, reg) || g->def_block[x->n] != d
+                  || !dominates(g, c->mark, b->mark)
+                  || stores_to(d, slot, inst_index(d, g->def[x->n]) + 1, d->insts->len))
+            return false;
+      if (b == c) return !stores_to(b, slot, 0, inst_index(b, g->def[reg]));
+
+      // Back from b to c, which d can only be on the way to by its other side.
+      GPtrArray* todo = g_ptr_array_new();
+      GPtrArray* visited = g_ptr_array_new();
+      bool same = true;
+      g_ptr_array_add(todo, (void*)b);
+      while (todo->len && same) {
+            const struct mir_block* e = g_ptr_array_index(todo, todo->len - 1);
+            g_ptr_array_set_size(todo, todo->len - 1);
+            if (e != b) same = e != d && !stores_to(e, slot, 0, e->insts->len);
+            if (e == c) continue;
+            for (guint i = 0; i != e->preds->len && same; ++i) {
+                  struct mir_block* pred = g_ptr_array_index(e->preds, i);
+                  if (pred->mark < 0 || g->seen[pred->mark]) continue;
+                  g->seen[pred->mark] = true;
+                  g_ptr_array_add(visited, pred);
+                  g_ptr_array_add(todo, pred);
+            }
+      }
+      // b all over again if it's in a loop of its own, or else up to reg.
+      if (same) same = !stores_to(b, slot, 0, g->seen[b->mark]? (int)b->insts->len : inst_index(b, g->def[reg]));
+      for (guint i = 0; i != visited->len; ++i)
+            g->seen[((struct mir_block*)g_ptr_array_index(visited, i))->mark] = false;
+      g_ptr_array_free(visited, true);
+      g_ptr_array_free(todo, true);
+      return same;
+}
+
+// The same comparison with its operands swapped, or its outcome negated.
+static int swap_op(int op) {
+      switch (op) {
+            case OP_LT: return OP_GT;
+            case OP_LEQ: return OP_GEQ;
+            case OP_GT: return OP_LT;
+            case OP_GEQ: return OP_LEQ;
+      }
+      return op;
+}
+
+static int negate_op(int op) {
+      switch (op) {
+            case OP_LT: return OP_GEQ;
+            case OP_LEQ: return OP_GT;
+            case OP_GT: return OP_LEQ;
+            case OP_GEQ: return OP_LT;
+            case OP_EQ: return OP_NEQ;
+            case OP_NEQ: return OP_EQ;
+      }
+      return op;
+}
+
+// Narrows [*lo, *hi] by what d branching on to c says about register reg, if
+// d's condition is a comparison of reg (or what it holds) against a constant.
+static void apply_fact(const struct range* g, const struct mir_block* d, const struct mir_block* c,
+            int reg, int64_t* lo, int64_t* hi) {
+      const struct mir_value* cond = &d->term.value;
+      bool truth = d->term.to[0] == c;
+      if (cond->kind != MIR_REG || !g->def[cond->n]) return;
+      const struct mir_inst* cmp = g->def[cond->n];
+      if (cmp->kind != MIR_BINARY || !(op_table[cmp->op].flags & (OPF_COMPARE | OPF_EQ))
+                  || cmp->a.type->unmut != type_i32())
+            return;
+
+      int op = cmp->op;
+      int64_t k;
+      if (cmp->b.kind == MIR_CONST && same_value(g, &cmp->a, d, c, reg)) {
+            k = cmp->b.n;
+      } else if (cmp->a.kind == MIR_CONST && same_value(g, &cmp->b, d, c, reg)) {
+            k = cmp->a.n;
+            op = swap_op(op);
+      } else {
+            return;
+      }
+      if (!truth) op = negate_op(op);
+
+      switch (op) {
+            case OP_LT: if (k - 1 < *hi) *hi = k - 1; break;
+            case OP_LEQ: if (k < *hi) *hi = k; break;
+            case OP_GT: if (k + 1 > *lo) *lo = k + 1; break;
+            case OP_GEQ: if (k > *lo) *lo = k; break;
+            case OP_EQ:
+                  if (k > *lo) *lo = k;
+                  if (k < *hi) *hi = k;
+                  break;
+      }
+}
+
+// What's known of the value once control reaches b: from the branches every
+// way there goes through, for a register.
+static void interval(const struct range* g, const struct mir_block* b,
+            const struct mir_value* v, int64_t* lo, int64_t* hi) {
+      if (v->kind == MIR_CONST) {
+            *lo = *hi = v->n;
+            return;
+      }
+      *lo = INT32_MIN;
+      *hi = INT32_MAX;
+      if (v->kind != MIR_REG) return;
+      if (g->nonneg[v->n]) *lo = 0;
+
+      // A block with just the one way in, from the end of a branch, only runs
+      // when the branch went its way.
+      int i = b->mark;
+      while (i) {
+            const struct mir_block* c = block_at(g, i);
+            const struct mir_block* d = block_at(g, g->idom[i]);
+            if (d->term.kind == MIR_BRANCH && c->preds->len == 1 && d->term.to[0] != d->term.to[1])
+                  apply_fact(g, d, c, v->n, lo, hi);
+            i = g->idom[i];
+      }
+}
+
+static bool value_nonneg(const struct range* g, const struct mir_value* v) {
+      return v->kind == MIR_CONST? v->n >= 0 : v->kind == MIR_REG && g->nonneg[v->n];
+}
+
+// Whether the register is never negative, given what's assumed of the others.
+static bool stays_nonneg(const struct range* g, int reg) {
+      const struct mir_inst* inst = g->def[reg];
+      if (!inst) return false;
+
+      if (inst->kind == MIR_PHI) {
+            for (guint i = 0; i != inst->args->len; ++i)
+                  if (!value_nonneg(g, &g_array_index(inst->args, struct mir_value, i))) return false;
+            return true;
+      }
+      if (inst->kind == MIR_ALLOCA) {
+            for (guint i = 0; i != g->stores[reg]->len; ++i)
+                  if (!value_nonneg(g, &g_array_index(g->stores[reg], struct mir_value, i))) return false;
+            return true;
+      }
+      if (inst->kind == MIR_LOAD) return g->nonneg[inst->a.n];
+
+      // x + k or x - k, which mustn't wrap around either.
+      if (inst->kind != MIR_BINARY || (inst->op != OP_ADD && inst->op != OP_SUB)
+                  || inst->a.type->unmut != type_i32())
+            return false;
+      const struct mir_value* x = &inst->a;
+      int64_t k;
+      if (inst->b.kind == MIR_CONST) {
+            k = inst->op == OP_ADD? inst->b.n : -(int64_t)inst->b.n;
+      } else if (inst->op == OP_ADD && inst->a.kind == MIR_CONST) {
+            k = inst->a.n;
+            x = &inst->b;
+      } else {
+            return false;
+      }
+      int64_t lo, hi;
+      interval(g, g->def_block[reg], x, &lo, &hi);
+      return lo + k >= 0 && hi + k <= INT32_MAX;
+}
+
+// Assumes every phi and sum, and every slot and load of one, is never negative
+// to begin with, then drops what doesn't follow until nothing changes: loop
+// counters depend on themselves.
+static void find_nonneg(struct range* g) {
+      guint n = g->fn->regs->len;
+      bool changed = true;
+
+      g->nonneg = g_new0(bool, n);
+      for (guint r = 0; r != n; ++r)
+            g->nonneg[r] = g->def[r] && (g->def[r]->kind == MIR_PHI || g->def[r]->kind == MIR_BINARY
+                  || g->stores[r] || slot_loaded(g, r) >= 0);
+      while (changed) {
+            changed = false;
+            for (guint r = 0; r != n; ++r) {
+                  if (!g->nonneg[r] || stays_nonneg(g, r)) continue;
+                  g->nonneg[r] = false;
+                  changed = true;
+            }
+      }
+}
+
+// The checks go once they've all been looked at, leaving g->def as it is till
+// then.
+static int drop_checks(struct range* g) {
+      int dropped = 0;
+      for (guint i = 0; i != g->order->len; ++i) {
+            struct mir_block* b = block_at(g, i);
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  if (inst->kind != MIR_BOUNDS) continue;
+                  int64_t lo, hi;
+                  interval(g, b, &inst->a, &lo, &hi);
+                  if (lo < 0 || hi >= inst->n) continue;
+                  inst->kind = MIR_INVALID;
+                  ++dropped;
+            }
+      }
+      if (dropped)
+            for (guint i = 0; i != g->order->len; ++i) mir_block_sweep(block_at(g, i));
+      return dropped;
+}
+
+// Whether the natural loop of the back edge from latch to header indexes an
+// array. seen is scratch space, a flag per block.
+static bool loop_indexes(const struct range* g, struct mir_block* latch, struct mir_block* header, bool* seen) {
+      GPtrArray* todo = g_ptr_array_new();
+      bool found = false;
+
+      for (guint i = 0; i != g->order->len; ++i) seen[i] = false;
+      seen[header->mark] = true;
+      if (!seen[latch->mark]) {
+            seen[latch->mark] = true;
+            g_ptr_array_add(todo, latch);
+      }
+      for (guint j = 0; j != header->insts->len && !found; ++j)
+            found = g_array_index(header->insts, struct mir_inst, j).kind == MIR_ELEM;
+      while (todo->len && !found) {
+            struct mir_block* b = g_ptr_array_index(todo, todo->len - 1);
+            g_ptr_array_set_size(todo, todo->len - 1);
+            for (guint j = 0; j != b->insts->len && !found; ++j)
+                  found = g_array_index(b->insts, struct mir_inst, j).kind == MIR_ELEM;
+            for (guint j = 0; j != b->preds->len; ++j) {
+                  struct mir_block* pred = g_ptr_array_index(b->preds, j);
+                  if (pred->mark < 0 || seen[pred->mark]) continue;
+                  seen[pred->mark] = true;
+                  g_ptr_array_add(todo, pred);
+            }
+      }
+      g_ptr_array_free(todo, true);
+      return found;
+}
+
+static void mark_loops(struct range* g) {
+      bool* seen = g_new(bool, g->order->len);
+      for (guint i = 0; i != g->order->len; ++i) {
+            struct mir_block* b = block_at(g, i);
+            for (int s = 0; s != mir_term_nsuccs(&b->term); ++s) {
+                  struct mir_block* header = *mir_term_succ(&b->term, s);
+                  if (dominates(g, header->mark, b->mark) && loop_indexes(g, b, header, seen))
+                        b->term.vectorize = true;
+            }
+      }
+      g_free(seen);
+}
+
+void bounds(struct mir_fn* fn) {
+      struct range g = {fn};
+
+      mir_compute_preds(fn);
+      g.order = mir_number_blocks(fn);
+      g.idom = mir_dominators(g.order);
+      g.seen = g_new0(bool, g.order->len);
+      find_defs(&g);
+      find_slots(&g);
+      find_nonneg(&g);
+
+      int dropped = drop_checks(&g);
+      if (stats_enabled) stats_add(STATS_CHECKS_DROPPED, dropped);
+      mark_loops(&g);
+
+      for (guint i = 0; i != fn->regs->len; ++i)
+            if (g.stores[i]) g_array_free(g.stores[i], true);
+      g_free(g.stores);
+      g_free(g.seen);
+      g_free(g.nonneg);
+      g_free(g.def_block);
+      g_free(g.def);
+      g_free(g.idom);
+      g_ptr_array_free(g.order, true);
+}
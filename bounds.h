@@ -0,0 +1,23 @@
+#ifndef RUSTC_BOUNDS_H_
+#define RUSTC_BOUNDS_H_
+
+#include "mir.h"
+
+// *** Bounds check elimination ***
+
+// Drops the MIR_BOUNDS checks whose index is known to be in range: a constant
+// one, or one that's never negative and that a branch on the way in already
+// compared against the length or less, the way a while (i < N) loop does. An
+// index is never negative if a branch on the way in says so, or if it's a
+// phi (a loop counter, say) of values that aren't, or it's what one of those
+// plus a constant comes to, where a branch says the sum can't overflow. Left
+// in a stack slot (unless mem2reg has run), a counter is followed through its
+// loads: the slot must hold an i32, only ever be loaded and stored, and have
+// only such values stored to it, and a branch on one load says the same of
+// another if there's no store to the slot in between.
+//
+// Marks the back edge of every loop that indexes an array for LLVM to
+// vectorize.
+void bounds(struct mir_fn* fn);
+
+#endif
@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "ast.h"
+#include "parallel.h"
+#include "stats.h"
+
+// Bumped whenever codegen changes what it makes of the same input.
+#define CACHE_VERSION "pa4 cache 1"
+
+// The first line of an entry's file, ahead of the IR.
+#define CACHE_HEADER "; pa4 cache %d %d %d\n"
+
+// State for hashing one fn.
+struct hasher {
+      GChecksum* sum;
+      // Symbol value -> the struct or enum, and the fn, of that name.
+      GHashTable* defs;
+      GHashTable* fns;
+      // The items whose definition (or signature, for a fn) is in already.
+      GHashTable* seen;
+};
+
+struct cache_job {
+      const struct item* fn;
+      struct cache_entry* entry;
+      const char* dir;
+      const char* config;
+      GHashTable* defs;
+      GHashTable* fns;
+};
+
+static void hash_int(struct hasher* h, int n) {
+      g_checksum_update(h->sum, (const guchar*)&n, sizeof n);
+}
+
+static void hash_str(struct hasher* h, const char* str) {
+      if (!str) {
+            hash_int(h, -1);
+            return;
+      }
+      hash_int(h, strlen(str));
+      g_checksum_update(h->sum, (const guchar*)str, strlen(str));
+}
+
+static void hash_sym(struct hasher* h, Symbol id) {
+      hash_str(h, symbol_to_str(id));
+}
+
+static void hash_type(struct hasher* h, const struct type* type);
+static void hash_pat(struct hasher* h, const struct pat* pat);
+static void hash_exp(struct hasher* h, const struct exp* exp);
+
+static void hash_types(struct hasher* h, const GList* types) {
+      hash_int(h, g_list_length((GList*)types));
+      for (const GList* p = types; p; p = p->next)
+            hash_type(h, p->data);
+}
+
+static void hash_pair(struct hasher* h, const struct pair* pair) {
+      hash_int(h, pair->kind);
+      switch (pair->kind) {
+            case PAIR_FIELD_DEF:
+                  hash_sym(h, pair->field_def.id);
+                  hash_type(h, pair->field_def.type);
+                  break;
+            case PAIR_CTOR_DEF:
+                  hash_sym(h, pair->ctor_def.id);
+                  hash_types(h, pair->ctor_def.types);
+                  break;
+            case PAIR_PARAM:
+                  hash_pat(h, pair->param.pat);
+                  hash_type(h, pair->param.type);
+                  break;
+            case PAIR_FIELD_PAT:
+                  hash_sym(h, pair->field_pat.id);
+                  hash_pat(h, pair->field_pat.pat);
+                  break;
+            case PAIR_FIELD_INIT:
+                  hash_sym(h, pair->field_init.id);
+                  hash_exp(h, pair->field_init.exp);
+                  break;
+            case PAIR_MATCH_ARM:
+                  hash_int(h, g_list_length(pair->match_arm.pats));
+                  for (const GList* p = pair->match_arm.pats; p; p = p->next)
+                        hash_pat(h, p->data);
+                  hash_exp(h, pair->match_arm.block);
+                  break;
+      }
+}
+
+static void hash_pairs(struct hasher* h, const GList* pairs) {
+      hash_int(h, g_list_length((GList*)pairs));
+      for (const GList* p = pairs; p; p = p->next)
+            hash_pair(h, p->data);
+}
+
+// The struct or enum named id, the first time it comes up: its layout and
+// so the code using it follows from its definition.
+static void hash_def(struct hasher* h, Symbol id) {
+      const struct item* def = g_hash_table_lookup(h->defs, GINT_TO_POINTER(id.value));
+      if (!def || g_hash_table_lookup(h->seen, def)) return;
+      g_hash_table_insert(h->seen, (gpointer)def, (gpointer)def);
+      hash_int(h, def->kind);
+      hash_sym(h, def->id);
+      if (def->kind == ITEM_STRUCT_DEF) hash_pairs(h, def->struct_def.fields);
+      else hash_pairs(h, def->enum_def.ctors);
+}
+
+// The signature of the fn called id, the first time it's called.
+static void hash_callee(struct hasher* h, Symbol id) {
+      const struct item* fn = g_hash_table_lookup(h->fns, GINT_TO_POINTER(id.value));
+      if (!fn || g_hash_table_lookup(h->seen, fn)) return;
+      g_hash_table_insert(h->seen, (gpointer)fn, (gpointer)fn);
+      hash_sym(h, fn->id);
+      hash_type(h, fn->fn_def.type);
+}
+
+static void hash_type(struct hasher* h, const struct type* type) {
+      if (!type) {
+            hash_int(h, -1);
+            return;
+      }
+      hash_int(h, type->kind);
+      switch (type->kind) {
+            case TYPE_REF: case TYPE_MUT: case TYPE_SLICE: case TYPE_BOX:
+                  hash_type(h, type->type);
+                  break;
+            case TYPE_ARRAY:
+                  hash_int(h, type->length);
+                  hash_type(h, type->type);
+                  break;
+            case TYPE_ID:
+                  hash_sym(h, type->id);
+                  hash_def(h, type->id);
+                  break;
+            case TYPE_FN:
+                  hash_pairs(h, type->params);
+                  hash_type(h, type->type);
+                  break;
+      }
+}
+
+static void hash_pats(struct hasher* h, const GList* pats) {
+      hash_int(h, g_list_length((GList*)pats));
+      for (const GList* p = pats; p; p = p->next)
+            hash_pat(h, p->data);
+}
+
+static void hash_pat(struct hasher* h, const struct pat* pat) {
+      hash_int(h, pat->kind);
+      switch (pat->kind) {
+            case PAT_REF:
+                  hash_pat(h, pat->pat);
+                  break;
+            case PAT_I32: case PAT_U8:
+                  hash_int(h, pat->num);
+                  break;
+            case PAT_STR:
+                  hash_str(h, pat->str);
+                  break;
+            case PAT_BIND:
+                  hash_int(h, pat->bind.ref);
+                  hash_int(h, pat->bind.mut);
+                  hash_sym(h, pat->bind.id);
+                  hash_int(h, pat->bind.slot);
+                  hash_str(h, pat->bind.ir_name);
+                  hash_int(h, pat->bind.borrowed);
+                  break;
+            case PAT_ARRAY:
+                  hash_pats(h, pat->array.pats);
+                  break;
+            case PAT_ENUM:
+                  hash_sym(h, pat->ctor.eid);
+                  hash_sym(h, pat->ctor.cid);
+                  hash_def(h, pat->ctor.eid);
+                  hash_pats(h, pat->ctor.pats);
+                  break;
+            case PAT_STRUCT:
+                  hash_sym(h, pat->strct.id);
+                  hash_def(h, pat->strct.id);
+                  hash_pairs(h, pat->strct.fields);
+                  break;
+      }
+}
+
+static void hash_stmt(struct hasher* h, const struct stmt* stmt) {
+      hash_int(h, stmt->kind);
+      hash_type(h, stmt->type);
+      switch (stmt->kind) {
+            case STMT_LET:
+                  hash_pat(h, stmt->let.pat);
+                  hash_type(h, stmt->let.type);
+                  hash_exp(h, stmt->let.exp);
+                  break;
+            case STMT_RETURN:
+            case STMT_EXP:
+                  hash_exp(h, stmt->exp);
+                  break;
+      }
+}
+
+static void hash_exps(struct hasher* h, const GList* exps) {
+      hash_int(h, g_list_length((GList*)exps));
+      for (const GList* p = exps; p; p = p->next)
+            hash_exp(h, p->data);
+}
+
+static void hash_exp(struct hasher* h, const struct exp* exp) {
+      if (!exp) {
+            hash_int(h, -1);
+            return;
+      }
+      hash_int(h, exp->kind);
+      hash_int(h, exp->local);
+      hash_type(h, exp->type);
+      switch (exp->kind) {
+            case EXP_U8: case EXP_I32:
+                  hash_int(h, exp->num);
+                  break;
+            case EXP_STR:
+                  hash_int(h, exp->string);
+                  hash_str(h, exp->str);
+                  break;
+            case EXP_ID:
+                  // Which binding, or else a name from outside the fn.
+                  hash_int(h, exp->bind? exp->bind->bind.slot : -1);
+                  hash_sym(h, exp->id);
+                  break;
+            case EXP_ENUM:
+                  hash_sym(h, exp->lit_enum.eid);
+                  hash_sym(h, exp->lit_enum.cid);
+                  hash_def(h, exp->lit_enum.eid);
+                  hash_exps(h, exp->lit_enum.exps);
+                  break;
+            case EXP_STRUCT:
+                  hash_sym(h, exp->lit_struct.id);
+                  hash_def(h, exp->lit_struct.id);
+                  hash_pairs(h, exp->lit_struct.fields);
+                  break;
+            case EXP_LOOKUP:
+                  hash_exp(h, exp->lookup.exp);
+                  hash_sym(h, exp->lookup.id);
+                  break;
+            case EXP_INDEX:
+                  hash_exp(h, exp->index.exp);
+                  hash_exp(h, exp->index.idx);
+                  break;
+            case EXP_FN_CALL:
+                  hash_sym(h, exp->fn_call.id);
+                  hash_callee(h, exp->fn_call.id);
+                  hash_exps(h, exp->fn_call.exps);
+                  break;
+            case EXP_ARRAY:
+                  hash_exps(h, exp->lit_array.exps);
+                  break;
+            case EXP_BOX_NEW:
+            case EXP_LOOP:
+                  hash_exp(h, exp->exp);
+                  break;
+            case EXP_MATCH:
+                  hash_exp(h, exp->match.exp);
+                  hash_pairs(h, exp->match.arms);
+                  break;
+            case EXP_IF:
+                  hash_exp(h, exp->if_else.cond);
+                  hash_exp(h, exp->if_else.block_true);
+                  hash_exp(h, exp->if_else.block_false);
+                  break;
+            case EXP_WHILE:
+                  hash_exp(h, exp->loop_while.cond);
+                  hash_exp(h, exp->loop_while.block);
+                  break;
+            case EXP_BLOCK:
+                  hash_int(h, g_list_length(exp->block.stmts));
+                  for (const GList* p = exp->block.stmts; p; p = p->next)
+                        hash_stmt(h, p->data);
+                  hash_exp(h, exp->block.exp);
+                  break;
+            case EXP_UNARY:
+                  hash_int(h, exp->unary.op);
+                  hash_int(h, exp->unary.mut);
+                  hash_exp(h, exp->unary.exp);
+                  break;
+            case EXP_BINARY:
+                  hash_int(h, exp->binary.op);
+                  hash_exp(h, exp->binary.left);
+                  hash_exp(h, exp->binary.right);
+                  break;
+      }
+}
+
+// Reads the entry's file, if there is one and it's whole.
+static void cache_read(struct cache_entry* entry) {
+      gchar* data;
+      gsize len;
+      if (!g_file_get_contents(entry->path, &data, &len, NULL)) return;
+
+      int boxes, checks, loops, header = 0;
+      const char* ir = memchr(data, '\n', len);
+      if (ir && sscanf(data, "; pa4 cache %d %d %d%n", &boxes, &checks, &loops, &header) == 3
+                  && data + header == ir) {
+            ++ir;
+            entry->hit = true;
+            entry->boxes = boxes;
+            entry->checks = checks;
+            entry->loops = loops;
+            entry->ir = ir_writer_mem();
+            ir_putn(entry->ir, ir, data + len - ir);
+      }
+      g_free(data);
+}
+
+static void cache_job_run(void* item, void* data) {
+      struct cache_job* job = item;
+      struct hasher h = {
+            g_checksum_new(G_CHECKSUM_SHA256),
+            job->defs,
+            job->fns,
+            g_hash_table_new(NULL, NULL),
+      };
+
+      hash_str(&h, CACHE_VERSION);
+      hash_str(&h, job->config);
+      hash_sym(&h, job->fn->id);
+      hash_type(&h, job->fn->fn_def.type);
+      hash_int(&h, job->fn->fn_def.slots);
+      hash_exp(&h, job->fn->fn_def.block);
+
+      char* name = g_strdup_printf("%s.ll", g_checksum_get_string(h.sum));
+      job->entry->path = g_build_filename(job->dir, name, NULL);
+      g_free(name);
+      cache_read(job->entry);
+
+      g_checksum_free(h.sum);
+      g_hash_table_destroy(h.seen);
+}
+
+GHashTable* cache_open(const char* dir, const GList* items, const char* config) {
+      GHashTable* cache = g_hash_table_new(NULL, NULL);
+      GHashTable* defs = g_hash_table_new(NULL, NULL);
+      GHashTable* fns = g_hash_table_new(NULL, NULL);
+      GArray* jobs = g_array_new(false, false, sizeof(struct cache_job));
+
+      if (g_mkdir_with_parents(dir, 0755)) {
+            printf("Error: can't create %s.\n", dir);
+            exit(1);
+      }
+
+      for (const GList* p = items; p; p = p->next) {
+            const struct item* item = p->data;
+            if (item->kind != ITEM_FN_DEF) {
+                  g_hash_table_insert(defs, GINT_TO_POINTER(item->id.value), (gpointer)item);
+                  continue;
+            }
+            g_hash_table_insert(fns, GINT_TO_POINTER(item->id.value), (gpointer)item);
+            struct cache_job job = {item, g_new0(struct cache_entry, 1), dir, config, defs, fns};
+            g_hash_table_insert(cache, (gpointer)item, job.entry);
+            g_array_append_val(jobs, job);
+      }
+
+      void** work = g_new(void*, jobs->len);
+      for (guint i = 0; i != jobs->len; ++i)
+            work[i] = &g_array_index(jobs, struct cache_job, i);
+      parallel_for(work, jobs->len, cache_job_run, NULL);
+
+      if (stats_enabled) {
+            int hits = 0;
+            for (guint i = 0; i != jobs->len; ++i)
+                  hits += g_array_index(jobs, struct cache_job, i).entry->hit;
+            stats_add(STATS_CACHE_HITS, hits);
+      }
+
+      g_free(work);
+      g_array_free(jobs, true);
+      g_hash_table_destroy(defs);
+      g_hash_table_destroy(fns);
+      return cache;
+}
+
+// g_file_set_contents() writes a temporary file and renames it, so another
+// pa4 reading the cache at the same time never sees half an entry.
+static void cache_write(const struct cache_entry* entry) {
+      size_t len;
+      const char* ir = ir_writer_data(entry->ir, &len);
+      char* header = g_strdup_printf(CACHE_HEADER, entry->boxes, entry->checks, entry->loops);
+      size_t header_len = strlen(header);
+
+      char* data = g_malloc(header_len + len);
+      memcpy(data, header, header_len);
+      memcpy(data + header_len, ir, len);
+      if (!g_file_set_contents(entry->path, data, header_len + len, NULL)) {
+            printf("Error: can't write %s.\n", entry->path);
+            exit(1);
+      }
+      g_free(data);
+      g_free(header);
+}
+
+void cache_close(GHashTable* cache) {
+      GHashTableIter i;
+      gpointer key, value;
+
+      g_hash_table_iter_init(&i, cache);
+      while (g_hash_table_iter_next(&i, &key, &value)) {
+            struct cache_entry* entry = value;
+            if (!entry->hit && entry->ir) cache_write(entry);
+            ir_writer_close(entry->ir);
+            g_free(entry->path);
+            g_free(entry);
+      }
+      g_hash_table_destroy(cache);
+}
@@ -0,0 +1,40 @@
+#ifndef RUSTC_CACHE_H_
+#define RUSTC_CACHE_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include "ir_writer.h"
+
+// *** Codegen cache (--cache=DIR) ***
+
+// The IR generated for each fn is kept in a directory, in a file named after
+// a hash of everything that goes into it: the fn as it stands once it's been
+// checked, inlined into and resolved (types, bindings, string pool indexes
+// and all), the signatures of the fns it calls, the structs and enums it
+// uses and the options codegen was run with. A fn whose hash is there isn't
+// lowered, optimized or emitted again; its IR is spliced in from the file.
+// Nothing is ever deleted from the directory.
+
+struct cache_entry {
+      bool hit;
+      // The fn's IR: read from the cache for a hit, otherwise handed over
+      // by codegen (an in-memory writer) for cache_close() to save.
+      struct ir_writer* ir;
+      // For the MIR emitter: whether the IR calls rt.box, whether it has
+      // bounds checks (calling llvm.trap), and how many !llvm.loop nodes it
+      // refers to, numbered from 0.
+      bool boxes;
+      bool checks;
+      int loops;
+      char* path;
+};
+
+// Hashes every fn of the (resolved) crate with config, a description of the
+// codegen options, and reads in whatever the cache in dir has for them.
+// Returns fn item -> struct cache_entry*.
+GHashTable* cache_open(const char* dir, const GList* items, const char* config);
+
+// Saves the IR of the entries that weren't hits, and frees them all.
+void cache_close(GHashTable* cache);
+
+#endif
@@ -6,6 +6,7 @@
 #include "env.h"
 #include "ast.h"
 #include "ast_print.h"
+#include "stats.h"
 
 // This is the information stored in the environment for every symbol.
 struct record {
@@ -14,56 +15,93 @@ struct record {
 };
 
 static struct record* record(struct type* type, struct item* def);
-static void insert_into(int key, struct record* value, GHashTable* ht);
-static void insert_copy_into(int key, struct record* value, GHashTable* ht);
+static GHashTable** table_for(struct env* env, Symbol symbol);
+static struct record* lookup_local(struct env* env, Symbol symbol);
+static struct record* lookup(struct env* env, Symbol symbol);
+static struct record* local_record(struct env* env, Symbol symbol);
 static void record_destroy(int key, struct record* rec);
 static void print_entry(int, struct record*, int);
 
 static struct record* record(struct type* type, struct item* def) {
       struct record* rec = malloc(sizeof(*rec));
+      assert(rec);
+      STATS_INC(STATS_ENV_RECORDS);
       rec->type = type;
       rec->def = def;
       return rec;
 }
 
 struct env* env_new(void) {
+      return env_push(NULL);
+}
+
+struct env* env_push(struct env* parent) {
       struct env* env = malloc(sizeof(*env));
-      env->types = g_hash_table_new(NULL, NULL);
-      env->vars = g_hash_table_new(NULL, NULL);
+      assert(env);
+      STATS_INC(STATS_ENV_SCOPES);
+      env->parent = parent;
+      // Created on first insert, so entering a scope that never binds
+      // anything (most blocks) costs a single allocation.
+      env->types = NULL;
+      env->vars = NULL;
       return env;
 }
 
-static void insert_into(int key, struct record* value, GHashTable* ht) {
-      g_hash_table_insert(ht, GINT_TO_POINTER(key), value);
+struct env* env_pop(struct env* env) {
+      assert(env);
+      struct env* parent = env->parent;
+      env_destroy(env);
+      return parent;
+}
+
+// Returns where the hash table for the symbol's namespace lives, or NULL if
+// that namespace isn't stored in the environment.
+static GHashTable** table_for(struct env* env, Symbol symbol) {
+      switch (symbol.kind) {
+            case SYMBOL_TYPE: return &env->types;
+            case SYMBOL_VAR: return &env->vars;
+      }
+      return NULL;
 }
 
-static void insert_copy_into(int key, struct record* value, GHashTable* ht) {
-      assert(value);
-      g_hash_table_insert(ht, GINT_TO_POINTER(key), record(value->type, value->def));
+static struct record* lookup_local(struct env* env, Symbol symbol) {
+      GHashTable** ht = table_for(env, symbol);
+      if (!ht || !*ht) return NULL;
+      return g_hash_table_lookup(*ht, GINT_TO_POINTER(symbol.value));
 }
 
-struct env* env_copy(struct env* old) {
-      struct env* new = env_new();
+// Innermost binding of the symbol visible from this scope.
+static struct record* lookup(struct env* env, Symbol symbol) {
+      for (; env; env = env->parent) {
+            struct record* rec = lookup_local(env, symbol);
+            if (rec) return rec;
+      }
+      return NULL;
+}
+
+// Returns the record for the symbol in the innermost scope, creating it if
+// needed. A fresh record starts out as a copy of the binding it shadows, so
+// setting only the type (or only the def) keeps the other half visible.
+static struct record* local_record(struct env* env, Symbol symbol) {
+      assert(env);
+      assert(symbol.kind == SYMBOL_TYPE || symbol.kind == SYMBOL_VAR);
+
+      struct record* rec = lookup_local(env, symbol);
+      if (rec) return rec;
 
-      g_hash_table_foreach(old->types, (GHFunc)insert_copy_into, new->types);
-      g_hash_table_foreach(old->vars, (GHFunc)insert_copy_into, new->vars);
+      struct record* outer = lookup(env->parent, symbol);
+      rec = outer? record(outer->type, outer->def) : record(NULL, NULL);
 
-      return new;
+      GHashTable** ht = table_for(env, symbol);
+      if (!*ht) *ht = g_hash_table_new(NULL, NULL);
+      g_hash_table_insert(*ht, GINT_TO_POINTER(symbol.value), rec);
+      return rec;
 }
 
 struct type* env_lookup(struct env* env, Symbol symbol) {
       assert(env);
 
-      struct record* rec = NULL;
-      switch (symbol.kind) {
-            case SYMBOL_TYPE:
-                  rec = (struct record*)g_hash_table_lookup(env->types, GINT_TO_POINTER(symbol.value));
-                  break;
-            case SYMBOL_VAR:
-                  rec = (struct record*)g_hash_table_lookup(env->vars, GINT_TO_POINTER(symbol.value));
-                  break;
-      }
-
+      struct record* rec = lookup(env, symbol);
       if (!rec) return type_error();
       return rec->type;
 }
@@ -71,85 +109,23 @@ struct type* env_lookup(struct env* env, Symbol symbol) {
 struct item* env_lookup_def(struct env* env, Symbol symbol) {
       assert(env);
 
-      struct record* rec = NULL;
-      switch (symbol.kind) {
-            case SYMBOL_TYPE:
-                  rec = (struct record*)g_hash_table_lookup(env->types, GINT_TO_POINTER(symbol.value));
-                  break;
-            case SYMBOL_VAR:
-                  rec = (struct record*)g_hash_table_lookup(env->vars, GINT_TO_POINTER(symbol.value));
-                  break;
-      }
-
-
+      struct record* rec = lookup(env, symbol);
       if (!rec) return NULL;
       return rec->def;
 }
 
 void env_insert(struct env* env, Symbol symbol, struct type* type) {
-      assert(env);
-      assert(symbol.kind == SYMBOL_TYPE || symbol.kind == SYMBOL_VAR);
-
-      switch (symbol.kind) {
-            case SYMBOL_TYPE: {
-                  assert(env->types);
-                  struct record* rec = g_hash_table_lookup(env->types, GINT_TO_POINTER(symbol.value));
-                  if (!rec) rec = record(NULL, NULL);
-                  rec->type = type;
-
-                  insert_into(symbol.value, rec, env->types);
-                  break;
-            }
-            case SYMBOL_VAR: {
-                  assert(env->vars);
-                  struct record* rec = g_hash_table_lookup(env->vars, GINT_TO_POINTER(symbol.value));
-                  if (!rec) rec = record(NULL, NULL);
-                  rec->type = type;
-
-                  insert_into(symbol.value, rec, env->vars);
-                  break;
-            }
-      }
+      local_record(env, symbol)->type = type;
 }
 
 void env_insert_def(struct env* env, Symbol symbol, struct item* def) {
-      assert(env);
-      assert(symbol.kind == SYMBOL_TYPE || symbol.kind == SYMBOL_VAR);
-
-      switch (symbol.kind) {
-            case SYMBOL_TYPE: {
-                  assert(env->types);
-                  struct record* rec = g_hash_table_lookup(env->types, GINT_TO_POINTER(symbol.value));
-                  if (!rec) rec = record(NULL, NULL);
-                  rec->def = def;
-
-                  insert_into(symbol.value, rec, env->types);
-                  break;
-            }
-            case SYMBOL_VAR: {
-                  assert(env->vars);
-                  struct record* rec = g_hash_table_lookup(env->vars, GINT_TO_POINTER(symbol.value));
-                  if (!rec) rec = record(NULL, NULL);
-                  rec->def = def;
-
-                  insert_into(symbol.value, rec, env->vars);
-                  break;
-            }
-      }
+      local_record(env, symbol)->def = def;
 }
 
 bool env_contains(struct env* env, Symbol symbol) {
       assert(env);
       assert(symbol.kind == SYMBOL_TYPE || symbol.kind == SYMBOL_VAR);
-      switch (symbol.kind) {
-            case SYMBOL_TYPE:
-                  assert(env->types);
-                  return g_hash_table_lookup(env->types, GINT_TO_POINTER(symbol.value)) != NULL;
-            case SYMBOL_VAR:
-                  assert(env->vars);
-                  return g_hash_table_lookup(env->vars, GINT_TO_POINTER(symbol.value)) != NULL;
-      }
-      return false;
+      return lookup(env, symbol) != NULL;
 }
 
 static void print_entry(int symbol_value, struct record* rec, int symbol_kind) {
@@ -177,10 +153,13 @@ static void print_entry(int symbol_value, struct record* rec, int symbol_kind) {
       puts(" }");
 }
 
+// Prints every scope, innermost first.
 void env_print(struct env* env) {
       assert(env);
-      g_hash_table_foreach(env->types, (GHFunc)print_entry, GINT_TO_POINTER(SYMBOL_TYPE));
-      g_hash_table_foreach(env->vars, (GHFunc)print_entry, GINT_TO_POINTER(SYMBOL_VAR));
+      for (; env; env = env->parent) {
+            if (env->types) g_hash_table_foreach(env->types, (GHFunc)print_entry, GINT_TO_POINTER(SYMBOL_TYPE));
+            if (env->vars) g_hash_table_foreach(env->vars, (GHFunc)print_entry, GINT_TO_POINTER(SYMBOL_VAR));
+      }
 }
 
 static void record_destroy(int key, struct record* rec) {
@@ -191,12 +170,15 @@ static void record_destroy(int key, struct record* rec) {
 void env_destroy(struct env* env) {
       if (!env) return;
 
-      g_hash_table_foreach(env->types, (GHFunc)record_destroy, NULL);
-      g_hash_table_destroy(env->types);
+      if (env->types) {
+            g_hash_table_foreach(env->types, (GHFunc)record_destroy, NULL);
+            g_hash_table_destroy(env->types);
+      }
 
-      g_hash_table_foreach(env->vars, (GHFunc)record_destroy, NULL);
-      g_hash_table_destroy(env->vars);
+      if (env->vars) {
+            g_hash_table_foreach(env->vars, (GHFunc)record_destroy, NULL);
+            g_hash_table_destroy(env->vars);
+      }
 
       free(env);
 }
-
@@ -7,19 +7,28 @@
 #include "symbol.h"
 #include "type.h"
 
+// An environment is a chain of scopes. Each scope only holds the bindings
+// made in it; lookups walk outwards until they find the symbol, so entering
+// and leaving a scope doesn't depend on how much is bound in the outer ones.
 struct env {
+      struct env* parent;
       GHashTable* vars;
       GHashTable* types;
 };
 
+// Creates an empty outermost scope.
 struct env* env_new(void);
-// Copies the hash table but not the types/items stored in the hash table.
-struct env* env_copy(struct env*);
+// Enters a new (empty) scope nested in the parameter scope. Bindings made in
+// the new scope shadow those of its parents until it's popped.
+struct env* env_push(struct env* parent);
+// Leaves and frees the innermost scope, returning its parent. Parents are left
+// untouched.
+struct env* env_pop(struct env*);
 
 bool env_contains(struct env*, Symbol);
 
-// Associates a symbol with the parameter type or item. Doesn't own the type
-// or item -- they don't get freed by destroy().
+// Associates a symbol with the parameter type or item in the innermost scope.
+// Doesn't own the type or item -- they don't get freed by destroy().
 void env_insert(struct env*, Symbol, struct type*);
 void env_insert_def(struct env*, Symbol, struct item*);
 
@@ -29,7 +38,8 @@ struct item* env_lookup_def(struct env*, Symbol);
 
 void env_print(struct env*);
 
-// Doesn't free the types and items themselves.
+// Frees a single scope (not its parents). Doesn't free the types and items
+// themselves.
 void env_destroy(struct env* env);
 
 #endif
@@ -0,0 +1,279 @@
+#include "escape.h"
+#include "ast.h"
+#include "stats.h"
+
+// Where a value goes: nowhere it could be kept (it's only looked at or
+// thrown away), somewhere that outlives the fn, or into a node.
+#define SINK_NONE (-1)
+#define SINK_ESCAPE (-2)
+
+// A binding or a Box::new.
+struct node {
+      // How many loops in it is.
+      int depth;
+      bool escapes;
+      // Of int: the bindings its value goes into.
+      GArray* to;
+};
+
+// State for one fn. Its bindings are nodes 0 to slots - 1, by slot; its
+// Box::news come after.
+struct escape {
+      // Of struct node.
+      GArray* nodes;
+      // Of struct exp*: the Box::new of node slots + i.
+      GPtrArray* boxes;
+      int slots;
+      int depth;
+};
+
+static struct node* node_at(struct escape* s, int n) {
+      return &g_array_index(s->nodes, struct node, n);
+}
+
+static void flow(struct escape* s, int from, int sink) {
+      struct node* node = node_at(s, from);
+      if (sink == SINK_ESCAPE) {
+            node->escapes = true;
+      } else if (sink >= 0) {
+            if (!node->to) node->to = g_array_new(false, false, sizeof(int));
+            g_array_append_val(node->to, sink);
+      }
+}
+
+static void bind_pat(struct escape* s, const struct pat* pat) {
+      switch (pat->kind) {
+            case PAT_BIND:
+                  node_at(s, pat->bind.slot)->depth = s->depth;
+                  break;
+            case PAT_REF:
+                  bind_pat(s, pat->pat);
+                  break;
+            case PAT_ARRAY:
+                  for (const GList* p = pat->array.pats; p; p = p->next)
+                        bind_pat(s, p->data);
+                  break;
+            case PAT_ENUM:
+                  for (const GList* p = pat->ctor.pats; p; p = p->next)
+                        bind_pat(s, p->data);
+                  break;
+            case PAT_STRUCT:
+                  for (const GList* p = pat->strct.fields; p; p = p->next) {
+                        const struct pair* field = p->data;
+                        bind_pat(s, field->field_pat.pat);
+                  }
+                  break;
+      }
+}
+
+// Whether a value of the type could be (or have in it) a box or a reference.
+static bool holds_box(const struct type* type) {
+      switch (type->unmut->kind) {
+            case TYPE_UNIT:
+            case TYPE_I32:
+            case TYPE_U8:
+            case TYPE_BOOL:
+            case TYPE_DIV:
+                  return false;
+      }
+      return true;
+}
+
+static void escape_exp(struct escape* s, struct exp* exp, int sink);
+
+static void escape_exps(struct escape* s, const GList* exps, int sink) {
+      for (const GList* p = exps; p; p = p->next)
+            escape_exp(s, p->data, sink);
+}
+
+// What's at the place (variable, deref, field or element) is going to sink
+// by reference: whatever holds it has to stay about as long.
+static void escape_place(struct escape* s, struct exp* exp, int sink) {
+      switch (exp->kind) {
+            case EXP_ID:
+                  if (exp->bind) flow(s, exp->bind->bind.slot, sink);
+                  return;
+            case EXP_UNARY:
+                  if (exp->unary.op != OP_MUL) break;
+                  escape_exp(s, exp->unary.exp, sink);
+                  return;
+            case EXP_LOOKUP:
+                  escape_place(s, exp->lookup.exp, sink);
+                  return;
+            case EXP_INDEX:
+                  escape_place(s, exp->index.exp, sink);
+                  escape_exp(s, exp->index.idx, SINK_NONE);
+                  return;
+      }
+      escape_exp(s, exp, sink);
+}
+
+static void escape_stmt(struct escape* s, struct stmt* stmt) {
+      switch (stmt->kind) {
+            case STMT_LET: {
+                  struct pat* pat = stmt->let.pat;
+                  bind_pat(s, pat);
+                  if (!stmt->let.exp) break;
+                  // Taking a value apart could put a box anywhere.
+                  if (pat->kind == PAT_BIND) escape_exp(s, stmt->let.exp, pat->bind.slot);
+                  else escape_exp(s, stmt->let.exp, pat->kind == PAT_WILD? SINK_NONE : SINK_ESCAPE);
+                  break;
+            }
+            case STMT_RETURN:
+                  escape_exp(s, stmt->exp, SINK_ESCAPE);
+                  break;
+            case STMT_EXP:
+                  escape_exp(s, stmt->exp, SINK_NONE);
+                  break;
+      }
+}
+
+static void escape_exp(struct escape* s, struct exp* exp, int sink) {
+      if (!exp) return;
+
+      switch (exp->kind) {
+            case EXP_ID:
+                  if (exp->bind) flow(s, exp->bind->bind.slot, sink);
+                  break;
+            case EXP_BOX_NEW: {
+                  struct node node = {s->depth};
+                  g_array_append_val(s->nodes, node);
+                  g_ptr_array_add(s->boxes, exp);
+                  flow(s, s->nodes->len - 1, sink);
+                  escape_exp(s, exp->exp, SINK_ESCAPE);
+                  break;
+            }
+            case EXP_ENUM:
+                  escape_exps(s, exp->lit_enum.exps, SINK_ESCAPE);
+                  break;
+            case EXP_STRUCT:
+                  for (const GList* p = exp->lit_struct.fields; p; p = p->next) {
+                        struct pair* field = p->data;
+                        escape_exp(s, field->field_init.exp, SINK_ESCAPE);
+                  }
+                  break;
+            case EXP_ARRAY:
+                  escape_exps(s, exp->lit_array.exps, SINK_ESCAPE);
+                  break;
+            case EXP_FN_CALL:
+                  escape_exps(s, exp->fn_call.exps, SINK_ESCAPE);
+                  break;
+            case EXP_LOOKUP:
+                  escape_exp(s, exp->lookup.exp, SINK_NONE);
+                  break;
+            case EXP_INDEX:
+                  escape_exp(s, exp->index.exp, SINK_NONE);
+                  escape_exp(s, exp->index.idx, SINK_NONE);
+                  break;
+            case EXP_MATCH:
+                  escape_exp(s, exp->match.exp, SINK_ESCAPE);
+                  for (const GList* p = exp->match.arms; p; p = p->next) {
+                        struct pair* arm = p->data;
+                        for (const GList* q = arm->match_arm.pats; q; q = q->next)
+                              bind_pat(s, q->data);
+                        escape_exp(s, arm->match_arm.block, sink);
+                  }
+                  break;
+            case EXP_IF:
+                  escape_exp(s, exp->if_else.cond, SINK_NONE);
+                  escape_exp(s, exp->if_else.block_true, sink);
+                  escape_exp(s, exp->if_else.block_false, sink);
+                  break;
+            case EXP_WHILE:
+                  ++s->depth;
+                  escape_exp(s, exp->loop_while.cond, SINK_NONE);
+                  escape_exp(s, exp->loop_while.block, SINK_NONE);
+                  --s->depth;
+                  break;
+            case EXP_LOOP:
+                  ++s->depth;
+                  escape_exp(s, exp->exp, SINK_NONE);
+                  --s->depth;
+                  break;
+            case EXP_BLOCK:
+                  for (const GList* p = exp->block.stmts; p; p = p->next)
+                        escape_stmt(s, p->data);
+                  escape_exp(s, exp->block.exp, sink);
+                  break;
+            case EXP_UNARY:
+                  if (exp->unary.op == OP_ADDROF) escape_place(s, exp->unary.exp, sink);
+                  // What's read through a reference or a box goes on to the
+                  // sink, so the reference does too: a box borrowed and read
+                  // back is still the box. (A number read out is just a number.)
+                  else if (exp->unary.op == OP_MUL && holds_box(exp->type))
+                        escape_exp(s, exp->unary.exp, sink);
+                  else escape_exp(s, exp->unary.exp, SINK_NONE);
+                  break;
+            case EXP_BINARY:
+                  if (exp->binary.op == OP_ASSIGN && exp->binary.left->kind == EXP_ID && exp->binary.left->bind) {
+                        escape_exp(s, exp->binary.right, exp->binary.left->bind->bind.slot);
+                  } else if (exp->binary.op == OP_ASSIGN) {
+                        escape_place(s, exp->binary.left, SINK_NONE);
+                        escape_exp(s, exp->binary.right, SINK_ESCAPE);
+                  } else {
+                        escape_exp(s, exp->binary.left, SINK_NONE);
+                        escape_exp(s, exp->binary.right, SINK_NONE);
+                  }
+                  break;
+      }
+}
+
+// Whether the box node n stays within the fn call (and loop iteration) it's
+// made in, going by every binding its value can end up in.
+static bool is_local(struct escape* s, int n, bool* seen) {
+      int depth = node_at(s, n)->depth;
+      GArray* todo = g_array_new(false, false, sizeof(int));
+      bool local = true;
+
+      for (guint i = 0; i != s->nodes->len; ++i) seen[i] = false;
+      seen[n] = true;
+      g_array_append_val(todo, n);
+      while (todo->len && local) {
+            struct node* node = node_at(s, g_array_index(todo, int, todo->len - 1));
+            g_array_set_size(todo, todo->len - 1);
+            local = !node->escapes && node->depth >= depth;
+            for (guint i = 0; node->to && i != node->to->len; ++i) {
+                  int to = g_array_index(node->to, int, i);
+                  if (seen[to]) continue;
+                  seen[to] = true;
+                  g_array_append_val(todo, to);
+            }
+      }
+      g_array_free(todo, true);
+      return local;
+}
+
+static void escape_fn(struct item* fn) {
+      struct escape s = {
+            g_array_new(false, true, sizeof(struct node)),
+            g_ptr_array_new(),
+            fn->fn_def.slots,
+            0,
+      };
+
+      // Parameters included, at depth 0.
+      g_array_set_size(s.nodes, s.slots);
+      escape_exp(&s, fn->fn_def.block, SINK_ESCAPE);
+
+      bool* seen = g_new(bool, s.nodes->len);
+      int local = 0;
+      for (guint i = 0; i != s.boxes->len; ++i) {
+            struct exp* box = g_ptr_array_index(s.boxes, i);
+            box->local = is_local(&s, s.slots + i, seen);
+            local += box->local;
+      }
+      if (stats_enabled) stats_add(STATS_STACK_BOXES, local);
+      g_free(seen);
+
+      for (guint i = 0; i != s.nodes->len; ++i)
+            if (node_at(&s, i)->to) g_array_free(node_at(&s, i)->to, true);
+      g_array_free(s.nodes, true);
+      g_ptr_array_free(s.boxes, true);
+}
+
+void escape_crate(GList* items) {
+      for (GList* i = items; i; i = i->next) {
+            struct item* item = i->data;
+            if (item->kind == ITEM_FN_DEF) escape_fn(item);
+      }
+}
@@ -0,0 +1,19 @@
+#ifndef RUSTC_ESCAPE_H_
+#define RUSTC_ESCAPE_H_
+
+#include <glib.h>
+
+// *** Box escape analysis ***
+
+// Sets exp->local on every Box::new of the (resolved) crate whose box can't
+// outlive the call of the fn making it, so it can go on the stack. A box
+// escapes if it's returned, passed to a fn, stored anywhere but a variable of
+// the fn (a struct field, an array, another box, through a reference), put in
+// a literal or matched on, or if a variable it ends up in does; so does one
+// made in a loop that ends up in a variable from outside it, which the next
+// time round would still be holding. Borrowing a variable counts as it
+// ending up wherever the reference does, and reading a box (or a reference)
+// back through one (*r) as that reference ending up wherever the box does.
+void escape_crate(GList* items);
+
+#endif
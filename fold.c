@@ -0,0 +1,243 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "fold.h"
+#include "ast.h"
+
+static void fold_exp(struct exp* exp);
+
+static bool is_i32(const struct exp* exp, int num) {
+      return exp->kind == EXP_I32 && exp->num == num;
+}
+
+static bool is_bool(const struct exp* exp) {
+      return exp->kind == EXP_TRUE || exp->kind == EXP_FALSE;
+}
+
+// Whether dropping the expression (rather than evaluating it) is invisible.
+static bool is_pure(const struct exp* exp) {
+      switch (exp->kind) {
+            case EXP_U8: case EXP_I32: case EXP_TRUE: case EXP_FALSE:
+            case EXP_STR: case EXP_UNIT: case EXP_ID:
+                  return true;
+            case EXP_LOOKUP:
+                  return is_pure(exp->lookup.exp);
+            case EXP_UNARY:
+                  return is_pure(exp->unary.exp);
+            case EXP_BINARY:
+                  return !exp_is_assign(exp) && !exp_is_cmp_assign(exp)
+                        && is_pure(exp->binary.left) && is_pure(exp->binary.right);
+      }
+      return false;
+}
+
+// The node turns into a constant or into one of its children. It keeps its
+// own type: a child may be the mut version of it.
+static void become_i32(struct exp* exp, int32_t num) {
+      exp->kind = EXP_I32;
+      exp->num = num;
+}
+
+static void become_bool(struct exp* exp, bool b) {
+      exp->kind = b? EXP_TRUE : EXP_FALSE;
+}
+
+static void become(struct exp* exp, const struct exp* with) {
+      struct type* type = exp->type;
+      *exp = *with;
+      exp->type = type;
+}
+
+// Two's complement, without the undefined behavior of signed overflow in C.
+static int32_t wrap(uint32_t n) {
+      return (int32_t)n;
+}
+
+static bool fold_arith(int op, int32_t l, int32_t r, int32_t* result) {
+      switch (op) {
+            case OP_ADD: *result = wrap((uint32_t)l + (uint32_t)r); return true;
+            case OP_SUB: *result = wrap((uint32_t)l - (uint32_t)r); return true;
+            case OP_MUL: *result = wrap((uint32_t)l * (uint32_t)r); return true;
+            case OP_DIV:
+            case OP_REM:
+                  if (r == 0 || (l == INT32_MIN && r == -1)) return false;
+                  *result = op == OP_DIV? l / r : l % r;
+                  return true;
+      }
+      return false;
+}
+
+static bool fold_compare(int op, int32_t l, int32_t r) {
+      switch (op) {
+            case OP_EQ: return l == r;
+            case OP_NEQ: return l != r;
+            case OP_LT: return l < r;
+            case OP_LEQ: return l <= r;
+            case OP_GT: return l > r;
+            case OP_GEQ: return l >= r;
+      }
+      assert(false);
+      return false;
+}
+
+static void fold_binary(struct exp* exp) {
+      struct exp* left = exp->binary.left;
+      struct exp* right = exp->binary.right;
+      int op = exp->binary.op;
+
+      fold_exp(left);
+      fold_exp(right);
+
+      if (exp_is_assign(exp) || exp_is_cmp_assign(exp)) return;
+
+      if (left->kind == EXP_I32 && right->kind == EXP_I32) {
+            int32_t n;
+            if (exp_is_arith(exp) && fold_arith(op, left->num, right->num, &n))
+                  become_i32(exp, n);
+            else if (exp_is_compare(exp) || exp_is_eq(exp))
+                  become_bool(exp, fold_compare(op, left->num, right->num));
+            return;
+      }
+
+      if (is_bool(left) && is_bool(right) && exp_is_eq(exp)) {
+            bool eq = left->kind == right->kind;
+            become_bool(exp, op == OP_EQ? eq : !eq);
+            return;
+      }
+
+      switch (op) {
+            case OP_ADD:
+                  if (is_i32(right, 0)) become(exp, left);
+                  else if (is_i32(left, 0)) become(exp, right);
+                  break;
+            case OP_SUB:
+                  if (is_i32(right, 0)) become(exp, left);
+                  break;
+            case OP_MUL:
+                  if (is_i32(right, 1)) become(exp, left);
+                  else if (is_i32(left, 1)) become(exp, right);
+                  else if ((is_i32(right, 0) && is_pure(left)) || (is_i32(left, 0) && is_pure(right)))
+                        become_i32(exp, 0);
+                  break;
+            case OP_DIV:
+                  if (is_i32(right, 1)) become(exp, left);
+                  break;
+            // The right operand of && and || only runs if the left one
+            // doesn't decide the result.
+            case OP_AND:
+                  if (left->kind == EXP_TRUE) become(exp, right);
+                  else if (left->kind == EXP_FALSE) become_bool(exp, false);
+                  else if (right->kind == EXP_TRUE) become(exp, left);
+                  break;
+            case OP_OR:
+                  if (left->kind == EXP_FALSE) become(exp, right);
+                  else if (left->kind == EXP_TRUE) become_bool(exp, true);
+                  else if (right->kind == EXP_FALSE) become(exp, left);
+                  break;
+      }
+}
+
+static void fold_unary(struct exp* exp) {
+      struct exp* operand = exp->unary.exp;
+      fold_exp(operand);
+
+      if (exp->unary.op == OP_SUB && operand->kind == EXP_I32)
+            become_i32(exp, wrap(-(uint32_t)operand->num));
+      else if (exp->unary.op == OP_NOT && is_bool(operand))
+            become_bool(exp, operand->kind == EXP_FALSE);
+}
+
+static void fold_stmt(struct stmt* stmt) {
+      switch (stmt->kind) {
+            case STMT_LET:
+                  if (stmt->let.exp) fold_exp(stmt->let.exp);
+                  break;
+            case STMT_RETURN:
+            case STMT_EXP:
+                  fold_exp(stmt->exp);
+                  break;
+      }
+}
+
+static void fold_exps(GList* exps) {
+      for (GList* p = exps; p; p = p->next)
+            fold_exp(p->data);
+}
+
+static void fold_exp(struct exp* exp) {
+      if (!exp) return;
+
+      switch (exp->kind) {
+            case EXP_ENUM:
+                  fold_exps(exp->lit_enum.exps);
+                  break;
+            case EXP_STRUCT:
+                  for (GList* p = exp->lit_struct.fields; p; p = p->next) {
+                        struct pair* field = p->data;
+                        fold_exp(field->field_init.exp);
+                  }
+                  break;
+            case EXP_LOOKUP:
+                  fold_exp(exp->lookup.exp);
+                  break;
+            case EXP_INDEX:
+                  fold_exp(exp->index.exp);
+                  fold_exp(exp->index.idx);
+                  break;
+            case EXP_FN_CALL:
+                  fold_exps(exp->fn_call.exps);
+                  break;
+            case EXP_ARRAY:
+                  fold_exps(exp->lit_array.exps);
+                  break;
+            case EXP_BOX_NEW:
+            case EXP_LOOP:
+                  fold_exp(exp->exp);
+                  break;
+            case EXP_MATCH:
+                  fold_exp(exp->match.exp);
+                  for (GList* p = exp->match.arms; p; p = p->next) {
+                        struct pair* arm = p->data;
+                        fold_exp(arm->match_arm.block);
+                  }
+                  break;
+            case EXP_IF:
+                  fold_exp(exp->if_else.cond);
+                  fold_exp(exp->if_else.block_true);
+                  fold_exp(exp->if_else.block_false);
+                  if (exp->if_else.cond->kind == EXP_TRUE)
+                        become(exp, exp->if_else.block_true);
+                  else if (exp->if_else.cond->kind == EXP_FALSE) {
+                        if (exp->if_else.block_false) become(exp, exp->if_else.block_false);
+                        else exp->kind = EXP_UNIT;
+                  }
+                  break;
+            case EXP_WHILE:
+                  fold_exp(exp->loop_while.cond);
+                  fold_exp(exp->loop_while.block);
+                  if (exp->loop_while.cond->kind == EXP_FALSE)
+                        exp->kind = EXP_UNIT;
+                  break;
+            case EXP_BLOCK:
+                  for (GList* p = exp->block.stmts; p; p = p->next)
+                        fold_stmt(p->data);
+                  fold_exp(exp->block.exp);
+                  break;
+            case EXP_UNARY:
+                  fold_unary(exp);
+                  break;
+            case EXP_BINARY:
+                  fold_binary(exp);
+                  break;
+      }
+}
+
+static void fold_item(struct item* item) {
+      assert(item);
+      if (item->kind == ITEM_FN_DEF)
+            fold_exp(item->fn_def.block);
+}
+
+void fold_crate(GList* items) {
+      g_list_foreach(items, (GFunc)fold_item, NULL);
+}
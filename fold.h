@@ -0,0 +1,17 @@
+#ifndef RUSTC_FOLD_H_
+#define RUSTC_FOLD_H_
+
+#include <glib.h>
+
+// *** Constant folding ***
+
+// Rewrites the (type checked) crate in place: evaluates i32 and bool
+// expressions whose operands are constants, drops identities like x + 0,
+// x * 1 and true && x, and replaces an if or while whose condition is a
+// constant with the branch that's taken.
+//
+// i32 arithmetic wraps like the add/sub/mul we emit; division and remainder
+// by zero (and INT_MIN / -1) are left for run time.
+void fold_crate(GList* items);
+
+#endif
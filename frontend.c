@@ -7,7 +7,28 @@
 #include "type.h"
 #include "env.h"
 #include "ast_print.h"
+#include "ir_writer.h"
+#include "parallel.h"
+#include "resolve.h"
+#include "fold.h"
+#include "stats.h"
+#include "mir_lower.h"
+#include "mir_emit.h"
+#include "mir_layout.h"
+#include "mir_llvm.h"
+#include "pass.h"
+#include "reach.h"
+#include "inline.h"
+#include "escape.h"
+#include "cache.h"
+#include "ast_image.h"
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static void annotate_stmt(struct stmt* stmt, struct env* env);
 
@@ -85,8 +106,10 @@ static struct env* build_env(GList* crate) {
                         }
                         env_insert_def(env, item->id, item);
 
+                        // Kept for item_get_field(), as checking looks fields up a lot.
                         GHashTable* fields = g_hash_table_new(NULL, NULL);
-                        for (GList* j = g_list_first(item->struct_def.fields); j; j = j->next) {
+                        int n = 0;
+                        for (GList* j = g_list_first(item->struct_def.fields); j; j = j->next, ++n) {
                               assert(j->data);
                               struct pair* pair = j->data;
                               assert(pair->kind == PAIR_FIELD_DEF);
@@ -95,25 +118,25 @@ static struct env* build_env(GList* crate) {
                                     printf("Error: duplicate declaration of the field `%s` of the struct `%s`.\n", symbol_to_str(pair->field_def.id), symbol_to_str(item->id));
                                     exit(1);
                               }
-                              g_hash_table_insert(fields, GINT_TO_POINTER(pair->field_def.id.value), GINT_TO_POINTER(true));
+                              pair->field_def.index = n;
+                              g_hash_table_insert(fields, GINT_TO_POINTER(pair->field_def.id.value), pair);
                         }
-                        g_hash_table_destroy(fields);
+                        item->struct_def.index = fields;
 
                         break;
                   }
             }
       }
-       // Adds types for builtin prints() and printi() functions.
-       // TODO: leak, some malloc'd data is only accessible via the env (as
-       // opposed to the AST), and won't get free'd.
-       env_insert(env, symbol_var(strdup("prints")), type_fn(
-                   g_list_append(NULL, GINT_TO_POINTER(
-                         param(pat_id(false, false, symbol_var(strdup("msg"))),
+       // Adds types for builtin prints() and printi() functions. Like the
+       // rest of the crate, they're allocated from the crate arena.
+       env_insert(env, symbol_var(symbol_intern("prints", strlen("prints"))), type_fn(
+                   ast_list_prepend(NULL, GINT_TO_POINTER(
+                         param(pat_id(false, false, symbol_var(symbol_intern("msg", strlen("msg")))),
                                type_ref(type_slice(type_u8()))))),
                    type_unit()));
-       env_insert(env, symbol_var(strdup("printi")), type_fn(
-                   g_list_append(NULL, GINT_TO_POINTER(
-                         param(pat_id(false, false, symbol_var(strdup("msg"))),
+       env_insert(env, symbol_var(symbol_intern("printi", strlen("printi"))), type_fn(
+                   ast_list_prepend(NULL, GINT_TO_POINTER(
+                         param(pat_id(false, false, symbol_var(symbol_intern("msg", strlen("msg")))),
                                type_i32()))),
                    type_unit()));
       return env;
@@ -134,15 +157,121 @@ static void check_main(struct env* env) {
       }
 }
 
+// The type of a part of a value of the given type: mutable if the whole is.
+static struct type* part_type(struct type* whole, struct type* part) {
+      if (type_is_mut(whole)) return type_mut(part);
+      return part;
+}
+
+// Checks a pattern against the type of the value it's matched with, and binds
+// its variables in env (also recording their types in binds, by symbol value).
+// Returns false if the pattern doesn't fit the type.
+static bool annotate_pat(struct pat* pat, struct type* type, struct env* env, GHashTable* binds) {
+      assert(pat);
+
+      switch (pat->kind) {
+            case PAT_WILD:
+                  return true;
+            case PAT_UNIT:
+                  return type_is_unit(type);
+            case PAT_TRUE:
+            case PAT_FALSE:
+                  return type_is_bool(type);
+            case PAT_I32:
+                  return type_is_i32(type);
+            case PAT_U8:
+                  return type_eq(type, type_u8());
+            case PAT_STR:
+                  return type_eq(type, type_ref(type_slice(type_u8())));
+            case PAT_REF:
+                  return type_is_ref(type) && annotate_pat(pat->pat, type_get_elem(type), env, binds);
+            case PAT_BIND: {
+                  struct type* bound = type->unmut;
+                  if (g_hash_table_contains(binds, GINT_TO_POINTER(pat->bind.id.value)))
+                        return false; // Bound twice in the same pattern.
+                  if (pat->bind.ref) {
+                        // A ref mut binding borrows the matched value mutably.
+                        if (pat->bind.mut && !type_is_mut(type)) return false;
+                        bound = pat->bind.mut? type_ref_mut(bound) : type_ref(bound);
+                  } else if (pat->bind.mut) bound = type_mut(bound);
+                  env_insert(env, pat->bind.id, bound);
+                  g_hash_table_insert(binds, GINT_TO_POINTER(pat->bind.id.value), bound);
+                  return true;
+            }
+            case PAT_ARRAY: {
+                  if (!type_is_array(type) || (int)g_list_length(pat->array.pats) != type->unmut->length)
+                        return false;
+                  bool ok = true;
+                  for (GList* p = pat->array.pats; p; p = p->next)
+                        ok = annotate_pat(p->data, part_type(type, type_get_elem(type)), env, binds) && ok;
+                  return ok;
+            }
+            case PAT_ENUM: {
+                  struct pair* ctor = item_get_ctor(env_lookup_def(env, pat->ctor.eid), pat->ctor.cid, NULL);
+                  if (!ctor || !type_eq(type, type_id(pat->ctor.eid))
+                              || g_list_length(ctor->ctor_def.types) != g_list_length(pat->ctor.pats))
+                        return false;
+                  bool ok = true;
+                  GList* t = ctor->ctor_def.types;
+                  for (GList* p = pat->ctor.pats; p; p = p->next, t = t->next)
+                        ok = annotate_pat(p->data, part_type(type, t->data), env, binds) && ok;
+                  return ok;
+            }
+            case PAT_STRUCT: {
+                  struct item* def = env_lookup_def(env, pat->strct.id);
+                  if (!def || def->kind != ITEM_STRUCT_DEF || !type_eq(type, type_id(pat->strct.id)))
+                        return false;
+                  bool ok = true;
+                  for (GList* p = pat->strct.fields; p; p = p->next) {
+                        struct pair* field = p->data;
+                        struct type* field_type = item_get_field_type(def, field->field_pat.id);
+                        ok = field_type != type_error()
+                              && annotate_pat(field->field_pat.pat, part_type(type, field_type), env, binds)
+                              && ok;
+                  }
+                  return ok;
+            }
+      }
+      return false;
+}
+
+// Whether two alternatives of an or-pattern bind the same names to the same
+// types.
+static bool same_binds(GHashTable* a, GHashTable* b) {
+      GHashTableIter i;
+      gpointer id, type;
+
+      if (g_hash_table_size(a) != g_hash_table_size(b)) return false;
+      g_hash_table_iter_init(&i, a);
+      while (g_hash_table_iter_next(&i, &id, &type))
+            if (g_hash_table_lookup(b, id) != type) return false;
+      return true;
+}
+
 static void annotate_exp(struct exp* exp, struct env* env) {
       assert(exp);
       switch (exp->kind) {
             case EXP_ID: {
-                  exp->type = type_copy(env_lookup(env, exp->id));
+                  exp->type = env_lookup(env, exp->id);
                   break;
             }
             case EXP_ENUM: {
-                  // TODO
+                  struct item* def = env_lookup_def(env, exp->lit_enum.eid);
+                  struct pair* ctor = item_get_ctor(def, exp->lit_enum.cid, NULL);
+                  GList* t = ctor? ctor->ctor_def.types : NULL;
+
+                  for (GList* a = exp->lit_enum.exps; a; a = a->next) {
+                        struct exp* arg = a->data;
+                        annotate_exp(arg, env);
+                        if (!t || !type_eq(t->data, arg->type))
+                              exp->type = type_error();
+                        if (t) t = t->next;
+                  }
+
+                  // Too few arguments, or no such constructor.
+                  if (!ctor || t) exp->type = type_error();
+                  else if (exp->type == type_invalid())
+                        exp->type = type_id(exp->lit_enum.eid);
                   break;
             }
             case EXP_STRUCT: {
@@ -173,7 +302,7 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                         struct exp* ele = i->data;
                         annotate_exp(ele, env);
                         if (ele_type == type_invalid()) {
-                              ele_type = type_copy(ele->type);
+                              ele_type = ele->type;
                         }
                         if (!type_eq(ele_type, ele->type)) {
                               ele_type = type_error();
@@ -190,8 +319,8 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                         struct item* def = env_lookup_def(env, type_get_id(exp->lookup.exp->type));
                         if (def) {
                               if (type_is_mut(exp->lookup.exp->type)) {
-                                    exp->type = type_mut(type_copy(item_get_field_type(def, exp->lookup.id)));
-                              } else exp->type = type_copy(item_get_field_type(def, exp->lookup.id));
+                                    exp->type = type_mut(item_get_field_type(def, exp->lookup.id));
+                              } else exp->type = item_get_field_type(def, exp->lookup.id);
                         } else exp->type = type_error();
                   } else exp->type = type_error();
                   break;
@@ -201,8 +330,8 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                   annotate_exp(exp->index.idx, env);
                   if (type_is_array(exp->index.exp->type) && type_is_i32(exp->index.idx->type)) {
                         if (type_is_mut(exp->index.exp->type)) {
-                              exp->type = type_mut(type_copy(type_get_elem(exp->index.exp->type)));
-                        } else exp->type = type_copy(type_get_elem(exp->index.exp->type));
+                              exp->type = type_mut(type_get_elem(exp->index.exp->type));
+                        } else exp->type = type_get_elem(exp->index.exp->type);
                   } else exp->type = type_error();
                   break;
             }
@@ -225,14 +354,48 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                   // If we haven't already set our type to error, then our type
                   // must be the function return type.
                   else if (exp->type == type_invalid())
-                        exp->type = type_copy(fn_type->type);
+                        exp->type = fn_type->type;
                   break;
             }
             case EXP_BOX_NEW: {
                   annotate_exp(exp->exp, env);
                   if (exp->exp->type == type_error())
                         exp->type = type_error();
-                  else exp->type = type_box(type_copy(exp->exp->type));
+                  else exp->type = type_box(exp->exp->type);
+                  break;
+            }
+            case EXP_MATCH: {
+                  annotate_exp(exp->match.exp, env);
+                  struct type* type = exp->match.exp->type;
+                  bool err = type == type_error() || !exp->match.arms;
+                  struct type* result = NULL;
+
+                  for (GList* p = exp->match.arms; p; p = p->next) {
+                        struct pair* arm = p->data;
+                        struct env* lenv = env_push(env);
+                        GHashTable* binds = NULL;
+
+                        for (GList* q = arm->match_arm.pats; q; q = q->next) {
+                              GHashTable* alt = g_hash_table_new(NULL, NULL);
+                              if (!annotate_pat(q->data, type, lenv, alt)) err = true;
+                              if (!binds) binds = alt;
+                              else {
+                                    if (!same_binds(binds, alt)) err = true;
+                                    g_hash_table_destroy(alt);
+                              }
+                        }
+                        if (binds) g_hash_table_destroy(binds);
+
+                        annotate_exp(arm->match_arm.block, lenv);
+                        env_pop(lenv);
+
+                        struct type* arm_type = arm->match_arm.block->type;
+                        if (arm_type == type_error()) err = true;
+                        else if (!result) result = arm_type;
+                        else if (!type_eq(result, arm_type)) err = true;
+                  }
+
+                  exp->type = err? type_error() : result;
                   break;
             }
             case EXP_IF: {
@@ -242,10 +405,10 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                         annotate_exp(exp->if_else.block_false, env);
                         if (type_is_bool(exp->if_else.cond->type)
                                     && type_eq(exp->if_else.block_true->type, exp->if_else.block_false->type)) {
-                              exp->type = type_copy(exp->if_else.block_true->type);
+                              exp->type = exp->if_else.block_true->type;
                         } else exp->type = type_error();
                   } else if (type_is_bool(exp->if_else.cond->type)) {
-                        exp->type = type_copy(exp->if_else.block_true->type);
+                        exp->type = exp->if_else.block_true->type;
                   } else exp->type = type_error();
                   break;
             }
@@ -266,7 +429,7 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                   break;
             }
             case EXP_BLOCK: {
-                  struct env* lenv = env_copy(env);
+                  struct env* lenv = env_push(env);
                   bool err = false;
                   for (GList* n = exp->block.stmts; n; n = n->next) {
                         struct stmt* stmt = n->data;
@@ -274,9 +437,9 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                         err = err || stmt->type == type_error();
                   }
                   annotate_exp(exp->block.exp, lenv);
-                  env_destroy(lenv);
+                  env_pop(lenv);
                   if (err) exp->type = type_error();
-                  else exp->type = type_copy(exp->block.exp->type);
+                  else exp->type = exp->block.exp->type;
                   break;
             }
             case EXP_BINARY: {
@@ -335,8 +498,8 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                   if (exp_is_addrof(exp)
                               && exp->unary.exp->type != type_error()) {
                         if (exp->unary.mut)
-                              exp->type = type_ref(type_mut(type_copy(exp->unary.exp->type)));
-                        else exp->type = type_ref(type_copy(exp->unary.exp->type));
+                              exp->type = type_ref(type_mut(exp->unary.exp->type));
+                        else exp->type = type_ref(exp->unary.exp->type);
                   }
 
                   if (exp_is_bool(exp)
@@ -348,7 +511,7 @@ static void annotate_exp(struct exp* exp, struct env* env) {
                   if (exp_is_arith(exp) && (
                                     type_is_ref(exp->unary.exp->type)
                                     || type_is_box(exp->unary.exp->type))) {
-                        exp->type = type_copy(type_get_elem(exp->unary.exp->type));
+                        exp->type = type_get_elem(exp->unary.exp->type);
                   }
                   if (exp_is_arith(exp) && type_is_i32(exp->unary.exp->type)) {
                     exp->type = type_i32();
@@ -369,7 +532,6 @@ static void annotate_stmt(struct stmt* stmt, struct env* env) {
                                     || stmt->let.exp->type == type_error()) {
                               stmt->type = type_error();
                         } else {
-                              // TODO (leak)
                               if (stmt->let.pat->bind.mut) {
                                 if (type_is_mut(stmt->let.exp->type)) {
                                   env_insert(env, stmt->let.pat->bind.id, stmt->let.exp->type);
@@ -380,7 +542,6 @@ static void annotate_stmt(struct stmt* stmt, struct env* env) {
                               stmt->type = type_unit();
                         }
                   } else if (stmt->let.type) {
-                        // TODO (leak)
                         if (stmt->let.pat->bind.mut) {
                               env_insert(env, stmt->let.pat->bind.id, type_mut(stmt->let.type));
                         } else env_insert(env, stmt->let.pat->bind.id, stmt->let.type);
@@ -414,17 +575,16 @@ static void annotate_item(struct item* item, struct env* env) {
 
       switch (item->kind) {
             case ITEM_FN_DEF: {
-                  struct env* lenv = env_copy(env);
+                  struct env* lenv = env_push(env);
                   env_insert(lenv, symbol_return(), item->fn_def.type->type);
                   for (GList* p = item->fn_def.type->params; p; p = p->next) {
                         struct pair* param = p->data;
-                         // TODO (leak)
                          if (param->param.pat->bind.mut) {
                                env_insert(lenv, param->param.pat->bind.id, type_mut(param->param.type));
                          } else env_insert(lenv, param->param.pat->bind.id, param->param.type);
                   }
                   annotate_exp(item->fn_def.block, lenv);
-                  env_destroy(lenv);
+                  env_pop(lenv);
 
                   if (type_eq(item->fn_def.block->type, item->fn_def.type->type)
                               || type_is_unit(item->fn_def.block->type)) {
@@ -442,18 +602,129 @@ static void annotate_item(struct item* item, struct env* env) {
       }
 }
 
+// Items are checked independently of each other: each one only reads the
+// global env (which is frozen once build_env() and check_main() are done) and
+// writes to its own local scopes and AST nodes. So they're spread over the
+// worker threads. Errors are only reported afterwards, from the item types, so
+// the output doesn't depend on the order the items finish in.
 static void annotate_crate(GList* crate, struct env* env) {
-      g_list_foreach(crate, (GFunc)annotate_item, env);
+      int n = g_list_length(crate);
+      void** items = malloc(n * sizeof(*items));
+      assert(items || !n);
+      int i = 0;
+      for (GList* p = crate; p; p = p->next) items[i++] = p->data;
+
+      parallel_for(items, n, (void (*)(void*, void*))annotate_item, env);
+      free(items);
 }
 
-int main(int argc, char** argv) {
-  struct type* type = type_ok();
-      if (!yyparse()) {
-            struct env* genv = build_env(crate);
+// Whether to generate code by way of MIR (--mir).
+static bool use_mir;
+// The largest fn that gets inlined (--inline=N).
+static int inline_threshold = INLINE_THRESHOLD;
+// Where to keep generated IR between runs (--cache=DIR), or NULL.
+static const char* cache_dir;
+// Whether to write the checked crate as an AST image (--emit-ast) rather than
+// IR, and whether the input is such an image rather than source (--load-ast).
+static bool emit_ast;
+static bool load_ast;
+// Whether to build the module with the LLVM C API (see mir_llvm.h) and write
+// it as bitcode (--emit-bc), or run it in-process (--run).
+static bool emit_bc;
+static bool run_jit;
+// What main returned, with --run.
+static int run_status;
+
+// The fns' cache entries, if there's a cache: keyed on, along with each fn,
+// the options that change what codegen makes of it.
+static GHashTable* open_cache(const GList* items) {
+      if (!cache_dir) return NULL;
+      char* passes = pass_pipeline();
+      char* config = g_strdup_printf("mir=%d ssa=%d passes=%s reorder-fields=%d",
+                  use_mir, llvm_ssa, use_mir? passes : "", mir_reorder_fields);
+      stats_begin(STATS_CACHE);
+      GHashTable* cache = cache_open(cache_dir, items, config);
+      stats_end(STATS_CACHE);
+      g_free(config);
+      g_free(passes);
+      return cache;
+}
 
-            check_main(genv);
-            annotate_crate(crate, genv);
-        
+static void close_cache(GHashTable* cache) {
+      if (!cache) return;
+      stats_begin(STATS_CACHE);
+      cache_close(cache);
+      stats_end(STATS_CACHE);
+}
+
+static void compile_mir(GList* items, const GPtrArray* strings, struct ir_writer* out) {
+      stats_begin(STATS_ESCAPE);
+      escape_crate(items);
+      stats_end(STATS_ESCAPE);
+
+      // After escape analysis, which decides where boxes go. The cache holds
+      // IR as text, which is no use to the LLVM C API backend.
+      GHashTable* cache = emit_bc || run_jit? NULL : open_cache(items);
+
+      stats_begin(STATS_LOWER);
+      struct mir_module* module = mir_lower_crate(items, strings, cache);
+      stats_end(STATS_LOWER);
+
+      stats_begin(STATS_OPTIMIZE);
+      pass_run(module);
+      stats_end(STATS_OPTIMIZE);
+
+      stats_begin(STATS_CODEGEN);
+      if (run_jit) run_status = mir_llvm_run(module);
+      else if (emit_bc) mir_llvm_bitcode(module, out);
+      else mir_emit_module(module, out);
+      stats_end(STATS_CODEGEN);
+
+      mir_module_free(module);
+      close_cache(cache);
+}
+
+// Parses and checks the program the lexer is currently reading into crate.
+// Returns whether it parsed.
+static bool check_crate(void) {
+      yylineno = 1;
+      stats_begin(STATS_PARSE);
+      int err = yyparse();
+      stats_end(STATS_PARSE);
+      if (err) return false;
+
+      stats_begin(STATS_BUILD_ENV);
+      struct env* genv = build_env(crate);
+      stats_end(STATS_BUILD_ENV);
+
+      stats_begin(STATS_CHECK_MAIN);
+      check_main(genv);
+      stats_end(STATS_CHECK_MAIN);
+
+      stats_begin(STATS_ANNOTATE);
+      annotate_crate(crate, genv);
+      stats_end(STATS_ANNOTATE);
+      return true;
+}
+
+// Loads the checked crate from an AST image instead.
+static bool load_crate(const void* image, size_t size, const char* name) {
+      stats_begin(STATS_LOAD);
+      crate = ast_image_load(image, size, name);
+      stats_end(STATS_LOAD);
+      return true;
+}
+
+// Compiles the program the lexer is currently reading or, with --load-ast, the
+// AST image (of size bytes, from name). Writes the IR (or with --emit-ast
+// the image) to out or, if the program doesn't type check, dumps the annotated
+// AST to stdout. Returns whether anything was written.
+static bool compile(struct ir_writer* out, const void* image, size_t size, const char* name) {
+      struct type* type = type_ok();
+
+      crate = NULL;
+      bool ok = false;
+      if (load_ast? load_crate(image, size, name) : check_crate()) {
             for (const GList* i = crate; i; i = i->next) {
               struct item* item = i->data;
               if (item->type != type_ok()) {
@@ -462,12 +733,242 @@ int main(int argc, char** argv) {
               }
             }
         
-            if (type != type_error())
-              llvm_crate(crate);     
-            else
+            if (emit_ast) {
+              ast_image_write(crate, out);
+              ok = true;
+            } else if (type != type_error()) {
+              stats_begin(STATS_FOLD);
+              fold_crate(crate);
+              stats_end(STATS_FOLD);
+
+              stats_begin(STATS_INLINE);
+              inline_crate(crate, inline_threshold);
+              stats_end(STATS_INLINE);
+
+              // From here on, only what main can reach.
+              stats_begin(STATS_REACH);
+              GList* live = reach_crate(crate);
+              stats_end(STATS_REACH);
+
+              stats_begin(STATS_RESOLVE);
+              GPtrArray* strings = resolve_crate(live);
+              stats_end(STATS_RESOLVE);
+
+              if (use_mir) compile_mir(live, strings, out);
+              else {
+                GHashTable* cache = open_cache(live);
+                stats_begin(STATS_CODEGEN);
+                llvm_crate(live, strings, cache, out);
+                stats_end(STATS_CODEGEN);
+                close_cache(cache);
+              }
+              g_ptr_array_free(strings, true);
+              ok = true;
+            } else
               crate_print(crate);
       }
 
+      // The arena keeps its first chunk, so the next file starts out with
+      // memory to allocate from.
+      stats_add_arena();
+      stats_begin(STATS_DESTROY);
       crate_destroy(crate);
+      stats_end(STATS_DESTROY);
+      return ok;
+}
+
+// Points the lexer at the file's contents, mapped rather than read. The flex
+// buffer must end with two NULs, and the rest of a mapping's last page is
+// zeros: so unless the file ends right at a page boundary, the mapping is
+// scanned in place. (It's mapped private and writable because flex pokes
+// NULs into its buffer.) Otherwise the contents get copied.
+static YY_BUFFER_STATE scan_file(const char* path, void** map, size_t* size) {
+      int fd = open(path, O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st)) {
+            printf("Error: can't read %s.\n", path);
+            exit(1);
+      }
+
+      *size = st.st_size;
+      *map = NULL;
+      if (*size) *map = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (*map == MAP_FAILED) {
+            printf("Error: can't read %s.\n", path);
+            exit(1);
+      }
+
+      long page = sysconf(_SC_PAGESIZE);
+      if (*size % page && page - *size % page >= 2)
+            return yy_scan_buffer(*map, *size + 2);
+      return yy_scan_bytes(*size? *map : "", *size);
+}
+
+// An AST image from fd, which is closed: mapped (read only, as it's never
+// written to) if it's a file, read in otherwise. Sets *map to whether it's
+// mapped; either way it's to be freed with free_image().
+static void* read_image(int fd, const char* name, size_t* size, bool* map) {
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st)) {
+            printf("Error: can't read %s.\n", name);
+            exit(1);
+      }
+
+      void* image = MAP_FAILED;
+      *map = S_ISREG(st.st_mode) && st.st_size;
+      if (*map) {
+            *size = st.st_size;
+            image = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+      }
+      if (image == MAP_FAILED) {
+            GByteArray* data = g_byte_array_new();
+            guint8 chunk[65536];
+            ssize_t n;
+            while ((n = read(fd, chunk, sizeof chunk)) > 0)
+                  g_byte_array_append(data, chunk, n);
+            if (n < 0) {
+                  printf("Error: can't read %s.\n", name);
+                  exit(1);
+            }
+            *map = false;
+            *size = data->len;
+            image = g_byte_array_free(data, false);
+      }
+      close(fd);
+      return image;
+}
+
+static void free_image(void* image, size_t size, bool map) {
+      if (map) munmap(image, size);
+      else g_free(image);
+}
+
+// outdir/name.ll (name.ast with --emit-ast, name.bc with --emit-bc) for the input path/name.rs (or
+// path/name.ast).
+static char* output_path(const char* outdir, const char* path) {
+      char* base = g_path_get_basename(path);
+      if (g_str_has_suffix(base, ".rs")) base[strlen(base) - strlen(".rs")] = 0;
+      else if (g_str_has_suffix(base, ".ast")) base[strlen(base) - strlen(".ast")] = 0;
+      char* name = g_strdup_printf(emit_ast? "%s.ast" : emit_bc? "%s.bc" : "%s.ll", base);
+      char* out = g_build_filename(outdir, name, NULL);
+      g_free(name);
+      g_free(base);
+      return out;
+}
+
+static void compile_file(const char* path, const char* outdir) {
+      void* map = NULL;
+      void* image = NULL;
+      size_t size;
+      bool mapped;
+      YY_BUFFER_STATE buf = NULL;
+      if (load_ast) image = read_image(open(path, O_RDONLY), path, &size, &mapped);
+      else buf = scan_file(path, &map, &size);
+
+      char* out_path = output_path(outdir, path);
+      struct ir_writer* out = ir_writer_file(out_path);
+      if (!out) {
+            printf("Error: can't write %s.\n", out_path);
+            exit(1);
+      }
+
+      bool ok = compile(out, image, size, path);
+
+      ir_writer_close(out);
+      if (!ok) unlink(out_path);
+      g_free(out_path);
+      if (image) free_image(image, size, mapped);
+      if (buf) yy_delete_buffer(buf);
+      if (map) munmap(map, size);
+}
+
+static void usage(const char* prog) {
+      printf("Usage: %s [-j N] [--ssa] [--mir] [--passes=LIST] [--reorder-fields] [--inline=N] [--cache=DIR] [--emit-ast] [--load-ast] [--emit-bc | --run] [--stats[=json]] < input.rs\n", prog);
+      printf("       %s [-j N] [--ssa] [--mir] [--passes=LIST] [--reorder-fields] [--inline=N] [--cache=DIR] [--emit-ast] [--load-ast] [--emit-bc] [--stats[=json]] -o outdir input.rs...\n", prog);
+      printf("Passes: simplify-cfg, mem2reg, tailcall, bounds, dce (default %s, or with --ssa %s).\n",
+                  PASS_DEFAULT, PASS_SSA);
+      printf("Inlining fns of up to %d nodes by default.\n", INLINE_THRESHOLD);
+      exit(1);
+}
+
+int main(int argc, char** argv) {
+      const char* outdir = NULL;
+      bool stats_json = false;
+      bool passes = false;
+      int i;
+
+      // -j N: number of worker threads for checking and codegen.
+      // -o outdir: compile each of the files that follow to outdir/*.ll.
+      // --ssa: keep scalars in registers instead of stack slots.
+      // --mir: generate code by way of MIR and its passes.
+      // --passes=LIST: the MIR passes to run, comma separated.
+      // --reorder-fields: with --mir, lay struct fields out for less padding.
+      // --inline=N: inline fns of up to N nodes (0: none).
+      // --cache=DIR: reuse the IR of fns that haven't changed since a run
+      // with the same DIR.
+      // --emit-ast: write the checked crate as an AST image (see ast_image.h),
+      // to outdir/*.ast, instead of IR.
+      // --load-ast: the input is an AST image rather than source.
+      // --emit-bc: write LLVM bitcode, built with the LLVM C API, instead of IR.
+      // --run: build the program the same way and run it, rather than write it.
+      // Both go by way of MIR, as --mir does.
+      // --stats, --stats=json: print phase times and counters to stderr.
+      for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+            if (!strcmp(argv[i], "-j") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+                  parallel_set_jobs(atoi(argv[++i]));
+            else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+                  outdir = argv[++i];
+            else if (!strcmp(argv[i], "--ssa"))
+                  llvm_ssa = true;
+            else if (!strcmp(argv[i], "--mir"))
+                  use_mir = true;
+            else if (!strncmp(argv[i], "--passes=", 9) && pass_set_pipeline(argv[i] + 9))
+                  passes = true;
+            else if (!strncmp(argv[i], "--inline=", 9) && isdigit((unsigned char)argv[i][9]))
+                  inline_threshold = atoi(argv[i] + 9);
+            else if (!strncmp(argv[i], "--cache=", 8) && argv[i][8])
+                  cache_dir = argv[i] + 8;
+            else if (!strcmp(argv[i], "--reorder-fields"))
+                  mir_reorder_fields = true;
+            else if (!strcmp(argv[i], "--emit-ast"))
+                  emit_ast = true;
+            else if (!strcmp(argv[i], "--load-ast"))
+                  load_ast = true;
+            else if (!strcmp(argv[i], "--emit-bc"))
+                  emit_bc = use_mir = true;
+            else if (!strcmp(argv[i], "--run"))
+                  run_jit = use_mir = true;
+            else if (!strcmp(argv[i], "--stats"))
+                  stats_enabled = true;
+            else if (!strcmp(argv[i], "--stats=json"))
+                  stats_enabled = stats_json = true;
+            else usage(argv[0]);
+      }
+
+      if (run_jit && (outdir || emit_bc || emit_ast)) usage(argv[0]);
+      if (llvm_ssa && !passes) pass_set_pipeline(PASS_SSA);
+      if (stats_enabled) pass_set_hook(stats_pass);
+
+      if (!outdir) {
+            if (i != argc) usage(argv[0]);
+            struct ir_writer* out = ir_writer_fd(STDOUT_FILENO);
+            if (load_ast) {
+                  size_t size;
+                  bool mapped;
+                  void* image = read_image(dup(STDIN_FILENO), "stdin", &size, &mapped);
+                  compile(out, image, size, "stdin");
+                  free_image(image, size, mapped);
+            } else compile(out, NULL, 0, NULL);
+            ir_writer_close(out);
+      } else {
+            if (i == argc) usage(argv[0]);
+            for (; i < argc; ++i)
+                  compile_file(argv[i], outdir);
+      }
+
+      if (stats_enabled) stats_print(stats_json);
+
       yylex_destroy();
+      return run_status;
 }
@@ -0,0 +1,306 @@
+#include <assert.h>
+#include <string.h>
+#include "inline.h"
+#include "ast.h"
+#include "stats.h"
+
+enum {
+      FN_NEW,
+      FN_VISITING,
+      FN_DONE,
+};
+
+struct fn {
+      struct item* item;
+      int state;
+      // Once done: whether calls to it get inlined.
+      bool inline_it;
+};
+
+struct inliner {
+      // Fn id -> struct fn.
+      GHashTable* fns;
+      int threshold;
+      int inlined;
+};
+
+static struct fn* fn_lookup(struct inliner* in, Symbol id) {
+      // NULL for printi(), prints().
+      return g_hash_table_lookup(in->fns, GINT_TO_POINTER(id.value));
+}
+
+// *** Walking ***
+
+struct walk {
+      // Called on every expression in the tree, children first.
+      void (*fn)(struct exp*, void*);
+      void* data;
+      // The statements on the way, and whether any was a return.
+      int stmts;
+      bool returns;
+};
+
+static void walk_exp(struct walk* w, struct exp* exp);
+
+static void walk_exps(struct walk* w, GList* exps) {
+      for (GList* p = exps; p; p = p->next)
+            walk_exp(w, p->data);
+}
+
+static void walk_stmt(struct walk* w, struct stmt* stmt) {
+      ++w->stmts;
+      switch (stmt->kind) {
+            case STMT_LET:
+                  walk_exp(w, stmt->let.exp);
+                  break;
+            case STMT_RETURN:
+                  w->returns = true;
+                  walk_exp(w, stmt->exp);
+                  break;
+            case STMT_EXP:
+                  walk_exp(w, stmt->exp);
+                  break;
+      }
+}
+
+static void walk_exp(struct walk* w, struct exp* exp) {
+      if (!exp) return;
+
+      switch (exp->kind) {
+            case EXP_ENUM:
+                  walk_exps(w, exp->lit_enum.exps);
+                  break;
+            case EXP_STRUCT:
+                  for (GList* p = exp->lit_struct.fields; p; p = p->next) {
+                        struct pair* field = p->data;
+                        walk_exp(w, field->field_init.exp);
+                  }
+                  break;
+            case EXP_LOOKUP:
+                  walk_exp(w, exp->lookup.exp);
+                  break;
+            case EXP_INDEX:
+                  walk_exp(w, exp->index.exp);
+                  walk_exp(w, exp->index.idx);
+                  break;
+            case EXP_FN_CALL:
+                  walk_exps(w, exp->fn_call.exps);
+                  break;
+            case EXP_ARRAY:
+                  walk_exps(w, exp->lit_array.exps);
+                  break;
+            case EXP_BOX_NEW:
+            case EXP_LOOP:
+                  walk_exp(w, exp->exp);
+                  break;
+            case EXP_MATCH:
+                  walk_exp(w, exp->match.exp);
+                  for (GList* p = exp->match.arms; p; p = p->next) {
+                        struct pair* arm = p->data;
+                        walk_exp(w, arm->match_arm.block);
+                  }
+                  break;
+            case EXP_IF:
+                  walk_exp(w, exp->if_else.cond);
+                  walk_exp(w, exp->if_else.block_true);
+                  walk_exp(w, exp->if_else.block_false);
+                  break;
+            case EXP_WHILE:
+                  walk_exp(w, exp->loop_while.cond);
+                  walk_exp(w, exp->loop_while.block);
+                  break;
+            case EXP_BLOCK:
+                  for (GList* p = exp->block.stmts; p; p = p->next)
+                        walk_stmt(w, p->data);
+                  walk_exp(w, exp->block.exp);
+                  break;
+            case EXP_UNARY:
+                  walk_exp(w, exp->unary.exp);
+                  break;
+            case EXP_BINARY:
+                  walk_exp(w, exp->binary.left);
+                  walk_exp(w, exp->binary.right);
+                  break;
+      }
+      w->fn(exp, w->data);
+}
+
+static void walk(struct exp* exp, void (*fn)(struct exp*, void*), void* data) {
+      struct walk w = {fn, data};
+      walk_exp(&w, exp);
+}
+
+// *** The cost model ***
+
+// A fn's size is the number of expression and statement nodes in its body.
+// One gets inlined if that's at most the threshold, and it's neither
+// recursive nor has a return statement (which would return from the caller).
+
+struct cost {
+      Symbol self;
+      int nodes;
+      bool recursive;
+};
+
+static void count_exp(struct exp* exp, void* data) {
+      struct cost* c = data;
+      ++c->nodes;
+      if (exp->kind == EXP_FN_CALL && exp->fn_call.id.value == c->self.value)
+            c->recursive = true;
+}
+
+static bool should_inline(const struct inliner* in, struct item* item) {
+      struct cost c = {item->id, 0, false};
+
+      for (GList* p = item->fn_def.type->params; p; p = p->next) {
+            struct pair* param = p->data;
+            if (param->param.pat->kind != PAT_BIND) return false;
+      }
+
+      struct walk w = {count_exp, &c};
+      walk_exp(&w, item->fn_def.block);
+      return !c.recursive && !w.returns && c.nodes + w.stmts <= in->threshold;
+}
+
+// *** Inlining ***
+
+struct mentions {
+      // Of Symbol values.
+      GHashTable* names;
+      bool found;
+};
+
+static void mentions_exp(struct exp* exp, void* data) {
+      struct mentions* m = data;
+      if (exp->kind == EXP_ID && g_hash_table_contains(m->names, GINT_TO_POINTER(exp->id.value)))
+            m->found = true;
+}
+
+// Whether binding the parameters to the arguments in turn would have an
+// argument see a parameter bound before it, instead of the caller's variable
+// of the same name.
+static bool needs_temps(const struct item* callee, GList* args) {
+      struct mentions m = {g_hash_table_new(NULL, NULL), false};
+      GList* a = args;
+      for (GList* p = callee->fn_def.type->params; p && !m.found; p = p->next, a = a->next) {
+            struct pair* param = p->data;
+            walk(a->data, mentions_exp, &m);
+            g_hash_table_add(m.names, GINT_TO_POINTER(param->param.pat->bind.id.value));
+      }
+      g_hash_table_destroy(m.names);
+      return m.found;
+}
+
+static Symbol temp_name(Symbol param) {
+      // Not something a program can name.
+      const char* name = symbol_to_str(param);
+      size_t len = strlen(name);
+      char* buf = g_malloc(len + sizeof ".arg");
+      memcpy(buf, name, len);
+      memcpy(buf + len, ".arg", sizeof ".arg");
+      Symbol s = symbol_var(symbol_intern(buf, len + sizeof ".arg" - 1));
+      g_free(buf);
+      return s;
+}
+
+// The call becomes the block, in place.
+static void inline_call(struct exp* call, const struct item* callee) {
+      GList* stmts = NULL;
+      GList* args = call->fn_call.exps;
+
+      if (needs_temps(callee, args)) {
+            GList* temps = NULL;
+            GList* a = args;
+            for (GList* p = callee->fn_def.type->params; p; p = p->next, a = a->next) {
+                  struct pair* param = p->data;
+                  struct exp* arg = a->data;
+                  Symbol temp = temp_name(param->param.pat->bind.id);
+                  stmts = ast_list_prepend(stmts, stmt_let(pat_id(false, false, temp), param->param.type, arg));
+                  struct exp* id = exp_id(temp);
+                  id->type = arg->type;
+                  temps = ast_list_prepend(temps, id);
+            }
+            args = ast_list_finish(temps);
+      }
+
+      GList* a = args;
+      for (GList* p = callee->fn_def.type->params; p; p = p->next, a = a->next) {
+            struct pair* param = p->data;
+            stmts = ast_list_prepend(stmts, stmt_let(pat_clone(param->param.pat), param->param.type, a->data));
+      }
+      for (GList* p = stmts; p; p = p->next)
+            ((struct stmt*)p->data)->type = type_unit();
+
+      struct exp* body = exp_clone(callee->fn_def.block);
+      // The block's type is the call's, which it already has.
+      call->kind = EXP_BLOCK;
+      call->block.stmts = ast_list_finish(stmts);
+      call->block.exp = body;
+}
+
+static void inline_exp(struct exp* exp, void* data) {
+      struct inliner* in = data;
+      if (exp->kind != EXP_FN_CALL) return;
+      struct fn* fn = fn_lookup(in, exp->fn_call.id);
+      if (!fn || fn->state != FN_DONE || !fn->inline_it) return;
+      inline_call(exp, fn->item);
+      ++in->inlined;
+}
+
+struct visit {
+      struct inliner* in;
+      GPtrArray* stack;
+};
+
+static void push_callee(struct exp* exp, void* data) {
+      struct visit* v = data;
+      if (exp->kind != EXP_FN_CALL) return;
+      struct fn* fn = fn_lookup(v->in, exp->fn_call.id);
+      // A call back into a fn that's being visited closes a cycle.
+      if (fn && fn->state == FN_NEW) g_ptr_array_add(v->stack, GINT_TO_POINTER(exp->fn_call.id.value));
+}
+
+int inline_crate(GList* items, int threshold) {
+      if (threshold <= 0) return 0;
+      struct inliner in = {g_hash_table_new_full(NULL, NULL, NULL, g_free), threshold, 0};
+
+      for (GList* i = items; i; i = i->next) {
+            struct item* item = i->data;
+            if (item->kind != ITEM_FN_DEF) continue;
+            struct fn* fn = g_new0(struct fn, 1);
+            fn->item = item;
+            g_hash_table_insert(in.fns, GINT_TO_POINTER(item->id.value), fn);
+      }
+
+      // A depth first walk of the call graph, callees first: a fn stays on
+      // the stack under its callees, and is done when it's back on top. A
+      // fn in a cycle is done before the one that closes it, which then
+      // can't inline the call back.
+      struct visit v = {&in, g_ptr_array_new()};
+      GPtrArray* stack = v.stack;
+      for (GList* i = items; i; i = i->next) {
+            struct item* item = i->data;
+            if (item->kind != ITEM_FN_DEF) continue;
+            g_ptr_array_add(stack, GINT_TO_POINTER(item->id.value));
+            while (stack->len) {
+                  gpointer id = g_ptr_array_index(stack, stack->len - 1);
+                  struct fn* fn = g_hash_table_lookup(in.fns, id);
+                  if (!fn || fn->state == FN_DONE) {
+                        g_ptr_array_set_size(stack, stack->len - 1);
+                  } else if (fn->state == FN_NEW) {
+                        fn->state = FN_VISITING;
+                        walk(fn->item->fn_def.block, push_callee, &v);
+                  } else {
+                        g_ptr_array_set_size(stack, stack->len - 1);
+                        walk(fn->item->fn_def.block, inline_exp, &in);
+                        fn->inline_it = should_inline(&in, fn->item);
+                        fn->state = FN_DONE;
+                  }
+            }
+      }
+      g_ptr_array_free(stack, true);
+      g_hash_table_destroy(in.fns);
+
+      if (stats_enabled) stats_add(STATS_INLINED, in.inlined);
+      return in.inlined;
+}
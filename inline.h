@@ -0,0 +1,28 @@
+#ifndef RUSTC_INLINE_H_
+#define RUSTC_INLINE_H_
+
+#include <glib.h>
+
+// *** Inlining ***
+
+// The largest fn body, counted in expression and statement nodes, that
+// inline_crate() copies into its callers by default.
+#define INLINE_THRESHOLD 16
+
+// Rewrites the (type checked) crate in place, replacing each call to a small
+// enough fn with a block that binds the arguments to the parameters with lets
+// and then runs a copy of the fn's body:
+//
+//   f(a, b)   becomes   { let x: T = a; let y: U = b; <body of f> }
+//
+// (with the arguments going through fresh variables first where that's what
+// keeps b from seeing the new x). Callees are done before their callers, so
+// a fn that becomes small by having its own calls inlined can be inlined in
+// turn. A fn is left alone if it's recursive, has a return statement (which
+// would return from the caller) or a parameter that's not a plain variable.
+// Runs before resolve_crate(), which gives the copies' bindings names of
+// their own. A threshold of 0 turns it off. Returns the number of calls
+// inlined.
+int inline_crate(GList* items, int threshold);
+
+#endif
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ir_writer.h"
+
+// Buffered output is handed to the fd once it grows past this.
+#define FLUSH_SIZE (256 * 1024)
+
+static struct ir_writer* writer(int fd, size_t cap) {
+      struct ir_writer* w = calloc(1, sizeof(*w));
+      assert(w);
+      w->fd = fd;
+      w->cap = cap;
+      w->buf = malloc(cap);
+      assert(w->buf);
+      return w;
+}
+
+struct ir_writer* ir_writer_fd(int fd) {
+      assert(fd >= 0);
+      return writer(fd, FLUSH_SIZE + 4096);
+}
+
+struct ir_writer* ir_writer_file(const char* path) {
+      int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0) return NULL;
+      struct ir_writer* w = ir_writer_fd(fd);
+      w->close_fd = true;
+      return w;
+}
+
+struct ir_writer* ir_writer_mem(void) {
+      return writer(-1, 4096);
+}
+
+struct ir_writer* ir_writer_pipe(const char* cmd) {
+      FILE* p = popen(cmd, "w");
+      if (!p) return NULL;
+      struct ir_writer* w = ir_writer_fd(fileno(p));
+      w->pipe = p;
+      return w;
+}
+
+static void write_all(struct ir_writer* w) {
+      const char* p = w->buf;
+      size_t left = w->len;
+      while (left && !w->failed) {
+            ssize_t n = write(w->fd, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) w->failed = true;
+            else {
+                  p += n;
+                  left -= n;
+            }
+      }
+      w->len = 0;
+}
+
+void ir_flush(struct ir_writer* w) {
+      assert(w);
+      if (w->fd >= 0 && w->len) write_all(w);
+}
+
+// Makes room for at least n more bytes.
+static void reserve(struct ir_writer* w, size_t n) {
+      if (w->len + n <= w->cap) return;
+      if (w->fd >= 0) {
+            write_all(w);
+            if (n <= w->cap) return;
+      }
+      while (w->len + n > w->cap) w->cap *= 2;
+      w->buf = realloc(w->buf, w->cap);
+      assert(w->buf);
+}
+
+void ir_putn(struct ir_writer* w, const char* str, size_t len) {
+      reserve(w, len);
+      memcpy(w->buf + w->len, str, len);
+      w->len += len;
+      if (w->fd >= 0 && w->len >= FLUSH_SIZE) write_all(w);
+}
+
+void ir_puts(struct ir_writer* w, const char* str) {
+      ir_putn(w, str, strlen(str));
+}
+
+void ir_putc(struct ir_writer* w, char c) {
+      reserve(w, 1);
+      w->buf[w->len++] = c;
+}
+
+void ir_uint(struct ir_writer* w, unsigned n) {
+      char tmp[16];
+      char* p = tmp + sizeof(tmp);
+      do {
+            *--p = '0' + n % 10;
+            n /= 10;
+      } while (n);
+      ir_putn(w, p, tmp + sizeof(tmp) - p);
+}
+
+void ir_int(struct ir_writer* w, int n) {
+      if (n < 0) {
+            ir_putc(w, '-');
+            ir_uint(w, -(unsigned)n);
+      } else ir_uint(w, n);
+}
+
+void ir_reg(struct ir_writer* w, int n) {
+      ir_lit(w, "%r");
+      ir_int(w, n);
+}
+
+void ir_string(struct ir_writer* w, int n, const char* str) {
+      static const char hex[] = "0123456789ABCDEF";
+      ir_lit(w, "@.str");
+      ir_int(w, n);
+      ir_lit(w, " = private unnamed_addr constant [");
+      ir_uint(w, strlen(str) + 1);
+      ir_lit(w, " x i8] c\"");
+      for (const unsigned char* c = (const unsigned char*)str; *c; ++c) {
+            if (*c >= ' ' && *c <= '~' && *c != '"' && *c != '\\') ir_putc(w, *c);
+            else {
+                  ir_putc(w, '\\');
+                  ir_putc(w, hex[*c >> 4]);
+                  ir_putc(w, hex[*c & 15]);
+            }
+      }
+      ir_lit(w, "\\00\", align 1\n");
+}
+
+void ir_append(struct ir_writer* w, const struct ir_writer* src) {
+      assert(src && src->fd < 0);
+      ir_putn(w, src->buf, src->len);
+}
+
+const char* ir_writer_data(const struct ir_writer* w, size_t* len) {
+      assert(w && w->fd < 0);
+      if (len) *len = w->len;
+      return w->buf;
+}
+
+int ir_writer_close(struct ir_writer* w) {
+      if (!w) return 0;
+
+      ir_flush(w);
+      int status = w->failed? -1 : 0;
+      if (w->pipe) {
+            int rc = pclose(w->pipe);
+            if (!status) status = rc;
+      } else if (w->close_fd && close(w->fd)) status = -1;
+
+      free(w->buf);
+      free(w);
+      return status;
+}
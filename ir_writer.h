@@ -0,0 +1,58 @@
+#ifndef RUSTC_IR_WRITER_H_
+#define RUSTC_IR_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// *** IR output sinks ***
+
+// Generated IR is accumulated in a growable buffer and handed to the sink in
+// large writes. A writer either targets a file descriptor (stdout, a file, or
+// a pipe into another process) or just keeps everything in memory.
+
+struct ir_writer {
+      char* buf;
+      size_t len;
+      size_t cap;
+      int fd;           // -1 for in-memory writers.
+      bool close_fd;    // Close fd when the writer is closed.
+      void* pipe;       // FILE* from popen(), for pipe writers.
+      bool failed;      // A write to the sink failed.
+};
+
+// Constructors.
+struct ir_writer* ir_writer_fd(int fd);
+struct ir_writer* ir_writer_file(const char* path);
+struct ir_writer* ir_writer_mem(void);
+// Runs the command (through the shell) with the IR on its stdin, e.g.
+// "clang -x ir -o a.out -".
+struct ir_writer* ir_writer_pipe(const char* cmd);
+
+void ir_putn(struct ir_writer*, const char* str, size_t len);
+void ir_puts(struct ir_writer*, const char* str);
+void ir_putc(struct ir_writer*, char c);
+void ir_int(struct ir_writer*, int n);
+void ir_uint(struct ir_writer*, unsigned n);
+// Virtual register number n, i.e., "%r<n>".
+void ir_reg(struct ir_writer*, int n);
+// The definition of constant @.str<n> holding the string (and a NUL), with
+// anything but printable ASCII escaped.
+void ir_string(struct ir_writer*, int n, const char* str);
+
+// For string literals, saves the strlen().
+#define ir_lit(w, lit) ir_putn((w), (lit), sizeof(lit) - 1)
+
+// Appends everything accumulated in the in-memory writer src.
+void ir_append(struct ir_writer*, const struct ir_writer* src);
+
+// Sends buffered output to the sink. Does nothing for in-memory writers.
+void ir_flush(struct ir_writer*);
+
+// Contents of an in-memory writer (not NUL-terminated).
+const char* ir_writer_data(const struct ir_writer*, size_t* len);
+
+// Flushes and frees the writer. Returns 0 on success, -1 if writing failed or
+// (for pipes) the exit status of the command otherwise.
+int ir_writer_close(struct ir_writer*);
+
+#endif
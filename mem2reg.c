@@ -0,0 +1,330 @@
+#include "mem2reg.h"
+
+// The per-function state. Blocks are referred to by their reverse postorder
+// number, which is also what their mark is set to (-1 if unreachable).
+struct promote {
+      struct mir_fn* fn;
+      // Of struct mir_block*, in reverse postorder.
+      GPtrArray* order;
+      int* idom;
+      // Block -> GArray of int: its dominance frontier.
+      GArray** df;
+      // Register -> the slot it's the address of, or -1.
+      int* slot_of;
+      // Slot -> the alloca's register.
+      GArray* slots;
+      // Block -> GArray of int: the slot of each phi this pass has put at
+      // the start of the block, in order.
+      GArray** phis;
+      // Register -> what a promoted load's result turned into (MIR_NONE if
+      // it's not one).
+      struct mir_value* repl;
+};
+
+static int index_of(const struct mir_block* b) {
+      return b->mark;
+}
+
+static void compute_dominators(struct promote* p) {
+      int n = p->order->len;
+
+      p->idom = mir_dominators(p->order);
+      p->df = g_new(GArray*, n);
+      for (int i = 0; i != n; ++i)
+            p->df[i] = g_array_new(false, false, sizeof(int));
+      for (int i = 0; i != n; ++i) {
+            struct mir_block* b = g_ptr_array_index(p->order, i);
+            if (b->preds->len < 2) continue;
+            for (guint j = 0; j != b->preds->len; ++j) {
+                  int runner = index_of(g_ptr_array_index(b->preds, j));
+                  if (runner < 0) continue;
+                  while (runner != p->idom[i]) {
+                        GArray* df = p->df[runner];
+                        if (!df->len || g_array_index(df, int, df->len - 1) != i)
+                              g_array_append_val(df, i);
+                        runner = p->idom[runner];
+                  }
+            }
+      }
+}
+
+static void disqualify(struct mir_value* v, void* data) {
+      struct promote* p = data;
+      if (v->kind == MIR_REG) p->slot_of[v->n] = -1;
+}
+
+// Which allocas can go: those whose register only ever shows up as the
+// address of a load or a store.
+static void find_slots(struct promote* p) {
+      struct mir_fn* fn = p->fn;
+
+      p->slot_of = g_new(int, fn->regs->len);
+      for (guint i = 0; i != fn->regs->len; ++i) p->slot_of[i] = -1;
+
+      for (guint i = 0; i != p->order->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(p->order, i);
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  if (inst->kind == MIR_ALLOCA) p->slot_of[inst->dst] = 0;
+            }
+      }
+
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  // Renaming never gets to unreachable blocks, so whatever
+                  // they use has to stay.
+                  switch (b->mark < 0? MIR_INVALID : inst->kind) {
+                        case MIR_LOAD:
+                              break;
+                        case MIR_STORE:
+                              disqualify(&inst->b, p);
+                              break;
+                        default:
+                              mir_inst_operands(inst, disqualify, p);
+                  }
+            }
+            disqualify(&b->term.value, p);
+      }
+
+      p->slots = g_array_new(false, false, sizeof(int));
+      for (guint i = 0; i != fn->regs->len; ++i) {
+            if (p->slot_of[i] < 0) continue;
+            p->slot_of[i] = p->slots->len;
+            g_array_append_val(p->slots, i);
+      }
+}
+
+static int slot_at(const struct promote* p, const struct mir_value* addr) {
+      return addr->kind == MIR_REG? p->slot_of[addr->n] : -1;
+}
+
+static struct type* slot_type(const struct promote* p, int slot) {
+      return mir_reg_info(p->fn, g_array_index(p->slots, int, slot))->type->type;
+}
+
+static void place_phis(struct promote* p) {
+      int n = p->order->len;
+      int nslots = p->slots->len;
+      // Block -> the last slot it got a phi for, or was queued for.
+      int* has_phi = g_new(int, n);
+      int* queued = g_new(int, n);
+      GArray* work = g_array_new(false, false, sizeof(int));
+      // Slot -> GArray of int, the blocks that store to it.
+      GArray** stores = g_new(GArray*, nslots);
+
+      for (int slot = 0; slot != nslots; ++slot)
+            stores[slot] = g_array_new(false, false, sizeof(int));
+      p->phis = g_new(GArray*, n);
+      for (int i = 0; i != n; ++i) {
+            struct mir_block* b = g_ptr_array_index(p->order, i);
+            has_phi[i] = queued[i] = -1;
+            p->phis[i] = g_array_new(false, false, sizeof(int));
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  int slot = inst->kind == MIR_STORE? slot_at(p, &inst->a) : -1;
+                  if (slot < 0) continue;
+                  GArray* blocks = stores[slot];
+                  if (!blocks->len || g_array_index(blocks, int, blocks->len - 1) != i)
+                        g_array_append_val(blocks, i);
+            }
+      }
+
+      for (int slot = 0; slot != nslots; ++slot) {
+            for (guint j = 0; j != stores[slot]->len; ++j) {
+                  int i = g_array_index(stores[slot], int, j);
+                  queued[i] = slot;
+                  g_array_append_val(work, i);
+            }
+            g_array_free(stores[slot], true);
+            while (work->len) {
+                  int b = g_array_index(work, int, work->len - 1);
+                  g_array_set_size(work, work->len - 1);
+                  for (guint j = 0; j != p->df[b]->len; ++j) {
+                        int d = g_array_index(p->df[b], int, j);
+                        if (has_phi[d] == slot) continue;
+                        has_phi[d] = slot;
+                        g_array_append_val(p->phis[d], slot);
+                        if (queued[d] == slot) continue;
+                        queued[d] = slot;
+                        g_array_append_val(work, d);
+                  }
+            }
+      }
+
+      // The phis' arguments are filled in while renaming.
+      for (int i = 0; i != n; ++i) {
+            struct mir_block* b = g_ptr_array_index(p->order, i);
+            GArray* slots = p->phis[i];
+            struct mir_inst* phis = g_new0(struct mir_inst, slots->len);
+            for (guint j = 0; j != slots->len; ++j) {
+                  struct type* type = slot_type(p, g_array_index(slots, int, j));
+                  phis[j].kind = MIR_PHI;
+                  phis[j].dst = mir_reg(p->fn, type, NULL).n;
+                  phis[j].args = g_array_new(false, false, sizeof(struct mir_value));
+                  phis[j].preds = g_ptr_array_new();
+                  for (guint k = 0; k != b->preds->len; ++k) {
+                        struct mir_block* pred = g_ptr_array_index(b->preds, k);
+                        struct mir_value undef = mir_undef(type);
+                        if (index_of(pred) < 0) continue;
+                        g_ptr_array_add(phis[j].preds, pred);
+                        g_array_append_val(phis[j].args, undef);
+                  }
+            }
+            g_array_prepend_vals(b->insts, phis, slots->len);
+            g_free(phis);
+      }
+
+      g_array_free(work, true);
+      g_free(stores);
+      g_free(queued);
+      g_free(has_phi);
+}
+
+struct undo {
+      int slot;
+      struct mir_value value;
+};
+
+static void set_value(struct mir_value* cur, GArray* log, int slot, struct mir_value value) {
+      struct undo u = {slot, cur[slot]};
+      g_array_append_val(log, u);
+      cur[slot] = value;
+}
+
+// Walks the dominator tree, keeping track of the value each slot holds on the
+// way, to replace its loads and fill in the phis.
+static void rename(struct promote* p) {
+      int n = p->order->len;
+      int nslots = p->slots->len;
+      struct mir_value* cur = g_new(struct mir_value, nslots);
+      GArray* log = g_array_new(false, false, sizeof(struct undo));
+      // Block -> its first child in the dominator tree, and the next sibling.
+      int* child = g_new(int, n);
+      int* sibling = g_new(int, n);
+      // The DFS stack holds blocks, each pushed twice: the second time (as
+      // ~block) it's left, with the log length to go back to.
+      GArray* stack = g_array_new(false, false, sizeof(int));
+
+      for (int i = 0; i != n; ++i) child[i] = sibling[i] = -1;
+      for (int i = n; --i > 0;) {
+            sibling[i] = child[p->idom[i]];
+            child[p->idom[i]] = i;
+      }
+      for (int i = 0; i != nslots; ++i) cur[i] = mir_undef(slot_type(p, i));
+
+      int entry = 0;
+      g_array_append_val(stack, entry);
+      while (stack->len) {
+            int i = g_array_index(stack, int, stack->len - 1);
+            g_array_set_size(stack, stack->len - 1);
+            if (i < 0) {
+                  guint mark = g_array_index(stack, int, stack->len - 1);
+                  g_array_set_size(stack, stack->len - 1);
+                  while (log->len != mark) {
+                        struct undo* u = &g_array_index(log, struct undo, log->len - 1);
+                        cur[u->slot] = u->value;
+                        g_array_set_size(log, log->len - 1);
+                  }
+                  continue;
+            }
+
+            struct mir_block* b = g_ptr_array_index(p->order, i);
+            int mark = log->len, leave = ~i;
+            g_array_append_val(stack, mark);
+            g_array_append_val(stack, leave);
+
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  int slot;
+                  if (j < p->phis[i]->len) {
+                        struct mir_value v = {MIR_REG, mir_reg_info(p->fn, inst->dst)->type, inst->dst};
+                        set_value(cur, log, g_array_index(p->phis[i], int, j), v);
+                        continue;
+                  }
+                  switch (inst->kind) {
+                        case MIR_ALLOCA:
+                              if (p->slot_of[inst->dst] >= 0) inst->kind = MIR_INVALID;
+                              break;
+                        case MIR_LOAD:
+                              if ((slot = slot_at(p, &inst->a)) < 0) break;
+                              p->repl[inst->dst] = cur[slot];
+                              inst->kind = MIR_INVALID;
+                              break;
+                        case MIR_STORE:
+                              if ((slot = slot_at(p, &inst->a)) < 0) break;
+                              set_value(cur, log, slot, inst->b);
+                              inst->kind = MIR_INVALID;
+                              break;
+                  }
+            }
+
+            for (int s = 0; s != mir_term_nsuccs(&b->term); ++s) {
+                  struct mir_block* succ = *mir_term_succ(&b->term, s);
+                  int si = index_of(succ);
+                  for (guint j = 0; j != p->phis[si]->len; ++j) {
+                        struct mir_inst* phi = &g_array_index(succ->insts, struct mir_inst, j);
+                        for (guint k = 0; k != phi->preds->len; ++k) {
+                              if (g_ptr_array_index(phi->preds, k) != b) continue;
+                              g_array_index(phi->args, struct mir_value, k) =
+                                    cur[g_array_index(p->phis[si], int, j)];
+                        }
+                  }
+            }
+
+            for (int c = child[i]; c >= 0; c = sibling[c])
+                  g_array_append_val(stack, c);
+      }
+
+      g_array_free(stack, true);
+      g_free(sibling);
+      g_free(child);
+      g_array_free(log, true);
+      g_free(cur);
+}
+
+// A load's replacement may be another load's result: follow the chain, which
+// ends since each value was defined before the load it replaces.
+static void substitute(struct mir_value* v, void* data) {
+      const struct promote* p = data;
+      while (v->kind == MIR_REG && p->repl[v->n].kind != MIR_NONE)
+            *v = p->repl[v->n];
+}
+
+void mem2reg(struct mir_fn* fn) {
+      struct promote p = {fn};
+
+      mir_compute_preds(fn);
+      p.order = mir_number_blocks(fn);
+      find_slots(&p);
+
+      if (p.slots->len) {
+            compute_dominators(&p);
+            place_phis(&p);
+            p.repl = g_new(struct mir_value, fn->regs->len);
+            for (guint i = 0; i != fn->regs->len; ++i) p.repl[i] = mir_none();
+            rename(&p);
+
+            for (guint i = 0; i != fn->blocks->len; ++i) {
+                  struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+                  mir_block_sweep(b);
+                  for (guint j = 0; j != b->insts->len; ++j)
+                        mir_inst_operands(&g_array_index(b->insts, struct mir_inst, j), substitute, &p);
+                  substitute(&b->term.value, &p);
+            }
+
+            for (guint i = 0; i != p.order->len; ++i) {
+                  g_array_free(p.df[i], true);
+                  g_array_free(p.phis[i], true);
+            }
+            g_free(p.df);
+            g_free(p.phis);
+            g_free(p.idom);
+            g_free(p.repl);
+      }
+
+      g_array_free(p.slots, true);
+      g_free(p.slot_of);
+      g_ptr_array_free(p.order, true);
+}
@@ -0,0 +1,15 @@
+#ifndef RUSTC_MEM2REG_H_
+#define RUSTC_MEM2REG_H_
+
+#include "mir.h"
+
+// *** Promoting stack slots to registers ***
+
+// Every MIR_ALLOCA whose address is only ever loaded from and stored to (never
+// passed on, offset or stored itself) goes, along with its loads and stores:
+// loads get the value last stored on the way in, with phis placed on the
+// slot's iterated dominance frontier where different stores meet. A load that
+// no store reaches gets undef.
+void mem2reg(struct mir_fn* fn);
+
+#endif
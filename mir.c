@@ -0,0 +1,272 @@
+#include <assert.h>
+#include "mir.h"
+
+struct mir_module* mir_module_new(void) {
+      struct mir_module* m = g_new0(struct mir_module, 1);
+      m->fns = g_ptr_array_new_with_free_func((GDestroyNotify)mir_fn_free);
+      m->structs = g_ptr_array_new();
+      m->struct_defs = g_hash_table_new(NULL, NULL);
+      m->enums = g_ptr_array_new();
+      m->enum_defs = g_hash_table_new(NULL, NULL);
+      return m;
+}
+
+void mir_module_free(struct mir_module* m) {
+      if (!m) return;
+      g_ptr_array_free(m->fns, true);
+      g_ptr_array_free(m->structs, true);
+      g_hash_table_destroy(m->struct_defs);
+      g_ptr_array_free(m->enums, true);
+      g_hash_table_destroy(m->enum_defs);
+      g_free(m);
+}
+
+struct mir_fn* mir_fn_new(Symbol id, struct type* ret) {
+      struct mir_fn* fn = g_new0(struct mir_fn, 1);
+      fn->id = id;
+      fn->ret = ret;
+      fn->params = g_array_new(false, false, sizeof(struct mir_value));
+      fn->regs = g_array_new(false, false, sizeof(struct mir_reg));
+      fn->blocks = g_ptr_array_new();
+      fn->strings = g_ptr_array_new_with_free_func(g_free);
+      return fn;
+}
+
+const char* mir_fn_keep(struct mir_fn* fn, char* str) {
+      g_ptr_array_add(fn->strings, str);
+      return str;
+}
+
+void mir_inst_free(struct mir_inst* inst) {
+      if (inst->args) g_array_free(inst->args, true);
+      if (inst->preds) g_ptr_array_free(inst->preds, true);
+      inst->args = NULL;
+      inst->preds = NULL;
+}
+
+static void block_free(struct mir_block* b) {
+      for (guint i = 0; i != b->insts->len; ++i)
+            mir_inst_free(&g_array_index(b->insts, struct mir_inst, i));
+      g_array_free(b->insts, true);
+      mir_term_free(&b->term);
+      if (b->preds) g_ptr_array_free(b->preds, true);
+      g_free(b);
+}
+
+void mir_fn_free(struct mir_fn* fn) {
+      for (guint i = 0; i != fn->blocks->len; ++i)
+            block_free(g_ptr_array_index(fn->blocks, i));
+      g_ptr_array_free(fn->blocks, true);
+      g_array_free(fn->params, true);
+      g_array_free(fn->regs, true);
+      g_ptr_array_free(fn->strings, true);
+      g_free(fn);
+}
+
+struct mir_block* mir_block_new(struct mir_fn* fn, const char* name) {
+      struct mir_block* b = g_new0(struct mir_block, 1);
+      b->id = fn->next_block++;
+      b->name = name;
+      b->insts = g_array_new(false, false, sizeof(struct mir_inst));
+      g_ptr_array_add(fn->blocks, b);
+      return b;
+}
+
+struct mir_value mir_none(void) {
+      struct mir_value v = {MIR_NONE};
+      return v;
+}
+
+struct mir_value mir_const(struct type* type, int n) {
+      struct mir_value v = {MIR_CONST, type, n};
+      return v;
+}
+
+struct mir_value mir_undef(struct type* type) {
+      struct mir_value v = {MIR_UNDEF, type};
+      return v;
+}
+
+struct mir_value mir_reg(struct mir_fn* fn, struct type* type, const char* name) {
+      struct mir_reg r = {type, name};
+      struct mir_value v = {MIR_REG, type, fn->regs->len};
+      g_array_append_val(fn->regs, r);
+      return v;
+}
+
+void mir_add(struct mir_block* b, const struct mir_inst* inst) {
+      assert(b->term.kind == MIR_TERM_NONE);
+      g_array_append_val(b->insts, *inst);
+}
+
+void mir_block_sweep(struct mir_block* b) {
+      guint n = 0;
+      for (guint i = 0; i != b->insts->len; ++i) {
+            struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, i);
+            if (inst->kind == MIR_INVALID) mir_inst_free(inst);
+            else g_array_index(b->insts, struct mir_inst, n++) = *inst;
+      }
+      g_array_set_size(b->insts, n);
+}
+
+struct mir_reg* mir_reg_info(const struct mir_fn* fn, int reg) {
+      assert(reg >= 0 && (guint)reg < fn->regs->len);
+      return &g_array_index(fn->regs, struct mir_reg, reg);
+}
+
+bool mir_inst_is_pure(const struct mir_inst* inst) {
+      switch (inst->kind) {
+            case MIR_STORE:
+            case MIR_CALL:
+            case MIR_SET_TAG:
+            case MIR_BOUNDS:
+                  return false;
+      }
+      return true;
+}
+
+void mir_inst_operands(struct mir_inst* inst, void (*fn)(struct mir_value*, void*), void* data) {
+      fn(&inst->a, data);
+      fn(&inst->b, data);
+      if (inst->args)
+            for (guint i = 0; i != inst->args->len; ++i)
+                  fn(&g_array_index(inst->args, struct mir_value, i), data);
+}
+
+int mir_term_nsuccs(const struct mir_term* term) {
+      switch (term->kind) {
+            case MIR_JUMP:
+                  return 1;
+            case MIR_BRANCH:
+                  return 2;
+            case MIR_SWITCH:
+                  return 1 + term->cases->len;
+      }
+      return 0;
+}
+
+struct mir_block** mir_term_succ(struct mir_term* term, int i) {
+      assert(i >= 0 && i < mir_term_nsuccs(term));
+      if (term->kind == MIR_SWITCH && i)
+            return &g_array_index(term->cases, struct mir_case, i - 1).to;
+      return &term->to[i];
+}
+
+void mir_term_switch(struct mir_term* term, struct mir_value value, struct mir_block* other) {
+      term->kind = MIR_SWITCH;
+      term->value = value;
+      term->to[0] = other;
+      term->to[1] = NULL;
+      term->cases = g_array_new(false, false, sizeof(struct mir_case));
+}
+
+void mir_term_add_case(struct mir_term* term, int n, struct mir_block* to) {
+      struct mir_case c = {n, to};
+      assert(term->kind == MIR_SWITCH);
+      g_array_append_val(term->cases, c);
+}
+
+void mir_term_free(struct mir_term* term) {
+      if (term->cases) g_array_free(term->cases, true);
+      term->cases = NULL;
+}
+
+void mir_compute_preds(struct mir_fn* fn) {
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            if (b->preds) g_ptr_array_set_size(b->preds, 0);
+            else b->preds = g_ptr_array_new();
+      }
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (int s = 0; s != mir_term_nsuccs(&b->term); ++s)
+                  g_ptr_array_add((*mir_term_succ(&b->term, s))->preds, b);
+      }
+}
+
+void mir_drop_blocks(struct mir_fn* fn) {
+      guint n = 0;
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            if (b->dead) block_free(b);
+            else g_ptr_array_index(fn->blocks, n++) = b;
+      }
+      g_ptr_array_set_size(fn->blocks, n);
+}
+
+GPtrArray* mir_number_blocks(struct mir_fn* fn) {
+      GPtrArray* post = g_ptr_array_new();
+      GArray* stack = g_array_new(false, false, sizeof(int));
+      // The DFS stack holds (block, next successor to look at) pairs.
+      GPtrArray* blocks = g_ptr_array_new();
+
+      for (guint i = 0; i != fn->blocks->len; ++i)
+            ((struct mir_block*)g_ptr_array_index(fn->blocks, i))->mark = -1;
+
+      struct mir_block* entry = g_ptr_array_index(fn->blocks, 0);
+      int zero = 0;
+      entry->mark = 0;
+      g_ptr_array_add(blocks, entry);
+      g_array_append_val(stack, zero);
+      while (blocks->len) {
+            struct mir_block* b = g_ptr_array_index(blocks, blocks->len - 1);
+            int* next = &g_array_index(stack, int, stack->len - 1);
+            if (*next == mir_term_nsuccs(&b->term)) {
+                  g_ptr_array_add(post, b);
+                  g_ptr_array_set_size(blocks, blocks->len - 1);
+                  g_array_set_size(stack, stack->len - 1);
+                  continue;
+            }
+            struct mir_block* s = *mir_term_succ(&b->term, (*next)++);
+            if (s->mark >= 0) continue;
+            s->mark = 0;
+            g_ptr_array_add(blocks, s);
+            g_array_append_val(stack, zero);
+      }
+      g_ptr_array_free(blocks, true);
+      g_array_free(stack, true);
+
+      GPtrArray* order = g_ptr_array_sized_new(post->len);
+      for (guint i = post->len; i--;) {
+            struct mir_block* b = g_ptr_array_index(post, i);
+            b->mark = order->len;
+            g_ptr_array_add(order, b);
+      }
+      g_ptr_array_free(post, true);
+      return order;
+}
+
+// Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm".
+static int intersect(const int* idom, int a, int b) {
+      while (a != b) {
+            while (a > b) a = idom[a];
+            while (b > a) b = idom[b];
+      }
+      return a;
+}
+
+int* mir_dominators(const GPtrArray* order) {
+      int n = order->len;
+      bool changed = true;
+      int* idom = g_new(int, n);
+      for (int i = 0; i != n; ++i) idom[i] = -1;
+      idom[0] = 0;
+
+      while (changed) {
+            changed = false;
+            for (int i = 1; i != n; ++i) {
+                  struct mir_block* b = g_ptr_array_index(order, i);
+                  int dom = -1;
+                  for (guint j = 0; j != b->preds->len; ++j) {
+                        int pred = ((struct mir_block*)g_ptr_array_index(b->preds, j))->mark;
+                        if (pred < 0 || idom[pred] < 0) continue;
+                        dom = dom < 0? pred : intersect(idom, pred, dom);
+                  }
+                  if (dom != idom[i]) {
+                        idom[i] = dom;
+                        changed = true;
+                  }
+            }
+      }
+      return idom;
+}
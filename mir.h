@@ -0,0 +1,219 @@
+#ifndef RUSTC_MIR_H_
+#define RUSTC_MIR_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include "symbol.h"
+#include "type.h"
+
+// *** Mid-level IR ***
+
+// What codegen works on between the typed AST and LLVM (see mir_lower.h,
+// pass.h, and mir_emit.h or mir_llvm.h). A function is a list of basic blocks,
+// the first of which is the entry; a block is a list of instructions ended by
+// a terminator. Instructions compute typed virtual registers, each defined
+// once. Variables start out in stack slots (MIR_ALLOCA) and are only turned
+// into registers by the mem2reg pass.
+//
+// MIR types are the language's types: a register of type ref T holds the
+// address of a T, and so does every MIR_ALLOCA. How an enum is laid out is up
+// to codegen (see mir_layout.h): MIR only gets at one through MIR_TAG,
+// MIR_SET_TAG and MIR_PAYLOAD.
+
+struct mir_block;
+struct cache_entry;
+
+// An instruction operand.
+enum {
+      MIR_NONE,         // no value (unit)
+      MIR_REG,          // register n
+      MIR_CONST,        // the i32, u8 or bool (0 or 1) n
+      MIR_STR,          // the address of string constant str, pooled as n
+      MIR_UNDEF,
+};
+
+struct mir_value {
+      int kind;
+      struct type* type;
+      int n;
+      const char* str;
+};
+
+enum {
+      MIR_INVALID,
+      MIR_BINARY,       // dst = a op b: an arithmetic, compare or eq OP_*
+      MIR_NEG,          // dst = -a
+      MIR_NOT,          // dst = !a
+      MIR_ALLOCA,       // dst = a new stack slot (dst is a ref)
+      MIR_LOAD,         // dst = *a
+      MIR_STORE,        // *a = b
+      MIR_FIELD,        // dst = &a->(field number n, in declaration order)
+      MIR_ELEM,         // dst = &(*a)[b]
+      MIR_CALL,         // dst = fn(args...), no dst for unit
+      MIR_PHI,          // dst = args[i], coming in from preds[i]
+      MIR_TAG,          // dst = the constructor number of the enum at a
+      MIR_SET_TAG,      // make the enum at a constructor number n
+      MIR_PAYLOAD,      // dst = &(field number field of constructor n at a)
+      MIR_BOX,          // dst = a new box on the heap (dst is a box)
+      MIR_BOUNDS,       // traps unless 0 <= a < n (an array index and length)
+};
+
+struct mir_inst {
+      int kind;
+      int op;
+      int n;
+      int field;
+      // A register, or -1.
+      int dst;
+      struct mir_value a, b;
+      Symbol fn;
+      // Of struct mir_value.
+      GArray* args;
+      // Of struct mir_block*.
+      GPtrArray* preds;
+      // MIR_CALL: may be emitted as an LLVM tail call (see tailcall.h).
+      bool tail;
+};
+
+enum {
+      MIR_TERM_NONE,    // the block is still being built
+      MIR_JUMP,         // to[0]
+      MIR_BRANCH,       // on value, to to[0] if true and to[1] if false
+      MIR_SWITCH,       // on value, to the case for it or else to to[0]
+      MIR_RETURN,       // value, MIR_NONE if unit
+      MIR_UNREACHABLE,
+};
+
+struct mir_case {
+      int n;
+      struct mir_block* to;
+};
+
+struct mir_term {
+      int kind;
+      struct mir_value value;
+      struct mir_block* to[2];
+      // MIR_SWITCH: of struct mir_case, no two for the same n.
+      GArray* cases;
+      // Set by the bounds pass on the back edge of a loop over an array, to
+      // have LLVM vectorize it.
+      bool vectorize;
+};
+
+struct mir_block {
+      // Unique within the function, also the label's suffix.
+      int id;
+      // The label's prefix; it always contains a dot followed by something
+      // other than a number, so that it can't clash with a variable.
+      const char* name;
+      // Of struct mir_inst.
+      GArray* insts;
+      struct mir_term term;
+      // Filled in by mir_compute_preds(): one entry per edge, so a block that
+      // goes here two ways (e.g. both sides of a branch) is in twice.
+      GPtrArray* preds;
+      // Scratch space for passes.
+      int mark;
+      // Set to have mir_drop_blocks() remove the block.
+      bool dead;
+};
+
+struct mir_reg {
+      struct type* type;
+      // The LLVM name, or NULL for %r<n>.
+      const char* name;
+};
+
+struct mir_fn {
+      Symbol id;
+      // Unit for none.
+      struct type* ret;
+      // Of struct mir_value: the incoming parameters' registers.
+      GArray* params;
+      // Of struct mir_reg, indexed by register.
+      GArray* regs;
+      // Of struct mir_block*, entry first.
+      GPtrArray* blocks;
+      int next_block;
+      // Strings freed along with the function.
+      GPtrArray* strings;
+      // With --cache, the function's entry (see cache.h). If the entry was a
+      // hit, the function isn't lowered, and has no blocks.
+      struct cache_entry* cached;
+};
+
+struct mir_module {
+      // Of struct mir_fn*, in source order.
+      GPtrArray* fns;
+      // Of const struct item*: the struct definitions.
+      GPtrArray* structs;
+      // Symbol value -> struct definition.
+      GHashTable* struct_defs;
+      // The same for enums.
+      GPtrArray* enums;
+      GHashTable* enum_defs;
+      // Of char*: the crate's string pool (see resolve.h), which the n of a
+      // MIR_STR indexes. Not the module's.
+      const GPtrArray* strings;
+};
+
+struct mir_module* mir_module_new(void);
+void mir_module_free(struct mir_module*);
+
+struct mir_fn* mir_fn_new(Symbol id, struct type* ret);
+void mir_fn_free(struct mir_fn*);
+// Takes ownership of the string, which then lives as long as the function.
+const char* mir_fn_keep(struct mir_fn*, char* str);
+struct mir_block* mir_block_new(struct mir_fn*, const char* name);
+
+// Operands.
+struct mir_value mir_none(void);
+struct mir_value mir_const(struct type* type, int n);
+struct mir_value mir_undef(struct type* type);
+// A new register.
+struct mir_value mir_reg(struct mir_fn*, struct type* type, const char* name);
+
+// Appends a copy of the instruction to the block.
+void mir_add(struct mir_block*, const struct mir_inst*);
+
+struct mir_reg* mir_reg_info(const struct mir_fn*, int reg);
+
+// Frees what the instruction owns (the instruction itself lives in its
+// block's array).
+void mir_inst_free(struct mir_inst*);
+
+// Removes the instructions whose kind was set to MIR_INVALID.
+void mir_block_sweep(struct mir_block*);
+
+// Whether the instruction can go if its result isn't used.
+bool mir_inst_is_pure(const struct mir_inst*);
+
+// Calls fn on every operand of the instruction.
+void mir_inst_operands(struct mir_inst*, void (*fn)(struct mir_value*, void*), void* data);
+
+// How many edges leave the terminator, and where the i'th one goes (the
+// default first for a switch).
+int mir_term_nsuccs(const struct mir_term*);
+struct mir_block** mir_term_succ(struct mir_term*, int i);
+
+// A switch terminator with no cases yet.
+void mir_term_switch(struct mir_term*, struct mir_value value, struct mir_block* other);
+void mir_term_add_case(struct mir_term*, int n, struct mir_block* to);
+// Frees what the terminator owns (a switch's cases).
+void mir_term_free(struct mir_term*);
+
+// (Re)computes every block's preds. Unreachable blocks count as preds too.
+void mir_compute_preds(struct mir_fn*);
+
+// Removes (and frees) the blocks marked dead, keeping the others in order.
+void mir_drop_blocks(struct mir_fn*);
+
+// Returns the blocks reachable from the entry in reverse postorder, setting
+// each one's mark to its position there (and an unreachable block's to -1).
+GPtrArray* mir_number_blocks(struct mir_fn*);
+
+// Given that order (and the preds), returns the immediate dominator of each
+// block as a position in it, the entry being its own.
+int* mir_dominators(const GPtrArray* order);
+
+#endif
@@ -0,0 +1,729 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mir_emit.h"
+#include "mir_layout.h"
+#include "ast.h"
+#include "cache.h"
+#include "parallel.h"
+#include "runtime.h"
+#include "stats.h"
+
+struct emitter {
+      const struct mir_module* module;
+      const struct mir_fn* fn;
+      struct ir_writer* out;
+      int insts;
+      // Registers made up on the way, %.t<n>: the dot keeps them clear of
+      // the function's own.
+      int temps;
+      // Worked out before any function is.
+      const struct mir_layouts* layouts;
+      // A bounds check ends an LLVM block, the rest of the MIR block going
+      // on in <label>.ok<n>. Block id -> how many checks it has, and how far
+      // into the current one's that is.
+      int* checks;
+      int check;
+      // The !llvm.loop metadata for the next loop to vectorize, numbered from
+      // 0 in each function and moved up as the function goes in the module.
+      int loop;
+      // What the function needs of the module: rt.box, and llvm.trap.
+      bool needs_box;
+      bool needs_trap;
+};
+
+static void emit_type(struct emitter* e, const struct type* type) {
+      switch (type->kind) {
+            case TYPE_I32:
+                  ir_lit(e->out, "i32");
+                  return;
+            case TYPE_U8:
+                  ir_lit(e->out, "i8");
+                  return;
+            case TYPE_BOOL:
+                  ir_lit(e->out, "i1");
+                  return;
+            case TYPE_UNIT:
+            case TYPE_DIV:
+                  ir_lit(e->out, "void");
+                  return;
+            case TYPE_MUT:
+                  emit_type(e, type->type);
+                  return;
+            case TYPE_REF:
+            case TYPE_BOX:
+                  emit_type(e, type->type);
+                  ir_putc(e->out, '*');
+                  return;
+            case TYPE_SLICE:
+                  // A slice is passed as a pointer to its first element.
+                  emit_type(e, type->type);
+                  return;
+            case TYPE_ARRAY:
+                  ir_putc(e->out, '[');
+                  ir_int(e->out, type->length);
+                  ir_lit(e->out, " x ");
+                  emit_type(e, type->type);
+                  ir_putc(e->out, ']');
+                  return;
+            case TYPE_ID:
+                  if (g_hash_table_lookup(e->module->struct_defs, GINT_TO_POINTER(type->id.value)))
+                        ir_lit(e->out, "%struct.");
+                  else ir_lit(e->out, "%enum.");
+                  ir_puts(e->out, symbol_to_str(type->id));
+                  return;
+      }
+      assert(false);
+}
+
+static void emit_reg(struct emitter* e, int reg) {
+      const struct mir_reg* r = mir_reg_info(e->fn, reg);
+      if (r->name) {
+            ir_putc(e->out, '%');
+            ir_puts(e->out, r->name);
+      } else ir_reg(e->out, reg);
+}
+
+static void emit_str_ref(struct emitter* e, int n, size_t len) {
+      ir_lit(e->out, "getelementptr inbounds ([");
+      ir_uint(e->out, len + 1);
+      ir_lit(e->out, " x i8]* @.str");
+      ir_int(e->out, n);
+      ir_lit(e->out, ", i32 0, i32 0)");
+}
+
+static void emit_value(struct emitter* e, const struct mir_value* v) {
+      switch (v->kind) {
+            case MIR_REG:
+                  emit_reg(e, v->n);
+                  return;
+            case MIR_CONST:
+                  if (type_is_bool(v->type)) {
+                        if (v->n) ir_lit(e->out, "true");
+                        else ir_lit(e->out, "false");
+                  } else ir_int(e->out, v->n);
+                  return;
+            case MIR_STR:
+                  emit_str_ref(e, v->n, strlen(v->str));
+                  return;
+            case MIR_UNDEF:
+                  ir_lit(e->out, "undef");
+                  return;
+      }
+      assert(false);
+}
+
+static void emit_typed(struct emitter* e, const struct mir_value* v) {
+      emit_type(e, v->type);
+      ir_putc(e->out, ' ');
+      emit_value(e, v);
+}
+
+static void emit_label(struct emitter* e, const struct mir_block* b) {
+      if (b == g_ptr_array_index(e->fn->blocks, 0)) {
+            ir_lit(e->out, "entry");
+            return;
+      }
+      ir_puts(e->out, b->name);
+      ir_int(e->out, b->id);
+}
+
+static void emit_check_label(struct emitter* e, const struct mir_block* b, int n) {
+      emit_label(e, b);
+      ir_lit(e->out, ".ok");
+      ir_int(e->out, n);
+}
+
+// The label of the LLVM block the MIR block ends in, as a phi knows it.
+static void emit_exit_label(struct emitter* e, const struct mir_block* b) {
+      if (e->checks[b->id]) emit_check_label(e, b, e->checks[b->id]);
+      else emit_label(e, b);
+}
+
+static void emit_dst(struct emitter* e, const struct mir_inst* inst) {
+      ir_lit(e->out, "  ");
+      if (inst->dst < 0) return;
+      emit_reg(e, inst->dst);
+      ir_lit(e->out, " = ");
+}
+
+static void emit_binary(struct emitter* e, const struct mir_inst* inst) {
+      const char* llvm = op_table[inst->op].llvm;
+      if (op_table[inst->op].flags & (OPF_COMPARE | OPF_EQ)) {
+            ir_lit(e->out, "icmp ");
+            // u8s compare unsigned.
+            if (llvm[0] == 's' && inst->a.type->kind == TYPE_U8) {
+                  ir_putc(e->out, 'u');
+                  llvm++;
+            }
+      }
+      ir_puts(e->out, llvm);
+      ir_putc(e->out, ' ');
+      emit_typed(e, &inst->a);
+      ir_lit(e->out, ", ");
+      emit_value(e, &inst->b);
+}
+
+// printi and prints go to the runtime's buffer (see runtime.h), a string
+// constant with its length.
+static void emit_print(struct emitter* e, bool str, const struct mir_value* arg) {
+      if (!str) {
+            ir_lit(e->out, "call void @rt.print.int(");
+            emit_typed(e, arg);
+      } else if (arg->kind != MIR_STR) {
+            ir_lit(e->out, "call void @rt.print.cstr(");
+            emit_typed(e, arg);
+      } else {
+            ir_lit(e->out, "call void @rt.print.str(i8* ");
+            emit_value(e, arg);
+            ir_lit(e->out, ", i64 ");
+            ir_uint(e->out, strlen(arg->str));
+      }
+      ir_putc(e->out, ')');
+}
+
+static void emit_call(struct emitter* e, const struct mir_inst* inst) {
+      const char* name = symbol_to_str(inst->fn);
+
+      if (inst->args->len == 1 && (!strcmp(name, "printi") || !strcmp(name, "prints"))) {
+            emit_print(e, name[5] == 's', &g_array_index(inst->args, struct mir_value, 0));
+            return;
+      }
+
+      if (inst->tail) ir_lit(e->out, "tail ");
+      ir_lit(e->out, "call ");
+      if (inst->dst < 0) ir_lit(e->out, "void");
+      else emit_type(e, mir_reg_info(e->fn, inst->dst)->type);
+      ir_lit(e->out, " @");
+      ir_puts(e->out, name);
+      ir_putc(e->out, '(');
+      for (guint i = 0; i != inst->args->len; ++i) {
+            if (i) ir_lit(e->out, ", ");
+            emit_typed(e, &g_array_index(inst->args, struct mir_value, i));
+      }
+      ir_putc(e->out, ')');
+}
+
+static void emit_int_type(struct emitter* e, int bits) {
+      ir_putc(e->out, 'i');
+      ir_int(e->out, bits);
+}
+
+static void emit_payload_type(struct emitter* e, const struct enum_layout* lay) {
+      ir_putc(e->out, '[');
+      ir_int(e->out, lay->payload_n);
+      ir_lit(e->out, " x ");
+      emit_int_type(e, lay->payload_align * 8);
+      ir_putc(e->out, ']');
+}
+
+static void emit_ctor_type(struct emitter* e, const struct type* type, const struct pair* ctor) {
+      emit_type(e, type->unmut);
+      ir_putc(e->out, '.');
+      ir_puts(e->out, symbol_to_str(ctor->ctor_def.id));
+}
+
+static void emit_field_addr(struct emitter* e, const struct mir_value* base, int n) {
+      ir_lit(e->out, "getelementptr inbounds ");
+      emit_typed(e, base);
+      ir_lit(e->out, ", i32 0, i32 ");
+      ir_int(e->out, n);
+}
+
+// Starts an instruction defining a made-up register, and returns its number.
+static int emit_temp(struct emitter* e) {
+      int t = e->temps++;
+      ir_lit(e->out, "  %.t");
+      ir_int(e->out, t);
+      ir_lit(e->out, " = ");
+      return t;
+}
+
+static void emit_temp_ref(struct emitter* e, int t) {
+      ir_lit(e->out, "%.t");
+      ir_int(e->out, t);
+}
+
+// MIR_TAG, MIR_SET_TAG and MIR_PAYLOAD, which take a few instructions each.
+static void emit_enum_inst(struct emitter* e, const struct mir_inst* inst) {
+      const struct type* type = inst->a.type->unmut->type;
+      const struct enum_layout* lay = mir_enum_layout(e->layouts, type);
+
+      if (inst->kind == MIR_PAYLOAD) {
+            if (lay->kind == LAYOUT_NICHE) {
+                  emit_dst(e, inst);
+                  emit_field_addr(e, &inst->a, inst->field);
+                  ir_putc(e->out, '\n');
+                  return;
+            }
+            const struct pair* ctor = mir_enum_ctor(e->layouts, type, inst->n);
+            int t = emit_temp(e);
+            emit_field_addr(e, &inst->a, 1);
+            ir_putc(e->out, '\n');
+            int c = emit_temp(e);
+            ir_lit(e->out, "bitcast ");
+            emit_payload_type(e, lay);
+            ir_lit(e->out, "* ");
+            emit_temp_ref(e, t);
+            ir_lit(e->out, " to ");
+            emit_ctor_type(e, type, ctor);
+            ir_lit(e->out, "*\n");
+            emit_dst(e, inst);
+            ir_lit(e->out, "getelementptr inbounds ");
+            emit_ctor_type(e, type, ctor);
+            ir_lit(e->out, "* ");
+            emit_temp_ref(e, c);
+            ir_lit(e->out, ", i32 0, i32 ");
+            ir_int(e->out, inst->field);
+            ir_putc(e->out, '\n');
+            return;
+      }
+
+      if (lay->kind == LAYOUT_NICHE) {
+            // The constructor with the pointer is there as soon as the pointer is.
+            if (inst->kind == MIR_SET_TAG && inst->n == lay->data_ctor) return;
+
+            const struct pair* ctor = mir_enum_ctor(e->layouts, type, lay->data_ctor);
+            const struct type* ptr = g_list_nth_data(ctor->ctor_def.types, lay->niche_field);
+            int t = emit_temp(e);
+            emit_field_addr(e, &inst->a, lay->niche_field);
+            ir_putc(e->out, '\n');
+            if (inst->kind == MIR_SET_TAG) {
+                  ir_lit(e->out, "  store ");
+                  emit_type(e, ptr);
+                  ir_lit(e->out, " null, ");
+                  emit_type(e, ptr);
+                  ir_lit(e->out, "* ");
+                  emit_temp_ref(e, t);
+                  ir_putc(e->out, '\n');
+                  return;
+            }
+            int v = emit_temp(e);
+            ir_lit(e->out, "load ");
+            emit_type(e, ptr);
+            ir_lit(e->out, "* ");
+            emit_temp_ref(e, t);
+            ir_putc(e->out, '\n');
+            int c = emit_temp(e);
+            ir_puts(e->out, lay->data_ctor? "icmp ne " : "icmp eq ");
+            emit_type(e, ptr);
+            ir_putc(e->out, ' ');
+            emit_temp_ref(e, v);
+            ir_lit(e->out, ", null\n");
+            emit_dst(e, inst);
+            ir_lit(e->out, "zext i1 ");
+            emit_temp_ref(e, c);
+            ir_lit(e->out, " to i32\n");
+            return;
+      }
+
+      int t = emit_temp(e);
+      emit_field_addr(e, &inst->a, 0);
+      ir_putc(e->out, '\n');
+      if (inst->kind == MIR_SET_TAG) {
+            ir_lit(e->out, "  store ");
+            emit_int_type(e, lay->tag_bits);
+            ir_putc(e->out, ' ');
+            ir_int(e->out, inst->n);
+            ir_lit(e->out, ", ");
+            emit_int_type(e, lay->tag_bits);
+            ir_lit(e->out, "* ");
+            emit_temp_ref(e, t);
+            ir_putc(e->out, '\n');
+            return;
+      }
+      if (lay->tag_bits == 32) {
+            emit_dst(e, inst);
+            ir_lit(e->out, "load i32* ");
+            emit_temp_ref(e, t);
+            ir_putc(e->out, '\n');
+            return;
+      }
+      int v = emit_temp(e);
+      ir_lit(e->out, "load ");
+      emit_int_type(e, lay->tag_bits);
+      ir_lit(e->out, "* ");
+      emit_temp_ref(e, t);
+      ir_putc(e->out, '\n');
+      emit_dst(e, inst);
+      ir_lit(e->out, "zext ");
+      emit_int_type(e, lay->tag_bits);
+      ir_putc(e->out, ' ');
+      emit_temp_ref(e, v);
+      ir_lit(e->out, " to i32\n");
+}
+
+// MIR_BOUNDS: a branch to the function's trap unless the index is in range,
+// read as unsigned so that a negative one isn't.
+static void emit_bounds(struct emitter* e, const struct mir_inst* inst, const struct mir_block* b) {
+      int t = emit_temp(e);
+      ir_lit(e->out, "icmp ult ");
+      emit_typed(e, &inst->a);
+      ir_lit(e->out, ", ");
+      ir_int(e->out, inst->n);
+      ir_lit(e->out, "\n  br i1 ");
+      emit_temp_ref(e, t);
+      ir_lit(e->out, ", label %");
+      emit_check_label(e, b, ++e->check);
+      ir_lit(e->out, ", label %bounds.fail\n\n");
+      emit_check_label(e, b, e->check);
+      ir_lit(e->out, ":\n");
+}
+
+// MIR_BOX: room for the value from the runtime, as the right pointer.
+static void emit_box(struct emitter* e, const struct mir_inst* inst) {
+      const struct type* type = mir_reg_info(e->fn, inst->dst)->type;
+      int size, align;
+      mir_layout_type(e->layouts, type->type, &size, &align);
+
+      int t = emit_temp(e);
+      ir_lit(e->out, "call i8* @rt.box(i64 ");
+      ir_int(e->out, size);
+      ir_lit(e->out, ")\n");
+      emit_dst(e, inst);
+      ir_lit(e->out, "bitcast i8* ");
+      emit_temp_ref(e, t);
+      ir_lit(e->out, " to ");
+      emit_type(e, type);
+      ir_putc(e->out, '\n');
+}
+
+static void emit_inst(struct emitter* e, const struct mir_inst* inst) {
+      if (inst->kind == MIR_TAG || inst->kind == MIR_SET_TAG || inst->kind == MIR_PAYLOAD) {
+            emit_enum_inst(e, inst);
+            return;
+      }
+      if (inst->kind == MIR_BOX) {
+            emit_box(e, inst);
+            return;
+      }
+
+      emit_dst(e, inst);
+
+      switch (inst->kind) {
+            case MIR_BINARY:
+                  emit_binary(e, inst);
+                  break;
+            case MIR_NEG:
+                  ir_lit(e->out, "sub ");
+                  emit_type(e, inst->a.type);
+                  ir_lit(e->out, " 0, ");
+                  emit_value(e, &inst->a);
+                  break;
+            case MIR_NOT:
+                  ir_lit(e->out, "xor i1 ");
+                  emit_value(e, &inst->a);
+                  ir_lit(e->out, ", true");
+                  break;
+            case MIR_ALLOCA:
+                  ir_lit(e->out, "alloca ");
+                  emit_type(e, mir_reg_info(e->fn, inst->dst)->type->type);
+                  break;
+            case MIR_LOAD:
+                  ir_lit(e->out, "load ");
+                  emit_typed(e, &inst->a);
+                  break;
+            case MIR_STORE:
+                  ir_lit(e->out, "store ");
+                  emit_typed(e, &inst->b);
+                  ir_lit(e->out, ", ");
+                  emit_typed(e, &inst->a);
+                  break;
+            case MIR_FIELD:
+                  emit_field_addr(e, &inst->a, mir_struct_layout(e->layouts, inst->a.type->unmut->type)->slot[inst->n]);
+                  break;
+            case MIR_ELEM:
+                  ir_lit(e->out, "getelementptr inbounds ");
+                  emit_typed(e, &inst->a);
+                  ir_lit(e->out, ", i32 0, ");
+                  emit_typed(e, &inst->b);
+                  break;
+            case MIR_CALL:
+                  emit_call(e, inst);
+                  break;
+            case MIR_PHI:
+                  ir_lit(e->out, "phi ");
+                  emit_type(e, mir_reg_info(e->fn, inst->dst)->type);
+                  for (guint i = 0; i != inst->args->len; ++i) {
+                        ir_puts(e->out, i? ", [ " : " [ ");
+                        emit_value(e, &g_array_index(inst->args, struct mir_value, i));
+                        ir_lit(e->out, ", %");
+                        emit_exit_label(e, g_ptr_array_index(inst->preds, i));
+                        ir_lit(e->out, " ]");
+                  }
+                  break;
+            default:
+                  assert(false);
+      }
+      ir_putc(e->out, '\n');
+}
+
+static void emit_term(struct emitter* e, const struct mir_term* term) {
+      switch (term->kind) {
+            case MIR_JUMP:
+                  ir_lit(e->out, "  br label %");
+                  emit_label(e, term->to[0]);
+                  break;
+            case MIR_BRANCH:
+                  ir_lit(e->out, "  br i1 ");
+                  emit_value(e, &term->value);
+                  ir_lit(e->out, ", label %");
+                  emit_label(e, term->to[0]);
+                  ir_lit(e->out, ", label %");
+                  emit_label(e, term->to[1]);
+                  break;
+            case MIR_SWITCH:
+                  ir_lit(e->out, "  switch ");
+                  emit_typed(e, &term->value);
+                  ir_lit(e->out, ", label %");
+                  emit_label(e, term->to[0]);
+                  ir_lit(e->out, " [");
+                  for (guint i = 0; i != term->cases->len; ++i) {
+                        const struct mir_case* c = &g_array_index(term->cases, struct mir_case, i);
+                        ir_lit(e->out, "\n    ");
+                        emit_type(e, term->value.type);
+                        ir_putc(e->out, ' ');
+                        ir_int(e->out, c->n);
+                        ir_lit(e->out, ", label %");
+                        emit_label(e, c->to);
+                  }
+                  ir_lit(e->out, "\n  ]");
+                  break;
+            case MIR_RETURN:
+                  if (e->fn->id.value == symbol_main().value)
+                        ir_lit(e->out, "  call void @rt.flush()\n  ret i32 0");
+                  else if (term->value.kind == MIR_NONE)
+                        ir_lit(e->out, "  ret void");
+                  else {
+                        ir_lit(e->out, "  ret ");
+                        emit_typed(e, &term->value);
+                  }
+                  break;
+            case MIR_UNREACHABLE:
+                  ir_lit(e->out, "  unreachable");
+                  break;
+            default:
+                  assert(false);
+      }
+      if (term->vectorize) {
+            ir_lit(e->out, ", !llvm.loop !");
+            ir_int(e->out, e->loop++);
+      }
+      ir_putc(e->out, '\n');
+}
+
+static void emit_fn(struct emitter* e) {
+      const struct mir_fn* fn = e->fn;
+
+      ir_lit(e->out, "define ");
+      if (fn->id.value == symbol_main().value) ir_lit(e->out, "i32");
+      else emit_type(e, fn->ret);
+      ir_lit(e->out, " @");
+      ir_puts(e->out, symbol_to_str(fn->id));
+      ir_putc(e->out, '(');
+      for (guint i = 0; i != fn->params->len; ++i) {
+            if (i) ir_lit(e->out, ", ");
+            emit_typed(e, &g_array_index(fn->params, struct mir_value, i));
+      }
+      ir_lit(e->out, ") nounwind {\n");
+
+      bool trap = false;
+      e->checks = g_new0(int, fn->next_block);
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            const struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len; ++j)
+                  e->checks[b->id] += g_array_index(b->insts, struct mir_inst, j).kind == MIR_BOUNDS;
+            trap = trap || e->checks[b->id];
+      }
+
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            const struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            if (i) ir_putc(e->out, '\n');
+            emit_label(e, b);
+            ir_lit(e->out, ":\n");
+            e->check = 0;
+            for (guint j = 0; j != b->insts->len; ++j) {
+                  const struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  if (inst->kind == MIR_BOUNDS) emit_bounds(e, inst, b);
+                  else emit_inst(e, inst);
+            }
+            emit_term(e, &b->term);
+            e->insts += b->insts->len + 1;
+      }
+      if (trap) ir_lit(e->out, "\nbounds.fail:\n  call void @rt.flush()\n  call void @llvm.trap() noreturn nounwind\n  unreachable\n");
+      ir_lit(e->out, "}\n\n");
+      g_free(e->checks);
+}
+
+static void emit_job_run(void* item, void* data) {
+      struct emitter* e = item;
+      if (!e->out) return;
+      emit_fn(e);
+      if (stats_enabled) stats_add(STATS_IR_INSTS, e->insts);
+}
+
+// Appends a function's IR, with its !llvm.loop references moved up by base.
+static void append_fn(struct ir_writer* out, const struct ir_writer* ir, int base) {
+      static const char ref[] = "!llvm.loop !";
+      size_t len;
+      const char* p = ir_writer_data(ir, &len);
+      const char* end = p + len;
+      const char* at;
+
+      while (base && (at = g_strstr_len(p, end - p, ref))) {
+            at += sizeof ref - 1;
+            ir_putn(out, p, at - p);
+            ir_int(out, base + (int)strtol(at, (char**)&p, 10));
+      }
+      ir_putn(out, p, end - p);
+}
+
+static void emit_enum(struct emitter* e, const struct item* def) {
+      const struct enum_layout* lay = g_hash_table_lookup(e->layouts->enums, GINT_TO_POINTER(def->id.value));
+      const char* name = symbol_to_str(def->id);
+
+      ir_lit(e->out, "%enum.");
+      ir_puts(e->out, name);
+      ir_lit(e->out, " = type { ");
+      if (lay->kind == LAYOUT_NICHE) {
+            const struct pair* ctor = g_list_nth_data(def->enum_def.ctors, lay->data_ctor);
+            for (const GList* t = ctor->ctor_def.types; t; t = t->next) {
+                  emit_type(e, t->data);
+                  if (t->next) ir_lit(e->out, ", ");
+            }
+            ir_lit(e->out, " }\n");
+            return;
+      }
+      emit_int_type(e, lay->tag_bits);
+      if (lay->kind == LAYOUT_UNION) {
+            ir_lit(e->out, ", ");
+            emit_payload_type(e, lay);
+      }
+      ir_lit(e->out, " }\n");
+
+      if (lay->kind != LAYOUT_UNION) return;
+      for (const GList* p = def->enum_def.ctors; p; p = p->next) {
+            const struct pair* ctor = p->data;
+            if (!ctor->ctor_def.types) continue;
+            ir_lit(e->out, "%enum.");
+            ir_puts(e->out, name);
+            ir_putc(e->out, '.');
+            ir_puts(e->out, symbol_to_str(ctor->ctor_def.id));
+            ir_lit(e->out, " = type { ");
+            for (const GList* t = ctor->ctor_def.types; t; t = t->next) {
+                  emit_type(e, t->data);
+                  if (t->next) ir_lit(e->out, ", ");
+            }
+            ir_lit(e->out, " }\n");
+      }
+}
+
+static void emit_struct(struct emitter* e, const struct item* def) {
+      ir_lit(e->out, "%struct.");
+      ir_puts(e->out, symbol_to_str(def->id));
+      ir_lit(e->out, " = type { ");
+      const struct struct_layout* lay = g_hash_table_lookup(e->layouts->structs, GINT_TO_POINTER(def->id.value));
+      for (int i = 0; i != lay->nfields; ++i) {
+            const struct pair* field = g_list_nth_data(def->struct_def.fields, lay->slot[lay->nfields + i]);
+            emit_type(e, field->field_def.type);
+            if (i + 1 != lay->nfields) ir_lit(e->out, ", ");
+      }
+      ir_lit(e->out, " }\n");
+}
+
+void mir_emit_module(struct mir_module* module, struct ir_writer* out) {
+      guint n = module->fns->len;
+      struct emitter* jobs = g_new0(struct emitter, n);
+      bool boxes = false, checks = false;
+      // Fn i's loops get metadata loops[i] on.
+      int* loops = g_new0(int, n + 1);
+
+      for (guint i = 0; i != n; ++i) {
+            struct mir_fn* fn = g_ptr_array_index(module->fns, i);
+            struct emitter* e = &jobs[i];
+            if (fn->cached && fn->cached->hit) {
+                  e->needs_box = fn->cached->boxes;
+                  e->needs_trap = fn->cached->checks;
+                  loops[i + 1] = fn->cached->loops;
+            }
+            for (guint j = 0; j != fn->blocks->len; ++j) {
+                  struct mir_block* b = g_ptr_array_index(fn->blocks, j);
+                  for (guint k = 0; k != b->insts->len; ++k) {
+                        struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, k);
+                        e->needs_box = e->needs_box || inst->kind == MIR_BOX;
+                        e->needs_trap = e->needs_trap || inst->kind == MIR_BOUNDS;
+                  }
+                  loops[i + 1] += b->term.vectorize;
+            }
+            boxes = boxes || e->needs_box;
+            checks = checks || e->needs_trap;
+            loops[i + 1] += loops[i];
+      }
+
+      for (guint i = 0; i != module->strings->len; ++i)
+            ir_string(out, i, g_ptr_array_index(module->strings, i));
+      if (module->strings->len) ir_putc(out, '\n');
+
+      struct mir_layouts layouts;
+      mir_layouts_init(&layouts, module);
+      struct emitter header = {module, NULL, out, 0, 0, &layouts};
+      for (guint i = 0; i != module->structs->len; ++i)
+            emit_struct(&header, g_ptr_array_index(module->structs, i));
+      for (guint i = 0; i != module->enums->len; ++i)
+            emit_enum(&header, g_ptr_array_index(module->enums, i));
+      if (module->structs->len || module->enums->len) ir_putc(out, '\n');
+
+      void** work = g_new(void*, n);
+      for (guint i = 0; i != n; ++i) {
+            jobs[i].module = module;
+            jobs[i].fn = g_ptr_array_index(module->fns, i);
+            if (!jobs[i].fn->cached || !jobs[i].fn->cached->hit) jobs[i].out = ir_writer_mem();
+            jobs[i].layouts = &layouts;
+            work[i] = &jobs[i];
+      }
+      parallel_for(work, n, emit_job_run, NULL);
+
+      // A function's IR goes into its cache entry (see cache.h) as it is.
+      for (guint i = 0; i != n; ++i) {
+            struct cache_entry* cached = jobs[i].fn->cached;
+            if (!jobs[i].out) {
+                  append_fn(out, cached->ir, loops[i]);
+                  continue;
+            }
+            append_fn(out, jobs[i].out, loops[i]);
+            if (cached) {
+                  cached->ir = jobs[i].out;
+                  cached->boxes = jobs[i].needs_box;
+                  cached->checks = jobs[i].needs_trap;
+                  cached->loops = loops[i + 1] - loops[i];
+            } else ir_writer_close(jobs[i].out);
+      }
+      g_free(work);
+      g_free(jobs);
+      mir_layouts_free(&layouts);
+
+      if (boxes) {
+            runtime_box(out);
+            ir_putc(out, '\n');
+      }
+      runtime_print(out);
+      if (checks) ir_lit(out, "declare void @llvm.trap() noreturn nounwind\n");
+
+      // Each loop its own node, by pointing at itself, then what they all ask for.
+      if (loops[n]) ir_putc(out, '\n');
+      for (int i = 0; i != loops[n]; ++i) {
+            ir_putc(out, '!');
+            ir_int(out, i);
+            ir_lit(out, " = !{!");
+            ir_int(out, i);
+            ir_lit(out, ", !");
+            ir_int(out, loops[n]);
+            ir_lit(out, "}\n");
+      }
+      if (loops[n]) {
+            ir_putc(out, '!');
+            ir_int(out, loops[n]);
+            ir_lit(out, " = !{!\"llvm.loop.vectorize.enable\", i1 true}\n");
+      }
+      g_free(loops);
+}
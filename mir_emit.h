@@ -0,0 +1,19 @@
+#ifndef RUSTC_MIR_EMIT_H_
+#define RUSTC_MIR_EMIT_H_
+
+#include "mir.h"
+#include "ir_writer.h"
+
+// *** LLVM IR from MIR ***
+
+// Writes the module as LLVM 3.6 assembly. Functions are printed concurrently,
+// each into its own buffer, and spliced together in order. The module's
+// string pool comes first, as @.str<n> constants.
+// Enums get a compact layout: a tag only as wide as it needs to be, and room
+// for the largest constructor's fields (see mir_layout.h). A bounds
+// check that's left branches to a block per function calling llvm.trap, and
+// loops the bounds pass marked get !llvm.loop metadata asking for them to be
+// vectorized.
+void mir_emit_module(struct mir_module* module, struct ir_writer* out);
+
+#endif
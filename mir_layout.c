@@ -0,0 +1,198 @@
+#include <assert.h>
+#include "mir_layout.h"
+#include "ast.h"
+
+bool mir_reorder_fields;
+
+const struct enum_layout* mir_enum_layout(const struct mir_layouts* l, const struct type* type) {
+      const struct enum_layout* lay = g_hash_table_lookup(l->enums, GINT_TO_POINTER(type->unmut->id.value));
+      assert(lay);
+      return lay;
+}
+
+const struct struct_layout* mir_struct_layout(const struct mir_layouts* l, const struct type* type) {
+      const struct struct_layout* lay = g_hash_table_lookup(l->structs, GINT_TO_POINTER(type->unmut->id.value));
+      assert(lay);
+      return lay;
+}
+
+static int align_to(int n, int align) {
+      return (n + align - 1) / align * align;
+}
+
+static void layout_enum(struct mir_layouts* l, const struct item* def);
+static void layout_struct(struct mir_layouts* l, const struct item* def);
+static void layout_add(struct mir_layouts* l, const struct type* type, int* size, int* align);
+
+// The size and alignment of a value of the type in memory, in bytes, for a
+// 64-bit target.
+static void layout_type(struct mir_layouts* l, const struct type* type, int* size, int* align) {
+      switch (type->kind) {
+            case TYPE_I32:
+                  *size = *align = 4;
+                  return;
+            case TYPE_U8:
+            case TYPE_BOOL:
+                  *size = *align = 1;
+                  return;
+            case TYPE_MUT:
+                  layout_type(l, type->type, size, align);
+                  return;
+            case TYPE_REF:
+            case TYPE_BOX:
+            case TYPE_SLICE:
+                  *size = *align = 8;
+                  return;
+            case TYPE_ARRAY:
+                  layout_type(l, type->type, size, align);
+                  *size *= type->length;
+                  return;
+            case TYPE_ID: {
+                  const struct item* def = g_hash_table_lookup(l->module->struct_defs, GINT_TO_POINTER(type->id.value));
+                  if (def) {
+                        layout_struct(l, def);
+                        *size = mir_struct_layout(l, type)->size;
+                        *align = mir_struct_layout(l, type)->align;
+                        return;
+                  }
+                  def = g_hash_table_lookup(l->module->enum_defs, GINT_TO_POINTER(type->id.value));
+                  assert(def);
+                  layout_enum(l, def);
+                  *size = mir_enum_layout(l, type)->size;
+                  *align = mir_enum_layout(l, type)->align;
+                  return;
+            }
+      }
+      *size = 0;
+      *align = 1;
+}
+
+// Puts a field of the type at the end of a struct so far size bytes long
+// and aligned to align.
+static void layout_add(struct mir_layouts* l, const struct type* type, int* size, int* align) {
+      int fs, fa;
+      layout_type(l, type, &fs, &fa);
+      *size = align_to(*size, fa) + fs;
+      if (fa > *align) *align = fa;
+}
+
+static void layout_fields(struct mir_layouts* l, const GList* types, int* size, int* align) {
+      int n = 0, a = 1;
+      for (const GList* t = types; t; t = t->next)
+            layout_add(l, t->data, &n, &a);
+      *size = align_to(n, a);
+      *align = a;
+}
+
+static void layout_struct(struct mir_layouts* l, const struct item* def) {
+      if (g_hash_table_lookup(l->structs, GINT_TO_POINTER(def->id.value))) return;
+
+      int n = g_list_length(def->struct_def.fields);
+      struct struct_layout* lay = g_malloc(sizeof *lay + 2 * n * sizeof *lay->slot);
+      int* order = lay->slot + n;
+      int* aligns = g_new(int, n);
+      int i = 0;
+      lay->nfields = n;
+
+      for (const GList* p = def->struct_def.fields; p; p = p->next, ++i) {
+            const struct pair* field = p->data;
+            int size;
+            layout_type(l, field->field_def.type, &size, &aligns[i]);
+            order[i] = i;
+      }
+
+      // An insertion sort, being stable and structs being small.
+      if (mir_reorder_fields) {
+            for (i = 1; i < n; ++i) {
+                  int f = order[i], j = i;
+                  for (; j && aligns[order[j - 1]] < aligns[f]; --j)
+                        order[j] = order[j - 1];
+                  order[j] = f;
+            }
+      }
+
+      int size = 0, align = 1;
+      for (i = 0; i != n; ++i) {
+            lay->slot[order[i]] = i;
+            layout_add(l, ((const struct pair*)g_list_nth_data(def->struct_def.fields, order[i]))->field_def.type, &size, &align);
+      }
+      lay->size = align_to(size, align);
+      lay->align = align;
+
+      g_free(aligns);
+      g_hash_table_insert(l->structs, GINT_TO_POINTER(def->id.value), lay);
+}
+
+static bool is_pointer(const struct type* type) {
+      return type->unmut->kind == TYPE_REF || type->unmut->kind == TYPE_BOX;
+}
+
+static void layout_enum(struct mir_layouts* l, const struct item* def) {
+      if (g_hash_table_lookup(l->enums, GINT_TO_POINTER(def->id.value))) return;
+
+      struct enum_layout* lay = g_new0(struct enum_layout, 1);
+      int nctors = 0, data = 0, data_ctor = -1, niche = -1;
+      int max_size = 0, max_align = 1;
+
+      for (const GList* p = def->enum_def.ctors; p; p = p->next, ++nctors) {
+            const struct pair* ctor = p->data;
+            if (!ctor->ctor_def.types) continue;
+            ++data;
+            data_ctor = nctors;
+            int size, align;
+            layout_fields(l, ctor->ctor_def.types, &size, &align);
+            if (size > max_size) max_size = size;
+            if (align > max_align) max_align = align;
+
+            niche = -1;
+            int i = 0;
+            for (const GList* t = ctor->ctor_def.types; t && niche < 0; t = t->next, ++i)
+                  if (is_pointer(t->data)) niche = i;
+      }
+
+      lay->tag_bits = nctors <= 1 << 8? 8 : nctors <= 1 << 16? 16 : 32;
+      if (!data) {
+            lay->kind = LAYOUT_TAG;
+            lay->size = lay->align = lay->tag_bits / 8;
+      } else if (nctors == 2 && data == 1 && niche >= 0) {
+            lay->kind = LAYOUT_NICHE;
+            lay->data_ctor = data_ctor;
+            lay->niche_field = niche;
+            lay->size = max_size;
+            lay->align = max_align;
+      } else {
+            int tag = lay->tag_bits / 8;
+            lay->kind = LAYOUT_UNION;
+            lay->payload_align = max_align;
+            lay->payload_n = (max_size + max_align - 1) / max_align;
+            lay->align = max_align > tag? max_align : tag;
+            lay->size = align_to(align_to(tag, max_align) + lay->payload_n * max_align, lay->align);
+      }
+      g_hash_table_insert(l->enums, GINT_TO_POINTER(def->id.value), lay);
+}
+
+const struct pair* mir_enum_ctor(const struct mir_layouts* l, const struct type* type, int n) {
+      const struct item* def = g_hash_table_lookup(l->module->enum_defs, GINT_TO_POINTER(type->unmut->id.value));
+      assert(def);
+      return g_list_nth_data(def->enum_def.ctors, n);
+}
+
+void mir_layout_type(const struct mir_layouts* l, const struct type* type, int* size, int* align) {
+      // Everything's laid out already, so this only looks layouts up.
+      layout_type((struct mir_layouts*)l, type, size, align);
+}
+
+void mir_layouts_init(struct mir_layouts* l, const struct mir_module* module) {
+      l->module = module;
+      l->enums = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+      l->structs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+      for (guint i = 0; i != module->structs->len; ++i)
+            layout_struct(l, g_ptr_array_index(module->structs, i));
+      for (guint i = 0; i != module->enums->len; ++i)
+            layout_enum(l, g_ptr_array_index(module->enums, i));
+}
+
+void mir_layouts_free(struct mir_layouts* l) {
+      g_hash_table_destroy(l->enums);
+      g_hash_table_destroy(l->structs);
+}
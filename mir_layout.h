@@ -0,0 +1,76 @@
+#ifndef RUSTC_MIR_LAYOUT_H_
+#define RUSTC_MIR_LAYOUT_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include "mir.h"
+
+// *** Layout ***
+
+// How a module's structs and enums are laid out in memory, for a 64-bit
+// target: the one thing both ways of generating code from MIR (mir_emit.h
+// and mir_llvm.h) have to agree on.
+
+// How an enum is laid out in memory. An enum whose constructors have no
+// fields is just its tag. One with a single fieldless constructor besides
+// one with a Box or reference field (like an Option of a Box) uses a null
+// pointer there for the fieldless one, so it needs no tag at all. Any other
+// is a tag followed by room for the largest constructor's fields, aligned
+// for the most demanding: %enum.X = type { iN, [n x iA] }, where each
+// constructor with fields has its own %enum.X.C struct to overlay on the
+// array. Tags are as narrow as the number of constructors allows.
+enum {
+      LAYOUT_TAG,
+      LAYOUT_NICHE,
+      LAYOUT_UNION,
+};
+
+struct enum_layout {
+      int kind;
+      // The tag's width in bits (LAYOUT_TAG, LAYOUT_UNION).
+      int tag_bits;
+      // LAYOUT_NICHE: the constructor with fields, and which one's the pointer.
+      int data_ctor, niche_field;
+      // LAYOUT_UNION: the payload array, n elements of align bytes.
+      int payload_align, payload_n;
+      int size, align;
+};
+
+// Where a struct's fields go: in the order they're declared, or with
+// mir_reorder_fields, the most aligned first (otherwise in declaration
+// order), which leaves no padding between fields whose sizes are multiples
+// of their alignments, as all of ours are. MIR numbers fields in declaration
+// order; codegen translates.
+struct struct_layout {
+      int size, align;
+      int nfields;
+      // slot[i]: where declared field i goes; slot[nfields + j]: which
+      // declared field goes in place j.
+      int slot[];
+};
+
+struct mir_layouts {
+      const struct mir_module* module;
+      // Enum id -> struct enum_layout and struct id -> struct struct_layout.
+      GHashTable* enums;
+      GHashTable* structs;
+};
+
+// Lays out every struct and enum of the module. After that the layouts are
+// only read, so the functions below can be called from several threads.
+void mir_layouts_init(struct mir_layouts*, const struct mir_module* module);
+void mir_layouts_free(struct mir_layouts*);
+
+const struct enum_layout* mir_enum_layout(const struct mir_layouts*, const struct type* type);
+const struct struct_layout* mir_struct_layout(const struct mir_layouts*, const struct type* type);
+// The size and alignment of a value of the type, in bytes.
+void mir_layout_type(const struct mir_layouts*, const struct type* type, int* size, int* align);
+
+// The n'th constructor (PAIR_CTOR_DEF) of the enum type.
+const struct pair* mir_enum_ctor(const struct mir_layouts*, const struct type* type, int n);
+
+// With mir_reorder_fields set, struct fields are laid out most aligned first
+// rather than in declaration order, to leave less padding.
+extern bool mir_reorder_fields;
+
+#endif
@@ -0,0 +1,1023 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mir_llvm.h"
+
+#ifdef PA4_LLVM
+
+#include <assert.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Analysis.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/DebugInfo.h>
+#include <llvm-c/ExecutionEngine.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/Transforms/PassManagerBuilder.h>
+#include "mir_layout.h"
+#include "ast.h"
+#include "stats.h"
+
+// The runtime's functions (see runtime.h), built as they're first called for.
+enum {
+      RT_BOX,
+      RT_WRITE,
+      RT_FLUSH,
+      RT_PRINT_STR,
+      RT_PRINT_CSTR,
+      RT_PRINT_INT,
+      RT_NFNS,
+};
+
+struct builder {
+      const struct mir_module* module;
+      const struct mir_layouts* layouts;
+      LLVMContextRef ctx;
+      LLVMModuleRef mod;
+      LLVMBuilderRef b;
+      // The string pool's @.str<n>, as i8*s.
+      LLVMValueRef* strs;
+      LLVMValueRef rt[RT_NFNS];
+      // What every loop to vectorize asks for, and the kind of its node.
+      LLVMMetadataRef vectorize;
+      unsigned loop_kind;
+      int insts;
+
+      // The function being built.
+      const struct mir_fn* fn;
+      LLVMValueRef llfn;
+      // Register -> its value, once it's been built.
+      LLVMValueRef* regs;
+      // Block id -> the LLVM block it starts in, and the one it ends in
+      // (a bounds check ends an LLVM block, as in mir_emit.c).
+      LLVMBasicBlockRef* starts;
+      LLVMBasicBlockRef* exits;
+      // The block per function calling llvm.trap, made when it's needed.
+      LLVMBasicBlockRef fail;
+      // Of const struct mir_inst*, with their values in phi_values: phis are
+      // built empty and filled in last, as what comes into one needn't be
+      // built yet when it is.
+      GPtrArray* phis;
+      GPtrArray* phi_values;
+};
+
+static LLVMTypeRef llvm_int(struct builder* g, int bits) {
+      return LLVMIntTypeInContext(g->ctx, bits);
+}
+
+static LLVMTypeRef llvm_i8_ptr(struct builder* g) {
+      return LLVMPointerType(llvm_int(g, 8), 0);
+}
+
+static LLVMValueRef llvm_i32(struct builder* g, long long n) {
+      return LLVMConstInt(llvm_int(g, 32), n, true);
+}
+
+static LLVMValueRef llvm_i64(struct builder* g, long long n) {
+      return LLVMConstInt(llvm_int(g, 64), n, true);
+}
+
+static LLVMTypeRef llvm_type(struct builder* g, const struct type* type);
+
+// %struct.X, %enum.X and %enum.X.C, made (bodies and all) before any function.
+static LLVMTypeRef llvm_named(struct builder* g, const char* prefix, const char* name, const char* ctor) {
+      char* full = ctor? g_strdup_printf("%s.%s.%s", prefix, name, ctor) : g_strdup_printf("%s.%s", prefix, name);
+      LLVMTypeRef t = LLVMGetTypeByName2(g->ctx, full);
+      g_free(full);
+      assert(t);
+      return t;
+}
+
+static LLVMTypeRef llvm_type(struct builder* g, const struct type* type) {
+      switch (type->kind) {
+            case TYPE_I32:
+                  return llvm_int(g, 32);
+            case TYPE_U8:
+                  return llvm_int(g, 8);
+            case TYPE_BOOL:
+                  return llvm_int(g, 1);
+            case TYPE_UNIT:
+            case TYPE_DIV:
+                  return LLVMVoidTypeInContext(g->ctx);
+            case TYPE_MUT:
+                  return llvm_type(g, type->type);
+            case TYPE_REF:
+            case TYPE_BOX:
+                  return LLVMPointerType(llvm_type(g, type->type), 0);
+            case TYPE_SLICE:
+                  // A slice is passed as a pointer to its first element.
+                  return llvm_type(g, type->type);
+            case TYPE_ARRAY:
+                  return LLVMArrayType(llvm_type(g, type->type), type->length);
+            case TYPE_ID:
+                  if (g_hash_table_lookup(g->module->struct_defs, GINT_TO_POINTER(type->id.value)))
+                        return llvm_named(g, "struct", symbol_to_str(type->id), NULL);
+                  return llvm_named(g, "enum", symbol_to_str(type->id), NULL);
+      }
+      assert(false);
+      return NULL;
+}
+
+static void llvm_attr(struct builder* g, LLVMValueRef fn, unsigned index, const char* name) {
+      unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+      LLVMAddAttributeAtIndex(fn, index, LLVMCreateEnumAttribute(g->ctx, kind, 0));
+}
+
+static LLVMValueRef llvm_call(LLVMBuilderRef b, LLVMValueRef fn, LLVMValueRef* args, unsigned n, const char* name) {
+      return LLVMBuildCall2(b, LLVMGlobalGetValueType(fn), fn, args, n, name);
+}
+
+// *** Runtime ***
+
+// runtime.c's, instruction for instruction, each function built with a
+// builder of its own as it may be wanted halfway through another.
+
+static LLVMValueRef rt_fn(struct builder* g, int which);
+
+// A function of the module's, declared if it isn't yet.
+static LLVMValueRef rt_extern(struct builder* g, const char* name, LLVMTypeRef type) {
+      LLVMValueRef fn = LLVMGetNamedFunction(g->mod, name);
+      if (fn) return fn;
+      fn = LLVMAddFunction(g->mod, name, type);
+      llvm_attr(g, fn, LLVMAttributeFunctionIndex, "nounwind");
+      return fn;
+}
+
+static LLVMValueRef rt_intrinsic(struct builder* g, const char* name, LLVMTypeRef* types, size_t n) {
+      return LLVMGetIntrinsicDeclaration(g->mod, LLVMLookupIntrinsicID(name, strlen(name)), types, n);
+}
+
+// An internal global, zeroed.
+static LLVMValueRef rt_global(struct builder* g, const char* name, LLVMTypeRef type) {
+      LLVMValueRef v = LLVMGetNamedGlobal(g->mod, name);
+      if (v) return v;
+      v = LLVMAddGlobal(g->mod, type, name);
+      LLVMSetInitializer(v, LLVMConstNull(type));
+      LLVMSetLinkage(v, LLVMInternalLinkage);
+      return v;
+}
+
+static LLVMValueRef rt_define(struct builder* g, const char* name, LLVMTypeRef ret, LLVMTypeRef* params, unsigned n) {
+      LLVMValueRef fn = LLVMAddFunction(g->mod, name, LLVMFunctionType(ret, params, n, false));
+      LLVMSetLinkage(fn, LLVMInternalLinkage);
+      llvm_attr(g, fn, LLVMAttributeFunctionIndex, "nounwind");
+      return fn;
+}
+
+static LLVMBasicBlockRef rt_block(struct builder* g, LLVMValueRef fn, const char* name) {
+      return LLVMAppendBasicBlockInContext(g->ctx, fn, name);
+}
+
+static LLVMValueRef rt_malloc(struct builder* g) {
+      LLVMTypeRef i64 = llvm_int(g, 64);
+      bool declared = LLVMGetNamedFunction(g->mod, "malloc");
+      LLVMValueRef fn = rt_extern(g, "malloc", LLVMFunctionType(llvm_i8_ptr(g), &i64, 1, false));
+      if (!declared) llvm_attr(g, fn, LLVMAttributeReturnIndex, "noalias");
+      return fn;
+}
+
+// Element i of a [n x i8] or [n x i64] global.
+static LLVMValueRef rt_index(struct builder* g, LLVMBuilderRef b, LLVMValueRef array, LLVMValueRef i, const char* name) {
+      LLVMValueRef at[] = {llvm_i64(g, 0), i};
+      return LLVMBuildInBoundsGEP2(b, LLVMGlobalGetValueType(array), array, at, 2, name);
+}
+
+static LLVMValueRef rt_build_box(struct builder* g, LLVMBuilderRef b) {
+      LLVMTypeRef i64 = llvm_int(g, 64);
+      LLVMTypeRef pools = LLVMArrayType(i64, 17);
+      LLVMValueRef pool_next = rt_global(g, "rt.pool.next", pools);
+      LLVMValueRef pool_end = rt_global(g, "rt.pool.end", pools);
+      LLVMValueRef malloc_fn = rt_malloc(g);
+      LLVMValueRef fn = rt_define(g, "rt.box", llvm_i8_ptr(g), &i64, 1);
+      LLVMValueRef size = LLVMGetParam(fn, 0);
+      LLVMSetValueName2(size, "size", 4);
+
+      LLVMBasicBlockRef entry = rt_block(g, fn, "entry");
+      LLVMBasicBlockRef heap = rt_block(g, fn, "heap");
+      LLVMBasicBlockRef pool = rt_block(g, fn, "pool");
+      LLVMBasicBlockRef take = rt_block(g, fn, "take");
+      LLVMBasicBlockRef refill = rt_block(g, fn, "refill");
+
+      LLVMPositionBuilderAtEnd(b, entry);
+      LLVMValueRef big = LLVMBuildICmp(b, LLVMIntUGT, size, llvm_i64(g, 256), "big");
+      LLVMBuildCondBr(b, big, heap, pool);
+
+      LLVMPositionBuilderAtEnd(b, heap);
+      LLVMBuildRet(b, llvm_call(b, malloc_fn, &size, 1, "p"));
+
+      LLVMPositionBuilderAtEnd(b, pool);
+      LLVMValueRef up = LLVMBuildAdd(b, size, llvm_i64(g, 15), "up");
+      LLVMValueRef class = LLVMBuildLShr(b, up, llvm_i64(g, 4), "class");
+      LLVMValueRef bytes = LLVMBuildShl(b, class, llvm_i64(g, 4), "bytes");
+      LLVMValueRef nextp = rt_index(g, b, pool_next, class, "nextp");
+      LLVMValueRef endp = rt_index(g, b, pool_end, class, "endp");
+      LLVMValueRef next = LLVMBuildLoad2(b, i64, nextp, "next");
+      LLVMValueRef end = LLVMBuildLoad2(b, i64, endp, "end");
+      LLVMValueRef after = LLVMBuildAdd(b, next, bytes, "after");
+      LLVMValueRef full = LLVMBuildICmp(b, LLVMIntUGT, after, end, "full");
+      LLVMBuildCondBr(b, full, refill, take);
+
+      LLVMPositionBuilderAtEnd(b, take);
+      LLVMBuildStore(b, after, nextp);
+      LLVMBuildRet(b, LLVMBuildIntToPtr(b, next, llvm_i8_ptr(g), "q"));
+
+      LLVMPositionBuilderAtEnd(b, refill);
+      LLVMValueRef chunk = LLVMBuildMul(b, bytes, llvm_i64(g, 64), "chunk");
+      LLVMValueRef c = llvm_call(b, malloc_fn, &chunk, 1, "c");
+      LLVMValueRef ci = LLVMBuildPtrToInt(b, c, i64, "ci");
+      LLVMBuildStore(b, LLVMBuildAdd(b, ci, bytes, "cnext"), nextp);
+      LLVMBuildStore(b, LLVMBuildAdd(b, ci, chunk, "cend"), endp);
+      LLVMBuildRet(b, c);
+      return fn;
+}
+
+static LLVMValueRef rt_out_buf(struct builder* g) {
+      return rt_global(g, "rt.out.buf", LLVMArrayType(llvm_int(g, 8), 65536));
+}
+
+static LLVMValueRef rt_out_len(struct builder* g) {
+      return rt_global(g, "rt.out.len", llvm_int(g, 64));
+}
+
+static LLVMValueRef rt_build_write(struct builder* g, LLVMBuilderRef b) {
+      LLVMTypeRef i64 = llvm_int(g, 64);
+      LLVMTypeRef write_params[] = {llvm_int(g, 32), llvm_i8_ptr(g), i64};
+      LLVMValueRef write_fn = LLVMGetNamedFunction(g->mod, "write");
+      if (!write_fn) write_fn = LLVMAddFunction(g->mod, "write", LLVMFunctionType(i64, write_params, 3, false));
+      LLVMTypeRef params[] = {llvm_i8_ptr(g), i64};
+      LLVMValueRef fn = rt_define(g, "rt.write", LLVMVoidTypeInContext(g->ctx), params, 2);
+      LLVMValueRef p = LLVMGetParam(fn, 0), n = LLVMGetParam(fn, 1);
+      LLVMSetValueName2(p, "p", 1);
+      LLVMSetValueName2(n, "n", 1);
+
+      LLVMBasicBlockRef entry = rt_block(g, fn, "entry");
+      LLVMBasicBlockRef loop = rt_block(g, fn, "loop");
+      LLVMBasicBlockRef write = rt_block(g, fn, "write");
+      LLVMBasicBlockRef wrote = rt_block(g, fn, "wrote");
+      LLVMBasicBlockRef done = rt_block(g, fn, "done");
+
+      LLVMPositionBuilderAtEnd(b, entry);
+      LLVMBuildBr(b, loop);
+
+      LLVMPositionBuilderAtEnd(b, loop);
+      LLVMValueRef at = LLVMBuildPhi(b, llvm_i8_ptr(g), "at");
+      LLVMValueRef left = LLVMBuildPhi(b, i64, "left");
+      LLVMValueRef more = LLVMBuildICmp(b, LLVMIntSGT, left, llvm_i64(g, 0), "more");
+      LLVMBuildCondBr(b, more, write, done);
+
+      LLVMPositionBuilderAtEnd(b, write);
+      LLVMValueRef args[] = {llvm_i32(g, 1), at, left};
+      LLVMValueRef w = llvm_call(b, write_fn, args, 3, "w");
+      LLVMValueRef ok = LLVMBuildICmp(b, LLVMIntSGT, w, llvm_i64(g, 0), "ok");
+      LLVMBuildCondBr(b, ok, wrote, done);
+
+      LLVMPositionBuilderAtEnd(b, wrote);
+      LLVMValueRef next = LLVMBuildInBoundsGEP2(b, llvm_int(g, 8), at, &w, 1, "next");
+      LLVMValueRef rest = LLVMBuildSub(b, left, w, "rest");
+      LLVMBuildBr(b, loop);
+
+      LLVMValueRef at_in[] = {p, next}, left_in[] = {n, rest};
+      LLVMBasicBlockRef from[] = {entry, wrote};
+      LLVMAddIncoming(at, at_in, from, 2);
+      LLVMAddIncoming(left, left_in, from, 2);
+
+      LLVMPositionBuilderAtEnd(b, done);
+      LLVMBuildRetVoid(b);
+      return fn;
+}
+
+static LLVMValueRef rt_build_flush(struct builder* g, LLVMBuilderRef b) {
+      LLVMValueRef write_fn = rt_fn(g, RT_WRITE);
+      LLVMValueRef out_buf = rt_out_buf(g), out_len = rt_out_len(g);
+      LLVMValueRef fn = rt_define(g, "rt.flush", LLVMVoidTypeInContext(g->ctx), NULL, 0);
+
+      LLVMPositionBuilderAtEnd(b, rt_block(g, fn, "entry"));
+      LLVMValueRef len = LLVMBuildLoad2(b, llvm_int(g, 64), out_len, "len");
+      LLVMValueRef args[] = {rt_index(g, b, out_buf, llvm_i64(g, 0), "buf"), len};
+      llvm_call(b, write_fn, args, 2, "");
+      LLVMBuildStore(b, llvm_i64(g, 0), out_len);
+      LLVMBuildRetVoid(b);
+      return fn;
+}
+
+static LLVMValueRef rt_build_print_str(struct builder* g, LLVMBuilderRef b) {
+      LLVMTypeRef i64 = llvm_int(g, 64);
+      LLVMValueRef write_fn = rt_fn(g, RT_WRITE), flush_fn = rt_fn(g, RT_FLUSH);
+      LLVMTypeRef copy_types[] = {llvm_i8_ptr(g), llvm_i8_ptr(g), i64};
+      LLVMValueRef memcpy_fn = rt_intrinsic(g, "llvm.memcpy", copy_types, 3);
+      LLVMValueRef out_buf = rt_out_buf(g), out_len = rt_out_len(g);
+      LLVMTypeRef params[] = {llvm_i8_ptr(g), i64};
+      LLVMValueRef fn = rt_define(g, "rt.print.str", LLVMVoidTypeInContext(g->ctx), params, 2);
+      LLVMValueRef s = LLVMGetParam(fn, 0), n = LLVMGetParam(fn, 1);
+      LLVMSetValueName2(s, "s", 1);
+      LLVMSetValueName2(n, "n", 1);
+
+      LLVMBasicBlockRef entry = rt_block(g, fn, "entry");
+      LLVMBasicBlockRef flush = rt_block(g, fn, "flush");
+      LLVMBasicBlockRef direct = rt_block(g, fn, "direct");
+      LLVMBasicBlockRef copy = rt_block(g, fn, "copy");
+
+      LLVMPositionBuilderAtEnd(b, entry);
+      LLVMValueRef len = LLVMBuildLoad2(b, i64, out_len, "len");
+      LLVMValueRef end = LLVMBuildAdd(b, len, n, "end");
+      LLVMValueRef fits = LLVMBuildICmp(b, LLVMIntULE, end, llvm_i64(g, 65536), "fits");
+      LLVMBuildCondBr(b, fits, copy, flush);
+
+      LLVMPositionBuilderAtEnd(b, flush);
+      llvm_call(b, flush_fn, NULL, 0, "");
+      LLVMValueRef big = LLVMBuildICmp(b, LLVMIntUGT, n, llvm_i64(g, 65536), "big");
+      LLVMBuildCondBr(b, big, direct, copy);
+
+      LLVMPositionBuilderAtEnd(b, direct);
+      LLVMValueRef args[] = {s, n};
+      llvm_call(b, write_fn, args, 2, "");
+      LLVMBuildRetVoid(b);
+
+      LLVMPositionBuilderAtEnd(b, copy);
+      LLVMValueRef at = LLVMBuildPhi(b, i64, "at");
+      LLVMValueRef at_in[] = {len, llvm_i64(g, 0)};
+      LLVMBasicBlockRef from[] = {entry, flush};
+      LLVMAddIncoming(at, at_in, from, 2);
+      LLVMValueRef copy_args[] = {rt_index(g, b, out_buf, at, "dst"), s, n, LLVMConstInt(llvm_int(g, 1), 0, false)};
+      llvm_call(b, memcpy_fn, copy_args, 4, "");
+      LLVMBuildStore(b, LLVMBuildAdd(b, at, n, "after"), out_len);
+      LLVMBuildRetVoid(b);
+      return fn;
+}
+
+static LLVMValueRef rt_build_print_cstr(struct builder* g, LLVMBuilderRef b) {
+      LLVMTypeRef i8p = llvm_i8_ptr(g);
+      LLVMValueRef print_fn = rt_fn(g, RT_PRINT_STR);
+      bool declared = LLVMGetNamedFunction(g->mod, "strlen");
+      LLVMValueRef strlen_fn = rt_extern(g, "strlen", LLVMFunctionType(llvm_int(g, 64), &i8p, 1, false));
+      if (!declared) llvm_attr(g, strlen_fn, LLVMAttributeFunctionIndex, "readonly");
+      LLVMValueRef fn = rt_define(g, "rt.print.cstr", LLVMVoidTypeInContext(g->ctx), &i8p, 1);
+      LLVMValueRef s = LLVMGetParam(fn, 0);
+      LLVMSetValueName2(s, "s", 1);
+
+      LLVMPositionBuilderAtEnd(b, rt_block(g, fn, "entry"));
+      LLVMValueRef args[] = {s, llvm_call(b, strlen_fn, &s, 1, "n")};
+      llvm_call(b, print_fn, args, 2, "");
+      LLVMBuildRetVoid(b);
+      return fn;
+}
+
+static LLVMValueRef rt_build_print_int(struct builder* g, LLVMBuilderRef b) {
+      LLVMTypeRef i32 = llvm_int(g, 32), i64 = llvm_int(g, 64);
+      LLVMTypeRef digits_type = LLVMArrayType(llvm_int(g, 8), 11);
+      LLVMValueRef print_fn = rt_fn(g, RT_PRINT_STR);
+      LLVMValueRef fn = rt_define(g, "rt.print.int", LLVMVoidTypeInContext(g->ctx), &i32, 1);
+      LLVMValueRef v = LLVMGetParam(fn, 0);
+      LLVMSetValueName2(v, "v", 1);
+
+      LLVMBasicBlockRef entry = rt_block(g, fn, "entry");
+      LLVMBasicBlockRef loop = rt_block(g, fn, "loop");
+      LLVMBasicBlockRef sign = rt_block(g, fn, "sign");
+      LLVMBasicBlockRef negative = rt_block(g, fn, "negative");
+      LLVMBasicBlockRef out = rt_block(g, fn, "out");
+
+      LLVMPositionBuilderAtEnd(b, entry);
+      LLVMValueRef digits = LLVMBuildAlloca(b, digits_type, "digits");
+      LLVMValueRef neg = LLVMBuildICmp(b, LLVMIntSLT, v, llvm_i32(g, 0), "neg");
+      LLVMValueRef minus = LLVMBuildSub(b, llvm_i32(g, 0), v, "minus");
+      LLVMValueRef mag = LLVMBuildSelect(b, neg, minus, v, "mag");
+      LLVMBuildBr(b, loop);
+
+      LLVMPositionBuilderAtEnd(b, loop);
+      LLVMValueRef x = LLVMBuildPhi(b, i32, "x");
+      LLVMValueRef i = LLVMBuildPhi(b, i64, "i");
+      LLVMValueRef q = LLVMBuildUDiv(b, x, llvm_i32(g, 10), "q");
+      LLVMValueRef tens = LLVMBuildMul(b, q, llvm_i32(g, 10), "tens");
+      LLVMValueRef r = LLVMBuildSub(b, x, tens, "r");
+      LLVMValueRef r8 = LLVMBuildTrunc(b, r, llvm_int(g, 8), "r8");
+      LLVMValueRef c = LLVMBuildAdd(b, r8, LLVMConstInt(llvm_int(g, 8), '0', false), "c");
+      LLVMValueRef j = LLVMBuildSub(b, i, llvm_i64(g, 1), "j");
+      LLVMValueRef pj[] = {llvm_i64(g, 0), j};
+      LLVMBuildStore(b, c, LLVMBuildInBoundsGEP2(b, digits_type, digits, pj, 2, "p"));
+      LLVMValueRef more = LLVMBuildICmp(b, LLVMIntNE, q, llvm_i32(g, 0), "more");
+      LLVMBuildCondBr(b, more, loop, sign);
+
+      LLVMValueRef x_in[] = {mag, q}, i_in[] = {llvm_i64(g, 11), j};
+      LLVMBasicBlockRef loop_from[] = {entry, loop};
+      LLVMAddIncoming(x, x_in, loop_from, 2);
+      LLVMAddIncoming(i, i_in, loop_from, 2);
+
+      LLVMPositionBuilderAtEnd(b, sign);
+      LLVMValueRef k = LLVMBuildSub(b, j, llvm_i64(g, 1), "k");
+      LLVMValueRef pk[] = {llvm_i64(g, 0), k};
+      LLVMValueRef s = LLVMBuildInBoundsGEP2(b, digits_type, digits, pk, 2, "s");
+      LLVMBuildCondBr(b, neg, negative, out);
+
+      LLVMPositionBuilderAtEnd(b, negative);
+      LLVMBuildStore(b, LLVMConstInt(llvm_int(g, 8), '-', false), s);
+      LLVMBuildBr(b, out);
+
+      LLVMPositionBuilderAtEnd(b, out);
+      LLVMValueRef from = LLVMBuildPhi(b, i64, "from");
+      LLVMValueRef from_in[] = {j, k};
+      LLVMBasicBlockRef out_from[] = {sign, negative};
+      LLVMAddIncoming(from, from_in, out_from, 2);
+      LLVMValueRef pf[] = {llvm_i64(g, 0), from};
+      LLVMValueRef args[] = {
+            LLVMBuildInBoundsGEP2(b, digits_type, digits, pf, 2, "at"),
+            LLVMBuildSub(b, llvm_i64(g, 11), from, "n"),
+      };
+      llvm_call(b, print_fn, args, 2, "");
+      LLVMBuildRetVoid(b);
+      return fn;
+}
+
+static LLVMValueRef rt_fn(struct builder* g, int which) {
+      static LLVMValueRef (*const build[RT_NFNS])(struct builder*, LLVMBuilderRef) = {
+            [RT_BOX] = rt_build_box,
+            [RT_WRITE] = rt_build_write,
+            [RT_FLUSH] = rt_build_flush,
+            [RT_PRINT_STR] = rt_build_print_str,
+            [RT_PRINT_CSTR] = rt_build_print_cstr,
+            [RT_PRINT_INT] = rt_build_print_int,
+      };
+      if (!g->rt[which]) {
+            LLVMBuilderRef b = LLVMCreateBuilderInContext(g->ctx);
+            g->rt[which] = build[which](g, b);
+            LLVMDisposeBuilder(b);
+      }
+      return g->rt[which];
+}
+
+// *** Functions ***
+
+static const char* reg_name(struct builder* g, int reg) {
+      const char* name = mir_reg_info(g->fn, reg)->name;
+      return name? name : "";
+}
+
+static LLVMValueRef build_value(struct builder* g, const struct mir_value* v) {
+      switch (v->kind) {
+            case MIR_REG:
+                  // Only a block nothing reaches uses a register before it's built.
+                  if (!g->regs[v->n]) return LLVMGetUndef(llvm_type(g, v->type));
+                  return g->regs[v->n];
+            case MIR_CONST:
+                  return LLVMConstInt(llvm_type(g, v->type), (long long)v->n, true);
+            case MIR_STR:
+                  return g->strs[v->n];
+            case MIR_UNDEF:
+                  return LLVMGetUndef(llvm_type(g, v->type));
+      }
+      assert(false);
+      return NULL;
+}
+
+static void set_dst(struct builder* g, const struct mir_inst* inst, LLVMValueRef v) {
+      g->regs[inst->dst] = v;
+}
+
+static LLVMValueRef build_binary(struct builder* g, const struct mir_inst* inst) {
+      LLVMValueRef a = build_value(g, &inst->a), b = build_value(g, &inst->b);
+      const char* name = reg_name(g, inst->dst);
+      // u8s compare unsigned.
+      bool u8 = inst->a.type->kind == TYPE_U8;
+
+      switch (inst->op) {
+            case OP_ADD:
+            case OP_ADD_ASSIGN:
+                  return LLVMBuildAdd(g->b, a, b, name);
+            case OP_SUB:
+            case OP_SUB_ASSIGN:
+                  return LLVMBuildSub(g->b, a, b, name);
+            case OP_MUL:
+            case OP_MUL_ASSIGN:
+                  return LLVMBuildMul(g->b, a, b, name);
+            case OP_DIV:
+            case OP_DIV_ASSIGN:
+                  return LLVMBuildSDiv(g->b, a, b, name);
+            case OP_REM:
+            case OP_REM_ASSIGN:
+                  return LLVMBuildSRem(g->b, a, b, name);
+            case OP_AND:
+                  return LLVMBuildAnd(g->b, a, b, name);
+            case OP_OR:
+                  return LLVMBuildOr(g->b, a, b, name);
+            case OP_EQ:
+                  return LLVMBuildICmp(g->b, LLVMIntEQ, a, b, name);
+            case OP_NEQ:
+                  return LLVMBuildICmp(g->b, LLVMIntNE, a, b, name);
+            case OP_LT:
+                  return LLVMBuildICmp(g->b, u8? LLVMIntULT : LLVMIntSLT, a, b, name);
+            case OP_LEQ:
+                  return LLVMBuildICmp(g->b, u8? LLVMIntULE : LLVMIntSLE, a, b, name);
+            case OP_GT:
+                  return LLVMBuildICmp(g->b, u8? LLVMIntUGT : LLVMIntSGT, a, b, name);
+            case OP_GEQ:
+                  return LLVMBuildICmp(g->b, u8? LLVMIntUGE : LLVMIntSGE, a, b, name);
+      }
+      assert(false);
+      return NULL;
+}
+
+// printi and prints, as in mir_emit.c.
+static void build_print(struct builder* g, bool str, const struct mir_value* arg) {
+      LLVMValueRef v = build_value(g, arg);
+      if (!str) llvm_call(g->b, rt_fn(g, RT_PRINT_INT), &v, 1, "");
+      else if (arg->kind != MIR_STR) llvm_call(g->b, rt_fn(g, RT_PRINT_CSTR), &v, 1, "");
+      else {
+            LLVMValueRef args[] = {v, llvm_i64(g, strlen(arg->str))};
+            llvm_call(g->b, rt_fn(g, RT_PRINT_STR), args, 2, "");
+      }
+}
+
+static void build_call(struct builder* g, const struct mir_inst* inst) {
+      const char* name = symbol_to_str(inst->fn);
+
+      if (inst->args->len == 1 && (!strcmp(name, "printi") || !strcmp(name, "prints"))) {
+            build_print(g, name[5] == 's', &g_array_index(inst->args, struct mir_value, 0));
+            return;
+      }
+
+      LLVMValueRef fn = LLVMGetNamedFunction(g->mod, name);
+      assert(fn);
+      LLVMValueRef* args = g_new(LLVMValueRef, inst->args->len + 1);
+      for (guint i = 0; i != inst->args->len; ++i)
+            args[i] = build_value(g, &g_array_index(inst->args, struct mir_value, i));
+      LLVMValueRef call = llvm_call(g->b, fn, args, inst->args->len, inst->dst < 0? "" : reg_name(g, inst->dst));
+      g_free(args);
+      if (inst->tail) LLVMSetTailCall(call, true);
+      if (inst->dst >= 0) set_dst(g, inst, call);
+}
+
+// &base->(field n of the struct it points to).
+static LLVMValueRef build_field_addr(struct builder* g, LLVMTypeRef type, LLVMValueRef base, int n, const char* name) {
+      return LLVMBuildStructGEP2(g->b, type, base, n, name);
+}
+
+// MIR_TAG, MIR_SET_TAG and MIR_PAYLOAD, following mir_emit.c's emit_enum_inst().
+static void build_enum_inst(struct builder* g, const struct mir_inst* inst) {
+      const struct type* type = inst->a.type->unmut->type;
+      const struct enum_layout* lay = mir_enum_layout(g->layouts, type);
+      LLVMTypeRef enum_type = llvm_type(g, type);
+      LLVMValueRef a = build_value(g, &inst->a);
+
+      if (inst->kind == MIR_PAYLOAD) {
+            const char* name = reg_name(g, inst->dst);
+            if (lay->kind == LAYOUT_NICHE) {
+                  set_dst(g, inst, build_field_addr(g, enum_type, a, inst->field, name));
+                  return;
+            }
+            const struct pair* ctor = mir_enum_ctor(g->layouts, type, inst->n);
+            LLVMTypeRef ctor_type = llvm_named(g, "enum", symbol_to_str(type->unmut->id), symbol_to_str(ctor->ctor_def.id));
+            LLVMValueRef t = build_field_addr(g, enum_type, a, 1, "");
+            LLVMValueRef c = LLVMBuildBitCast(g->b, t, LLVMPointerType(ctor_type, 0), "");
+            set_dst(g, inst, build_field_addr(g, ctor_type, c, inst->field, name));
+            return;
+      }
+
+      if (lay->kind == LAYOUT_NICHE) {
+            // The constructor with the pointer is there as soon as the pointer is.
+            if (inst->kind == MIR_SET_TAG && inst->n == lay->data_ctor) return;
+
+            const struct pair* ctor = mir_enum_ctor(g->layouts, type, lay->data_ctor);
+            LLVMTypeRef ptr = llvm_type(g, g_list_nth_data(ctor->ctor_def.types, lay->niche_field));
+            LLVMValueRef t = build_field_addr(g, enum_type, a, lay->niche_field, "");
+            if (inst->kind == MIR_SET_TAG) {
+                  LLVMBuildStore(g->b, LLVMConstNull(ptr), t);
+                  return;
+            }
+            LLVMValueRef v = LLVMBuildLoad2(g->b, ptr, t, "");
+            LLVMValueRef c = LLVMBuildICmp(g->b, lay->data_ctor? LLVMIntNE : LLVMIntEQ, v, LLVMConstNull(ptr), "");
+            set_dst(g, inst, LLVMBuildZExt(g->b, c, llvm_int(g, 32), reg_name(g, inst->dst)));
+            return;
+      }
+
+      LLVMTypeRef tag = llvm_int(g, lay->tag_bits);
+      LLVMValueRef t = build_field_addr(g, enum_type, a, 0, "");
+      if (inst->kind == MIR_SET_TAG) {
+            LLVMBuildStore(g->b, LLVMConstInt(tag, inst->n, false), t);
+            return;
+      }
+      if (lay->tag_bits == 32) {
+            set_dst(g, inst, LLVMBuildLoad2(g->b, tag, t, reg_name(g, inst->dst)));
+            return;
+      }
+      LLVMValueRef v = LLVMBuildLoad2(g->b, tag, t, "");
+      set_dst(g, inst, LLVMBuildZExt(g->b, v, llvm_int(g, 32), reg_name(g, inst->dst)));
+}
+
+static LLVMBasicBlockRef build_fail(struct builder* g) {
+      if (g->fail) return g->fail;
+      g->fail = LLVMAppendBasicBlockInContext(g->ctx, g->llfn, "bounds.fail");
+      LLVMBuilderRef b = LLVMCreateBuilderInContext(g->ctx);
+      LLVMPositionBuilderAtEnd(b, g->fail);
+      llvm_call(b, rt_fn(g, RT_FLUSH), NULL, 0, "");
+      LLVMValueRef trap = llvm_call(b, rt_intrinsic(g, "llvm.trap", NULL, 0), NULL, 0, "");
+      LLVMAddCallSiteAttribute(trap, LLVMAttributeFunctionIndex,
+                  LLVMCreateEnumAttribute(g->ctx, LLVMGetEnumAttributeKindForName("noreturn", 8), 0));
+      LLVMBuildUnreachable(b);
+      LLVMDisposeBuilder(b);
+      return g->fail;
+}
+
+// MIR_BOUNDS: the rest of the block goes on in <label>.ok<n>, right after.
+static void build_bounds(struct builder* g, const struct mir_inst* inst, const char* label, int n) {
+      LLVMValueRef in = LLVMBuildICmp(g->b, LLVMIntULT, build_value(g, &inst->a), llvm_i32(g, inst->n), "");
+      char* name = g_strdup_printf("%s.ok%d", label, n);
+      LLVMBasicBlockRef here = LLVMGetInsertBlock(g->b);
+      LLVMBasicBlockRef ok = LLVMAppendBasicBlockInContext(g->ctx, g->llfn, name);
+      g_free(name);
+      LLVMMoveBasicBlockAfter(ok, here);
+      LLVMBuildCondBr(g->b, in, ok, build_fail(g));
+      LLVMPositionBuilderAtEnd(g->b, ok);
+}
+
+// MIR_BOX: room for the value from the runtime, as the right pointer.
+static void build_box(struct builder* g, const struct mir_inst* inst) {
+      const struct type* type = mir_reg_info(g->fn, inst->dst)->type;
+      int size, align;
+      mir_layout_type(g->layouts, type->type, &size, &align);
+
+      LLVMValueRef n = llvm_i64(g, size);
+      LLVMValueRef t = llvm_call(g->b, rt_fn(g, RT_BOX), &n, 1, "");
+      set_dst(g, inst, LLVMBuildBitCast(g->b, t, llvm_type(g, type), reg_name(g, inst->dst)));
+}
+
+static void build_inst(struct builder* g, const struct mir_inst* inst) {
+      const char* name = inst->dst < 0? "" : reg_name(g, inst->dst);
+
+      switch (inst->kind) {
+            case MIR_BINARY:
+                  set_dst(g, inst, build_binary(g, inst));
+                  return;
+            case MIR_NEG:
+                  set_dst(g, inst, LLVMBuildSub(g->b, LLVMConstNull(llvm_type(g, inst->a.type)), build_value(g, &inst->a), name));
+                  return;
+            case MIR_NOT:
+                  set_dst(g, inst, LLVMBuildXor(g->b, build_value(g, &inst->a), LLVMConstInt(llvm_int(g, 1), 1, false), name));
+                  return;
+            case MIR_ALLOCA:
+                  set_dst(g, inst, LLVMBuildAlloca(g->b, llvm_type(g, mir_reg_info(g->fn, inst->dst)->type->type), name));
+                  return;
+            case MIR_LOAD:
+                  set_dst(g, inst, LLVMBuildLoad2(g->b, llvm_type(g, mir_reg_info(g->fn, inst->dst)->type), build_value(g, &inst->a), name));
+                  return;
+            case MIR_STORE:
+                  LLVMBuildStore(g->b, build_value(g, &inst->b), build_value(g, &inst->a));
+                  return;
+            case MIR_FIELD: {
+                  const struct type* type = inst->a.type->unmut->type;
+                  int slot = mir_struct_layout(g->layouts, type)->slot[inst->n];
+                  set_dst(g, inst, build_field_addr(g, llvm_type(g, type), build_value(g, &inst->a), slot, name));
+                  return;
+            }
+            case MIR_ELEM: {
+                  LLVMValueRef at[] = {llvm_i32(g, 0), build_value(g, &inst->b)};
+                  LLVMTypeRef type = llvm_type(g, inst->a.type->unmut->type);
+                  set_dst(g, inst, LLVMBuildInBoundsGEP2(g->b, type, build_value(g, &inst->a), at, 2, name));
+                  return;
+            }
+            case MIR_CALL:
+                  build_call(g, inst);
+                  return;
+            case MIR_PHI:
+                  set_dst(g, inst, LLVMBuildPhi(g->b, llvm_type(g, mir_reg_info(g->fn, inst->dst)->type), name));
+                  g_ptr_array_add(g->phis, (void*)inst);
+                  g_ptr_array_add(g->phi_values, g->regs[inst->dst]);
+                  return;
+            case MIR_TAG:
+            case MIR_SET_TAG:
+            case MIR_PAYLOAD:
+                  build_enum_inst(g, inst);
+                  return;
+            case MIR_BOX:
+                  build_box(g, inst);
+                  return;
+      }
+      assert(false);
+}
+
+static void build_term(struct builder* g, const struct mir_term* term) {
+      LLVMValueRef t = NULL;
+      switch (term->kind) {
+            case MIR_JUMP:
+                  t = LLVMBuildBr(g->b, g->starts[term->to[0]->id]);
+                  break;
+            case MIR_BRANCH:
+                  t = LLVMBuildCondBr(g->b, build_value(g, &term->value),
+                              g->starts[term->to[0]->id], g->starts[term->to[1]->id]);
+                  break;
+            case MIR_SWITCH:
+                  t = LLVMBuildSwitch(g->b, build_value(g, &term->value), g->starts[term->to[0]->id], term->cases->len);
+                  for (guint i = 0; i != term->cases->len; ++i) {
+                        const struct mir_case* c = &g_array_index(term->cases, struct mir_case, i);
+                        LLVMAddCase(t, LLVMConstInt(llvm_type(g, term->value.type), (long long)c->n, true), g->starts[c->to->id]);
+                  }
+                  break;
+            case MIR_RETURN:
+                  if (g->fn->id.value == symbol_main().value) {
+                        llvm_call(g->b, rt_fn(g, RT_FLUSH), NULL, 0, "");
+                        t = LLVMBuildRet(g->b, llvm_i32(g, 0));
+                  } else if (term->value.kind == MIR_NONE) t = LLVMBuildRetVoid(g->b);
+                  else t = LLVMBuildRet(g->b, build_value(g, &term->value));
+                  break;
+            case MIR_UNREACHABLE:
+                  t = LLVMBuildUnreachable(g->b);
+                  break;
+            default:
+                  assert(false);
+      }
+
+      // Each loop its own node, by pointing at itself.
+      if (term->vectorize) {
+            LLVMMetadataRef self = LLVMTemporaryMDNode(g->ctx, NULL, 0);
+            LLVMMetadataRef ops[] = {self, g->vectorize};
+            LLVMMetadataRef loop = LLVMMDNodeInContext2(g->ctx, ops, 2);
+            LLVMMetadataReplaceAllUsesWith(self, loop);
+            LLVMSetMetadata(t, g->loop_kind, LLVMMetadataAsValue(g->ctx, loop));
+      }
+}
+
+static void build_block(struct builder* g, const struct mir_block* b) {
+      LLVMPositionBuilderAtEnd(g->b, g->starts[b->id]);
+      const char* label = LLVMGetBasicBlockName(g->starts[b->id]);
+      int checks = 0;
+      for (guint j = 0; j != b->insts->len; ++j) {
+            const struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+            if (inst->kind == MIR_BOUNDS) build_bounds(g, inst, label, ++checks);
+            else build_inst(g, inst);
+      }
+      build_term(g, &b->term);
+      g->exits[b->id] = LLVMGetInsertBlock(g->b);
+      g->insts += b->insts->len + 1;
+}
+
+static LLVMValueRef declare_fn(struct builder* g, const struct mir_fn* fn) {
+      guint n = fn->params->len;
+      LLVMTypeRef* params = g_new(LLVMTypeRef, n + 1);
+      for (guint i = 0; i != n; ++i)
+            params[i] = llvm_type(g, g_array_index(fn->params, struct mir_value, i).type);
+      LLVMTypeRef ret = fn->id.value == symbol_main().value? llvm_int(g, 32) : llvm_type(g, fn->ret);
+      LLVMValueRef llfn = LLVMAddFunction(g->mod, symbol_to_str(fn->id), LLVMFunctionType(ret, params, n, false));
+      g_free(params);
+      llvm_attr(g, llfn, LLVMAttributeFunctionIndex, "nounwind");
+      return llfn;
+}
+
+static void build_fn(struct builder* g, struct mir_fn* fn) {
+      assert(fn->blocks->len);
+      g->fn = fn;
+      g->llfn = LLVMGetNamedFunction(g->mod, symbol_to_str(fn->id));
+      g->regs = g_new0(LLVMValueRef, fn->regs->len);
+      g->starts = g_new0(LLVMBasicBlockRef, fn->next_block);
+      g->exits = g_new0(LLVMBasicBlockRef, fn->next_block);
+      g->fail = NULL;
+      g->phis = g_ptr_array_new();
+      g->phi_values = g_ptr_array_new();
+
+      for (guint i = 0; i != fn->params->len; ++i) {
+            int reg = g_array_index(fn->params, struct mir_value, i).n;
+            g->regs[reg] = LLVMGetParam(g->llfn, i);
+            LLVMSetValueName2(g->regs[reg], reg_name(g, reg), strlen(reg_name(g, reg)));
+      }
+
+      // The blocks go in in MIR's order, but are filled in dominators first,
+      // so that every register is built before it's used (but by a phi).
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            const struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            char* label = i? g_strdup_printf("%s%d", b->name, b->id) : g_strdup("entry");
+            g->starts[b->id] = LLVMAppendBasicBlockInContext(g->ctx, g->llfn, label);
+            g_free(label);
+      }
+      GPtrArray* order = mir_number_blocks(fn);
+      for (guint i = 0; i != order->len; ++i)
+            build_block(g, g_ptr_array_index(order, i));
+      g_ptr_array_free(order, true);
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            const struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            if (b->mark < 0) build_block(g, b);
+      }
+      if (g->fail) LLVMMoveBasicBlockAfter(g->fail, LLVMGetLastBasicBlock(g->llfn));
+
+      for (guint i = 0; i != g->phis->len; ++i) {
+            const struct mir_inst* inst = g_ptr_array_index(g->phis, i);
+            guint n = inst->args->len;
+            LLVMValueRef* values = g_new(LLVMValueRef, n + 1);
+            LLVMBasicBlockRef* from = g_new(LLVMBasicBlockRef, n + 1);
+            for (guint j = 0; j != n; ++j) {
+                  values[j] = build_value(g, &g_array_index(inst->args, struct mir_value, j));
+                  from[j] = g->exits[((const struct mir_block*)g_ptr_array_index(inst->preds, j))->id];
+            }
+            LLVMAddIncoming(g_ptr_array_index(g->phi_values, i), values, from, n);
+            g_free(values);
+            g_free(from);
+      }
+
+      g_ptr_array_free(g->phis, true);
+      g_ptr_array_free(g->phi_values, true);
+      g_free(g->regs);
+      g_free(g->starts);
+      g_free(g->exits);
+}
+
+// *** Modules ***
+
+static void build_struct(struct builder* g, const struct item* def) {
+      const struct struct_layout* lay = g_hash_table_lookup(g->layouts->structs, GINT_TO_POINTER(def->id.value));
+      LLVMTypeRef* fields = g_new(LLVMTypeRef, lay->nfields + 1);
+      for (int i = 0; i != lay->nfields; ++i) {
+            const struct pair* field = g_list_nth_data(def->struct_def.fields, lay->slot[lay->nfields + i]);
+            fields[i] = llvm_type(g, field->field_def.type);
+      }
+      LLVMStructSetBody(llvm_named(g, "struct", symbol_to_str(def->id), NULL), fields, lay->nfields, false);
+      g_free(fields);
+}
+
+static void build_fields(struct builder* g, LLVMTypeRef type, const GList* types) {
+      guint n = g_list_length((GList*)types);
+      LLVMTypeRef* fields = g_new(LLVMTypeRef, n + 1);
+      n = 0;
+      for (const GList* t = types; t; t = t->next)
+            fields[n++] = llvm_type(g, t->data);
+      LLVMStructSetBody(type, fields, n, false);
+      g_free(fields);
+}
+
+static void build_enum(struct builder* g, const struct item* def) {
+      const struct enum_layout* lay = g_hash_table_lookup(g->layouts->enums, GINT_TO_POINTER(def->id.value));
+      const char* name = symbol_to_str(def->id);
+      LLVMTypeRef type = llvm_named(g, "enum", name, NULL);
+
+      if (lay->kind == LAYOUT_NICHE) {
+            const struct pair* ctor = g_list_nth_data(def->enum_def.ctors, lay->data_ctor);
+            build_fields(g, type, ctor->ctor_def.types);
+            return;
+      }
+      LLVMTypeRef fields[] = {
+            llvm_int(g, lay->tag_bits),
+            LLVMArrayType(llvm_int(g, lay->payload_align * 8), lay->payload_n),
+      };
+      LLVMStructSetBody(type, fields, lay->kind == LAYOUT_UNION? 2 : 1, false);
+
+      if (lay->kind != LAYOUT_UNION) return;
+      for (const GList* p = def->enum_def.ctors; p; p = p->next) {
+            const struct pair* ctor = p->data;
+            if (!ctor->ctor_def.types) continue;
+            build_fields(g, llvm_named(g, "enum", name, symbol_to_str(ctor->ctor_def.id)), ctor->ctor_def.types);
+      }
+}
+
+// Every struct and enum type is named before any gets its body, as bodies
+// refer to other types.
+static void name_types(struct builder* g) {
+      for (guint i = 0; i != g->module->structs->len; ++i) {
+            const struct item* def = g_ptr_array_index(g->module->structs, i);
+            char* name = g_strdup_printf("struct.%s", symbol_to_str(def->id));
+            LLVMStructCreateNamed(g->ctx, name);
+            g_free(name);
+      }
+      for (guint i = 0; i != g->module->enums->len; ++i) {
+            const struct item* def = g_ptr_array_index(g->module->enums, i);
+            char* name = g_strdup_printf("enum.%s", symbol_to_str(def->id));
+            LLVMStructCreateNamed(g->ctx, name);
+            g_free(name);
+            const struct enum_layout* lay = g_hash_table_lookup(g->layouts->enums, GINT_TO_POINTER(def->id.value));
+            if (lay->kind != LAYOUT_UNION) continue;
+            for (const GList* p = def->enum_def.ctors; p; p = p->next) {
+                  const struct pair* ctor = p->data;
+                  if (!ctor->ctor_def.types) continue;
+                  name = g_strdup_printf("enum.%s.%s", symbol_to_str(def->id), symbol_to_str(ctor->ctor_def.id));
+                  LLVMStructCreateNamed(g->ctx, name);
+                  g_free(name);
+            }
+      }
+}
+
+static void build_strings(struct builder* g) {
+      const GPtrArray* strings = g->module->strings;
+      g->strs = g_new(LLVMValueRef, strings->len + 1);
+      for (guint i = 0; i != strings->len; ++i) {
+            const char* s = g_ptr_array_index(strings, i);
+            LLVMValueRef init = LLVMConstStringInContext(g->ctx, s, strlen(s), false);
+            LLVMTypeRef type = LLVMTypeOf(init);
+            char* name = g_strdup_printf(".str%u", i);
+            LLVMValueRef v = LLVMAddGlobal(g->mod, type, name);
+            g_free(name);
+            LLVMSetInitializer(v, init);
+            LLVMSetGlobalConstant(v, true);
+            LLVMSetLinkage(v, LLVMPrivateLinkage);
+            LLVMSetUnnamedAddress(v, LLVMGlobalUnnamedAddr);
+            LLVMSetAlignment(v, 1);
+            LLVMValueRef at[] = {llvm_i32(g, 0), llvm_i32(g, 0)};
+            g->strs[i] = LLVMConstInBoundsGEP2(type, v, at, 2);
+      }
+}
+
+// The module in g->mod, in g->ctx.
+static void build_module(struct builder* g, const struct mir_module* module, const struct mir_layouts* layouts) {
+      memset(g, 0, sizeof *g);
+      g->module = module;
+      g->layouts = layouts;
+      g->ctx = LLVMContextCreate();
+      g->mod = LLVMModuleCreateWithNameInContext("pa4", g->ctx);
+      g->b = LLVMCreateBuilderInContext(g->ctx);
+      LLVMMetadataRef enable[] = {
+            LLVMMDStringInContext2(g->ctx, "llvm.loop.vectorize.enable", strlen("llvm.loop.vectorize.enable")),
+            LLVMValueAsMetadata(LLVMConstInt(llvm_int(g, 1), 1, false)),
+      };
+      g->vectorize = LLVMMDNodeInContext2(g->ctx, enable, 2);
+      g->loop_kind = LLVMGetMDKindIDInContext(g->ctx, "llvm.loop", strlen("llvm.loop"));
+
+      build_strings(g);
+      name_types(g);
+      for (guint i = 0; i != module->structs->len; ++i)
+            build_struct(g, g_ptr_array_index(module->structs, i));
+      for (guint i = 0; i != module->enums->len; ++i)
+            build_enum(g, g_ptr_array_index(module->enums, i));
+
+      for (guint i = 0; i != module->fns->len; ++i)
+            declare_fn(g, g_ptr_array_index(module->fns, i));
+      for (guint i = 0; i != module->fns->len; ++i)
+            build_fn(g, g_ptr_array_index(module->fns, i));
+      // The print runtime goes in whether or not anything prints, as in mir_emit.c.
+      for (int i = RT_WRITE; i != RT_NFNS; ++i)
+            rt_fn(g, i);
+
+      LLVMDisposeBuilder(g->b);
+      g->b = NULL;
+      g_free(g->strs);
+      g->strs = NULL;
+      if (stats_enabled) stats_add(STATS_IR_INSTS, g->insts);
+
+      bool broken = LLVMVerifyModule(g->mod, LLVMPrintMessageAction, NULL);
+      assert(!broken);
+      (void)broken;
+}
+
+void mir_llvm_bitcode(const struct mir_module* module, struct ir_writer* out) {
+      struct mir_layouts layouts;
+      struct builder g;
+      mir_layouts_init(&layouts, module);
+      build_module(&g, module, &layouts);
+      mir_layouts_free(&layouts);
+
+      LLVMMemoryBufferRef bc = LLVMWriteBitcodeToMemoryBuffer(g.mod);
+      ir_putn(out, LLVMGetBufferStart(bc), LLVMGetBufferSize(bc));
+      LLVMDisposeMemoryBuffer(bc);
+      LLVMDisposeModule(g.mod);
+      LLVMContextDispose(g.ctx);
+}
+
+int mir_llvm_run(const struct mir_module* module) {
+      struct mir_layouts layouts;
+      struct builder g;
+      mir_layouts_init(&layouts, module);
+      build_module(&g, module, &layouts);
+      mir_layouts_free(&layouts);
+
+      LLVMLinkInMCJIT();
+      LLVMInitializeNativeTarget();
+      LLVMInitializeNativeAsmPrinter();
+      char* triple = LLVMGetDefaultTargetTriple();
+      LLVMSetTarget(g.mod, triple);
+      LLVMDisposeMessage(triple);
+
+      // The engine owns the module from here on.
+      struct LLVMMCJITCompilerOptions options;
+      LLVMInitializeMCJITCompilerOptions(&options, sizeof options);
+      options.OptLevel = 2;
+      LLVMExecutionEngineRef engine;
+      char* err;
+      if (LLVMCreateMCJITCompilerForModule(&engine, g.mod, &options, sizeof options, &err)) {
+            printf("Error: can't JIT the program: %s.\n", err);
+            exit(1);
+      }
+
+      // What clang -O2 would do to the module, for this machine, before MCJIT
+      // compiles it on being asked for main.
+      LLVMSetModuleDataLayout(g.mod, LLVMGetExecutionEngineTargetData(engine));
+      LLVMPassManagerRef passes = LLVMCreatePassManager();
+      LLVMAddAnalysisPasses(LLVMGetExecutionEngineTargetMachine(engine), passes);
+      LLVMPassManagerBuilderRef opt = LLVMPassManagerBuilderCreate();
+      LLVMPassManagerBuilderSetOptLevel(opt, 2);
+      LLVMPassManagerBuilderPopulateModulePassManager(opt, passes);
+      LLVMPassManagerBuilderDispose(opt);
+      LLVMRunPassManager(passes, g.mod);
+      LLVMDisposePassManager(passes);
+
+      int (*main_fn)(void) = (int (*)(void))LLVMGetFunctionAddress(engine, "main");
+      assert(main_fn);
+      int status = main_fn();
+      LLVMDisposeExecutionEngine(engine);
+      LLVMContextDispose(g.ctx);
+      return status;
+}
+
+#else
+
+void mir_llvm_bitcode(const struct mir_module* module, struct ir_writer* out) {
+      printf("Error: pa4 was built without LLVM, so it can't write bitcode (make LLVM_CONFIG=llvm-config).\n");
+      exit(1);
+}
+
+int mir_llvm_run(const struct mir_module* module) {
+      printf("Error: pa4 was built without LLVM, so it can't run programs (make LLVM_CONFIG=llvm-config).\n");
+      exit(1);
+}
+
+#endif
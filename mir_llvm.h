@@ -0,0 +1,24 @@
+#ifndef RUSTC_MIR_LLVM_H_
+#define RUSTC_MIR_LLVM_H_
+
+#include "mir.h"
+#include "ir_writer.h"
+
+// *** LLVM modules from MIR, through the LLVM C API ***
+
+// The other way to generate code from MIR: the module mir_emit_module() would
+// write out (runtime included, the same layouts, see mir_layout.h), built in
+// memory with LLVM's IR builder instead, so nothing gets printed only for LLVM
+// to parse it back. One function after another: an LLVM context isn't for
+// sharing between threads. Only there if pa4 is built with LLVM (make
+// LLVM_CONFIG=llvm-config); otherwise both exit with an error. The functions
+// of the module must have blocks (see mir_fn.cached).
+
+// Writes the module as LLVM bitcode (--emit-bc).
+void mir_llvm_bitcode(const struct mir_module* module, struct ir_writer* out);
+
+// Optimizes the module, compiles it for this machine with MCJIT and runs its
+// main in the pa4 process (--run). Returns what main did.
+int mir_llvm_run(const struct mir_module* module);
+
+#endif
@@ -0,0 +1,927 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mir_lower.h"
+#include "ast.h"
+#include "cache.h"
+#include "parallel.h"
+
+// State for lowering one function.
+struct lower {
+      const struct mir_module* module;
+      struct mir_fn* fn;
+      // Stack slots all go at the start of the function, in here.
+      struct mir_block* slots;
+      struct mir_block* cur;
+      // Binding slot -> the register holding its address.
+      struct mir_value* binds;
+};
+
+static struct mir_value lower_exp(struct lower* l, const struct exp* exp);
+
+static void unsupported(const char* what) {
+      printf("Error: %s can't be compiled to MIR yet.\n", what);
+      exit(1);
+}
+
+static struct type* type_of(const struct exp* exp) {
+      return exp->type->unmut;
+}
+
+static bool has_value(const struct type* type) {
+      return type && !type_is_unit(type) && type->kind != TYPE_DIV;
+}
+
+static struct mir_value emit(struct lower* l, struct mir_inst* inst, struct type* type) {
+      struct mir_value dst = mir_none();
+      inst->dst = -1;
+      if (has_value(type)) {
+            dst = mir_reg(l->fn, type, NULL);
+            inst->dst = dst.n;
+      }
+      mir_add(l->cur, inst);
+      return dst;
+}
+
+static void terminate(struct lower* l, int kind, struct mir_value value,
+            struct mir_block* a, struct mir_block* b) {
+      l->cur->term.kind = kind;
+      l->cur->term.value = value;
+      l->cur->term.to[0] = a;
+      l->cur->term.to[1] = b;
+}
+
+static void jump(struct lower* l, struct mir_block* to) {
+      terminate(l, MIR_JUMP, mir_none(), to, NULL);
+}
+
+static void branch(struct lower* l, struct mir_value cond, struct mir_block* t, struct mir_block* f) {
+      terminate(l, MIR_BRANCH, cond, t, f);
+}
+
+// A new stack slot for a value of the given type.
+static struct mir_value alloca_slot(struct lower* l, struct type* type, const char* name) {
+      struct mir_inst inst = {MIR_ALLOCA};
+      struct mir_value dst = mir_reg(l->fn, type_ref(type), name);
+      inst.dst = dst.n;
+      mir_add(l->slots, &inst);
+      return dst;
+}
+
+static struct mir_value load(struct lower* l, struct mir_value addr, struct type* type) {
+      struct mir_inst inst = {MIR_LOAD};
+      inst.a = addr;
+      return emit(l, &inst, type);
+}
+
+static void store(struct lower* l, struct mir_value addr, struct mir_value value) {
+      if (value.kind == MIR_NONE) return;
+      struct mir_inst inst = {MIR_STORE};
+      inst.a = addr;
+      inst.b = value;
+      emit(l, &inst, NULL);
+}
+
+static int field_index(struct lower* l, Symbol sid, Symbol fid) {
+      const struct item* def = g_hash_table_lookup(l->module->struct_defs, GINT_TO_POINTER(sid.value));
+      const struct pair* field = item_get_field(def, fid);
+      assert(field);
+      return field->field_def.index;
+}
+
+static struct mir_value field_addr(struct lower* l, struct mir_value base, int n, struct type* type) {
+      struct mir_inst inst = {MIR_FIELD};
+      inst.a = base;
+      inst.n = n;
+      return emit(l, &inst, type_ref(type));
+}
+
+static struct mir_value elem_addr(struct lower* l, struct mir_value base, struct mir_value idx, struct type* type) {
+      struct mir_inst inst = {MIR_ELEM};
+      inst.a = base;
+      inst.b = idx;
+      return emit(l, &inst, type_ref(type));
+}
+
+static const struct item* enum_def(struct lower* l, Symbol eid) {
+      const struct item* def = g_hash_table_lookup(l->module->enum_defs, GINT_TO_POINTER(eid.value));
+      assert(def);
+      return def;
+}
+
+static int ctor_tag(struct lower* l, Symbol eid, Symbol cid) {
+      int tag = -1;
+      struct pair* ctor = item_get_ctor(enum_def(l, eid), cid, &tag);
+      assert(ctor);
+      return tag;
+}
+
+static struct mir_value payload_addr(struct lower* l, struct mir_value base, int tag, int field, struct type* type) {
+      struct mir_inst inst = {MIR_PAYLOAD};
+      inst.a = base;
+      inst.n = tag;
+      inst.field = field;
+      return emit(l, &inst, type_ref(type));
+}
+
+// The address of what the expression denotes: variables, derefs, fields and
+// elements can be assigned to (and borrowed) in place, anything else is
+// evaluated into a temporary.
+static struct mir_value lower_place(struct lower* l, const struct exp* exp) {
+      switch (exp->kind) {
+            case EXP_ID:
+                  if (!exp->bind) unsupported("A function used as a value");
+                  return l->binds[exp->bind->bind.slot];
+            case EXP_UNARY:
+                  if (exp->unary.op == OP_MUL)
+                        return lower_exp(l, exp->unary.exp);
+                  break;
+            case EXP_LOOKUP: {
+                  struct type* stype = type_of(exp->lookup.exp);
+                  struct mir_value base = lower_place(l, exp->lookup.exp);
+                  return field_addr(l, base, field_index(l, stype->id, exp->lookup.id), type_of(exp));
+            }
+            case EXP_INDEX: {
+                  struct mir_value base = lower_place(l, exp->index.exp);
+                  struct mir_value idx = lower_exp(l, exp->index.idx);
+                  // A slice's length isn't known, so it goes unchecked.
+                  struct type* atype = type_of(exp->index.exp);
+                  if (atype->kind == TYPE_ARRAY) {
+                        struct mir_inst check = {MIR_BOUNDS};
+                        check.a = idx;
+                        check.n = atype->length;
+                        emit(l, &check, NULL);
+                  }
+                  return elem_addr(l, base, idx, type_of(exp));
+            }
+      }
+
+      struct mir_value tmp = alloca_slot(l, type_of(exp), NULL);
+      store(l, tmp, lower_exp(l, exp));
+      return tmp;
+}
+
+static struct mir_value binary(struct lower* l, int op, struct mir_value a, struct mir_value b, struct type* type) {
+      struct mir_inst inst = {MIR_BINARY};
+      inst.op = op;
+      inst.a = a;
+      inst.b = b;
+      return emit(l, &inst, type);
+}
+
+// The plain operator behind a compound assignment.
+static int assign_op(int op) {
+      switch (op) {
+            case OP_ADD_ASSIGN: return OP_ADD;
+            case OP_SUB_ASSIGN: return OP_SUB;
+            case OP_MUL_ASSIGN: return OP_MUL;
+            case OP_DIV_ASSIGN: return OP_DIV;
+            case OP_REM_ASSIGN: return OP_REM;
+      }
+      assert(false);
+      return OP_INVALID;
+}
+
+// The right operand of && and || only runs if the left one doesn't decide
+// the result; the result goes through a slot.
+static struct mir_value lower_logical(struct lower* l, const struct exp* exp) {
+      bool is_and = exp->binary.op == OP_AND;
+      struct mir_value result = alloca_slot(l, type_bool(), NULL);
+      struct mir_block* rhs = mir_block_new(l->fn, is_and? "land.rhs" : "lor.rhs");
+      struct mir_block* end = mir_block_new(l->fn, is_and? "land.end" : "lor.end");
+
+      struct mir_value left = lower_exp(l, exp->binary.left);
+      store(l, result, mir_const(type_bool(), !is_and));
+      if (is_and) branch(l, left, rhs, end);
+      else branch(l, left, end, rhs);
+
+      l->cur = rhs;
+      store(l, result, lower_exp(l, exp->binary.right));
+      jump(l, end);
+
+      l->cur = end;
+      return load(l, result, type_bool());
+}
+
+static struct mir_value lower_binary(struct lower* l, const struct exp* exp) {
+      const struct exp* left = exp->binary.left;
+      const struct exp* right = exp->binary.right;
+
+      if (exp_is_assign(exp)) {
+            struct mir_value addr = lower_place(l, left);
+            store(l, addr, lower_exp(l, right));
+            return mir_none();
+      }
+      if (exp_is_cmp_assign(exp)) {
+            struct mir_value addr = lower_place(l, left);
+            struct mir_value old = load(l, addr, type_of(left));
+            struct mir_value value = lower_exp(l, right);
+            store(l, addr, binary(l, assign_op(exp->binary.op), old, value, type_of(left)));
+            return mir_none();
+      }
+      if (exp->binary.op == OP_AND || exp->binary.op == OP_OR)
+            return lower_logical(l, exp);
+
+      struct mir_value a = lower_exp(l, left);
+      struct mir_value b = lower_exp(l, right);
+      return binary(l, exp->binary.op, a, b, type_of(exp));
+}
+
+static struct mir_value lower_unary(struct lower* l, const struct exp* exp) {
+      struct mir_inst inst = {MIR_INVALID};
+      switch (exp->unary.op) {
+            case OP_ADDROF:
+                  return lower_place(l, exp->unary.exp);
+            case OP_MUL:
+                  return load(l, lower_exp(l, exp->unary.exp), type_of(exp));
+            case OP_SUB:
+                  inst.kind = MIR_NEG;
+                  break;
+            case OP_NOT:
+                  inst.kind = MIR_NOT;
+                  break;
+            default:
+                  assert(false);
+      }
+      inst.a = lower_exp(l, exp->unary.exp);
+      return emit(l, &inst, type_of(exp));
+}
+
+static struct mir_value lower_if(struct lower* l, const struct exp* exp) {
+      struct mir_block* then = mir_block_new(l->fn, "if.then");
+      struct mir_block* other = mir_block_new(l->fn, "if.else");
+      struct mir_block* end = mir_block_new(l->fn, "if.end");
+      struct mir_value result = mir_none();
+      if (has_value(type_of(exp)))
+            result = alloca_slot(l, type_of(exp), NULL);
+
+      branch(l, lower_exp(l, exp->if_else.cond), then, other);
+
+      l->cur = then;
+      struct mir_value v = lower_exp(l, exp->if_else.block_true);
+      if (result.kind != MIR_NONE) store(l, result, v);
+      jump(l, end);
+
+      l->cur = other;
+      if (exp->if_else.block_false) {
+            v = lower_exp(l, exp->if_else.block_false);
+            if (result.kind != MIR_NONE) store(l, result, v);
+      }
+      jump(l, end);
+
+      l->cur = end;
+      if (result.kind == MIR_NONE) return result;
+      return load(l, result, type_of(exp));
+}
+
+static struct mir_value lower_while(struct lower* l, const struct exp* exp) {
+      struct mir_block* cond = mir_block_new(l->fn, "while.cond");
+      struct mir_block* body = mir_block_new(l->fn, "while.body");
+      struct mir_block* end = mir_block_new(l->fn, "while.end");
+
+      jump(l, cond);
+      l->cur = cond;
+      branch(l, lower_exp(l, exp->loop_while.cond), body, end);
+
+      l->cur = body;
+      lower_exp(l, exp->loop_while.block);
+      jump(l, cond);
+
+      l->cur = end;
+      return mir_none();
+}
+
+static struct mir_value lower_loop(struct lower* l, const struct exp* exp) {
+      struct mir_block* body = mir_block_new(l->fn, "loop.body");
+
+      jump(l, body);
+      l->cur = body;
+      lower_exp(l, exp->exp);
+      jump(l, body);
+
+      // There's no way out, so whatever follows is dead.
+      l->cur = mir_block_new(l->fn, "loop.end");
+      return mir_none();
+}
+
+static struct mir_value lower_call(struct lower* l, const struct exp* exp) {
+      struct mir_inst inst = {MIR_CALL};
+      inst.fn = exp->fn_call.id;
+      inst.args = g_array_new(false, false, sizeof(struct mir_value));
+      for (const GList* p = exp->fn_call.exps; p; p = p->next) {
+            struct mir_value arg = lower_exp(l, p->data);
+            g_array_append_val(inst.args, arg);
+      }
+      return emit(l, &inst, type_of(exp));
+}
+
+static struct mir_value lower_struct(struct lower* l, const struct exp* exp) {
+      struct mir_value tmp = alloca_slot(l, type_of(exp), NULL);
+      for (const GList* p = exp->lit_struct.fields; p; p = p->next) {
+            const struct pair* field = p->data;
+            struct mir_value v = lower_exp(l, field->field_init.exp);
+            int n = field_index(l, exp->lit_struct.id, field->field_init.id);
+            store(l, field_addr(l, tmp, n, type_of(field->field_init.exp)), v);
+      }
+      return load(l, tmp, type_of(exp));
+}
+
+static struct mir_value lower_array(struct lower* l, const struct exp* exp) {
+      struct mir_value tmp = alloca_slot(l, type_of(exp), NULL);
+      int i = 0;
+      for (const GList* p = exp->lit_array.exps; p; p = p->next, ++i) {
+            struct mir_value v = lower_exp(l, p->data);
+            store(l, elem_addr(l, tmp, mir_const(type_i32(), i), type_of(p->data)), v);
+      }
+      return load(l, tmp, type_of(exp));
+}
+
+static struct mir_value lower_enum(struct lower* l, const struct exp* exp) {
+      struct mir_value tmp = alloca_slot(l, type_of(exp), NULL);
+      int tag = ctor_tag(l, exp->lit_enum.eid, exp->lit_enum.cid);
+      int i = 0;
+      for (const GList* p = exp->lit_enum.exps; p; p = p->next, ++i) {
+            struct mir_value v = lower_exp(l, p->data);
+            store(l, payload_addr(l, tmp, tag, i, type_of(p->data)), v);
+      }
+
+      struct mir_inst inst = {MIR_SET_TAG};
+      inst.a = tmp;
+      inst.n = tag;
+      emit(l, &inst, NULL);
+      return load(l, tmp, type_of(exp));
+}
+
+// A box that escape_crate() found doesn't outlive the call is just a stack
+// slot, which is what mem2reg likes best anyway.
+static struct mir_value lower_box(struct lower* l, const struct exp* exp) {
+      struct type* type = type_of(exp->exp);
+      if (!has_value(type)) unsupported("A box of nothing");
+
+      struct mir_value v = lower_exp(l, exp->exp);
+      struct mir_value box;
+      if (exp->local) {
+            box = alloca_slot(l, type, NULL);
+      } else {
+            struct mir_inst inst = {MIR_BOX};
+            box = emit(l, &inst, type_of(exp));
+      }
+      store(l, box, v);
+      return box;
+}
+
+static struct mir_value bind(struct lower* l, const struct pat* pat, struct type* type, const char* name) {
+      if (pat->kind != PAT_BIND) unsupported("A destructuring pattern");
+      struct mir_value slot = alloca_slot(l, type->unmut, name);
+      l->binds[pat->bind.slot] = slot;
+      return slot;
+}
+
+// *** Match ***
+
+// A match becomes a decision tree (after Maranget, "Compiling Pattern Matching
+// to Good Decision Trees"). The arms' patterns make up a matrix with a row per
+// alternative and a column per part of the scrutinee still to be looked at.
+// Each node of the tree tests one part, picked from the first row, and sends
+// every row on to the outcomes it's still possible under: so a part is never
+// tested twice on the way to an arm, and rows share the tests they have in
+// common. A test on an integer or an enum's tag is a single switch, which
+// LLVM turns into a jump table or a binary search.
+
+// A part of the scrutinee.
+struct occ {
+      struct mir_value addr;
+      struct type* type;
+};
+
+struct match_bind {
+      const struct pat* pat;
+      struct occ occ;
+};
+
+struct row {
+      // Of const struct pat*, one per column; NULL matches anything.
+      GPtrArray* pats;
+      // Of struct match_bind: the variables the row has bound on the way.
+      GArray* binds;
+      int arm;
+};
+
+struct matcher {
+      struct lower* l;
+      // Arm -> the block for its body, and whether anything goes there.
+      struct mir_block** arms;
+      bool* reached;
+      // Where control goes if no arm matches. (Matches aren't checked for
+      // exhaustiveness, so it's undefined.)
+      struct mir_block* fail;
+};
+
+static struct row* row_new(int arm) {
+      struct row* r = g_new(struct row, 1);
+      r->pats = g_ptr_array_new();
+      r->binds = g_array_new(false, false, sizeof(struct match_bind));
+      r->arm = arm;
+      return r;
+}
+
+static void row_free(struct row* r) {
+      g_ptr_array_free(r->pats, true);
+      g_array_free(r->binds, true);
+      g_free(r);
+}
+
+// The row with column c replaced by the given patterns.
+static struct row* row_expand(const struct row* r, guint c, const struct pat** pats, int n) {
+      struct row* e = row_new(r->arm);
+      g_array_append_vals(e->binds, r->binds->data, r->binds->len);
+      for (guint i = 0; i != r->pats->len; ++i) {
+            if (i != c) g_ptr_array_add(e->pats, g_ptr_array_index(r->pats, i));
+            else for (int j = 0; j != n; ++j) g_ptr_array_add(e->pats, (gpointer)pats[j]);
+      }
+      return e;
+}
+
+static GArray* occs_expand(GArray* occs, guint c, const struct occ* parts, int n) {
+      GArray* e = g_array_new(false, false, sizeof(struct occ));
+      g_array_append_vals(e, occs->data, c);
+      g_array_append_vals(e, parts, n);
+      g_array_append_vals(e, &g_array_index(occs, struct occ, c + 1), occs->len - c - 1);
+      return e;
+}
+
+// Variables and wildcards always match: they're taken out of the matrix, the
+// variables moving to their rows' binds.
+static void strip(GPtrArray* rows, GArray* occs) {
+      for (guint i = 0; i != rows->len; ++i) {
+            struct row* r = g_ptr_array_index(rows, i);
+            for (guint c = 0; c != r->pats->len; ++c) {
+                  const struct pat* pat = g_ptr_array_index(r->pats, c);
+                  if (!pat) continue;
+                  if (pat->kind == PAT_BIND) {
+                        struct match_bind b = {pat, g_array_index(occs, struct occ, c)};
+                        g_array_append_val(r->binds, b);
+                  } else if (pat->kind != PAT_WILD && pat->kind != PAT_UNIT) continue;
+                  g_ptr_array_index(r->pats, c) = NULL;
+            }
+      }
+}
+
+// A binding's slot, shared by every way into the arm (and every alternative).
+static struct mir_value bind_slot(struct lower* l, const struct pat* pat, struct type* type) {
+      if (l->binds[pat->bind.slot].kind != MIR_NONE) return l->binds[pat->bind.slot];
+      return bind(l, pat, type, pat->bind.ir_name);
+}
+
+static void match_leaf(struct matcher* m, const struct row* r) {
+      struct lower* l = m->l;
+      for (guint i = 0; i != r->binds->len; ++i) {
+            const struct match_bind* b = &g_array_index(r->binds, struct match_bind, i);
+            if (b->pat->bind.ref)
+                  store(l, bind_slot(l, b->pat, type_ref(b->occ.type)), b->occ.addr);
+            else store(l, bind_slot(l, b->pat, b->occ.type), load(l, b->occ.addr, b->occ.type));
+      }
+      m->reached[r->arm] = true;
+      jump(l, m->arms[r->arm]);
+}
+
+// A constructor of the tested column's type: a tag, a bool or an integer.
+struct ctor {
+      int n;
+      // The parts it has (for an enum constructor), and their types.
+      int arity;
+      const GList* types;
+};
+
+static bool pat_is_ctor(struct lower* l, const struct pat* pat, int n) {
+      switch (pat->kind) {
+            case PAT_TRUE: return n == 1;
+            case PAT_FALSE: return n == 0;
+            case PAT_I32:
+            case PAT_U8: return pat->num == n;
+            case PAT_ENUM: return ctor_tag(l, pat->ctor.eid, pat->ctor.cid) == n;
+      }
+      assert(false);
+      return false;
+}
+
+static void match_compile(struct matcher* m, GPtrArray* rows, GArray* occs);
+
+// The rows that can still match if column c is the constructor, with the
+// column replaced by its parts (found at the given addresses).
+static void match_ctor(struct matcher* m, GPtrArray* rows, GArray* occs, guint c,
+            const struct ctor* ctor, const struct occ* parts) {
+      GPtrArray* spec = g_ptr_array_new();
+      const struct pat** wild = g_new0(const struct pat*, ctor->arity + 1);
+      const struct pat** sub = g_new0(const struct pat*, ctor->arity + 1);
+
+      for (guint i = 0; i != rows->len; ++i) {
+            const struct row* r = g_ptr_array_index(rows, i);
+            const struct pat* pat = g_ptr_array_index(r->pats, c);
+            if (!pat) g_ptr_array_add(spec, row_expand(r, c, wild, ctor->arity));
+            else if (pat_is_ctor(m->l, pat, ctor->n)) {
+                  int j = 0;
+                  if (pat->kind == PAT_ENUM)
+                        for (const GList* p = pat->ctor.pats; p; p = p->next) sub[j++] = p->data;
+                  g_ptr_array_add(spec, row_expand(r, c, sub, ctor->arity));
+            }
+      }
+      g_free(sub);
+      g_free(wild);
+
+      match_compile(m, spec, occs_expand(occs, c, parts, ctor->arity));
+}
+
+// The rows that can still match if column c is none of the constructors
+// tested for, with the column gone.
+static void match_default(struct matcher* m, GPtrArray* rows, GArray* occs, guint c) {
+      GPtrArray* spec = g_ptr_array_new();
+      for (guint i = 0; i != rows->len; ++i) {
+            const struct row* r = g_ptr_array_index(rows, i);
+            if (!g_ptr_array_index(r->pats, c)) g_ptr_array_add(spec, row_expand(r, c, NULL, 0));
+      }
+      match_compile(m, spec, occs_expand(occs, c, NULL, 0));
+}
+
+// Splits the rows over a struct, array or reference pattern's parts, which
+// takes no test.
+static void match_expand(struct matcher* m, GPtrArray* rows, GArray* occs, guint c, const struct pat* first) {
+      struct lower* l = m->l;
+      const struct occ* occ = &g_array_index(occs, struct occ, c);
+      struct type* type = occ->type;
+      int n = 0;
+
+      switch (first->kind) {
+            case PAT_REF: n = 1; break;
+            case PAT_ARRAY: n = type->length; break;
+            case PAT_STRUCT: {
+                  const struct item* def = g_hash_table_lookup(l->module->struct_defs, GINT_TO_POINTER(type->id.value));
+                  n = g_list_length(def->struct_def.fields);
+                  break;
+            }
+      }
+
+      struct occ* parts = g_new(struct occ, n);
+      if (first->kind == PAT_REF) {
+            parts[0].type = type->type->unmut;
+            parts[0].addr = load(l, occ->addr, type);
+      } else if (first->kind == PAT_ARRAY) {
+            for (int i = 0; i != n; ++i) {
+                  parts[i].type = type->type->unmut;
+                  parts[i].addr = elem_addr(l, occ->addr, mir_const(type_i32(), i), parts[i].type);
+            }
+      } else {
+            const struct item* def = g_hash_table_lookup(l->module->struct_defs, GINT_TO_POINTER(type->id.value));
+            int i = 0;
+            for (const GList* p = def->struct_def.fields; p; p = p->next, ++i) {
+                  const struct pair* field = p->data;
+                  parts[i].type = field->field_def.type->unmut;
+                  parts[i].addr = field_addr(l, occ->addr, i, parts[i].type);
+            }
+      }
+
+      GPtrArray* spec = g_ptr_array_new();
+      const struct pat** sub = g_new0(const struct pat*, n + 1);
+      for (guint i = 0; i != rows->len; ++i) {
+            const struct row* r = g_ptr_array_index(rows, i);
+            const struct pat* pat = g_ptr_array_index(r->pats, c);
+            for (int j = 0; j != n; ++j) sub[j] = NULL;
+            if (pat && pat->kind == PAT_REF) sub[0] = pat->pat;
+            else if (pat && pat->kind == PAT_ARRAY) {
+                  int j = 0;
+                  for (const GList* p = pat->array.pats; p; p = p->next) sub[j++] = p->data;
+            } else if (pat) {
+                  // Fields left out of a struct pattern match anything.
+                  for (const GList* p = pat->strct.fields; p; p = p->next) {
+                        const struct pair* field = p->data;
+                        sub[field_index(l, type->id, field->field_pat.id)] = field->field_pat.pat;
+                  }
+            }
+            g_ptr_array_add(spec, row_expand(r, c, sub, n));
+      }
+      g_free(sub);
+
+      GArray* sub_occs = occs_expand(occs, c, parts, n);
+      g_free(parts);
+      match_compile(m, spec, sub_occs);
+}
+
+// Tests column c against the constructors the rows mention, in the order
+// they first come up.
+static void match_test(struct matcher* m, GPtrArray* rows, GArray* occs, guint c, const struct pat* first) {
+      struct lower* l = m->l;
+      const struct occ occ = g_array_index(occs, struct occ, c);
+      GArray* ctors = g_array_new(false, false, sizeof(struct ctor));
+      const struct item* def = NULL;
+      int nctors = 0;
+
+      if (first->kind == PAT_TRUE || first->kind == PAT_FALSE) nctors = 2;
+      else if (first->kind == PAT_ENUM) {
+            def = enum_def(l, first->ctor.eid);
+            nctors = g_list_length(def->enum_def.ctors);
+      }
+
+      for (guint i = 0; i != rows->len; ++i) {
+            const struct row* r = g_ptr_array_index(rows, i);
+            const struct pat* pat = g_ptr_array_index(r->pats, c);
+            if (!pat) continue;
+            if (pat->kind == PAT_STR) unsupported("A string pattern");
+
+            struct ctor ctor = {pat->num, 0, NULL};
+            if (pat->kind == PAT_TRUE || pat->kind == PAT_FALSE) ctor.n = pat->kind == PAT_TRUE;
+            else if (pat->kind == PAT_ENUM) {
+                  ctor.n = ctor_tag(l, pat->ctor.eid, pat->ctor.cid);
+                  ctor.types = ((const struct pair*)g_list_nth_data(def->enum_def.ctors, ctor.n))->ctor_def.types;
+                  ctor.arity = g_list_length((GList*)ctor.types);
+            }
+
+            bool seen = false;
+            for (guint j = 0; j != ctors->len && !seen; ++j)
+                  seen = g_array_index(ctors, struct ctor, j).n == ctor.n;
+            if (!seen) g_array_append_val(ctors, ctor);
+      }
+
+      // If every constructor comes up, the last one needs no test of its own.
+      bool complete = nctors && (int)ctors->len == nctors;
+      struct mir_block* other = mir_block_new(l->fn, complete? "match.case" : "match.default");
+      struct mir_block** cases = g_new(struct mir_block*, ctors->len);
+      for (guint i = 0; i != ctors->len; ++i)
+            cases[i] = complete && i + 1 == ctors->len? other : mir_block_new(l->fn, "match.case");
+
+      if (first->kind == PAT_ENUM) {
+            struct mir_inst inst = {MIR_TAG};
+            inst.a = occ.addr;
+            struct mir_value tag = emit(l, &inst, type_i32());
+            mir_term_switch(&l->cur->term, tag, other);
+      } else if (nctors) {
+            // A bool: a branch, true first.
+            struct mir_value v = load(l, occ.addr, occ.type);
+            struct mir_block *t = other, *f = other;
+            for (guint i = 0; i != ctors->len; ++i) {
+                  if (g_array_index(ctors, struct ctor, i).n) t = cases[i];
+                  else f = cases[i];
+            }
+            branch(l, v, t, f);
+      } else mir_term_switch(&l->cur->term, load(l, occ.addr, occ.type), other);
+
+      if (l->cur->term.kind == MIR_SWITCH)
+            for (guint i = 0; i + complete != ctors->len; ++i)
+                  mir_term_add_case(&l->cur->term, g_array_index(ctors, struct ctor, i).n, cases[i]);
+
+      for (guint i = 0; i != ctors->len; ++i) {
+            const struct ctor* ctor = &g_array_index(ctors, struct ctor, i);
+            struct occ* parts = g_new(struct occ, ctor->arity + 1);
+            l->cur = cases[i];
+            int j = 0;
+            for (const GList* t = ctor->types; t; t = t->next, ++j) {
+                  parts[j].type = ((struct type*)t->data)->unmut;
+                  parts[j].addr = payload_addr(l, occ.addr, ctor->n, j, parts[j].type);
+            }
+            match_ctor(m, rows, occs, c, ctor, parts);
+            g_free(parts);
+      }
+      if (!complete) {
+            l->cur = other;
+            match_default(m, rows, occs, c);
+      }
+
+      g_free(cases);
+      g_array_free(ctors, true);
+}
+
+// Emits the tree for the rows from l->cur on. Takes the rows and occs.
+static void match_compile(struct matcher* m, GPtrArray* rows, GArray* occs) {
+      strip(rows, occs);
+
+      if (!rows->len) jump(m->l, m->fail);
+      else {
+            const struct row* r = g_ptr_array_index(rows, 0);
+            guint c = 0;
+            while (c != r->pats->len && !g_ptr_array_index(r->pats, c)) ++c;
+
+            if (c == r->pats->len) match_leaf(m, r);
+            else {
+                  const struct pat* first = g_ptr_array_index(r->pats, c);
+                  if (first->kind == PAT_REF || first->kind == PAT_ARRAY || first->kind == PAT_STRUCT)
+                        match_expand(m, rows, occs, c, first);
+                  else match_test(m, rows, occs, c, first);
+            }
+      }
+
+      for (guint i = 0; i != rows->len; ++i) row_free(g_ptr_array_index(rows, i));
+      g_ptr_array_free(rows, true);
+      g_array_free(occs, true);
+}
+
+static struct mir_value lower_match(struct lower* l, const struct exp* exp) {
+      int narms = g_list_length(exp->match.arms);
+      struct matcher m = {
+            l,
+            g_new(struct mir_block*, narms),
+            g_new0(bool, narms),
+            NULL,
+      };
+      struct mir_value result = mir_none();
+      if (has_value(type_of(exp)))
+            result = alloca_slot(l, type_of(exp), NULL);
+
+      struct occ scrutinee = {lower_place(l, exp->match.exp), type_of(exp->match.exp)->unmut};
+      GArray* occs = g_array_new(false, false, sizeof(struct occ));
+      g_array_append_val(occs, scrutinee);
+
+      GPtrArray* rows = g_ptr_array_new();
+      int i = 0;
+      for (const GList* p = exp->match.arms; p; p = p->next, ++i) {
+            const struct pair* arm = p->data;
+            m.arms[i] = mir_block_new(l->fn, "match.arm");
+            for (const GList* q = arm->match_arm.pats; q; q = q->next) {
+                  struct row* r = row_new(i);
+                  g_ptr_array_add(r->pats, q->data);
+                  g_ptr_array_add(rows, r);
+            }
+      }
+      m.fail = mir_block_new(l->fn, "match.fail");
+      m.fail->term.kind = MIR_UNREACHABLE;
+      struct mir_block* end = mir_block_new(l->fn, "match.end");
+
+      match_compile(&m, rows, occs);
+
+      i = 0;
+      for (const GList* p = exp->match.arms; p; p = p->next, ++i) {
+            const struct pair* arm = p->data;
+            // An arm only earlier ones can match never gets its bindings.
+            if (!m.reached[i]) {
+                  m.arms[i]->term.kind = MIR_UNREACHABLE;
+                  continue;
+            }
+            l->cur = m.arms[i];
+            struct mir_value v = lower_exp(l, arm->match_arm.block);
+            if (result.kind != MIR_NONE) store(l, result, v);
+            jump(l, end);
+      }
+
+      g_free(m.arms);
+      g_free(m.reached);
+      l->cur = end;
+      if (result.kind == MIR_NONE) return result;
+      return load(l, result, type_of(exp));
+}
+
+static void lower_stmt(struct lower* l, const struct stmt* stmt) {
+      switch (stmt->kind) {
+            case STMT_LET: {
+                  struct type* type = stmt->let.type? stmt->let.type : stmt->let.exp->type;
+                  struct mir_value v = mir_none();
+                  // The initializer doesn't see the new binding.
+                  if (stmt->let.exp) v = lower_exp(l, stmt->let.exp);
+                  struct mir_value slot = bind(l, stmt->let.pat, type, stmt->let.pat->bind.ir_name);
+                  store(l, slot, v);
+                  break;
+            }
+            case STMT_RETURN:
+                  terminate(l, MIR_RETURN, lower_exp(l, stmt->exp), NULL, NULL);
+                  l->cur = mir_block_new(l->fn, "return.after");
+                  break;
+            case STMT_EXP:
+                  lower_exp(l, stmt->exp);
+                  break;
+      }
+}
+
+static struct mir_value lower_exp(struct lower* l, const struct exp* exp) {
+      if (!exp) return mir_none();
+
+      switch (exp->kind) {
+            case EXP_UNIT:
+                  return mir_none();
+            case EXP_U8:
+            case EXP_I32:
+                  return mir_const(type_of(exp), exp->num);
+            case EXP_TRUE:
+                  return mir_const(type_bool(), 1);
+            case EXP_FALSE:
+                  return mir_const(type_bool(), 0);
+            case EXP_STR: {
+                  struct mir_value v = {MIR_STR, type_of(exp), exp->string, exp->str};
+                  return v;
+            }
+            case EXP_ID:
+            case EXP_LOOKUP:
+            case EXP_INDEX:
+                  return load(l, lower_place(l, exp), type_of(exp));
+            case EXP_STRUCT:
+                  return lower_struct(l, exp);
+            case EXP_ARRAY:
+                  return lower_array(l, exp);
+            case EXP_FN_CALL:
+                  return lower_call(l, exp);
+            case EXP_IF:
+                  return lower_if(l, exp);
+            case EXP_WHILE:
+                  return lower_while(l, exp);
+            case EXP_LOOP:
+                  return lower_loop(l, exp);
+            case EXP_BLOCK:
+                  for (const GList* p = exp->block.stmts; p; p = p->next)
+                        lower_stmt(l, p->data);
+                  return lower_exp(l, exp->block.exp);
+            case EXP_UNARY:
+                  return lower_unary(l, exp);
+            case EXP_BINARY:
+                  return lower_binary(l, exp);
+            case EXP_ENUM:
+                  return lower_enum(l, exp);
+            case EXP_BOX_NEW:
+                  return lower_box(l, exp);
+            case EXP_MATCH:
+                  return lower_match(l, exp);
+      }
+      assert(false);
+      return mir_none();
+}
+
+struct lower_job {
+      const struct mir_module* module;
+      const struct item* item;
+      struct mir_fn* fn;
+      struct cache_entry* cached;
+};
+
+static void lower_fn(void* item, void* data) {
+      struct lower_job* job = item;
+      const struct item* def = job->item;
+      struct type* ret = def->fn_def.type->type? def->fn_def.type->type : type_unit();
+      if (job->cached && job->cached->hit) {
+            job->fn = mir_fn_new(def->id, ret->unmut);
+            job->fn->cached = job->cached;
+            return;
+      }
+      struct lower l = {
+            .module = job->module,
+            .fn = mir_fn_new(def->id, ret->unmut),
+            .binds = g_new0(struct mir_value, def->fn_def.slots),
+      };
+
+      // The slots get a block of their own, which the entry block follows
+      // until simplify-cfg merges the two.
+      l.slots = mir_block_new(l.fn, "entry");
+      l.cur = mir_block_new(l.fn, "entry.body");
+
+      for (const GList* p = def->fn_def.type->params; p; p = p->next) {
+            const struct pair* param = p->data;
+            const struct pat* pat = param->param.pat;
+            if (pat->kind != PAT_BIND) unsupported("A destructuring parameter");
+
+            // The incoming value is the slot's name without the ".addr".
+            const char* name = pat->bind.ir_name;
+            char* base = g_strndup(name, strlen(name) - strlen(".addr"));
+            struct mir_value v = mir_reg(l.fn, param->param.type->unmut, mir_fn_keep(l.fn, base));
+            g_array_append_val(l.fn->params, v);
+            store(&l, bind(&l, pat, param->param.type, name), v);
+      }
+
+      struct mir_value v = lower_exp(&l, def->fn_def.block);
+      if (has_value(ret) && v.kind == MIR_NONE)
+            // Only reached by falling out of a loop or after a return.
+            terminate(&l, MIR_UNREACHABLE, v, NULL, NULL);
+      else terminate(&l, MIR_RETURN, has_value(ret)? v : mir_none(), NULL, NULL);
+
+      l.slots->term.kind = MIR_JUMP;
+      l.slots->term.to[0] = g_ptr_array_index(l.fn->blocks, 1);
+
+      g_free(l.binds);
+      l.fn->cached = job->cached;
+      job->fn = l.fn;
+}
+
+struct mir_module* mir_lower_crate(const GList* items, const GPtrArray* strings, GHashTable* cache) {
+      struct mir_module* m = mir_module_new();
+      m->strings = strings;
+      GArray* jobs = g_array_new(false, false, sizeof(struct lower_job));
+
+      for (const GList* p = items; p; p = p->next) {
+            const struct item* item = p->data;
+            if (item->kind == ITEM_STRUCT_DEF) {
+                  g_ptr_array_add(m->structs, (gpointer)item);
+                  g_hash_table_insert(m->struct_defs, GINT_TO_POINTER(item->id.value), (gpointer)item);
+            } else if (item->kind == ITEM_ENUM_DEF) {
+                  g_ptr_array_add(m->enums, (gpointer)item);
+                  g_hash_table_insert(m->enum_defs, GINT_TO_POINTER(item->id.value), (gpointer)item);
+            } else if (item->kind == ITEM_FN_DEF) {
+                  struct lower_job job = {m, item, NULL, cache? g_hash_table_lookup(cache, item) : NULL};
+                  g_array_append_val(jobs, job);
+            }
+      }
+
+      void** work = g_new(void*, jobs->len);
+      for (guint i = 0; i != jobs->len; ++i)
+            work[i] = &g_array_index(jobs, struct lower_job, i);
+      parallel_for(work, jobs->len, lower_fn, NULL);
+
+      for (guint i = 0; i != jobs->len; ++i)
+            g_ptr_array_add(m->fns, g_array_index(jobs, struct lower_job, i).fn);
+      g_free(work);
+      g_array_free(jobs, true);
+      return m;
+}
@@ -0,0 +1,25 @@
+#ifndef RUSTC_MIR_LOWER_H_
+#define RUSTC_MIR_LOWER_H_
+
+#include <glib.h>
+#include "mir.h"
+
+// *** Lowering the typed AST to MIR ***
+
+// Builds the MIR for the (type checked and resolved) crate: one mir_fn per
+// function, in source order, with every binding in its own stack slot (named
+// after the binding's IR name) and the value of && and || and of if/else
+// expressions going through a slot too. A match becomes a decision tree of
+// switches and branches on the scrutinee's parts, each tested at most once on
+// the way to an arm. A Box::new that escape_crate() marked local is a stack
+// slot; any other is a MIR_BOX. Has the functions lowered concurrently.
+//
+// Slices and string patterns aren't supported yet: they're reported as an
+// error.
+//
+// The module refers to strings, the pool resolve_crate() returned, for its
+// string constants. With a cache from cache_open() (or NULL), each fn gets
+// its entry, and the fns that were hits aren't lowered.
+struct mir_module* mir_lower_crate(const GList* items, const GPtrArray* strings, GHashTable* cache);
+
+#endif
@@ -0,0 +1,51 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <glib.h>
+#include "parallel.h"
+
+static int jobs;
+
+struct work {
+      void** items;
+      int n;
+      volatile gint next;
+      void (*fn)(void*, void*);
+      void* data;
+};
+
+void parallel_set_jobs(int n) {
+      assert(n > 0);
+      jobs = n;
+}
+
+int parallel_jobs(void) {
+      if (!jobs) jobs = g_get_num_processors();
+      return jobs;
+}
+
+static gpointer worker(struct work* work) {
+      int i;
+      while ((i = g_atomic_int_add(&work->next, 1)) < work->n)
+            work->fn(work->items[i], work->data);
+      return NULL;
+}
+
+void parallel_for(void** items, int n, void (*fn)(void* item, void* data), void* data) {
+      struct work work = {items, n, 0, fn, data};
+
+      int nthreads = parallel_jobs() < n? parallel_jobs() : n;
+      if (nthreads <= 1) {
+            worker(&work);
+            return;
+      }
+
+      // The calling thread is one of the workers.
+      GThread** threads = malloc((nthreads - 1) * sizeof(*threads));
+      assert(threads);
+      for (int t = 0; t != nthreads - 1; ++t)
+            threads[t] = g_thread_new("worker", (GThreadFunc)worker, &work);
+      worker(&work);
+      for (int t = 0; t != nthreads - 1; ++t)
+            g_thread_join(threads[t]);
+      free(threads);
+}
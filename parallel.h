@@ -0,0 +1,18 @@
+#ifndef RUSTC_PARALLEL_H_
+#define RUSTC_PARALLEL_H_
+
+// *** Worker threads ***
+
+// Number of threads the parallel phases use. Defaults to the number of
+// processors.
+void parallel_set_jobs(int jobs);
+int parallel_jobs(void);
+
+// Calls fn(items[i], data) once for every 0 <= i < n, spread over up to
+// parallel_jobs() threads, and returns once all calls are done. Workers pull the
+// next index from a shared counter, so uneven items balance out. The calls may
+// run in any order, so fn must only touch state private to its item (or
+// state that's read-only for the duration).
+void parallel_for(void** items, int n, void (*fn)(void* item, void* data), void* data);
+
+#endif
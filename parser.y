@@ -19,6 +19,7 @@ extern int yylex(void);
 %union {
       char* str;
       int num;
+      Symbol sym;
 
       GList* list;
 
@@ -69,7 +70,8 @@ extern int yylex(void);
 %token T_U8 "u8"
 %token T_BOOL "bool"
 %token <num> T_LIT_U8 T_LIT_I32
-%token <str> T_LIT_STR T_ID
+%token <str> T_LIT_STR
+%token <sym> T_ID
 
 %type <list> crate items field_defs ctor_defs types params pats
              pat_fields stmts exps field_inits arms pats_or
@@ -92,50 +94,50 @@ extern int yylex(void);
 
 %%
 
-crate : items                                    { parse_done($1); }
+crate : items                                    { parse_done(ast_list_finish($1)); }
 
-items : item                                     { $$ = g_list_append(NULL, $1); }
-      | items item                               { $$ = g_list_append($1, $2); }
+items : item                                     { $$ = ast_list_prepend(NULL, $1); }
+      | items item                               { $$ = ast_list_prepend($1, $2); }
 
-item  : "fn" T_ID '(' params ')' "->" type block { $$ = item_fn_def(symbol_var($2), $4, $7, $8); }
-      | "fn" T_ID '(' params ')' "->" '!' block  { $$ = item_fn_def(symbol_var($2), $4, type_div(), $8); }
-      | "fn" T_ID '(' params ')' block           { $$ = item_fn_def(symbol_var($2), $4, type_unit(), $6); }
+item  : "fn" T_ID '(' params ')' "->" type block { $$ = item_fn_def(symbol_var($2), ast_list_finish($4), $7, $8); }
+      | "fn" T_ID '(' params ')' "->" '!' block  { $$ = item_fn_def(symbol_var($2), ast_list_finish($4), type_div(), $8); }
+      | "fn" T_ID '(' params ')' block           { $$ = item_fn_def(symbol_var($2), ast_list_finish($4), type_unit(), $6); }
       | "fn" T_ID '(' ')' "->" type block        { $$ = item_fn_def(symbol_var($2), NULL, $6, $7); }
       | "fn" T_ID '(' ')' "->" '!' block         { $$ = item_fn_def(symbol_var($2), NULL, type_div(), $7); }
       | "fn" T_ID '(' ')' block                  { $$ = item_fn_def(symbol_var($2), NULL, type_unit(), $5); }
-      | "enum" T_ID '{' ctor_defs '}'            { $$ = item_enum_def(symbol_type($2), $4); }
-      | "struct" T_ID '{' field_defs '}'         { $$ = item_struct_def(symbol_type($2), $4); }
+      | "enum" T_ID '{' ctor_defs '}'            { $$ = item_enum_def(symbol_type($2), ast_list_finish($4)); }
+      | "struct" T_ID '{' field_defs '}'         { $$ = item_struct_def(symbol_type($2), ast_list_finish($4)); }
 
 field_defs
-      : field_def                                { $$ = g_list_append(NULL, $1); }
-      | field_defs ',' field_def                 { $$ = g_list_append($1, $3); }
+      : field_def                                { $$ = ast_list_prepend(NULL, $1); }
+      | field_defs ',' field_def                 { $$ = ast_list_prepend($1, $3); }
 
 field_def
       : T_ID ':' type                            { $$ = field_def(symbol_field($1), $3); }
 
 ctor_defs
-      : ctor_def                                 { $$ = g_list_append(NULL, $1); }
-      | ctor_defs ',' ctor_def                   { $$ = g_list_append($1, $3); }
+      : ctor_def                                 { $$ = ast_list_prepend(NULL, $1); }
+      | ctor_defs ',' ctor_def                   { $$ = ast_list_prepend($1, $3); }
 
 ctor_def
       : T_ID                                     { $$ = ctor_def(symbol_ctor($1), NULL); }
-      | T_ID '(' types ')'                       { $$ = ctor_def(symbol_ctor($1), $3); }
+      | T_ID '(' types ')'                       { $$ = ctor_def(symbol_ctor($1), ast_list_finish($3)); }
 
-types : type                                     { $$ = g_list_append(NULL, $1); }
-      | types ',' type                           { $$ = g_list_append($1, $3); }
+types : type                                     { $$ = ast_list_prepend(NULL, $1); }
+      | types ',' type                           { $$ = ast_list_prepend($1, $3); }
 
-params: param                                    { $$ = g_list_append(NULL, $1); }
-      | params ',' param                         { $$ = g_list_append($1, $3); }
+params: param                                    { $$ = ast_list_prepend(NULL, $1); }
+      | params ',' param                         { $$ = ast_list_prepend($1, $3); }
 
 param : pat ':' type                             { $$ = param($1, $3); }
 
 pat   : '_'                                      { $$ = pat_wild(); }
       | '&' pat                                  { $$ = pat_ref($2); }
       | '(' ')'                                  { $$ = pat_unit(); }
-      | '[' pats ']'                             { $$ = pat_array($2); }
-      | T_ID '{' pat_fields '}'                  { $$ = pat_struct(symbol_type($1), $3); }
+      | '[' pats ']'                             { $$ = pat_array(ast_list_finish($2)); }
+      | T_ID '{' pat_fields '}'                  { $$ = pat_struct(symbol_type($1), ast_list_finish($3)); }
       | T_ID "::" T_ID                           { $$ = pat_enum(symbol_type($1), symbol_ctor($3), NULL); }
-      | T_ID "::" T_ID '(' pats ')'              { $$ = pat_enum(symbol_type($1), symbol_ctor($3), $5); }
+      | T_ID "::" T_ID '(' pats ')'              { $$ = pat_enum(symbol_type($1), symbol_ctor($3), ast_list_finish($5)); }
       | T_ID                                     { $$ = pat_id(0, 0, symbol_var($1)); }
       | "ref" T_ID                               { $$ = pat_id(1, 0, symbol_var($2)); }
       | "ref" "mut" T_ID                         { $$ = pat_id(1, 1, symbol_var($3)); }
@@ -148,19 +150,19 @@ pat   : '_'                                      { $$ = pat_wild(); }
       | '-' T_LIT_I32                            { $$ = pat_i32(-$2); }
 
 pats
-      : pat                                      { $$ = g_list_append(NULL, $1); }
-      | pats ',' pat                             { $$ = g_list_append($1, $3); }
+      : pat                                      { $$ = ast_list_prepend(NULL, $1); }
+      | pats ',' pat                             { $$ = ast_list_prepend($1, $3); }
 
 pats_or
-      : pat                                      { $$ = g_list_append(NULL, $1); }
-      | pats_or '|' pat                          { $$ = g_list_append($1, $3); }
+      : pat                                      { $$ = ast_list_prepend(NULL, $1); }
+      | pats_or '|' pat                          { $$ = ast_list_prepend($1, $3); }
 
 pat_field
       : T_ID ':' pat                             { $$ = field_pat(symbol_field($1), $3); }
 
 pat_fields
-      : pat_field                                { $$ = g_list_append(NULL, $1); }
-      | pat_fields ',' pat_field                 { $$ = g_list_append($1, $3); }
+      : pat_field                                { $$ = ast_list_prepend(NULL, $1); }
+      | pat_fields ',' pat_field                 { $$ = ast_list_prepend($1, $3); }
 
 type  : T_ID                                     { $$ = type_id(symbol_type($1)); }
       | '&' type                                 { $$ = type_ref($2); }
@@ -174,12 +176,12 @@ type  : T_ID                                     { $$ = type_id(symbol_type($1))
       | "Box" '<' type '>'                       { $$ = type_box($3); }
 
 block : '{' '}'                                  { $$ = exp_block(NULL, exp_unit()); }
-      | '{' stmts '}'                            { $$ = exp_block($2, exp_unit()); }
-      | '{' stmts exp '}'                        { $$ = exp_block($2, $3); }
+      | '{' stmts '}'                            { $$ = exp_block(ast_list_finish($2), exp_unit()); }
+      | '{' stmts exp '}'                        { $$ = exp_block(ast_list_finish($2), $3); }
       | '{' exp '}'                              { $$ = exp_block(NULL, $2); }
 
-stmts : stmt                                     { $$ = g_list_append(NULL, $1); }
-      | stmts stmt                               { $$ = g_list_append($1, $2); }
+stmts : stmt                                     { $$ = ast_list_prepend(NULL, $1); }
+      | stmts stmt                               { $$ = ast_list_prepend($1, $2); }
 
 stmt  : "let" pat ':' type '=' exp ';'           { $$ = stmt_let($2, $4, $6); }
       | "let" pat '=' exp ';'                    { $$ = stmt_let($2, NULL, $4); }
@@ -188,8 +190,8 @@ stmt  : "let" pat ':' type '=' exp ';'           { $$ = stmt_let($2, $4, $6); }
       | "return" exp ';'                         { $$ = stmt_return($2); }
       | exp ';'                                  { $$ = stmt_exp($1); }
 
-exps  : exp                                      { $$ = g_list_append(NULL, $1); }
-      | exps ',' exp                             { $$ = g_list_append($1, $3); }
+exps  : exp                                      { $$ = ast_list_prepend(NULL, $1); }
+      | exps ',' exp                             { $$ = ast_list_prepend($1, $3); }
 
 single_exp
       : T_LIT_U8                                 { $$ = exp_u8($1); }
@@ -199,17 +201,17 @@ single_exp
       | T_LIT_STR                                { $$ = exp_str($1); }
       | T_ID                                     { $$ = exp_id(symbol_var($1)); }
       | T_ID "::" T_ID                           { $$ = exp_enum(symbol_type($1), symbol_ctor($3), NULL); }
-      | T_ID "::" T_ID '(' exps ')'              { $$ = exp_enum(symbol_type($1), symbol_ctor($3), $5); }
-      | T_ID '{' field_inits '}'                 { $$ = exp_struct(symbol_type($1), $3); }
+      | T_ID "::" T_ID '(' exps ')'              { $$ = exp_enum(symbol_type($1), symbol_ctor($3), ast_list_finish($5)); }
+      | T_ID '{' field_inits '}'                 { $$ = exp_struct(symbol_type($1), ast_list_finish($3)); }
       | exp '.' T_ID                             { $$ = exp_lookup($1, symbol_field($3)); }
       | exp '[' exp ']'                          { $$ = exp_index($1, $3); }
       | T_ID '(' ')'                             { $$ = exp_fn_call(symbol_var($1), NULL); }
-      | T_ID '(' exps ')'                        { $$ = exp_fn_call(symbol_var($1), $3); }
-      | '[' exps ']'                             { $$ = exp_array($2); }
+      | T_ID '(' exps ')'                        { $$ = exp_fn_call(symbol_var($1), ast_list_finish($3)); }
+      | '[' exps ']'                             { $$ = exp_array(ast_list_finish($2)); }
       | '(' ')'                                  { $$ = exp_unit(); }
       | '(' exp ')'                              { $$ = $2; }
       | "Box" "::" "new" '(' exp ')'             { $$ = exp_box_new($5); }
-      | "match" '(' exp ')' '{' arms '}'         { $$ = exp_match($3, $6); }
+      | "match" '(' exp ')' '{' arms '}'         { $$ = exp_match($3, ast_list_finish($6)); }
       | "if" '(' exp ')' block                   { $$ = exp_if($3, $5, NULL); }
       | "if" '(' exp ')' block "else" block      { $$ = exp_if($3, $5, $7); }
       | "while" '(' exp ')' block                { $$ = exp_while($3, $5); }
@@ -217,39 +219,39 @@ single_exp
       | block
 
 exp   : single_exp
-      | %prec UNARY '-' exp                      { $$ = exp_unary("-", $2); }
-      | %prec UNARY '!' exp                      { $$ = exp_unary("!", $2); }
-      | %prec UNARY '*' exp                      { $$ = exp_unary("*", $2); }
-      | %prec UNARY '&' exp                      { $$ = exp_unary("&", $2); }
+      | %prec UNARY '-' exp                      { $$ = exp_unary(OP_SUB, $2); }
+      | %prec UNARY '!' exp                      { $$ = exp_unary(OP_NOT, $2); }
+      | %prec UNARY '*' exp                      { $$ = exp_unary(OP_MUL, $2); }
+      | %prec UNARY '&' exp                      { $$ = exp_unary(OP_ADDROF, $2); }
       | %prec UNARY '&' "mut" exp                { $$ = exp_addrof_mut($3); }
-      | exp '=' exp                              { $$ = exp_binary("=", $1, $3); }
-      | exp "-=" exp                             { $$ = exp_binary("-=", $1, $3); }
-      | exp "+=" exp                             { $$ = exp_binary("+=", $1, $3); }
-      | exp "*=" exp                             { $$ = exp_binary("*=", $1, $3); }
-      | exp "/=" exp                             { $$ = exp_binary("/=", $1, $3); }
-      | exp "%=" exp                             { $$ = exp_binary("%=", $1, $3); }
-      | exp "||" exp                             { $$ = exp_binary("||", $1, $3); }
-      | exp "&&" exp                             { $$ = exp_binary("&&", $1, $3); }
-      | exp "==" exp                             { $$ = exp_binary("==", $1, $3); }
-      | exp "!=" exp                             { $$ = exp_binary("!=", $1, $3); }
-      | exp '<' exp                              { $$ = exp_binary("<", $1, $3); }
-      | exp '>' exp                              { $$ = exp_binary(">", $1, $3); }
-      | exp "<=" exp                             { $$ = exp_binary("<=", $1, $3); }
-      | exp ">=" exp                             { $$ = exp_binary(">=", $1, $3); }
-      | exp '+' exp                              { $$ = exp_binary("+", $1, $3); }
-      | exp '-' exp                              { $$ = exp_binary("-", $1, $3); }
-      | exp '*' exp                              { $$ = exp_binary("*", $1, $3); }
-      | exp '/' exp                              { $$ = exp_binary("/", $1, $3); }
-      | exp '%' exp                              { $$ = exp_binary("%", $1, $3); }
+      | exp '=' exp                              { $$ = exp_binary(OP_ASSIGN, $1, $3); }
+      | exp "-=" exp                             { $$ = exp_binary(OP_SUB_ASSIGN, $1, $3); }
+      | exp "+=" exp                             { $$ = exp_binary(OP_ADD_ASSIGN, $1, $3); }
+      | exp "*=" exp                             { $$ = exp_binary(OP_MUL_ASSIGN, $1, $3); }
+      | exp "/=" exp                             { $$ = exp_binary(OP_DIV_ASSIGN, $1, $3); }
+      | exp "%=" exp                             { $$ = exp_binary(OP_REM_ASSIGN, $1, $3); }
+      | exp "||" exp                             { $$ = exp_binary(OP_OR, $1, $3); }
+      | exp "&&" exp                             { $$ = exp_binary(OP_AND, $1, $3); }
+      | exp "==" exp                             { $$ = exp_binary(OP_EQ, $1, $3); }
+      | exp "!=" exp                             { $$ = exp_binary(OP_NEQ, $1, $3); }
+      | exp '<' exp                              { $$ = exp_binary(OP_LT, $1, $3); }
+      | exp '>' exp                              { $$ = exp_binary(OP_GT, $1, $3); }
+      | exp "<=" exp                             { $$ = exp_binary(OP_LEQ, $1, $3); }
+      | exp ">=" exp                             { $$ = exp_binary(OP_GEQ, $1, $3); }
+      | exp '+' exp                              { $$ = exp_binary(OP_ADD, $1, $3); }
+      | exp '-' exp                              { $$ = exp_binary(OP_SUB, $1, $3); }
+      | exp '*' exp                              { $$ = exp_binary(OP_MUL, $1, $3); }
+      | exp '/' exp                              { $$ = exp_binary(OP_DIV, $1, $3); }
+      | exp '%' exp                              { $$ = exp_binary(OP_REM, $1, $3); }
 
 field_inits
-      : field_init                               { $$ = g_list_append(NULL, $1); }
-      | field_inits ',' field_init               { $$ = g_list_append($1, $3); }
+      : field_init                               { $$ = ast_list_prepend(NULL, $1); }
+      | field_inits ',' field_init               { $$ = ast_list_prepend($1, $3); }
 
 field_init
       : T_ID ':' exp                             { $$ = field_init(symbol_field($1), $3); }
 
-arms  : arm                                      { $$ = g_list_append(NULL, $1); }
-      | arms ',' arm                             { $$ = g_list_append($1, $3); }
+arms  : arm                                      { $$ = ast_list_prepend(NULL, $1); }
+      | arms ',' arm                             { $$ = ast_list_prepend($1, $3); }
 
-arm   : pats_or "=>" block                       { $$ = match_arm($1, $3); }
+arm   : pats_or "=>" block                       { $$ = match_arm(ast_list_finish($1), $3); }
@@ -0,0 +1,270 @@
+#include <assert.h>
+#include <string.h>
+#include "pass.h"
+#include "mem2reg.h"
+#include "tailcall.h"
+#include "bounds.h"
+#include "parallel.h"
+
+static void simplify_cfg(struct mir_fn* fn);
+static void dce(struct mir_fn* fn);
+
+static const struct pass passes[] = {
+      {"simplify-cfg", simplify_cfg},
+      {"mem2reg", mem2reg},
+      {"tailcall", tailcall},
+      {"bounds", bounds},
+      {"dce", dce},
+};
+
+#define NPASSES (sizeof passes / sizeof *passes)
+#define MAX_PIPELINE 32
+
+static const struct pass* pipeline[MAX_PIPELINE];
+static int pipeline_len = -1;
+static void (*pass_hook)(const char* pass, bool done);
+
+static const struct pass* pass_lookup(const char* name, size_t len) {
+      for (size_t i = 0; i != NPASSES; ++i)
+            if (strlen(passes[i].name) == len && !strncmp(passes[i].name, name, len))
+                  return &passes[i];
+      return NULL;
+}
+
+bool pass_set_pipeline(const char* names) {
+      const struct pass* p[MAX_PIPELINE];
+      int n = 0;
+
+      while (*names) {
+            const char* end = strchr(names, ',');
+            size_t len = end? (size_t)(end - names) : strlen(names);
+            if (n == MAX_PIPELINE || !(p[n++] = pass_lookup(names, len))) return false;
+            names += len;
+            if (*names) ++names;
+      }
+
+      memcpy(pipeline, p, n * sizeof *p);
+      pipeline_len = n;
+      return true;
+}
+
+char* pass_pipeline(void) {
+      if (pipeline_len < 0) return g_strdup(PASS_DEFAULT);
+      GString* names = g_string_new("");
+      for (int i = 0; i != pipeline_len; ++i) {
+            if (i) g_string_append_c(names, ',');
+            g_string_append(names, pipeline[i]->name);
+      }
+      return g_string_free(names, false);
+}
+
+void pass_set_hook(void (*hook)(const char* pass, bool done)) {
+      pass_hook = hook;
+}
+
+static void pass_job_run(void* fn, void* data) {
+      const struct pass* pass = data;
+      // One from the cache has nothing to work on.
+      if (!((struct mir_fn*)fn)->blocks->len) return;
+      pass->run(fn);
+}
+
+void pass_run(struct mir_module* module) {
+      if (pipeline_len < 0) {
+            bool ok = pass_set_pipeline(PASS_DEFAULT);
+            assert(ok);
+      }
+
+      for (int i = 0; i != pipeline_len; ++i) {
+            const struct pass* pass = pipeline[i];
+            if (pass_hook) pass_hook(pass->name, false);
+            parallel_for(module->fns->pdata, module->fns->len, pass_job_run, (void*)pass);
+            if (pass_hook) pass_hook(pass->name, true);
+      }
+}
+
+// *** simplify-cfg ***
+
+static bool has_phis(const struct mir_block* b) {
+      return b->insts->len && g_array_index(b->insts, struct mir_inst, 0).kind == MIR_PHI;
+}
+
+// Phis in b that have an entry for pred get it for with instead.
+static void phis_rename_pred(struct mir_block* b, struct mir_block* pred, struct mir_block* with) {
+      for (guint i = 0; i != b->insts->len; ++i) {
+            struct mir_inst* phi = &g_array_index(b->insts, struct mir_inst, i);
+            if (phi->kind != MIR_PHI) break;
+            for (guint j = 0; j != phi->preds->len; ++j)
+                  if (g_ptr_array_index(phi->preds, j) == pred)
+                        g_ptr_array_index(phi->preds, j) = with;
+      }
+}
+
+// Phis in b lose their entries for the dead preds.
+static void phis_drop_dead_preds(struct mir_block* b) {
+      for (guint i = 0; i != b->insts->len; ++i) {
+            struct mir_inst* phi = &g_array_index(b->insts, struct mir_inst, i);
+            if (phi->kind != MIR_PHI) break;
+            guint n = 0;
+            for (guint j = 0; j != phi->preds->len; ++j) {
+                  struct mir_block* pred = g_ptr_array_index(phi->preds, j);
+                  if (pred->dead) continue;
+                  g_ptr_array_index(phi->preds, n) = pred;
+                  g_array_index(phi->args, struct mir_value, n) = g_array_index(phi->args, struct mir_value, j);
+                  ++n;
+            }
+            g_ptr_array_set_size(phi->preds, n);
+            g_array_set_size(phi->args, n);
+      }
+}
+
+static void drop_unreachable(struct mir_fn* fn) {
+      GPtrArray* stack = g_ptr_array_new();
+
+      for (guint i = 0; i != fn->blocks->len; ++i)
+            ((struct mir_block*)g_ptr_array_index(fn->blocks, i))->mark = 0;
+
+      struct mir_block* entry = g_ptr_array_index(fn->blocks, 0);
+      entry->mark = 1;
+      g_ptr_array_add(stack, entry);
+      while (stack->len) {
+            struct mir_block* b = g_ptr_array_index(stack, stack->len - 1);
+            g_ptr_array_set_size(stack, stack->len - 1);
+            for (int s = 0; s != mir_term_nsuccs(&b->term); ++s) {
+                  struct mir_block* succ = *mir_term_succ(&b->term, s);
+                  if (succ->mark) continue;
+                  succ->mark = 1;
+                  g_ptr_array_add(stack, succ);
+            }
+      }
+      g_ptr_array_free(stack, true);
+
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            b->dead = !b->mark;
+      }
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            if (!b->dead) phis_drop_dead_preds(b);
+      }
+      mir_drop_blocks(fn);
+}
+
+// Where a jump to b really goes: past any empty blocks that just jump on
+// (unless their target has phis, which care where they're entered from).
+static struct mir_block* jump_target(struct mir_fn* fn, struct mir_block* b) {
+      struct mir_block* entry = g_ptr_array_index(fn->blocks, 0);
+      for (guint steps = 0; steps != fn->blocks->len; ++steps) {
+            if (b == entry || b->insts->len || b->term.kind != MIR_JUMP) break;
+            struct mir_block* next = b->term.to[0];
+            if (next == b || has_phis(next)) break;
+            b = next;
+      }
+      return b;
+}
+
+static void thread_jumps(struct mir_fn* fn) {
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            int n = mir_term_nsuccs(&b->term);
+            bool same = true;
+            for (int s = 0; s != n; ++s) {
+                  struct mir_block** succ = mir_term_succ(&b->term, s);
+                  *succ = jump_target(fn, *succ);
+                  same = same && *succ == b->term.to[0];
+            }
+
+            // A branch or switch that goes the same way whatever the value is
+            // a jump (unless there are phis that count its edges).
+            if (n > 1 && same && !has_phis(b->term.to[0])) {
+                  mir_term_free(&b->term);
+                  b->term.kind = MIR_JUMP;
+                  b->term.value = mir_none();
+            }
+      }
+}
+
+// b absorbs its successor for as long as it has just the one and is the
+// successor's only predecessor.
+static void merge_chain(struct mir_fn* fn, struct mir_block* b) {
+      struct mir_block* entry = g_ptr_array_index(fn->blocks, 0);
+      while (b->term.kind == MIR_JUMP) {
+            struct mir_block* next = b->term.to[0];
+            if (next == b || next == entry || next->dead || next->preds->len != 1 || has_phis(next))
+                  break;
+
+            g_array_append_vals(b->insts, next->insts->data, next->insts->len);
+            // The instructions changed hands, don't free what they own.
+            g_array_set_size(next->insts, 0);
+            b->term = next->term;
+            next->term.cases = NULL;
+            next->dead = true;
+
+            for (int s = 0; s != mir_term_nsuccs(&b->term); ++s) {
+                  struct mir_block* succ = *mir_term_succ(&b->term, s);
+                  phis_rename_pred(succ, next, b);
+                  for (guint i = 0; i != succ->preds->len; ++i)
+                        if (g_ptr_array_index(succ->preds, i) == next)
+                              g_ptr_array_index(succ->preds, i) = b;
+            }
+      }
+}
+
+static void simplify_cfg(struct mir_fn* fn) {
+      drop_unreachable(fn);
+      thread_jumps(fn);
+      drop_unreachable(fn);
+
+      mir_compute_preds(fn);
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            if (!b->dead) merge_chain(fn, b);
+      }
+      mir_drop_blocks(fn);
+}
+
+// *** dce ***
+
+static void count_use(struct mir_value* v, void* data) {
+      int* uses = data;
+      if (v->kind == MIR_REG) uses[v->n]++;
+}
+
+static void uncount_use(struct mir_value* v, void* data) {
+      int* uses = data;
+      if (v->kind == MIR_REG) uses[v->n]--;
+}
+
+static void dce(struct mir_fn* fn) {
+      int* uses = g_new0(int, fn->regs->len);
+      bool changed = true;
+
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len; ++j)
+                  mir_inst_operands(&g_array_index(b->insts, struct mir_inst, j), count_use, uses);
+            count_use(&b->term.value, uses);
+      }
+
+      // Going backwards, a chain of dead instructions within a block goes in
+      // one sweep; a dead value feeding another block's takes more.
+      while (changed) {
+            changed = false;
+            for (guint i = 0; i != fn->blocks->len; ++i) {
+                  struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+                  bool swept = false;
+                  for (guint j = b->insts->len; j--;) {
+                        struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                        if (inst->kind == MIR_INVALID || !mir_inst_is_pure(inst)
+                                    || inst->dst < 0 || uses[inst->dst])
+                              continue;
+                        mir_inst_operands(inst, uncount_use, uses);
+                        inst->kind = MIR_INVALID;
+                        swept = changed = true;
+                  }
+                  if (swept) mir_block_sweep(b);
+            }
+      }
+
+      g_free(uses);
+}
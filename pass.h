@@ -0,0 +1,47 @@
+#ifndef RUSTC_PASS_H_
+#define RUSTC_PASS_H_
+
+#include <stdbool.h>
+#include "mir.h"
+
+// *** MIR pass manager ***
+
+// A pass rewrites one function at a time. The pass manager runs the passes of
+// its pipeline in order, each over every function of the module (the
+// functions concurrently) before the next one starts.
+//
+// The passes:
+//  simplify-cfg  drops unreachable blocks, skips blocks that only jump on
+//                and merges blocks into their only predecessor
+//  mem2reg       turns stack slots that are only loaded and stored into
+//                registers, with phis where control flow joins
+//  tailcall      turns calls of a function by itself whose result is returned
+//                (possibly after adding or multiplying it) into loops, and
+//                marks other calls in tail position
+//  bounds        drops array bounds checks that can't fail, and has loops
+//                over arrays vectorized
+//  dce           drops instructions whose results aren't used
+struct pass {
+      const char* name;
+      void (*run)(struct mir_fn*);
+};
+
+// The pipeline unless told otherwise, and the one for --ssa.
+#define PASS_DEFAULT "simplify-cfg,tailcall,bounds,dce"
+#define PASS_SSA "simplify-cfg,mem2reg,tailcall,bounds,dce,simplify-cfg"
+
+// Sets the pipeline from a comma separated list of pass names (empty for no
+// passes at all). Returns false, leaving the pipeline alone, if a name is
+// unknown.
+bool pass_set_pipeline(const char* names);
+
+// The pipeline, in the form pass_set_pipeline() takes (to be g_free()d).
+char* pass_pipeline(void);
+
+// The hook is called with a pass's name before (done = false) and after
+// (done = true) it runs over a module, e.g. to time it.
+void pass_set_hook(void (*hook)(const char* pass, bool done));
+
+void pass_run(struct mir_module* module);
+
+#endif
@@ -0,0 +1,141 @@
+#include <assert.h>
+#include "reach.h"
+#include "ast.h"
+#include "stats.h"
+
+struct reach {
+      // Fn id -> ITEM_FN_DEF.
+      GHashTable* fns;
+      // Fn id -> true, for the fns found so far.
+      GHashTable* live;
+      // The live fns whose bodies are still to be looked through.
+      GPtrArray* todo;
+};
+
+static void reach_fn(struct reach* r, Symbol id) {
+      struct item* fn = g_hash_table_lookup(r->fns, GINT_TO_POINTER(id.value));
+      // printi(), prints().
+      if (!fn) return;
+      if (g_hash_table_lookup(r->live, GINT_TO_POINTER(id.value))) return;
+      g_hash_table_insert(r->live, GINT_TO_POINTER(id.value), GINT_TO_POINTER(true));
+      g_ptr_array_add(r->todo, fn);
+}
+
+static void reach_exp(struct reach* r, const struct exp* exp);
+
+static void reach_exps(struct reach* r, const GList* exps) {
+      for (const GList* p = exps; p; p = p->next)
+            reach_exp(r, p->data);
+}
+
+static void reach_stmt(struct reach* r, const struct stmt* stmt) {
+      switch (stmt->kind) {
+            case STMT_LET:
+                  reach_exp(r, stmt->let.exp);
+                  break;
+            case STMT_RETURN:
+            case STMT_EXP:
+                  reach_exp(r, stmt->exp);
+                  break;
+      }
+}
+
+static void reach_exp(struct reach* r, const struct exp* exp) {
+      if (!exp) return;
+
+      switch (exp->kind) {
+            case EXP_ENUM:
+                  reach_exps(r, exp->lit_enum.exps);
+                  break;
+            case EXP_STRUCT:
+                  for (const GList* p = exp->lit_struct.fields; p; p = p->next) {
+                        const struct pair* field = p->data;
+                        reach_exp(r, field->field_init.exp);
+                  }
+                  break;
+            case EXP_LOOKUP:
+                  reach_exp(r, exp->lookup.exp);
+                  break;
+            case EXP_INDEX:
+                  reach_exp(r, exp->index.exp);
+                  reach_exp(r, exp->index.idx);
+                  break;
+            case EXP_FN_CALL:
+                  reach_fn(r, exp->fn_call.id);
+                  reach_exps(r, exp->fn_call.exps);
+                  break;
+            case EXP_ARRAY:
+                  reach_exps(r, exp->lit_array.exps);
+                  break;
+            case EXP_BOX_NEW:
+            case EXP_LOOP:
+                  reach_exp(r, exp->exp);
+                  break;
+            case EXP_MATCH:
+                  reach_exp(r, exp->match.exp);
+                  for (const GList* p = exp->match.arms; p; p = p->next) {
+                        const struct pair* arm = p->data;
+                        reach_exp(r, arm->match_arm.block);
+                  }
+                  break;
+            case EXP_IF:
+                  reach_exp(r, exp->if_else.cond);
+                  reach_exp(r, exp->if_else.block_true);
+                  reach_exp(r, exp->if_else.block_false);
+                  break;
+            case EXP_WHILE:
+                  reach_exp(r, exp->loop_while.cond);
+                  reach_exp(r, exp->loop_while.block);
+                  break;
+            case EXP_BLOCK:
+                  for (const GList* p = exp->block.stmts; p; p = p->next)
+                        reach_stmt(r, p->data);
+                  reach_exp(r, exp->block.exp);
+                  break;
+            case EXP_UNARY:
+                  reach_exp(r, exp->unary.exp);
+                  break;
+            case EXP_BINARY:
+                  reach_exp(r, exp->binary.left);
+                  reach_exp(r, exp->binary.right);
+                  break;
+      }
+}
+
+GList* reach_crate(GList* items) {
+      struct reach r = {
+            g_hash_table_new(NULL, NULL),
+            g_hash_table_new(NULL, NULL),
+            g_ptr_array_new(),
+      };
+
+      for (GList* i = items; i; i = i->next) {
+            struct item* item = i->data;
+            if (item->kind == ITEM_FN_DEF)
+                  g_hash_table_insert(r.fns, GINT_TO_POINTER(item->id.value), item);
+      }
+
+      // Calls are the only way to use a fn, so what main can run is all
+      // that's live.
+      reach_fn(&r, symbol_main());
+      while (r.todo->len) {
+            struct item* fn = g_ptr_array_index(r.todo, r.todo->len - 1);
+            g_ptr_array_set_size(r.todo, r.todo->len - 1);
+            reach_exp(&r, fn->fn_def.block);
+      }
+
+      GList* live = NULL;
+      int dead = 0;
+      for (GList* i = items; i; i = i->next) {
+            struct item* item = i->data;
+            if (item->kind == ITEM_FN_DEF && !g_hash_table_lookup(r.live, GINT_TO_POINTER(item->id.value)))
+                  ++dead;
+            else live = ast_list_prepend(live, item);
+      }
+      if (stats_enabled) stats_add(STATS_DEAD_FNS, dead);
+
+      g_ptr_array_free(r.todo, true);
+      g_hash_table_destroy(r.live);
+      g_hash_table_destroy(r.fns);
+      return ast_list_finish(live);
+}
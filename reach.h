@@ -0,0 +1,15 @@
+#ifndef RUSTC_REACH_H_
+#define RUSTC_REACH_H_
+
+#include <glib.h>
+
+// *** Dead item elimination ***
+
+// Returns the items of the (type checked) crate that the program can use:
+// the fns main calls, directly or not, along with every struct and enum
+// definition. In their original order, in a list from the crate arena.
+// Leaving the rest out of codegen leaves out the string constants only they
+// use as well.
+GList* reach_crate(GList* items);
+
+#endif
@@ -0,0 +1,297 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+#include "resolve.h"
+#include "ast.h"
+#include "arena.h"
+
+// State for resolving one function.
+struct resolver {
+      // Symbol value -> the innermost PAT_BIND currently in scope for it.
+      GHashTable* scope;
+      // What each binding in scope replaced, so leaving a block can put it
+      // back. Entries past a block's mark belong to that block.
+      GArray* shadowed;
+      // IR names already used in the function.
+      GHashTable* taken;
+      int slots;
+      // The crate's string literals, each once, and what's in them -> index + 1.
+      GPtrArray* pool;
+      GHashTable* strings;
+};
+
+struct shadow {
+      int id;
+      struct pat* prev;
+};
+
+static void resolve_exp(struct resolver* r, struct exp* exp);
+
+// Names codegen makes up on its own: "entry", "retval", "r<N>", "cmp<N>".
+static bool is_reserved(const char* name) {
+      if (!strcmp(name, "entry") || !strcmp(name, "retval")) return true;
+
+      const char* digits = NULL;
+      if (name[0] == 'r') digits = name + 1;
+      else if (!strncmp(name, "cmp", 3)) digits = name + 3;
+      if (!digits || !*digits) return false;
+
+      for (; *digits; ++digits)
+            if (!isdigit((unsigned char)*digits)) return false;
+      return true;
+}
+
+static bool is_taken(struct resolver* r, const char* name) {
+      return is_reserved(name) || g_hash_table_lookup(r->taken, name);
+}
+
+static void take(struct resolver* r, const char* name) {
+      g_hash_table_insert(r->taken, (gpointer)name, (gpointer)name);
+}
+
+static const char* arena_name(const char* name, const char* suffix, int n) {
+      char* str = n? g_strdup_printf("%s.%d", name, n) : g_strdup_printf("%s%s", name, suffix);
+      char* ir = arena_strdup(crate_arena(), str);
+      g_free(str);
+      return ir;
+}
+
+// The name unchanged if it's free, otherwise the name with the first free
+// ".N" suffix.
+static const char* fresh_name(struct resolver* r, const char* name) {
+      const char* ir = arena_strdup(crate_arena(), name);
+      for (int n = 1; is_taken(r, ir); ++n)
+            ir = arena_name(name, "", n);
+      take(r, ir);
+      return ir;
+}
+
+static int scope_enter(struct resolver* r) {
+      return r->shadowed->len;
+}
+
+static void scope_leave(struct resolver* r, int mark) {
+      while (r->shadowed->len > (guint)mark) {
+            struct shadow s = g_array_index(r->shadowed, struct shadow, r->shadowed->len - 1);
+            if (s.prev) g_hash_table_insert(r->scope, GINT_TO_POINTER(s.id), s.prev);
+            else g_hash_table_remove(r->scope, GINT_TO_POINTER(s.id));
+            g_array_set_size(r->shadowed, r->shadowed->len - 1);
+      }
+}
+
+static void bind(struct resolver* r, struct pat* pat, bool param) {
+      if (!pat) return;
+
+      switch (pat->kind) {
+            case PAT_BIND: {
+                  const char* name = fresh_name(r, symbol_to_str(pat->bind.id));
+                  if (param) {
+                        // The bare name is the incoming value, the slot is
+                        // name.addr (which can't clash: user names have no dot).
+                        name = arena_name(name, ".addr", 0);
+                        take(r, name);
+                  }
+                  pat->bind.slot = r->slots++;
+                  pat->bind.ir_name = name;
+
+                  struct shadow s = {pat->bind.id.value,
+                        g_hash_table_lookup(r->scope, GINT_TO_POINTER(pat->bind.id.value))};
+                  g_array_append_val(r->shadowed, s);
+                  g_hash_table_insert(r->scope, GINT_TO_POINTER(pat->bind.id.value), pat);
+                  break;
+            }
+            case PAT_REF:
+                  bind(r, pat->pat, param);
+                  break;
+            case PAT_ARRAY:
+                  for (GList* p = pat->array.pats; p; p = p->next)
+                        bind(r, p->data, param);
+                  break;
+            case PAT_ENUM:
+                  for (GList* p = pat->ctor.pats; p; p = p->next)
+                        bind(r, p->data, param);
+                  break;
+            case PAT_STRUCT:
+                  for (GList* p = pat->strct.fields; p; p = p->next) {
+                        struct pair* field = p->data;
+                        bind(r, field->field_pat.pat, param);
+                  }
+                  break;
+      }
+}
+
+// The later alternatives of an or-pattern bind the same names as the first
+// one, which they share slots with: whichever alternative matches, the arm's
+// body finds the values in the same place.
+static void bind_alt(struct resolver* r, struct pat* pat) {
+      switch (pat->kind) {
+            case PAT_BIND: {
+                  struct pat* first = g_hash_table_lookup(r->scope, GINT_TO_POINTER(pat->bind.id.value));
+                  assert(first);
+                  pat->bind.slot = first->bind.slot;
+                  pat->bind.ir_name = first->bind.ir_name;
+                  break;
+            }
+            case PAT_REF:
+                  bind_alt(r, pat->pat);
+                  break;
+            case PAT_ARRAY:
+                  for (GList* p = pat->array.pats; p; p = p->next)
+                        bind_alt(r, p->data);
+                  break;
+            case PAT_ENUM:
+                  for (GList* p = pat->ctor.pats; p; p = p->next)
+                        bind_alt(r, p->data);
+                  break;
+            case PAT_STRUCT:
+                  for (GList* p = pat->strct.fields; p; p = p->next) {
+                        struct pair* field = p->data;
+                        bind_alt(r, field->field_pat.pat);
+                  }
+                  break;
+      }
+}
+
+static void resolve_exps(struct resolver* r, GList* exps) {
+      for (GList* p = exps; p; p = p->next)
+            resolve_exp(r, p->data);
+}
+
+static void resolve_stmt(struct resolver* r, struct stmt* stmt) {
+      switch (stmt->kind) {
+            case STMT_LET:
+                  // The initializer still sees whatever the let shadows.
+                  resolve_exp(r, stmt->let.exp);
+                  bind(r, stmt->let.pat, false);
+                  break;
+            case STMT_RETURN:
+            case STMT_EXP:
+                  resolve_exp(r, stmt->exp);
+                  break;
+      }
+}
+
+static void pool_string(struct resolver* r, struct exp* exp) {
+      int n = GPOINTER_TO_INT(g_hash_table_lookup(r->strings, exp->str));
+      if (!n) {
+            g_ptr_array_add(r->pool, exp->str);
+            n = r->pool->len;
+            g_hash_table_insert(r->strings, exp->str, GINT_TO_POINTER(n));
+      }
+      exp->string = n - 1;
+}
+
+static void resolve_exp(struct resolver* r, struct exp* exp) {
+      if (!exp) return;
+
+      switch (exp->kind) {
+            case EXP_ID:
+                  exp->bind = g_hash_table_lookup(r->scope, GINT_TO_POINTER(exp->id.value));
+                  break;
+            case EXP_STR:
+                  pool_string(r, exp);
+                  break;
+            case EXP_ENUM:
+                  resolve_exps(r, exp->lit_enum.exps);
+                  break;
+            case EXP_STRUCT:
+                  for (GList* p = exp->lit_struct.fields; p; p = p->next) {
+                        struct pair* field = p->data;
+                        resolve_exp(r, field->field_init.exp);
+                  }
+                  break;
+            case EXP_LOOKUP:
+                  resolve_exp(r, exp->lookup.exp);
+                  break;
+            case EXP_INDEX:
+                  resolve_exp(r, exp->index.exp);
+                  resolve_exp(r, exp->index.idx);
+                  break;
+            case EXP_FN_CALL:
+                  resolve_exps(r, exp->fn_call.exps);
+                  break;
+            case EXP_ARRAY:
+                  resolve_exps(r, exp->lit_array.exps);
+                  break;
+            case EXP_BOX_NEW:
+            case EXP_LOOP:
+                  resolve_exp(r, exp->exp);
+                  break;
+            case EXP_MATCH:
+                  resolve_exp(r, exp->match.exp);
+                  for (GList* p = exp->match.arms; p; p = p->next) {
+                        struct pair* arm = p->data;
+                        int mark = scope_enter(r);
+                        bind(r, arm->match_arm.pats->data, false);
+                        for (GList* q = arm->match_arm.pats->next; q; q = q->next)
+                              bind_alt(r, q->data);
+                        resolve_exp(r, arm->match_arm.block);
+                        scope_leave(r, mark);
+                  }
+                  break;
+            case EXP_IF:
+                  resolve_exp(r, exp->if_else.cond);
+                  resolve_exp(r, exp->if_else.block_true);
+                  resolve_exp(r, exp->if_else.block_false);
+                  break;
+            case EXP_WHILE:
+                  resolve_exp(r, exp->loop_while.cond);
+                  resolve_exp(r, exp->loop_while.block);
+                  break;
+            case EXP_BLOCK: {
+                  int mark = scope_enter(r);
+                  for (GList* p = exp->block.stmts; p; p = p->next)
+                        resolve_stmt(r, p->data);
+                  resolve_exp(r, exp->block.exp);
+                  scope_leave(r, mark);
+                  break;
+            }
+            case EXP_UNARY:
+                  resolve_exp(r, exp->unary.exp);
+                  if (exp_is_addrof(exp) && exp->unary.exp->kind == EXP_ID && exp->unary.exp->bind)
+                        exp->unary.exp->bind->bind.borrowed = true;
+                  break;
+            case EXP_BINARY:
+                  resolve_exp(r, exp->binary.left);
+                  resolve_exp(r, exp->binary.right);
+                  break;
+      }
+}
+
+static void resolve_item(struct item* item, struct resolver* r) {
+      assert(item);
+      if (item->kind != ITEM_FN_DEF) return;
+
+      g_hash_table_remove_all(r->scope);
+      g_hash_table_remove_all(r->taken);
+      g_array_set_size(r->shadowed, 0);
+      r->slots = 0;
+
+      for (GList* p = item->fn_def.type->params; p; p = p->next) {
+            struct pair* param = p->data;
+            bind(r, param->param.pat, true);
+      }
+      resolve_exp(r, item->fn_def.block);
+      item->fn_def.slots = r->slots;
+}
+
+GPtrArray* resolve_crate(GList* items) {
+      struct resolver r = {
+            g_hash_table_new(NULL, NULL),
+            g_array_new(false, false, sizeof(struct shadow)),
+            g_hash_table_new(g_str_hash, g_str_equal),
+            0,
+            g_ptr_array_new(),
+            g_hash_table_new(g_str_hash, g_str_equal),
+      };
+
+      g_list_foreach(items, (GFunc)resolve_item, &r);
+
+      g_hash_table_destroy(r.scope);
+      g_array_free(r.shadowed, true);
+      g_hash_table_destroy(r.taken);
+      g_hash_table_destroy(r.strings);
+      return r.pool;
+}
@@ -0,0 +1,29 @@
+#ifndef RUSTC_RESOLVE_H_
+#define RUSTC_RESOLVE_H_
+
+#include <glib.h>
+
+// *** Name resolution ***
+
+// Numbers every binding (fn parameter, let, match arm pattern) of every
+// function and gives it an IR name that's unique within the function, then
+// points each EXP_ID at the binding it refers to. So codegen never has to look
+// a variable up by name.
+//
+// The IR name of a let binding is the variable name, and that of a parameter
+// is the name followed by ".addr" (the incoming value itself is the bare
+// name). When a name is already taken in the function (by shadowing, or
+// because it looks like one of the registers codegen makes up), it gets a
+// ".N" suffix instead. The alternatives of an or-pattern (A | B => ...) all
+// share the first one's bindings.
+//
+// Also flags the bindings whose address is taken (&x, &mut x), which are the
+// ones that have to stay in memory.
+//
+// And pools the crate's string literals, wherever they are: returns each
+// different one once, in the order they first appear (of char*, still owned
+// by the crate), and sets every EXP_STR's string to its index there. Codegen
+// emits the pool as @.str<index> constants.
+GPtrArray* resolve_crate(GList* items);
+
+#endif
@@ -0,0 +1,173 @@
+#include "runtime.h"
+
+// Boxes of up to 256 bytes come out of pools, one per multiple of 16 bytes,
+// each carved out of chunks of 64 boxes; bigger ones are malloc()ed as they
+// are. A pool is the next free address and the end of its chunk. Nothing
+// frees a box, so there's no going back to a pool.
+static const char box_runtime[] =
+      "@rt.pool.next = internal global [17 x i64] zeroinitializer\n"
+      "@rt.pool.end = internal global [17 x i64] zeroinitializer\n"
+      "\n"
+      "define internal i8* @rt.box(i64 %size) nounwind {\n"
+      "entry:\n"
+      "  %big = icmp ugt i64 %size, 256\n"
+      "  br i1 %big, label %heap, label %pool\n"
+      "\n"
+      "heap:\n"
+      "  %p = call i8* @malloc(i64 %size)\n"
+      "  ret i8* %p\n"
+      "\n"
+      "pool:\n"
+      "  %up = add i64 %size, 15\n"
+      "  %class = lshr i64 %up, 4\n"
+      "  %bytes = shl i64 %class, 4\n"
+      "  %nextp = getelementptr inbounds [17 x i64]* @rt.pool.next, i64 0, i64 %class\n"
+      "  %endp = getelementptr inbounds [17 x i64]* @rt.pool.end, i64 0, i64 %class\n"
+      "  %next = load i64* %nextp\n"
+      "  %end = load i64* %endp\n"
+      "  %after = add i64 %next, %bytes\n"
+      "  %full = icmp ugt i64 %after, %end\n"
+      "  br i1 %full, label %refill, label %take\n"
+      "\n"
+      "take:\n"
+      "  store i64 %after, i64* %nextp\n"
+      "  %q = inttoptr i64 %next to i8*\n"
+      "  ret i8* %q\n"
+      "\n"
+      "refill:\n"
+      "  %chunk = mul i64 %bytes, 64\n"
+      "  %c = call i8* @malloc(i64 %chunk)\n"
+      "  %ci = ptrtoint i8* %c to i64\n"
+      "  %cnext = add i64 %ci, %bytes\n"
+      "  %cend = add i64 %ci, %chunk\n"
+      "  store i64 %cnext, i64* %nextp\n"
+      "  store i64 %cend, i64* %endp\n"
+      "  ret i8* %c\n"
+      "}\n"
+      "\n"
+      "declare noalias i8* @malloc(i64) nounwind\n";
+
+// Output goes into a 64K buffer that's written out when it fills up and when
+// main returns, rather than through printf() a call at a time. printi turns
+// its number into digits itself, last first, and prints has the length of
+// its string up front, unless it's not a literal. A string too big for the
+// buffer is written out as it is, after whatever came before it.
+static const char print_runtime[] =
+      "@rt.out.buf = internal global [65536 x i8] zeroinitializer\n"
+      "@rt.out.len = internal global i64 0\n"
+      "\n"
+      "define internal void @rt.write(i8* %p, i64 %n) nounwind {\n"
+      "entry:\n"
+      "  br label %loop\n"
+      "\n"
+      "loop:\n"
+      "  %at = phi i8* [%p, %entry], [%next, %wrote]\n"
+      "  %left = phi i64 [%n, %entry], [%rest, %wrote]\n"
+      "  %more = icmp sgt i64 %left, 0\n"
+      "  br i1 %more, label %write, label %done\n"
+      "\n"
+      "write:\n"
+      "  %w = call i64 @write(i32 1, i8* %at, i64 %left)\n"
+      "  %ok = icmp sgt i64 %w, 0\n"
+      "  br i1 %ok, label %wrote, label %done\n"
+      "\n"
+      "wrote:\n"
+      "  %next = getelementptr inbounds i8* %at, i64 %w\n"
+      "  %rest = sub i64 %left, %w\n"
+      "  br label %loop\n"
+      "\n"
+      "done:\n"
+      "  ret void\n"
+      "}\n"
+      "\n"
+      "define internal void @rt.flush() nounwind {\n"
+      "entry:\n"
+      "  %len = load i64* @rt.out.len\n"
+      "  %buf = getelementptr inbounds [65536 x i8]* @rt.out.buf, i64 0, i64 0\n"
+      "  call void @rt.write(i8* %buf, i64 %len)\n"
+      "  store i64 0, i64* @rt.out.len\n"
+      "  ret void\n"
+      "}\n"
+      "\n"
+      "define internal void @rt.print.str(i8* %s, i64 %n) nounwind {\n"
+      "entry:\n"
+      "  %len = load i64* @rt.out.len\n"
+      "  %end = add i64 %len, %n\n"
+      "  %fits = icmp ule i64 %end, 65536\n"
+      "  br i1 %fits, label %copy, label %flush\n"
+      "\n"
+      "flush:\n"
+      "  call void @rt.flush()\n"
+      "  %big = icmp ugt i64 %n, 65536\n"
+      "  br i1 %big, label %direct, label %copy\n"
+      "\n"
+      "direct:\n"
+      "  call void @rt.write(i8* %s, i64 %n)\n"
+      "  ret void\n"
+      "\n"
+      "copy:\n"
+      "  %at = phi i64 [%len, %entry], [0, %flush]\n"
+      "  %dst = getelementptr inbounds [65536 x i8]* @rt.out.buf, i64 0, i64 %at\n"
+      "  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %dst, i8* %s, i64 %n, i32 1, i1 false)\n"
+      "  %after = add i64 %at, %n\n"
+      "  store i64 %after, i64* @rt.out.len\n"
+      "  ret void\n"
+      "}\n"
+      "\n"
+      "define internal void @rt.print.cstr(i8* %s) nounwind {\n"
+      "entry:\n"
+      "  %n = call i64 @strlen(i8* %s)\n"
+      "  call void @rt.print.str(i8* %s, i64 %n)\n"
+      "  ret void\n"
+      "}\n"
+      "\n"
+      "define internal void @rt.print.int(i32 %v) nounwind {\n"
+      "entry:\n"
+      "  %digits = alloca [11 x i8]\n"
+      "  %neg = icmp slt i32 %v, 0\n"
+      "  %minus = sub i32 0, %v\n"
+      "  %mag = select i1 %neg, i32 %minus, i32 %v\n"
+      "  br label %loop\n"
+      "\n"
+      "loop:\n"
+      "  %x = phi i32 [%mag, %entry], [%q, %loop]\n"
+      "  %i = phi i64 [11, %entry], [%j, %loop]\n"
+      "  %q = udiv i32 %x, 10\n"
+      "  %tens = mul i32 %q, 10\n"
+      "  %r = sub i32 %x, %tens\n"
+      "  %r8 = trunc i32 %r to i8\n"
+      "  %c = add i8 %r8, 48\n"
+      "  %j = sub i64 %i, 1\n"
+      "  %p = getelementptr inbounds [11 x i8]* %digits, i64 0, i64 %j\n"
+      "  store i8 %c, i8* %p\n"
+      "  %more = icmp ne i32 %q, 0\n"
+      "  br i1 %more, label %loop, label %sign\n"
+      "\n"
+      "sign:\n"
+      "  %k = sub i64 %j, 1\n"
+      "  %s = getelementptr inbounds [11 x i8]* %digits, i64 0, i64 %k\n"
+      "  br i1 %neg, label %negative, label %out\n"
+      "\n"
+      "negative:\n"
+      "  store i8 45, i8* %s\n"
+      "  br label %out\n"
+      "\n"
+      "out:\n"
+      "  %from = phi i64 [%j, %sign], [%k, %negative]\n"
+      "  %at = getelementptr inbounds [11 x i8]* %digits, i64 0, i64 %from\n"
+      "  %n = sub i64 11, %from\n"
+      "  call void @rt.print.str(i8* %at, i64 %n)\n"
+      "  ret void\n"
+      "}\n"
+      "\n"
+      "declare i64 @write(i32, i8*, i64)\n"
+      "declare i64 @strlen(i8*) nounwind readonly\n"
+      "declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i32, i1) nounwind\n";
+
+void runtime_box(struct ir_writer* out) {
+      ir_lit(out, box_runtime);
+}
+
+void runtime_print(struct ir_writer* out) {
+      ir_lit(out, print_runtime);
+}
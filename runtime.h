@@ -0,0 +1,20 @@
+#ifndef RUSTC_RUNTIME_H_
+#define RUSTC_RUNTIME_H_
+
+#include "ir_writer.h"
+
+// *** Runtime ***
+
+// The support code generated programs call into, written out as LLVM 3.6
+// assembly for the module to carry along: all of it internal, so it's
+// dropped wherever nothing uses it.
+
+// i8* @rt.box(i64 size) gives room for a box of that many bytes.
+void runtime_box(struct ir_writer* out);
+
+// void @rt.print.int(i32) and void @rt.print.str(i8*, i64 length) do
+// printi and prints, buffered: main has to call void @rt.flush() before it
+// returns. void @rt.print.cstr(i8*) prints a string whose length isn't known.
+void runtime_print(struct ir_writer* out);
+
+#endif
@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "stats.h"
+#include "ast.h" // For the crate arena.
+#include "arena.h"
+
+bool stats_enabled;
+
+static const char* phase_names[STATS_NPHASES] = {
+      [STATS_LOAD] = "load",
+      [STATS_PARSE] = "parse",
+      [STATS_BUILD_ENV] = "build_env",
+      [STATS_CHECK_MAIN] = "check_main",
+      [STATS_ANNOTATE] = "annotate",
+      [STATS_FOLD] = "fold",
+      [STATS_INLINE] = "inline",
+      [STATS_REACH] = "reach",
+      [STATS_RESOLVE] = "resolve",
+      [STATS_ESCAPE] = "escape",
+      [STATS_CACHE] = "cache",
+      [STATS_LOWER] = "lower",
+      [STATS_OPTIMIZE] = "optimize",
+      [STATS_CODEGEN] = "codegen",
+      [STATS_DESTROY] = "destroy",
+};
+
+static const char* counter_names[STATS_NCOUNTERS] = {
+      [STATS_ENV_SCOPES] = "env_scopes",
+      [STATS_ENV_RECORDS] = "env_records",
+      [STATS_IR_INSTS] = "ir_insts",
+      [STATS_DEAD_FNS] = "dead_fns",
+      [STATS_INLINED] = "inlined",
+      [STATS_TAIL_CALLS] = "tail_calls",
+      [STATS_STACK_BOXES] = "stack_boxes",
+      [STATS_CHECKS_DROPPED] = "checks_dropped",
+      [STATS_CACHE_HITS] = "cache_hits",
+};
+
+struct phase {
+      double wall, cpu;       // accumulated, in seconds
+      double wall0, cpu0;     // at stats_begin()
+};
+
+static struct phase phases[STATS_NPHASES];
+
+// The passes that ran, by name: a pass that's in the pipeline twice adds up.
+#define MAX_PASSES 16
+static struct {
+      const char* name;
+      struct phase t;
+} passes[MAX_PASSES];
+static int npasses;
+
+static volatile gint counters[STATS_NCOUNTERS];
+static size_t nodes[ARENA_NKINDS];
+
+static double wall_now(void) {
+      return g_get_monotonic_time() / 1e6;
+}
+
+static double cpu_now(void) {
+      struct timespec ts;
+      clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+      return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void stats_add(int counter, int n) {
+      assert(counter >= 0 && counter < STATS_NCOUNTERS);
+      g_atomic_int_add(&counters[counter], n);
+}
+
+void stats_begin(int phase) {
+      if (!stats_enabled) return;
+      phases[phase].wall0 = wall_now();
+      phases[phase].cpu0 = cpu_now();
+}
+
+void stats_end(int phase) {
+      if (!stats_enabled) return;
+      phases[phase].wall += wall_now() - phases[phase].wall0;
+      phases[phase].cpu += cpu_now() - phases[phase].cpu0;
+}
+
+void stats_pass(const char* pass, bool done) {
+      int i = 0;
+
+      if (!stats_enabled) return;
+      while (i != npasses && strcmp(passes[i].name, pass)) ++i;
+      if (i == npasses) {
+            if (npasses == MAX_PASSES) return;
+            passes[npasses++].name = pass;
+      }
+
+      struct phase* t = &passes[i].t;
+      if (!done) {
+            t->wall0 = wall_now();
+            t->cpu0 = cpu_now();
+      } else {
+            t->wall += wall_now() - t->wall0;
+            t->cpu += cpu_now() - t->cpu0;
+      }
+}
+
+void stats_add_arena(void) {
+      if (!stats_enabled) return;
+      const struct arena_stats* s = arena_stats(crate_arena());
+      for (int k = 0; k != ARENA_NKINDS; ++k)
+            nodes[k] += s->nodes[k];
+}
+
+// In kilobytes.
+static long peak_rss(void) {
+      struct rusage ru;
+      if (getrusage(RUSAGE_SELF, &ru)) return 0;
+      return ru.ru_maxrss;
+}
+
+static void print_text(void) {
+      double wall = 0, cpu = 0;
+
+      fprintf(stderr, "%-16s %10s %10s\n", "phase", "wall (s)", "cpu (s)");
+      for (int p = 0; p != STATS_NPHASES; ++p) {
+            fprintf(stderr, "%-16s %10.6f %10.6f\n", phase_names[p], phases[p].wall, phases[p].cpu);
+            wall += phases[p].wall;
+            cpu += phases[p].cpu;
+      }
+      fprintf(stderr, "%-16s %10.6f %10.6f\n\n", "total", wall, cpu);
+
+      if (npasses) {
+            fprintf(stderr, "%-16s %10s %10s\n", "pass", "wall (s)", "cpu (s)");
+            for (int i = 0; i != npasses; ++i)
+                  fprintf(stderr, "%-16s %10.6f %10.6f\n", passes[i].name, passes[i].t.wall, passes[i].t.cpu);
+            fprintf(stderr, "\n");
+      }
+
+      for (int k = 0; k != ARENA_NKINDS; ++k)
+            fprintf(stderr, "%-16s %10zu\n", arena_kind_to_str(k), nodes[k]);
+      for (int c = 0; c != STATS_NCOUNTERS; ++c)
+            fprintf(stderr, "%-16s %10d\n", counter_names[c], g_atomic_int_get(&counters[c]));
+      fprintf(stderr, "%-16s %10ld\n", "peak_rss_kb", peak_rss());
+}
+
+static void print_json(void) {
+      fprintf(stderr, "{\"phases\": {");
+      for (int p = 0; p != STATS_NPHASES; ++p)
+            fprintf(stderr, "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}",
+                        p? ", " : "", phase_names[p], phases[p].wall, phases[p].cpu);
+
+      fprintf(stderr, "}, \"passes\": {");
+      for (int i = 0; i != npasses; ++i)
+            fprintf(stderr, "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}",
+                        i? ", " : "", passes[i].name, passes[i].t.wall, passes[i].t.cpu);
+
+      fprintf(stderr, "}, \"nodes\": {");
+      for (int k = 0; k != ARENA_NKINDS; ++k)
+            fprintf(stderr, "%s\"%s\": %zu", k? ", " : "", arena_kind_to_str(k), nodes[k]);
+
+      fprintf(stderr, "}, \"counters\": {");
+      for (int c = 0; c != STATS_NCOUNTERS; ++c)
+            fprintf(stderr, "%s\"%s\": %d", c? ", " : "", counter_names[c], g_atomic_int_get(&counters[c]));
+
+      fprintf(stderr, "}, \"peak_rss_kb\": %ld}\n", peak_rss());
+}
+
+void stats_print(bool json) {
+      if (json) print_json();
+      else print_text();
+}
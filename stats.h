@@ -0,0 +1,67 @@
+#ifndef RUSTC_STATS_H_
+#define RUSTC_STATS_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+// *** Compiler statistics (--stats) ***
+
+// The phases of a compilation, in order.
+enum {
+      STATS_LOAD,             // --load-ast only, instead of parse to annotate
+      STATS_PARSE,
+      STATS_BUILD_ENV,
+      STATS_CHECK_MAIN,
+      STATS_ANNOTATE,
+      STATS_FOLD,
+      STATS_INLINE,
+      STATS_REACH,
+      STATS_RESOLVE,
+      STATS_ESCAPE,           // --mir only, as are lower and optimize
+      STATS_CACHE,            // --cache only: hashing, reading and saving
+      STATS_LOWER,
+      STATS_OPTIMIZE,
+      STATS_CODEGEN,
+      STATS_DESTROY,
+      STATS_NPHASES,
+};
+
+// Event counters.
+enum {
+      STATS_ENV_SCOPES,       // env_push() calls
+      STATS_ENV_RECORDS,      // env records created (shadowing copies included)
+      STATS_IR_INSTS,         // IR instructions emitted
+      STATS_DEAD_FNS,         // fns main never calls, left out of codegen
+      STATS_INLINED,          // calls inlined
+      STATS_TAIL_CALLS,       // self tail calls turned into loops
+      STATS_STACK_BOXES,      // Box::news put on the stack
+      STATS_CHECKS_DROPPED,   // array bounds checks proven redundant
+      STATS_CACHE_HITS,       // fns whose IR came out of --cache
+      STATS_NCOUNTERS,
+};
+
+// Off unless asked for, in which case counting costs an atomic add.
+extern bool stats_enabled;
+
+#define STATS_INC(counter) do { \
+      if (stats_enabled) stats_add((counter), 1); \
+} while (0)
+
+void stats_add(int counter, int n);
+
+// Brackets a phase. A phase can run any number of times (once per file in
+// batch mode); its times add up.
+void stats_begin(int phase);
+void stats_end(int phase);
+
+// Times the MIR passes (see pass_set_hook()), each under its own name within
+// the optimize phase.
+void stats_pass(const char* pass, bool done);
+
+// Adds up the crate arena's node counts; call before it's reset.
+void stats_add_arena(void);
+
+// Prints everything to stderr, as text or as a single JSON object.
+void stats_print(bool json);
+
+#endif
@@ -1,48 +1,96 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include "symbol.h"
+#include "ast.h" // For the crate arena.
+#include "arena.h"
 
 static bool symbol_is_valid(Symbol x);
 
 // *** Symbols ***
 
-Symbol symbol_ctor(char* id) {
-      assert(id);
-      GQuark q = g_quark_from_string(id);
-      free(id);
-      return (Symbol){SYMBOL_CTOR, q};
+// A string as seen by the table: either an interned copy or, while looking up,
+// a slice of the caller's buffer.
+struct name {
+      const char* str;
+      size_t len;
+};
+
+// name -> symbol value, and symbol value -> string. Value 0 stays unused.
+static GHashTable* table;
+static GPtrArray* strings;
+static Symbol special_return, special_main;
+
+static guint name_hash(const struct name* n) {
+      guint h = 5381;
+      for (size_t i = 0; i != n->len; ++i)
+            h = h * 33 + (unsigned char)n->str[i];
+      return h;
+}
+
+static gboolean name_eq(const struct name* a, const struct name* b) {
+      return a->len == b->len && !memcmp(a->str, b->str, a->len);
+}
+
+static int intern(const char* str, size_t len) {
+      struct name key = {str, len};
+      gpointer value = g_hash_table_lookup(table, &key);
+      if (value) return GPOINTER_TO_INT(value);
+
+      struct name* n = arena_alloc(crate_arena(), ARENA_OTHER, sizeof(*n));
+      char* copy = arena_alloc(crate_arena(), ARENA_STR, len + 1);
+      memcpy(copy, str, len);
+      n->str = copy;
+      n->len = len;
+
+      int id = strings->len;
+      g_ptr_array_add(strings, copy);
+      g_hash_table_insert(table, n, GINT_TO_POINTER(id));
+      return id;
 }
 
-Symbol symbol_type(char* id) {
-      assert(id);
-      GQuark q = g_quark_from_string(id);
-      free(id);
-      return (Symbol){SYMBOL_TYPE, q};
+// Sets up the table along with the special symbols, so that they can be had
+// without touching the table (e.g., from the checker's worker threads).
+static void table_init(void) {
+      if (table) return;
+      table = g_hash_table_new((GHashFunc)name_hash, (GEqualFunc)name_eq);
+      strings = g_ptr_array_new();
+      g_ptr_array_add(strings, NULL);
+      special_return = (Symbol){SYMBOL_VAR, intern("$return", strlen("$return"))};
+      special_main = (Symbol){SYMBOL_VAR, intern("main", strlen("main"))};
 }
 
-Symbol symbol_var(char* id) {
-      assert(id);
-      GQuark q = g_quark_from_string(id);
-      free(id);
-      return (Symbol){SYMBOL_VAR, q};
+Symbol symbol_intern(const char* str, size_t len) {
+      assert(str);
+      table_init();
+      return (Symbol){SYMBOL_INVALID, intern(str, len)};
 }
 
-Symbol symbol_field(char* id) {
-      assert(id);
-      GQuark q = g_quark_from_string(id);
-      free(id);
-      return (Symbol){SYMBOL_FIELD, q};
+Symbol symbol_ctor(Symbol x) {
+      return (Symbol){SYMBOL_CTOR, x.value};
+}
+
+Symbol symbol_type(Symbol x) {
+      return (Symbol){SYMBOL_TYPE, x.value};
+}
+
+Symbol symbol_var(Symbol x) {
+      return (Symbol){SYMBOL_VAR, x.value};
+}
+
+Symbol symbol_field(Symbol x) {
+      return (Symbol){SYMBOL_FIELD, x.value};
 }
 
 Symbol symbol_return(void) {
-      GQuark q = g_quark_from_string("$return");
-      return (Symbol){SYMBOL_VAR, q};
+      table_init();
+      return special_return;
 }
 
 Symbol symbol_main(void) {
-      GQuark q = g_quark_from_string("main");
-      return (Symbol){SYMBOL_VAR, q};
+      table_init();
+      return special_main;
 }
 
 static bool symbol_is_valid(Symbol x) {
@@ -54,5 +102,14 @@ static bool symbol_is_valid(Symbol x) {
 
 const char* symbol_to_str(Symbol x) {
       assert(symbol_is_valid(x));
-      return g_quark_to_string(x.value);
+      assert(strings && x.value > 0 && x.value < (int)strings->len);
+      return g_ptr_array_index(strings, x.value);
+}
+
+void symbol_table_destroy(void) {
+      if (!table) return;
+      g_hash_table_destroy(table);
+      g_ptr_array_free(strings, true);
+      table = NULL;
+      strings = NULL;
 }
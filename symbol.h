@@ -15,22 +15,25 @@ enum {
 
 struct symbol {
       int kind;
-      GQuark value;
+      int value;
 };
 
 typedef struct symbol Symbol;
 
-// These functions translate a string into a symbol unique to that string. The
-// resulting symbol can be quickly compared for equality and the like and it
-// also carries around its namespace (i.e., whether it's a struct field,
-// enum constructor name, type name, or variable name).
+// Translates len bytes of str into a symbol unique to that string. The
+// resulting symbol can be quickly compared for equality and the like. The
+// string is only copied the first time it's seen, so it can point straight
+// into the lexer's buffer.
 //
-// They take ownership of the string argument (i.e., they free it). Don't call
-// with static strings.
-Symbol symbol_ctor(char*);
-Symbol symbol_type(char*);
-Symbol symbol_var(char*);
-Symbol symbol_field(char*);
+// The symbol doesn't belong to a namespace yet (its kind is SYMBOL_INVALID);
+// the functions below say whether it's a struct field, enum constructor name,
+// type name, or variable name.
+Symbol symbol_intern(const char* str, size_t len);
+
+Symbol symbol_ctor(Symbol);
+Symbol symbol_type(Symbol);
+Symbol symbol_var(Symbol);
+Symbol symbol_field(Symbol);
 
 // Special symbol for storing the function return type.
 Symbol symbol_return(void);
@@ -41,4 +44,8 @@ Symbol symbol_main(void);
 // string shouldn't be messed with.
 const char* symbol_to_str(Symbol);
 
+// The table is per compilation: its strings live in the crate arena and it
+// must be dropped along with the crate. Symbols are invalid afterwards.
+void symbol_table_destroy(void);
+
 #endif
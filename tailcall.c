@@ -0,0 +1,365 @@
+#include "tailcall.h"
+#include "ast.h"
+#include "stats.h"
+
+// A block ending in a call of the function itself whose result is returned.
+struct site {
+      struct mir_block* b;
+      // The block the return is in, if it's not b: one holding just a phi of
+      // the result (or nothing, for unit) and returning that.
+      struct mir_block* ret;
+      // Where the call is in b, the add or multiply of its result that
+      // follows it, and the store of what that comes to (-1 if none).
+      int call;
+      int acc;
+      int store;
+};
+
+static bool is_reg(const struct mir_value* v, int reg) {
+      return v->kind == MIR_REG && v->n == reg;
+}
+
+// The store ending b, or NULL if it ends otherwise.
+static struct mir_inst* last_store(struct mir_block* b) {
+      struct mir_inst* last = b->insts->len? &g_array_index(b->insts, struct mir_inst, b->insts->len - 1) : NULL;
+      return last && last->kind == MIR_STORE? last : NULL;
+}
+
+// Whether b goes straight on to return register reg (-1 for unit), setting
+// *ret to the block that returns it. Unless mem2reg has run, what an if or a
+// match comes to goes through a stack slot: then b stores reg last, and goes
+// on to a block that only loads the slot back and returns that.
+static bool returns_reg(struct mir_block* b, int reg, struct mir_block** ret) {
+      struct mir_term* term = &b->term;
+      struct mir_inst* store = last_store(b);
+
+      *ret = NULL;
+      if (store && !is_reg(&store->b, reg)) return false;
+      if (term->kind == MIR_RETURN)
+            return !store && (reg < 0? term->value.kind == MIR_NONE : is_reg(&term->value, reg));
+      if (term->kind != MIR_JUMP) return false;
+
+      struct mir_block* e = term->to[0];
+      if (e == b || e->term.kind != MIR_RETURN) return false;
+      if (store) {
+            struct mir_inst* load = e->insts->len == 1? &g_array_index(e->insts, struct mir_inst, 0) : NULL;
+            if (!load || load->kind != MIR_LOAD || store->a.kind != MIR_REG
+                        || !is_reg(&load->a, store->a.n) || !is_reg(&e->term.value, load->dst))
+                  return false;
+            *ret = e;
+            return true;
+      }
+      if (reg < 0) {
+            *ret = e;
+            return !e->insts->len && e->term.value.kind == MIR_NONE;
+      }
+      if (e->insts->len != 1) return false;
+      struct mir_inst* phi = &g_array_index(e->insts, struct mir_inst, 0);
+      if (phi->kind != MIR_PHI || !is_reg(&e->term.value, phi->dst)) return false;
+      for (guint i = 0; i != phi->preds->len; ++i)
+            if (g_ptr_array_index(phi->preds, i) == b
+                        && !is_reg(&g_array_index(phi->args, struct mir_value, i), reg))
+                  return false;
+      *ret = e;
+      return true;
+}
+
+// How many instructions of b come before the store of its result, if it
+// ends with one.
+static guint before_store(struct mir_block* b) {
+      return b->insts->len - (last_store(b) != NULL);
+}
+
+static bool is_self_call(const struct mir_fn* fn, const struct mir_inst* inst) {
+      return inst->kind == MIR_CALL && inst->fn.value == fn->id.value;
+}
+
+// The operand of an accumulating add or multiply that isn't the call's result,
+// or NULL if inst isn't one.
+static struct mir_value* acc_operand(const struct mir_fn* fn, struct mir_inst* inst, int call) {
+      if (inst->kind != MIR_BINARY || (inst->op != OP_ADD && inst->op != OP_MUL)) return NULL;
+      if (fn->ret != type_i32() && fn->ret != type_u8()) return NULL;
+      if (is_reg(&inst->a, call) == is_reg(&inst->b, call)) return NULL;
+      return is_reg(&inst->a, call)? &inst->b : &inst->a;
+}
+
+// Whether inst loads a stack slot, which (as none escapes) the call before it
+// can't have stored to: one can come between a call and the add or multiply
+// of its result, as in fact(n - 1) * n unless mem2reg has run.
+static bool loads_slot(const struct mir_fn* fn, const struct mir_inst* inst) {
+      if (inst->kind != MIR_LOAD || inst->a.kind != MIR_REG) return false;
+      struct mir_block* entry = g_ptr_array_index(fn->blocks, 0);
+      for (guint i = 0; i != entry->insts->len; ++i) {
+            struct mir_inst* slot = &g_array_index(entry->insts, struct mir_inst, i);
+            if (slot->kind == MIR_ALLOCA && slot->dst == inst->a.n) return true;
+      }
+      return false;
+}
+
+static bool find_site(struct mir_fn* fn, struct mir_block* b, struct site* s) {
+      guint n = before_store(b);
+      if (!n) return false;
+
+      struct mir_inst* last = &g_array_index(b->insts, struct mir_inst, n - 1);
+      s->b = b;
+      s->store = n != b->insts->len? (int)n : -1;
+      s->acc = -1;
+      if (is_self_call(fn, last)) {
+            s->call = n - 1;
+            return returns_reg(b, last->dst, &s->ret);
+      }
+
+      int call = n - 1;
+      while (call && loads_slot(fn, &g_array_index(b->insts, struct mir_inst, call - 1))) --call;
+      if (!call--) return false;
+      struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, call);
+      if (!is_self_call(fn, inst) || inst->dst < 0 || !acc_operand(fn, last, inst->dst)) return false;
+      s->call = call;
+      s->acc = n - 1;
+      return returns_reg(b, last->dst, &s->ret);
+}
+
+static struct mir_inst new_phi(int dst) {
+      struct mir_inst phi = {MIR_PHI};
+      phi.dst = dst;
+      phi.args = g_array_new(false, false, sizeof(struct mir_value));
+      phi.preds = g_ptr_array_new();
+      return phi;
+}
+
+static void phi_add(struct mir_inst* phi, struct mir_value v, struct mir_block* pred) {
+      g_array_append_val(phi->args, v);
+      g_ptr_array_add(phi->preds, pred);
+}
+
+// Phis in b lose their entries for pred, or have them say with instead.
+static void phis_repred(struct mir_block* b, struct mir_block* pred, struct mir_block* with) {
+      for (guint i = 0; i != b->insts->len; ++i) {
+            struct mir_inst* phi = &g_array_index(b->insts, struct mir_inst, i);
+            if (phi->kind != MIR_PHI) break;
+            for (guint j = phi->preds->len; j--;) {
+                  if (g_ptr_array_index(phi->preds, j) != pred) continue;
+                  if (with) {
+                        g_ptr_array_index(phi->preds, j) = with;
+                  } else {
+                        g_ptr_array_remove_index(phi->preds, j);
+                        g_array_remove_index(phi->args, j);
+                  }
+            }
+      }
+}
+
+static void rename_use(struct mir_value* v, void* data) {
+      const int* repl = data;
+      if (v->kind == MIR_REG && repl[v->n] >= 0) v->n = repl[v->n];
+}
+
+// dst = acc op v, appended to b (whatever its terminator).
+static struct mir_value accumulate(struct mir_fn* fn, struct mir_block* b, int op,
+            struct mir_value acc, struct mir_value v) {
+      struct mir_inst inst = {MIR_BINARY};
+      inst.op = op;
+      inst.a = acc;
+      inst.b = v;
+      inst.dst = mir_reg(fn, fn->ret, NULL).n;
+      g_array_append_val(b->insts, inst);
+      return (struct mir_value) {MIR_REG, fn->ret, inst.dst};
+}
+
+static void eliminate(struct mir_fn* fn, GArray* sites, int op) {
+      struct mir_block* entry = g_ptr_array_index(fn->blocks, 0);
+      struct mir_block* header = mir_block_new(fn, "tailrecurse");
+      guint nparams = fn->params->len;
+      struct mir_inst* phis = g_new(struct mir_inst, nparams + 1);
+
+      // Every use of a parameter becomes one of its phi.
+      for (guint i = 0; i != nparams; ++i) {
+            struct mir_value* p = &g_array_index(fn->params, struct mir_value, i);
+            phis[i] = new_phi(mir_reg(fn, p->type, NULL).n);
+      }
+      int* repl = g_new(int, fn->regs->len);
+      for (guint i = 0; i != fn->regs->len; ++i) repl[i] = -1;
+      for (guint i = 0; i != nparams; ++i)
+            repl[g_array_index(fn->params, struct mir_value, i).n] = phis[i].dst;
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len; ++j)
+                  mir_inst_operands(&g_array_index(b->insts, struct mir_inst, j), rename_use, repl);
+            rename_use(&b->term.value, repl);
+      }
+      g_free(repl);
+
+      for (guint i = 0; i != nparams; ++i)
+            phi_add(&phis[i], g_array_index(fn->params, struct mir_value, i), entry);
+      struct mir_value acc = mir_none();
+      if (op != OP_INVALID) {
+            phis[nparams] = new_phi(mir_reg(fn, fn->ret, NULL).n);
+            acc = (struct mir_value) {MIR_REG, fn->ret, phis[nparams].dst};
+            phi_add(&phis[nparams], mir_const(fn->ret, op == OP_MUL), entry);
+
+            // The other returns fold the total in.
+            for (guint i = 0; i != fn->blocks->len; ++i) {
+                  struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+                  bool site = false;
+                  for (guint j = 0; j != sites->len; ++j)
+                        site = site || g_array_index(sites, struct site, j).b == b;
+                  if (site || b->term.kind != MIR_RETURN) continue;
+                  b->term.value = accumulate(fn, b, op, acc, b->term.value);
+            }
+      }
+
+      // The calls become jumps to the header, handing it their arguments.
+      for (guint i = 0; i != sites->len; ++i) {
+            struct site* s = &g_array_index(sites, struct site, i);
+            struct mir_block* b = s->b;
+            struct mir_block* pred = b == entry? header : b;
+            struct mir_inst* call = &g_array_index(b->insts, struct mir_inst, s->call);
+            for (guint j = 0; j != nparams; ++j)
+                  phi_add(&phis[j], g_array_index(call->args, struct mir_value, j), pred);
+
+            struct mir_value total = acc;
+            struct mir_value x = mir_none();
+            if (s->acc >= 0) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, s->acc);
+                  x = *acc_operand(fn, inst, call->dst);
+                  inst->kind = MIR_INVALID;
+            }
+            call->kind = MIR_INVALID;
+            if (s->store >= 0) g_array_index(b->insts, struct mir_inst, s->store).kind = MIR_INVALID;
+            mir_block_sweep(b);
+            if (x.kind != MIR_NONE) total = accumulate(fn, b, op, acc, x);
+            if (op != OP_INVALID) phi_add(&phis[nparams], total, pred);
+
+            // The block returning the result is one pred short now.
+            if (s->ret) phis_repred(s->ret, b, NULL);
+            mir_term_free(&b->term);
+            b->term.kind = MIR_JUMP;
+            b->term.value = mir_none();
+            b->term.to[0] = header;
+      }
+
+      // What the entry does besides allocating moves to the header, so that
+      // looping leaves the stack alone.
+      g_array_append_vals(header->insts, phis, nparams + (op != OP_INVALID));
+      g_free(phis);
+      guint n = 0;
+      for (guint i = 0; i != entry->insts->len; ++i) {
+            struct mir_inst* inst = &g_array_index(entry->insts, struct mir_inst, i);
+            if (inst->kind == MIR_ALLOCA) g_array_index(entry->insts, struct mir_inst, n++) = *inst;
+            else g_array_append_val(header->insts, *inst);
+      }
+      g_array_set_size(entry->insts, n);
+      header->term = entry->term;
+      entry->term.kind = MIR_JUMP;
+      entry->term.value = mir_none();
+      entry->term.to[0] = header;
+      entry->term.cases = NULL;
+      entry->term.vectorize = false;
+      for (int s = 0; s != mir_term_nsuccs(&header->term); ++s) {
+            struct mir_block* succ = *mir_term_succ(&header->term, s);
+            if (succ != header) phis_repred(succ, entry, header);
+      }
+
+      // Keep the header next to the entry in the listing.
+      for (guint i = fn->blocks->len - 1; i != 1; --i)
+            g_ptr_array_index(fn->blocks, i) = g_ptr_array_index(fn->blocks, i - 1);
+      g_ptr_array_index(fn->blocks, 1) = header;
+
+      mir_compute_preds(fn);
+}
+
+// Whether the address of a stack slot is ever passed on, stored, returned or
+// computed with, rather than just loaded from, stored to or offset.
+static bool slots_escape(const struct mir_fn* fn) {
+      bool* addr = g_new0(bool, fn->regs->len);
+      bool changed = true, escape = false;
+
+      while (changed) {
+            changed = false;
+            for (guint i = 0; i != fn->blocks->len; ++i) {
+                  struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+                  for (guint j = 0; j != b->insts->len; ++j) {
+                        struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                        bool derived = inst->kind == MIR_ALLOCA;
+                        switch (inst->kind) {
+                              case MIR_FIELD:
+                              case MIR_ELEM:
+                              case MIR_PAYLOAD:
+                                    derived = inst->a.kind == MIR_REG && addr[inst->a.n];
+                                    break;
+                              case MIR_PHI:
+                                    for (guint k = 0; k != inst->args->len; ++k) {
+                                          struct mir_value* v = &g_array_index(inst->args, struct mir_value, k);
+                                          derived = derived || (v->kind == MIR_REG && addr[v->n]);
+                                    }
+                                    break;
+                        }
+                        if (derived && !addr[inst->dst]) addr[inst->dst] = changed = true;
+                  }
+            }
+      }
+
+      for (guint i = 0; i != fn->blocks->len && !escape; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            for (guint j = 0; j != b->insts->len && !escape; ++j) {
+                  struct mir_inst* inst = &g_array_index(b->insts, struct mir_inst, j);
+                  switch (inst->kind) {
+                        case MIR_STORE:
+                              escape = inst->b.kind == MIR_REG && addr[inst->b.n];
+                              break;
+                        case MIR_BINARY:
+                              escape = (inst->a.kind == MIR_REG && addr[inst->a.n])
+                                    || (inst->b.kind == MIR_REG && addr[inst->b.n]);
+                              break;
+                        case MIR_CALL:
+                              for (guint k = 0; k != inst->args->len; ++k) {
+                                    struct mir_value* v = &g_array_index(inst->args, struct mir_value, k);
+                                    escape = escape || (v->kind == MIR_REG && addr[v->n]);
+                              }
+                              break;
+                  }
+            }
+            escape = escape || (b->term.value.kind == MIR_REG && addr[b->term.value.n]);
+      }
+
+      g_free(addr);
+      return escape;
+}
+
+static void mark_tail_calls(struct mir_fn* fn) {
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct mir_block* b = g_ptr_array_index(fn->blocks, i);
+            struct mir_block* ret;
+            guint n = before_store(b);
+            if (!n) continue;
+            struct mir_inst* last = &g_array_index(b->insts, struct mir_inst, n - 1);
+            if (last->kind == MIR_CALL && returns_reg(b, last->dst, &ret)) last->tail = true;
+      }
+}
+
+void tailcall(struct mir_fn* fn) {
+      // The next time round would store over what's at the address.
+      if (slots_escape(fn)) return;
+
+      GArray* sites = g_array_new(false, false, sizeof(struct site));
+      int op = OP_INVALID;
+
+      // Accumulating the one way only: a sum can't take in a product.
+      for (guint i = 0; i != fn->blocks->len; ++i) {
+            struct site s;
+            if (!find_site(fn, g_ptr_array_index(fn->blocks, i), &s)) continue;
+            if (s.acc >= 0) {
+                  int sop = g_array_index(s.b->insts, struct mir_inst, s.acc).op;
+                  if (op != OP_INVALID && sop != op) continue;
+                  op = sop;
+            }
+            g_array_append_val(sites, s);
+      }
+
+      if (sites->len) {
+            eliminate(fn, sites, op);
+            if (stats_enabled) stats_add(STATS_TAIL_CALLS, sites->len);
+      }
+      g_array_free(sites, true);
+      mark_tail_calls(fn);
+}
@@ -0,0 +1,21 @@
+#ifndef RUSTC_TAILCALL_H_
+#define RUSTC_TAILCALL_H_
+
+#include "mir.h"
+
+// *** Tail calls ***
+
+// A call of the function itself whose result is returned straight away
+// becomes a jump back to the top: the parameters turn into phis at a new
+// "tailrecurse" block right after the entry's allocas, fed the call's
+// arguments. So does one whose result is first added to or multiplied by
+// something (return n * f(n - 1)), by keeping a running total in another phi
+// that every remaining return folds its value into. The result can get returned
+// through a stack slot too, as an if's value does unless mem2reg has run: stored
+// there last, and loaded back by a block that returns it. Any other call whose
+// result is returned straight away is marked tail. A function that lets the
+// address of one of its stack slots out is left alone: a call could be using
+// the slot, which a loop would reuse and a tail call would pop.
+void tailcall(struct mir_fn* fn);
+
+#endif
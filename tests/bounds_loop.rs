@@ -0,0 +1,15 @@
+// pa4: --mir
+// stats: checks_dropped 2
+// traps
+// The default pipeline leaves loop counters in stack slots: the checks of
+// a[i] under while (i < 5) go all the same, while a[5] still traps, once what
+// was printed before it is out.
+
+fn main() {
+      let mut a = [1, 2, 3, 4, 5];
+      let mut s = 0;
+      let mut i = 0;
+      while (i < 5) { s = s + a[i]; a[i] = s; i = i + 1; };
+      printi(s);
+      printi(a[5]);
+}
@@ -0,0 +1,25 @@
+// pa4: --mir
+// Also compiled by tests/run.sh with --cache, before and after k changes.
+
+struct P { a: u8, b: i32, c: bool, d: i32 }
+
+// Small enough to be inlined into its callers, which have to see it change.
+fn k() -> i32 { 1 }
+
+fn get(p: P) -> i32 {
+      if (p.c) { p.b * k() + p.d } else { if (p.a == b'a') { 0 - 1 } else { 0 } }
+}
+
+fn scale(n: i32) -> i32 {
+      let mut s = 0;
+      let mut i = 0;
+      while (i < n) { s = s + k(); i = i + 1; };
+      s
+}
+
+fn main() {
+      let p = P { a: b'a', b: 10, c: true, d: 5 };
+      printi(get(p)); prints(b" ");
+      printi(scale(4)); prints(b" ");
+      printi(k());
+}
@@ -0,0 +1,32 @@
+// pa4: --mir --inline=0
+// A box borrowed and read back through the reference escapes along with what
+// it's read into: it mustn't be left in the stack frame of the fn returning it.
+
+fn mk() -> Box<i32> {
+      let b = Box::new(41);
+      let r = &b;
+      *r
+}
+
+fn mk_let() -> Box<i32> {
+      let b = Box::new(42);
+      let r = &b;
+      let c = *r;
+      return c;
+}
+
+// Writes over the stack where mk()'s and mk_let()'s frames were.
+fn clobber(n: i32) -> i32 {
+      let a = [99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99];
+      if (n == 0) { return a[3]; };
+      return clobber(n - 1) + a[n];
+}
+
+fn main() {
+      let p = mk();
+      let q = mk_let();
+      clobber(8);
+      printi(*p);
+      prints(b" ");
+      printi(*q);
+}
@@ -0,0 +1,63 @@
+// pa4: --mir
+// stats: inlined 8
+// ir: call i1 @even(
+// ir: call i32 @big(
+// ir: call i32 @twice(
+// pa4: --mir --inline=0
+// stats: inlined 0
+// Inlining is only ever a way of compiling the same program faster.
+
+// Bound one after the other, x = y would have y see the new x: the
+// arguments go through fresh variables first.
+fn sub(x: i32, y: i32) -> i32 {
+      x - y
+}
+
+// So does an argument mentioning a parameter's name at all.
+fn mix(a: i32, b: i32, c: i32) -> i32 {
+      a * 100 + b * 10 + c
+}
+
+// A cycle: odd is done first, and gets inlined into even and main, while the
+// call back to even stays a call.
+fn even(n: i32) -> bool {
+      if (n == 0) { true } else { odd(n - 1) }
+}
+
+fn odd(n: i32) -> bool {
+      if (n == 0) { false } else { even(n - 1) }
+}
+
+// Too big to be copied into its callers.
+fn big(n: i32) -> i32 {
+      let mut s = n;
+      s = s * 3 + 1;
+      s = s * 3 + 1;
+      s = s * 3 + 1;
+      s = s * 3 + 1;
+      s = s * 3 + 1;
+      s = s * 3 + 1;
+      s = s * 3 + 1;
+      s
+}
+
+// Gets sub inlined into it twice, which leaves it too big for main.
+fn twice(x: i32, y: i32) -> i32 {
+      sub(y, x) + sub(x, y) + x
+}
+
+fn main() {
+      let x = 10;
+      let y = 3;
+      let a = 1;
+      let b = 2;
+      let c = 3;
+      printi(sub(y, x)); prints(b" ");
+      printi(sub(x + y, x)); prints(b" ");
+      printi(mix(y, x, 1)); prints(b" ");
+      printi(mix(b, a, c)); prints(b" ");
+      if (even(10)) { prints(b"even "); };
+      if (odd(7)) { prints(b"odd "); };
+      printi(big(x)); prints(b" ");
+      printi(twice(y, x));
+}
@@ -0,0 +1,73 @@
+// pa4: --mir --inline=0
+// ir: ^%enum\.Color = type { i8 }$
+// ir: ^%enum\.Opt = type { i32, i32\* }$
+// ir: ^%enum\.Cell = type { i32\* }$
+// ir: ^%enum\.Mixed = type { i8, \[[0-9]* x i64\] }$
+// ir: ^%struct\.P = type { i8, i32, i1, i32\* }$
+// pa4: --mir --inline=0 --reorder-fields
+// ir: ^%enum\.Opt = type { i32, i32\* }$
+// ir: ^%enum\.Mixed = type { i8, \[[0-9]* x i64\] }$
+// ir: ^%struct\.P = type { i32\*, i32, i8, i1 }$
+// One enum of each layout (see mir_layout.h), built, kept in arrays and
+// structs, passed around and matched: just a tag, a null pointer for the
+// fieldless constructor, and a tag with a payload of structs whose fields
+// --reorder-fields moves around.
+
+enum Color { Red, Green, Blue }
+enum Opt { Nothing, Some(i32, &i32) }
+enum Cell { Empty, Full(Box<i32>) }
+struct P { a: u8, b: i32, c: bool, d: &i32 }
+enum Mixed { A(u8), B(i32, bool), C([i32; 3]), D, E(P, u8) }
+struct Holder { tag: bool, m: Mixed, o: Opt, n: u8 }
+
+fn color(c: Color) -> i32 {
+      match (c) { Color::Red => { 1 }, Color::Green => { 2 }, Color::Blue => { 3 } }
+}
+
+fn opt(o: Opt) -> i32 {
+      match (o) { Opt::Some(n, &x) => { n * 100 + x }, Opt::Nothing => { 0 - 1 } }
+}
+
+fn cell(c: Cell) -> i32 {
+      match (c) { Cell::Full(b) => { *b }, Cell::Empty => { 0 } }
+}
+
+fn mixed(m: Mixed) -> i32 {
+      match (m) {
+            Mixed::A(b) => { 1000 },
+            Mixed::B(x, true) => { x },
+            Mixed::B(x, false) => { 0 - x },
+            Mixed::C([a, b, c]) => { a + b + c },
+            Mixed::D => { 7 },
+            Mixed::E(P { a: _, b: b, c: true, d: &d }, n) => { b + d + 1 },
+            Mixed::E(P { a: _, b: b, c: false, d: _ }, n) => { b - 1 }
+      }
+}
+
+fn holder(h: Holder) -> i32 {
+      if (h.tag) { mixed(h.m) * 10 + opt(h.o) } else { 0 }
+}
+
+fn main() {
+      let cs = [Color::Blue, Color::Red, Color::Green];
+      let mut i = 0;
+      while (i < 3) { printi(color(cs[i])); i = i + 1; };
+      prints(b" ");
+
+      let v = 42;
+      let os = [Opt::Some(3, &v), Opt::Nothing];
+      printi(opt(os[0])); prints(b" ");
+      printi(opt(os[1])); prints(b" ");
+
+      printi(cell(Cell::Full(Box::new(9)))); prints(b" ");
+      printi(cell(Cell::Empty)); prints(b" ");
+
+      let w = 5;
+      let ms = [Mixed::A(b'x'), Mixed::B(4, true), Mixed::B(4, false), Mixed::C([1, 2, 3]), Mixed::D,
+            Mixed::E(P { a: b'p', b: 20, c: true, d: &w }, b'q'), Mixed::E(P { a: b'p', b: 20, c: false, d: &w }, b'q')];
+      i = 0;
+      while (i < 7) { printi(mixed(ms[i])); prints(b" "); i = i + 1; };
+
+      let h = Holder { tag: true, m: Mixed::B(6, true), o: Opt::Some(1, &w), n: b'n' };
+      printi(holder(h));
+}
@@ -0,0 +1,51 @@
+// pa4: --mir --inline=0
+// Dispatch on enum tags, and on what's in the payloads once the tag is known:
+// the rows of a constructor share its tag test, and _ or a binding takes what
+// the rows above it leave.
+
+enum Shape { Circle(i32), Rect(i32, i32), Tri(i32, i32, i32), Empty }
+enum Opt { Nothing, Some(i32) }
+enum Tree { Leaf(i32), Node(Opt, Opt) }
+
+fn area(s: Shape) -> i32 {
+      match (s) {
+            Shape::Circle(r) => { 3 * r * r },
+            Shape::Rect(w, h) => { w * h },
+            Shape::Tri(a, b, c) => { a + b + c },
+            Shape::Empty => { 0 }
+      }
+}
+
+fn rect(s: Shape) -> i32 {
+      match (s) {
+            Shape::Rect(0, _) => { 1 },
+            Shape::Rect(_, 0) => { 2 },
+            Shape::Rect(w, h) => { w - h },
+            _ => { 0 - 1 }
+      }
+}
+
+fn sum(t: Tree) -> i32 {
+      match (t) {
+            Tree::Leaf(n) => { n },
+            Tree::Node(Opt::Some(a), Opt::Some(b)) => { a + b },
+            Tree::Node(Opt::Some(a), Opt::Nothing) => { a },
+            Tree::Node(Opt::Nothing, o) => { match (o) { Opt::Some(b) => { 0 - b }, Opt::Nothing => { 0 } } }
+      }
+}
+
+fn main() {
+      printi(area(Shape::Circle(2))); prints(b" ");
+      printi(area(Shape::Rect(3, 4))); prints(b" ");
+      printi(area(Shape::Tri(3, 4, 6))); prints(b" ");
+      printi(area(Shape::Empty)); prints(b" ");
+      printi(rect(Shape::Rect(0, 9))); prints(b" ");
+      printi(rect(Shape::Rect(9, 0))); prints(b" ");
+      printi(rect(Shape::Rect(9, 4))); prints(b" ");
+      printi(rect(Shape::Circle(1))); prints(b" ");
+      printi(sum(Tree::Leaf(7))); prints(b" ");
+      printi(sum(Tree::Node(Opt::Some(1), Opt::Some(2)))); prints(b" ");
+      printi(sum(Tree::Node(Opt::Some(5), Opt::Nothing))); prints(b" ");
+      printi(sum(Tree::Node(Opt::Nothing, Opt::Some(6)))); prints(b" ");
+      printi(sum(Tree::Node(Opt::Nothing, Opt::Nothing)));
+}
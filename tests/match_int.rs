@@ -0,0 +1,57 @@
+// pa4: --mir --inline=0
+// Matches on integers: dense cases make a switch, negative literals and u8s
+// are cases like any others, and _ or a binding takes the rest.
+
+fn day(n: i32) -> i32 {
+      match (n) {
+            0 => { 10 },
+            1 => { 11 },
+            2 => { 12 },
+            3 => { 13 },
+            4 => { 14 },
+            5 => { 15 },
+            6 => { 16 },
+            _ => { 0 }
+      }
+}
+
+fn sign(n: i32) -> i32 {
+      match (n) {
+            -1 => { 100 },
+            0 => { 200 },
+            -2147483648 => { 300 },
+            x => { x * 2 }
+      }
+}
+
+fn letter(c: u8) -> i32 {
+      match (c) {
+            b'a' => { 1 },
+            b'z' => { 26 },
+            _ => { 0 }
+      }
+}
+
+fn both(a: i32, b: bool) -> i32 {
+      match (b) {
+            true => { match (a) { 1 => { 1 }, 2 => { 4 }, n => { n } } },
+            false => { 0 - a }
+      }
+}
+
+fn main() {
+      let mut i = 0 - 1;
+      while (i < 8) { printi(day(i)); prints(b" "); i = i + 1; };
+      printi(sign(0 - 1)); prints(b" ");
+      printi(sign(0)); prints(b" ");
+      printi(sign(0 - 2147483647 - 1)); prints(b" ");
+      printi(sign(0 - 3)); prints(b" ");
+      printi(sign(21)); prints(b" ");
+      printi(letter(b'a')); prints(b" ");
+      printi(letter(b'z')); prints(b" ");
+      printi(letter(b'q')); prints(b" ");
+      printi(both(1, true)); prints(b" ");
+      printi(both(2, true)); prints(b" ");
+      printi(both(3, true)); prints(b" ");
+      printi(both(3, false));
+}
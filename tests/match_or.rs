@@ -0,0 +1,37 @@
+// pa4: --mir --inline=0
+// Or-patterns: of integers, of constructors, and of constructors binding the
+// same name in every alternative.
+
+enum Shape { Circle(i32), Square(i32), Rect(i32, i32), Empty }
+
+fn small(n: i32) -> i32 {
+      match (n) {
+            0 | 1 => { 10 },
+            2 => { 20 },
+            -7 | 8 | 9 => { 70 },
+            x => { x + 100 }
+      }
+}
+
+fn side(s: Shape) -> i32 {
+      match (s) {
+            Shape::Circle(r) | Shape::Square(r) => { r },
+            Shape::Rect(w, 0) | Shape::Rect(0, w) => { w * 10 },
+            Shape::Rect(_, _) | Shape::Empty => { 0 - 1 }
+      }
+}
+
+fn main() {
+      printi(small(0)); prints(b" ");
+      printi(small(1)); prints(b" ");
+      printi(small(2)); prints(b" ");
+      printi(small(0 - 7)); prints(b" ");
+      printi(small(9)); prints(b" ");
+      printi(small(42)); prints(b" ");
+      printi(side(Shape::Circle(3))); prints(b" ");
+      printi(side(Shape::Square(4))); prints(b" ");
+      printi(side(Shape::Rect(5, 0))); prints(b" ");
+      printi(side(Shape::Rect(0, 6))); prints(b" ");
+      printi(side(Shape::Rect(7, 8))); prints(b" ");
+      printi(side(Shape::Empty));
+}
@@ -0,0 +1,139 @@
+#!/bin/sh
+# Compiles and runs each tests/*.rs, comparing what it prints with the .out
+# file next to it. A test's first line can give pa4 flags, as in
+# "// pa4: --mir --inline=0", and there can be more such lines, one per way to
+# compile it (all of them have to print the same); the IR is run with lli.
+# After a "// pa4:" line can come what else that way is to do: what --stats
+# is to count, as in "// stats: checks_dropped 2", and what the IR has to
+# have a line of, as in "// ir: ^%enum\.Opt = type { i32, i32\* }$" (a grep
+# pattern). A test meant to end at a failed check says "// traps" (any other
+# has to exit 0). Each way, the IR has to come out the same by way of an AST
+# image (--emit-ast, then --load-ast).
+#
+# Usage: tests/run.sh [pa4]. LLI overrides the lli to run the IR with.
+
+PA4=${1:-./pa4}
+LLI=${LLI:-lli}
+DIR=$(dirname "$0")
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# The lines of test $1 saying "// $2: ...", without that, that go with its
+# $3'th "// pa4:" line.
+directive() {
+      awk -v d="// $2:" -v k="$3" 'index($0, "// pa4:") == 1 { ++n }
+            n == k && index($0, d) == 1 { sub(/^[^:]*: */, ""); print }' "$1"
+}
+
+# Compiles and runs test $1 the $2'th way, saying what went wrong if anything
+# did.
+run() {
+      test=$1
+      flags=$(directive "$test" pa4 $2)
+      name=$(basename "$test" .rs)${flags:+ ($flags)}
+      stats=$(directive "$test" stats $2)
+
+      if ! "$PA4" $flags ${stats:+--stats} < "$test" > "$TMP/test.ll" 2> "$TMP/test.stats"; then
+            echo "$name: pa4 failed"
+            return 1
+      fi
+      wrong=$(echo "$stats" | while read -r counter n; do
+            [ -z "$counter" ] || grep -q "^$counter  *$n\$" "$TMP/test.stats" \
+                  || echo "$counter $(sed -n "s/^$counter  *//p" "$TMP/test.stats"), expected $n"
+      done)
+      if [ -n "$wrong" ]; then
+            echo "$name: --stats counted $wrong"
+            return 1
+      fi
+      missing=$(directive "$test" ir $2 | while read -r pattern; do
+            grep -q "$pattern" "$TMP/test.ll" || echo "$pattern"
+      done)
+      if [ -n "$missing" ]; then
+            echo "$name: no line of the IR matches $missing"
+            return 1
+      fi
+
+      # The same by way of an AST image.
+      if ! "$PA4" $flags --emit-ast < "$test" > "$TMP/test.ast" \
+                  || ! "$PA4" $flags --load-ast < "$TMP/test.ast" > "$TMP/loaded.ll" \
+                  || ! cmp -s "$TMP/test.ll" "$TMP/loaded.ll"; then
+            echo "$name: the IR differs by way of --emit-ast and --load-ast"
+            return 1
+      fi
+
+      "$LLI" "$TMP/test.ll" < /dev/null > "$TMP/test.out" 2> /dev/null
+      status=$?
+      if grep -q '^// traps$' "$test"; then
+            [ $status -ne 0 ] || { echo "$name: didn't trap"; return 1; }
+      elif [ $status -ne 0 ]; then
+            echo "$name: exited with $status"
+            return 1
+      fi
+      if ! cmp -s "$TMP/test.out" "${test%.rs}.out"; then
+            echo "$name: printed $(cat "$TMP/test.out"), expected $(cat "${test%.rs}.out")"
+            return 1
+      fi
+}
+
+# Compiles tests/cache.rs with --cache=DIR and without, then again after k
+# has changed, and then as it was, which has to find what it needs in DIR;
+# all that the way each of the options that change the IR has it. Each time
+# the IR has to come out the same both ways.
+run_cache() {
+      sed 's/fn k() -> i32 { 1 }/fn k() -> i32 { 2 }/' "$DIR/cache.rs" > "$TMP/cache.rs"
+      if cmp -s "$DIR/cache.rs" "$TMP/cache.rs"; then
+            echo "--cache: no fn k() -> i32 { 1 } to change"
+            return 1
+      fi
+      for flags in "--mir" "--mir --reorder-fields" "--mir --inline=0" "--mir --ssa" ""; do
+            for src in "$DIR/cache.rs" "$TMP/cache.rs" "$DIR/cache.rs"; do
+                  "$PA4" $flags < "$src" > "$TMP/plain.ll"
+                  "$PA4" $flags --cache="$TMP/cache" --stats < "$src" > "$TMP/cached.ll" 2> "$TMP/cache.stats"
+                  if ! cmp -s "$TMP/plain.ll" "$TMP/cached.ll"; then
+                        echo "--cache${flags:+ ($flags)}: the IR of $src differs with --cache"
+                        return 1
+                  fi
+            done
+            if grep -q '^cache_hits  *0$' "$TMP/cache.stats"; then
+                  echo "--cache${flags:+ ($flags)}: nothing reused"
+                  return 1
+            fi
+      done
+      echo "--cache: ok"
+}
+
+# An AST image cut short, or with its last word overwritten, has to be
+# turned down with an error, not crash --load-ast.
+run_bad_ast() {
+      "$PA4" --mir --emit-ast < "$DIR/match_enum.rs" > "$TMP/good.ast"
+      size=$(wc -c < "$TMP/good.ast")
+      head -c $((size / 2)) "$TMP/good.ast" > "$TMP/bad1.ast"
+      head -c $((size - 1)) "$TMP/good.ast" > "$TMP/bad2.ast"
+      { head -c $((size - 4)) "$TMP/good.ast"; printf '\377\377\377\377'; } > "$TMP/bad3.ast"
+      : > "$TMP/bad4.ast"
+      for image in "$TMP"/bad*.ast; do
+            "$PA4" --mir --load-ast < "$image" > "$TMP/bad.out" 2>&1
+            status=$?
+            if [ $status -ne 1 ] || ! grep -q "^Error: stdin isn't a valid AST image" "$TMP/bad.out"; then
+                  echo "--load-ast: $(basename "$image") of $size bytes exited with $status: $(head -c 200 "$TMP/bad.out")"
+                  return 1
+            fi
+      done
+      echo "--load-ast: ok"
+}
+
+failed=0
+for test in "$DIR"/*.rs; do
+      ok=true
+      ways=$(grep -c '^// pa4:' "$test")
+      k=$((ways != 0))
+      while [ $k -le $ways ]; do
+            run "$test" $k || ok=false
+            k=$((k + 1))
+      done
+      if $ok; then echo "$(basename "$test" .rs): ok"; else failed=1; fi
+done
+run_cache || failed=1
+run_bad_ast || failed=1
+exit $failed
@@ -0,0 +1,24 @@
+// pa4: --mir
+// Self tail calls under the default pipeline, where an if's value goes
+// through a stack slot: recursing this deep only works as a loop.
+
+fn cnt(n: i32, acc: i32) -> i32 {
+      if (n == 0) { acc } else { cnt(n - 1, acc + 1) }
+}
+
+fn len(n: i32) -> i32 {
+      if (n == 0) { 0 } else { 1 + len(n - 1) }
+}
+
+// n is loaded again after the call, before the multiply.
+fn fact(n: i32) -> i32 {
+      if (n <= 1) { 1 } else { fact(n - 1) * n }
+}
+
+fn main() {
+      printi(cnt(10000000, 0));
+      prints(b" ");
+      printi(len(10000000));
+      prints(b" ");
+      printi(fact(12));
+}
@@ -1,83 +1,134 @@
 #include <assert.h>
 #include <stdlib.h>
 #include "type.h"
-#include "ast.h" // For pair (params).
+#include "ast.h" // For pair (params) and the crate arena.
+#include "arena.h"
 
 static struct type* strip_mut(const struct type*);
 
+// Every type other than fn types is interned: constructing the same type twice
+// yields the same pointer. Keys are shallow since the component types are
+// already unique. The checker builds types from several threads at once, so
+// the table (and the arena allocation behind it) is guarded by a lock.
+static GHashTable* table;
+static GMutex table_lock;
+
+static guint type_hash(const struct type* t) {
+      return (guint)t->kind * 31u
+            ^ g_direct_hash(t->type) * 17u
+            ^ (guint)t->length * 7u
+            ^ (guint)t->id.value;
+}
+
+static gboolean type_key_eq(const struct type* a, const struct type* b) {
+      return a->kind == b->kind
+            && a->type == b->type
+            && a->length == b->length
+            && a->id.kind == b->id.kind
+            && a->id.value == b->id.value;
+}
+
 static struct type* type_new(int kind) {
-      struct type* n = calloc(1, sizeof(*n));
-      assert(n);
+      struct type* n = arena_alloc(crate_arena(), ARENA_TYPE, sizeof(*n));
       n->kind = kind;
+      n->unmut = n;
+      return n;
+}
+
+// Caller holds table_lock.
+static struct type* intern_locked(struct type key) {
+      if (!table) table = g_hash_table_new((GHashFunc)type_hash, (GEqualFunc)type_key_eq);
+
+      struct type* n = g_hash_table_lookup(table, &key);
+      if (n) return n;
+
+      n = type_new(key.kind);
+      *n = key;
+      n->unmut = n;
+      g_hash_table_insert(table, n, n);
+
+      // Precompute the mutability-free version of the type so that type_eq()
+      // is a pointer comparison.
+      if (n->kind == TYPE_MUT) {
+            n->unmut = n->type->unmut;
+      } else if (n->type && n->type->unmut != n->type) {
+            struct type bare = key;
+            bare.type = key.type->unmut;
+            n->unmut = intern_locked(bare);
+      }
       return n;
 }
+
+static struct type* intern(struct type key) {
+      g_mutex_lock(&table_lock);
+      struct type* n = intern_locked(key);
+      g_mutex_unlock(&table_lock);
+      return n;
+}
+
+static struct type* intern_child(int kind, struct type* type, int length) {
+      assert(type);
+      struct type key = {.kind = kind, .type = type, .length = length};
+      return intern(key);
+}
+
 struct type* type_invalid(void) {
-      static struct type n = {.kind = TYPE_INVALID};
+      static struct type n = {.kind = TYPE_INVALID, .unmut = &n};
       return &n;
 }
 struct type* type_error(void) {
-      static struct type n = {.kind = TYPE_ERROR};
+      static struct type n = {.kind = TYPE_ERROR, .unmut = &n};
       return &n;
 }
 struct type* type_ok(void) {
-      static struct type n = {.kind = TYPE_OK};
+      static struct type n = {.kind = TYPE_OK, .unmut = &n};
       return &n;
 }
 struct type* type_unit(void) {
-      static struct type n = {.kind = TYPE_UNIT};
+      static struct type n = {.kind = TYPE_UNIT, .unmut = &n};
       return &n;
 }
 struct type* type_i32(void) {
-      static struct type n = {.kind = TYPE_I32};
+      static struct type n = {.kind = TYPE_I32, .unmut = &n};
       return &n;
 }
 struct type* type_u8(void) {
-      static struct type n = {.kind = TYPE_U8};
+      static struct type n = {.kind = TYPE_U8, .unmut = &n};
       return &n;
 }
 struct type* type_bool(void) {
-      static struct type n = {.kind = TYPE_BOOL};
+      static struct type n = {.kind = TYPE_BOOL, .unmut = &n};
       return &n;
 }
 struct type* type_div(void) {
-      static struct type n = {.kind = TYPE_DIV};
+      static struct type n = {.kind = TYPE_DIV, .unmut = &n};
       return &n;
 }
 struct type* type_ref(struct type* type) {
-      struct type* n = type_new(TYPE_REF);
-      n->type = type;
-      return n;
+      return intern_child(TYPE_REF, type, 0);
 }
 struct type* type_mut(struct type* type) {
-      struct type* n = type_new(TYPE_MUT);
-      n->type = type;
-      return n;
+      return intern_child(TYPE_MUT, type, 0);
 }
 struct type* type_ref_mut(struct type* type) {
       return type_ref(type_mut(type));
 }
 struct type* type_slice(struct type* type) {
-      struct type* n = type_new(TYPE_SLICE);
-      n->type = type;
-      return n;
+      return intern_child(TYPE_SLICE, type, 0);
 }
 struct type* type_array(struct type* type, int length) {
-      struct type* n = type_new(TYPE_ARRAY);
-      n->type = type;
-      n->length = length;
-      return n;
+      return intern_child(TYPE_ARRAY, type, length);
 }
 struct type* type_box(struct type* type) {
-      struct type* n = type_new(TYPE_BOX);
-      n->type = type;
-      return n;
+      return intern_child(TYPE_BOX, type, 0);
 }
 struct type* type_id(Symbol id) {
-      struct type* n = type_new(TYPE_ID);
-      n->id = id;
-      return n;
+      struct type key = {.kind = TYPE_ID, .id = id};
+      return intern(key);
 }
 struct type* type_fn(GList* params, struct type* ret) {
+      // Not interned: a fn type carries its parameter patterns and belongs to
+      // the item (or builtin) it was made for.
       struct type* n = type_new(TYPE_FN);
       n->params = params;
       n->type = ret;
@@ -86,47 +137,7 @@ struct type* type_fn(GList* params, struct type* ret) {
 
 bool type_eq(const struct type* left, const struct type* right) {
       assert(left); assert(right);
-
-      left = strip_mut(left);
-      right = strip_mut(right);
-
-      assert(left); assert(right);
-
-      if (left == right) return true;
-
-      if (left->kind != right->kind) return false;
-
-      switch (left->kind) {
-            case TYPE_INVALID:
-            case TYPE_ERROR:
-            case TYPE_OK:
-            case TYPE_UNIT:
-            case TYPE_I32:
-            case TYPE_U8:
-            case TYPE_BOOL:
-            case TYPE_DIV:
-                  return false;
-
-            case TYPE_ID:
-                  return left->id.value == right->id.value;
-
-            case TYPE_REF:
-            case TYPE_MUT:
-            case TYPE_SLICE:
-            case TYPE_BOX:
-                  return type_eq(left->type, right->type);
-
-            case TYPE_ARRAY:
-                  return left->length == right->length &&
-                        type_eq(left->type, right->type);
-
-            case TYPE_FN: {
-                  // TODO (though probably shouldn't need this).
-                  assert(false);
-            }
-
-            default: assert(false);
-      }
+      return left->unmut == right->unmut;
 }
 
 struct type* strip_mut(const struct type* type) {
@@ -183,83 +194,8 @@ Symbol type_get_id(struct type* type) {
       return type->id;
 }
 
-struct type* type_copy(const struct type* old) {
-      assert(old);
-
-      switch (old->kind) {
-            case TYPE_INVALID:
-            case TYPE_ERROR:
-            case TYPE_OK:
-            case TYPE_UNIT:
-            case TYPE_I32:
-            case TYPE_U8:
-            case TYPE_BOOL:
-            case TYPE_DIV:
-                  return (struct type*)old;
-
-            case TYPE_ID: {
-                  struct type* new = calloc(1, sizeof(*new));
-                  *new = *old;
-                  return new;
-            }
-
-            case TYPE_REF:
-            case TYPE_MUT:
-            case TYPE_SLICE:
-            case TYPE_ARRAY:
-            case TYPE_BOX: {
-                  struct type* new = calloc(1, sizeof(*new));
-                  *new = *old;
-                  new->type = type_copy(old->type);
-                  return new;
-            }
-
-            case TYPE_FN: {
-                  struct type* new = calloc(1, sizeof(*new));
-                  *new = *old;
-
-                  // TODO (though probably shouldn't need this).
-                  assert(false); // need to copy params.
-
-                  return new;
-            }
-
-            default: assert(false);
-      }
-}
-
-void type_destroy(struct type* type) {
-      if (!type) return;
-
-      switch (type->kind) {
-            case TYPE_INVALID:
-            case TYPE_ERROR:
-            case TYPE_OK:
-            case TYPE_UNIT:
-            case TYPE_I32:
-            case TYPE_U8:
-            case TYPE_BOOL:
-            case TYPE_DIV:
-                  return;
-
-            case TYPE_ID:
-                  break;
-
-            case TYPE_REF:
-            case TYPE_MUT:
-            case TYPE_SLICE:
-            case TYPE_ARRAY:
-            case TYPE_BOX:
-                  type_destroy(type->type);
-                  break;
-
-            case TYPE_FN:
-                  type_destroy(type->type);
-                  g_list_free_full(type->params, (GDestroyNotify)pair_destroy);
-                  break;
-
-            default: assert(false);
-      }
-
-      free(type);
+void type_table_destroy(void) {
+      if (!table) return;
+      g_hash_table_destroy(table);
+      table = NULL;
 }
@@ -29,9 +29,13 @@ struct type {
       struct type* type;
       int length;
       Symbol id;
+      // This type with every TYPE_MUT wrapper removed (possibly itself).
+      struct type* unmut;
 };
 
-/* Constructors. */
+/* Constructors. Types are allocated from the crate arena. Apart from
+ * type_fn(), these return interned types: building the same type twice yields
+ * the same pointer. */
 struct type* type_invalid(void);
 struct type* type_error(void);
 struct type* type_ok(void);
@@ -49,7 +53,8 @@ struct type* type_box(struct type* type);
 struct type* type_id(Symbol id);
 struct type* type_fn(GList* params, struct type* ret);
 
-// Recursively compare two types for equality. Equality modulo mutability.
+// Compare two types for equality, modulo mutability. Since types are interned
+// this is a pointer comparison.
 bool type_eq(const struct type*, const struct type*);
 
 // Check if a type is mutable.
@@ -69,10 +74,8 @@ struct type* type_get_elem(struct type*);
 
 Symbol type_get_id(struct type*);
 
-// Create (allocate) a new type as a copy of the parameter type.
-struct type* type_copy(const struct type* type);
-
-// Recursively free memory.
-void type_destroy(struct type* type);
+// Forgets every interned type. The types themselves live in the crate arena
+// and go away with crate_destroy(), which calls this.
+void type_table_destroy(void);
 
 #endif